@@ -27,16 +27,31 @@
 #include <schroot/auth/pam-conv-tty.h>
 #endif // SCHROOT_FEATURE_PAM
 #include <schroot/chroot/facet/factory.h>
+#include <schroot/chroot/facet/session-clonable.h>
+#include <schroot/chroot/gc.h>
+#include <schroot/chroot/pool.h>
 #include <schroot/keyfile-writer.h>
+#include <schroot/log-sink.h>
+#include <schroot/metrics.h>
+#include <schroot/reclaim.h>
 #include <schroot/session.h>
+#include <schroot/trace.h>
+#include <schroot/util.h>
 
 #include <bin/schroot/main.h>
+#include <bin/schroot/server.h>
 
+#include <cerrno>
 #include <cstdlib>
+#include <cstring>
 #include <ctime>
 #include <iostream>
 #include <locale>
+#include <map>
+#include <memory>
 
+#include <sys/types.h>
+#include <sys/wait.h>
 #include <termios.h>
 #include <unistd.h>
 
@@ -71,12 +86,83 @@ namespace bin
   namespace schroot
   {
 
+    namespace
+    {
+
+      /**
+       * Stream JSON objects, either as a single JSON array or as one
+       * object per line (JSON Lines).  Each object is written and
+       * flushed as soon as it is complete, so that consumers can
+       * process the output incrementally.
+       */
+      class json_records
+      {
+      public:
+        /**
+         * The constructor.
+         *
+         * @param stream the stream to output to.
+         * @param format the output format (json or jsonl).
+         */
+        json_records (std::ostream&      stream,
+                      const std::string& format):
+          stream(stream),
+          array(format == "json"),
+          count(0)
+        {
+          if (this->array)
+            this->stream << '[';
+        }
+
+        /// The destructor.  Terminates the array.
+        ~json_records ()
+        {
+          if (this->array)
+            this->stream << (this->count ? "\n]\n" : "]\n");
+          this->stream << std::flush;
+        }
+
+        /**
+         * Begin a new object.
+         *
+         * @returns the stream to write the object to.
+         */
+        std::ostream&
+        begin ()
+        {
+          if (this->array)
+            this->stream << (this->count ? ",\n  " : "\n  ");
+          ++this->count;
+          return this->stream;
+        }
+
+        /// End the current object.
+        void
+        end ()
+        {
+          if (!this->array)
+            this->stream << '\n';
+          this->stream << std::flush;
+        }
+
+      private:
+        /// The stream to output to.
+        std::ostream& stream;
+        /// Output a JSON array rather than JSON Lines.
+        bool          array;
+        /// The number of objects written.
+        unsigned int  count;
+      };
+
+    }
+
     main::main (schroot::options::ptr& options):
       bin::common::main("schroot",
                         _("[OPTION…] [COMMAND] — run command or shell in a chroot"),
                         options,
                         true),
-      opts(options)
+      opts(options),
+      session_directory(SCHROOT_SESSION_DIR)
     {
     }
 
@@ -100,6 +186,21 @@ namespace bin
     void
     main::action_info ()
     {
+      if (this->opts->format != "text")
+        {
+          json_records records(std::cout, this->opts->format);
+
+          for (const auto& chroot_name : this->chroot_names)
+            {
+              const auto chroot = this->chroots.find(chroot_name);
+              assert(chroot->second);
+
+              chroot->second->print_details_json(records.begin());
+              records.end();
+            }
+          return;
+        }
+
       for(auto chroot_name = this->chroot_names.begin();
           chroot_name != this->chroot_names.end();
           ++chroot_name)
@@ -120,6 +221,25 @@ namespace bin
     void
     main::action_location ()
     {
+      if (this->opts->format != "text")
+        {
+          json_records records(std::cout, this->opts->format);
+
+          for (const auto& chroot_name : this->chroot_names)
+            {
+              const auto chroot = this->chroots.find(chroot_name);
+              assert(chroot->second);
+
+              records.begin()
+                << "{\"name\":" << ::schroot::json_string(chroot_name)
+                << ",\"path\":"
+                << ::schroot::json_string(chroot->second->get_path())
+                << '}';
+              records.end();
+            }
+          return;
+        }
+
       for(const auto& chroot_name : this->chroot_names)
         {
           // This should never fail, so no error handling here--we already
@@ -136,6 +256,40 @@ namespace bin
     void
     main::action_config ()
     {
+      if (this->opts->format != "text")
+        {
+          json_records records(std::cout, this->opts->format);
+
+          for (const auto& chroot_name : this->chroot_names)
+            {
+              const auto chroot = this->chroots.find(chroot_name);
+              assert(chroot->second);
+
+              // Generated chroots (e.g. source chroots) are not printed.
+              if (!chroot->second->get_original())
+                continue;
+
+              ::schroot::keyfile info;
+              info << chroot->second;
+
+              for (const auto& group : info.get_groups())
+                {
+                  std::ostream& stream(records.begin());
+                  stream << "{\"name\":" << ::schroot::json_string(group);
+                  for (const auto& key : info.get_keys(group))
+                    {
+                      std::string value;
+                      info.get_value(group, key, value);
+                      stream << ',' << ::schroot::json_string(key)
+                             << ':' << ::schroot::json_string(value);
+                    }
+                  stream << '}';
+                  records.end();
+                }
+            }
+          return;
+        }
+
       std::cout << "# "
         // TRANSLATORS: %1% = program name
         // TRANSLATORS: %2% = program version
@@ -162,6 +316,265 @@ namespace bin
       std::cout << ::schroot::keyfile_writer(info) << std::flush;
     }
 
+    void
+    main::set_session_directory (const std::string& dir)
+    {
+      this->session_directory = dir;
+    }
+
+    int
+    main::action_gc ()
+    {
+      ::schroot::chroot::gc collector;
+      collector.set_idle_time(this->opts->gc_idle);
+      collector.set_orphans(this->opts->gc_orphans);
+
+      // Forget any sessions which have gone away, even if no stale
+      // sessions are ended.
+      ::schroot::metrics::update_sessions();
+
+      // Sessions which the caller is not permitted to end are skipped,
+      // rather than failing to end them.
+      if (getuid() != 0 && !this->chroot_objects.empty())
+        {
+          create_session(::schroot::session::OPERATION_END);
+          add_session_auth();
+        }
+
+      std::vector<std::pair<::schroot::session::chroot_list::value_type,
+                            ::schroot::chroot::gc::candidate>> stale;
+      for (const auto& chroot : this->chroot_objects)
+        {
+          if (this->session)
+            {
+              this->session->set_chroots({chroot});
+              if (this->session->get_auth_status() ==
+                  ::schroot::auth::auth::STATUS_FAIL)
+                {
+                  ::schroot::log_debug(::schroot::DEBUG_INFO)
+                    << "Skipping session " << chroot.chroot->get_name()
+                    << ": not permitted to end it" << endl;
+                  continue;
+                }
+            }
+
+          ::schroot::chroot::gc::candidate candidate;
+          if (collector.check(chroot.chroot, candidate))
+            stale.push_back(std::make_pair(chroot, candidate));
+        }
+
+      // Pooled sessions which are out of date, or in excess of the
+      // pool size, are drained when collecting all sessions.  Only
+      // root may modify the pools.
+      std::vector<std::pair<std::unique_ptr<::schroot::chroot::pool>,
+                            ::schroot::string_list>> pools;
+      if (this->opts->all_sessions && getuid() == 0)
+        {
+          try
+            {
+              ::schroot::chroot::config sources;
+              sources.add("chroot", SCHROOT_CONF);
+              sources.add("chroot", SCHROOT_CONF_CHROOT_D);
+
+              for (const auto& source : sources.get_chroots("chroot"))
+                {
+                  if (!source->get_facet<::schroot::chroot::facet::session_clonable>())
+                    continue;
+
+                  std::unique_ptr<::schroot::chroot::pool>
+                    pool(new ::schroot::chroot::pool(source));
+                  ::schroot::string_list surplus(pool->get_surplus_members());
+                  if (!surplus.empty())
+                    pools.push_back(std::make_pair(std::move(pool), surplus));
+                }
+            }
+          catch (const std::runtime_error& e)
+            {
+              ::schroot::log_exception_warning(e);
+            }
+        }
+
+      // Storage queued for reclaim by a background process which was
+      // interrupted is reclaimed by a new background process.
+      ::schroot::reclaim queue;
+      ::schroot::string_list queued;
+      try
+        {
+          queued = queue.get_items();
+        }
+      catch (const ::schroot::reclaim::error& e)
+        {
+          ::schroot::log_exception_warning(e);
+        }
+
+      if (this->opts->dry_run)
+        {
+          for (const auto& session : stale)
+            std::cout << session.first.chroot->get_name() << ": "
+                      << ::schroot::chroot::gc::describe(session.second)
+                      << '\n';
+          for (const auto& pool : pools)
+            for (const auto& member : pool.second)
+              std::cout << member << ": "
+                        << ::schroot::chroot::gc::describe
+                           ({::schroot::chroot::chroot::ptr(),
+                             ::schroot::chroot::gc::STALE_POOL, 0})
+                        << '\n';
+          for (const auto& item : queued)
+            // TRANSLATORS: %1% = reclaim queue item
+            std::cout << format(_("%1%: queued for reclaim"))
+              % (queue.get_queue_directory() + '/' + item) << '\n';
+          std::cout << std::flush;
+          return EXIT_SUCCESS;
+        }
+
+      int status = EXIT_SUCCESS;
+
+      // Surplus members are claimed from the pool, and then ended like
+      // any other stale session.  A pool being refilled is skipped,
+      // since the refill discards its surplus members.
+      for (auto& pool : pools)
+        {
+          try
+            {
+              if (!pool.first->lock())
+                continue;
+
+              for (const auto& member : pool.second)
+                {
+                  ::schroot::chroot::chroot::ptr session
+                    (pool.first->claim_member(member, member, member,
+                                              "root", true));
+                  if (session)
+                    stale.push_back
+                      (std::make_pair
+                       (::schroot::session::chroot_list::value_type{member, session},
+                        ::schroot::chroot::gc::candidate
+                        {session, ::schroot::chroot::gc::STALE_POOL, 0}));
+                }
+
+              pool.first->unlock();
+            }
+          catch (const std::runtime_error& e)
+            {
+              ::schroot::log_exception_error(e);
+              status = EXIT_FAILURE;
+            }
+        }
+
+      std::map<pid_t, std::string> running;
+
+      // Wait for any session being ended to finish.
+      auto wait_one = [&] ()
+        {
+          int child_status;
+          pid_t pid = waitpid(-1, &child_status, 0);
+          if (pid == -1)
+            {
+              if (errno != EINTR)
+                running.clear();
+              return;
+            }
+
+          auto child = running.find(pid);
+          if (child == running.end())
+            return;
+
+          if (!WIFEXITED(child_status) || WEXITSTATUS(child_status) != 0)
+            {
+              // TRANSLATORS: %1% = session name
+              ::schroot::log_error()
+                << format(_("%1%: Failed to end stale session"))
+                % child->second << endl;
+              status = EXIT_FAILURE;
+            }
+          running.erase(child);
+        };
+
+      for (const auto& session : stale)
+        {
+          while (running.size() >= this->opts->gc_jobs)
+            wait_one();
+
+          const std::string& name(session.first.chroot->get_name());
+          if (!this->opts->quiet)
+            // TRANSLATORS: %1% = session name
+            // TRANSLATORS: %2% = reason the session is stale
+            ::schroot::log_info()
+              << format(_("%1%: Ending stale session: %2%"))
+              % name % ::schroot::chroot::gc::describe(session.second)
+              << endl;
+
+          ::schroot::log_flush();
+          pid_t pid = fork();
+          if (pid == -1)
+            {
+              ::schroot::log_error()
+                << format(_("Failed to fork child: %1%")) % strerror(errno)
+                << endl;
+              status = EXIT_FAILURE;
+              break;
+            }
+          else if (pid == 0)
+            {
+              int child_status = end_session(session.first);
+              ::schroot::metrics::flush();
+              ::schroot::log_flush();
+              _exit(child_status);
+            }
+
+          running.insert(std::make_pair(pid, name));
+        }
+
+      while (!running.empty())
+        wait_one();
+
+      if (!queued.empty())
+        {
+          try
+            {
+              queue.run_background();
+            }
+          catch (const ::schroot::reclaim::error& e)
+            {
+              ::schroot::log_exception_warning(e);
+              status = EXIT_FAILURE;
+            }
+        }
+
+      return status;
+    }
+
+    int
+    main::end_session (const ::schroot::session::chroot_list::value_type& session)
+    {
+      try
+        {
+          this->chroot_objects.clear();
+          this->chroot_objects.push_back(session);
+
+          create_session(::schroot::session::OPERATION_END);
+          add_session_auth();
+
+          this->session->set_force(this->opts->session_force);
+          this->session->set_async_end(this->opts->async_end);
+          if (this->opts->quiet)
+            this->session->set_verbosity("quiet");
+          else if (this->opts->verbose)
+            this->session->set_verbosity("verbose");
+
+          this->session->run();
+          return this->session->get_child_status();
+        }
+      catch (const std::exception& e)
+        {
+          if (!this->opts->quiet)
+            ::schroot::log_exception_error(e);
+        }
+
+      return EXIT_FAILURE;
+    }
+
     void
     main::get_chroot_options ()
     {
@@ -210,7 +623,8 @@ namespace bin
           std::string chroot_namespace("chroot");
           if (this->opts->action == options::ACTION_SESSION_RECOVER ||
               this->opts->action == options::ACTION_SESSION_RUN ||
-              this->opts->action == options::ACTION_SESSION_END)
+              this->opts->action == options::ACTION_SESSION_END ||
+              this->opts->action == options::ACTION_SESSION_GC)
             chroot_namespace = "session";
 
           // Validate and normalise
@@ -223,7 +637,18 @@ namespace bin
     void
     main::load_config ()
     {
+      ::schroot::trace::span span("load_config");
+
       this->config = ::schroot::chroot::config::ptr(new ::schroot::chroot::config);
+
+      /* Only the session itself is needed when operating on a single
+         named session. */
+      if (load_session_config())
+        {
+          this->opts->load_chroots = false;
+          return;
+        }
+
       /* The normal chroot list is used when starting a session or running
          any chroot type or session, or displaying chroot information. */
       if (this->opts->load_chroots == true)
@@ -234,7 +659,47 @@ namespace bin
       /* The session chroot list is used when running or ending an
          existing session, or displaying chroot information. */
       if (this->opts->load_sessions == true)
-        this->config->add("session", SCHROOT_SESSION_DIR);
+        this->config->add("session", this->session_directory);
+    }
+
+    bool
+    main::load_session_config ()
+    {
+      if (!(this->opts->action == options::ACTION_SESSION_RECOVER ||
+            this->opts->action == options::ACTION_SESSION_RUN ||
+            this->opts->action == options::ACTION_SESSION_END) ||
+          this->opts->chroots.size() != 1 ||
+          this->opts->all_sessions)
+        return false;
+
+      std::string name(this->opts->chroots.front());
+      const std::string prefix =
+        std::string("session") + ::schroot::chroot::config::namespace_separator;
+      if (name.compare(0, prefix.length(), prefix) == 0)
+        name = name.substr(prefix.length());
+
+      // Names in other namespaces, and names which could not be a
+      // session file, are resolved using the full configuration.
+      if (!::schroot::is_valid_sessionname(name))
+        return false;
+
+      std::string file(this->session_directory + '/' + name);
+      try
+        {
+          if (!::schroot::stat(file).is_regular())
+            return false;
+        }
+      catch (const std::runtime_error&)
+        {
+          // No session file; this may be an alias or a plain chroot.
+          return false;
+        }
+
+      ::schroot::log_debug(::schroot::DEBUG_NOTICE)
+        << "Loading only session: " << file << endl;
+      this->config->add("session", file);
+
+      return true;
     }
 
     int
@@ -252,6 +717,12 @@ namespace bin
           return EXIT_SUCCESS;
         }
 
+      if (this->opts->action == options::ACTION_SESSION_SERVE)
+        {
+          server requests(STDIN_FILENO);
+          return requests.run();
+        }
+
       /* Initialise chroot configuration. */
       load_config();
 
@@ -278,7 +749,10 @@ namespace bin
                 log_exception_warning(error((this->opts->all_chroots == true) ?
                                             SCHROOT_CONF : SCHROOT_SESSION_DIR,
                                             CHROOT_NOTDEFINED));
-              return EXIT_SUCCESS;
+              // Garbage collection also drains session pools and the
+              // reclaim queue, which need no sessions.
+              if (this->opts->action != options::ACTION_SESSION_GC)
+                return EXIT_SUCCESS;
             }
         }
       this->chroot_objects.clear();
@@ -320,6 +794,8 @@ namespace bin
           action_config();
           return EXIT_SUCCESS;
         }
+      if (this->opts->action == options::ACTION_SESSION_GC)
+        return action_gc();
 
       /* Create a session. */
       ::schroot::session::operation sess_op(::schroot::session::OPERATION_AUTOMATIC);
@@ -346,6 +822,7 @@ namespace bin
           this->session->set_preserve_environment(this->opts->preserve);
           this->session->set_session_id(this->opts->session_name);
           this->session->set_force(this->opts->session_force);
+          this->session->set_async_end(this->opts->async_end);
           if (this->opts->quiet)
             this->session->set_verbosity("quiet");
           else if (this->opts->verbose)
@@ -402,6 +879,19 @@ namespace bin
     void
     main::action_list ()
     {
+      if (this->opts->format != "text")
+        {
+          json_records records(std::cout, this->opts->format);
+
+          for (const auto& chroot : this->chroot_names)
+            {
+              records.begin()
+                << "{\"name\":" << ::schroot::json_string(chroot) << '}';
+              records.end();
+            }
+          return;
+        }
+
       // This list is pre-validated.
       for (const auto& chroot : this->chroot_names)
         std::cout << chroot << '\n';
@@ -24,6 +24,7 @@
 
 #include <schroot/chroot/config.h>
 #include <schroot/custom-error.h>
+#include <schroot/session.h>
 
 /**
  * schroot binary components.
@@ -93,6 +94,24 @@ namespace bin
       virtual void
       action_config ();
 
+      /**
+       * Set the session directory.  This is intended for testing.
+       *
+       * @param dir the session directory.
+       */
+      void
+      set_session_directory (const std::string& dir);
+
+      /**
+       * End stale sessions.  Each session is ended in a separate
+       * child process, with up to the configured number of sessions
+       * being ended concurrently.
+       *
+       * @returns the exit status.
+       */
+      virtual int
+      action_gc ();
+
     protected:
       /**
        * Run the program.  This is the program-specific run method which
@@ -118,6 +137,29 @@ namespace bin
       virtual void
       load_config ();
 
+      /**
+       * Load the configuration for a single named session.  This is
+       * used when running, recovering or ending an explicitly named
+       * session, which only requires the session's own file rather
+       * than all chroot definitions and sessions.
+       *
+       * @returns true if the session configuration was loaded, or
+       * false if the full configuration must be loaded, for example
+       * if the name is an alias or a plain chroot.
+       */
+      bool
+      load_session_config ();
+
+      /**
+       * End a single session.  This is run in a child process by
+       * action_gc().
+       *
+       * @param session the session to end.
+       * @returns the exit status.
+       */
+      int
+      end_session (const ::schroot::session::chroot_list::value_type& session);
+
       /**
        * Create a session.  This sets the session member.
        *
@@ -132,7 +174,6 @@ namespace bin
       virtual void
       add_session_auth ();
 
-    private:
       /// The program options.
       options::ptr                    opts;
       /// The chroot configuration.
@@ -145,6 +186,8 @@ namespace bin
       ::schroot::session::chroot_list chroot_objects;
       /// The session.
       ::schroot::session::ptr         session;
+      /// The session directory.
+      std::string                     session_directory;
     };
 
   }
@@ -18,6 +18,7 @@
 
 #include <config.h>
 
+#include <schroot/chroot/gc.h>
 #include <schroot/util.h>
 
 #include <schroot/options.h>
@@ -44,6 +45,8 @@ namespace bin
     const options::action_type options::ACTION_SESSION_RECOVER ("session_recover");
     const options::action_type options::ACTION_SESSION_RUN ("session_run");
     const options::action_type options::ACTION_SESSION_END ("session_end");
+    const options::action_type options::ACTION_SESSION_GC ("session_gc");
+    const options::action_type options::ACTION_SESSION_SERVE ("session_serve");
     const options::action_type options::ACTION_LIST ("list");
     const options::action_type options::ACTION_INFO ("info");
     const options::action_type options::ACTION_LOCATION ("location");
@@ -62,8 +65,14 @@ namespace bin
       all_sessions(false),
       all_source_chroots(false),
       exclude_aliases(false),
+      format("text"),
       session_name(),
       session_force(false),
+      async_end(false),
+      gc_idle(::schroot::chroot::gc::default_idle_time),
+      gc_jobs(4),
+      gc_orphans(false),
+      dry_run(false),
       useroptions(),
       useroptions_map(),
       chroot(_("Chroot selection")),
@@ -89,6 +98,8 @@ namespace bin
       action.add(ACTION_SESSION_RECOVER);
       action.add(ACTION_SESSION_RUN);
       action.add(ACTION_SESSION_END);
+      action.add(ACTION_SESSION_GC);
+      action.add(ACTION_SESSION_SERVE);
       action.add(ACTION_LIST);
       action.add(ACTION_INFO);
       action.add(ACTION_LOCATION);
@@ -100,7 +111,9 @@ namespace bin
         ("info,i",
          _("Show information about selected chroots"))
         ("config",
-         _("Dump configuration of selected chroots"));
+         _("Dump configuration of selected chroots"))
+        ("format", opt::value<std::string>(&this->format),
+         _("Output format for --list, --info, --location and --config (text, json or jsonl)"));
 
       chroot.add_options()
         ("chroot,c", opt::value<::schroot::string_list>(&this->chroots),
@@ -138,13 +151,27 @@ namespace bin
         ("run-session,r",
          _("Run an existing session"))
         ("end-session,e",
-         _("End an existing session"));
+         _("End an existing session"))
+        ("gc",
+         _("End stale sessions with no running processes"))
+        ("serve",
+         _("Serve session requests from a program on standard input"));
 
       session_options.add_options()
         ("session-name,n", opt::value<std::string>(&this->session_name),
          _("Session name (defaults to an automatically generated name)"))
         ("force,f",
-         _("Force operation, even if it fails"));
+         _("Force operation, even if it fails"))
+        ("async",
+         _("End sessions quickly, deleting their storage in the background"))
+        ("gc-idle", opt::value<unsigned int>(&this->gc_idle),
+         _("Idle time in seconds after which a session is stale (default 86400)"))
+        ("gc-orphans",
+         _("Sessions whose driver has exited are stale"))
+        ("gc-jobs", opt::value<unsigned int>(&this->gc_jobs),
+         _("Maximum number of stale sessions to end concurrently (default 4)"))
+        ("dry-run",
+         _("Report stale sessions without ending them"));
       hidden.add_options()
         ("command", opt::value<::schroot::string_list>(&this->command),
          _("Command to run"));
@@ -240,8 +267,18 @@ namespace bin
         this->action = ACTION_SESSION_RUN;
       if (vm.count("end-session"))
         this->action = ACTION_SESSION_END;
+      if (vm.count("gc"))
+        this->action = ACTION_SESSION_GC;
+      if (vm.count("serve"))
+        this->action = ACTION_SESSION_SERVE;
+      if (vm.count("gc-orphans"))
+        this->gc_orphans = true;
+      if (vm.count("dry-run"))
+        this->dry_run = true;
       if (vm.count("force"))
         this->session_force = true;
+      if (vm.count("async"))
+        this->async_end = true;
 
       if (this->all == true)
         {
@@ -317,6 +354,26 @@ namespace bin
             throw error
               (_("--session-name is not permitted for the specified action; did you mean to use --chroot?"));
         }
+      else if (this->action == ACTION_SESSION_GC)
+        {
+          // Only sessions may be collected; all sessions by default.
+          this->load_chroots = false;
+          this->load_sessions = true;
+          this->all = this->all_chroots = this->all_source_chroots = false;
+          if (this->chroots.empty())
+            this->all_sessions = true;
+
+          if (this->gc_jobs == 0)
+            throw error(_("--gc-jobs must be at least 1"));
+        }
+      else if (this->action == ACTION_SESSION_SERVE)
+        {
+          // Each request loads the configuration it needs.
+          this->load_chroots = this->load_sessions = false;
+          if (!this->chroots.empty() || all_used() || !this->command.empty())
+            throw error
+              (_("--serve does not accept chroots or a command; these are given with each request"));
+        }
       else if (this->action == ACTION_HELP ||
                this->action == ACTION_VERSION)
         {
@@ -353,6 +410,28 @@ namespace bin
           throw error(_("Unknown action specified"));
         }
 
+      if (this->format != "text" && this->format != "json" &&
+          this->format != "jsonl")
+        throw error(_("Invalid output format"));
+
+      if (this->format != "text" &&
+          this->action != ACTION_LIST &&
+          this->action != ACTION_INFO &&
+          this->action != ACTION_LOCATION &&
+          this->action != ACTION_CONFIG)
+        throw error
+          (_("--format is not permitted for the specified action"));
+
+      if (this->dry_run && this->action != ACTION_SESSION_GC)
+        throw error
+          (_("--dry-run is not permitted for the specified action"));
+
+      if (this->async_end &&
+          this->action != ACTION_SESSION_END &&
+          this->action != ACTION_SESSION_GC)
+        throw error
+          (_("--async is not permitted for the specified action"));
+
       if (!this->session_name.empty() && this->action != ACTION_SESSION_BEGIN)
         throw error
           (_("--session-name is not permitted for the specified action"));
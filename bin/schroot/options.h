@@ -42,6 +42,10 @@ namespace bin
       static const action_type ACTION_SESSION_RUN;
       /// End an existing session.
       static const action_type ACTION_SESSION_END;
+      /// End stale sessions.
+      static const action_type ACTION_SESSION_GC;
+      /// Serve session requests.
+      static const action_type ACTION_SESSION_SERVE;
       /// Display a list of chroots.
       static const action_type ACTION_LIST;
       /// Display chroot information.
@@ -84,6 +88,8 @@ namespace bin
       bool                    all_source_chroots;
       /// Exclude aliases in output.
       bool                    exclude_aliases;
+      /// Output format (text, json or jsonl).
+      std::string             format;
       /// Load chroots.
       bool                    load_chroots;
       /// Load sessions.
@@ -92,6 +98,16 @@ namespace bin
       std::string             session_name;
       /// Force session operations.
       bool                    session_force;
+      /// End sessions asynchronously.
+      bool                    async_end;
+      /// Idle time in seconds after which a session is stale.
+      unsigned int            gc_idle;
+      /// Maximum number of stale sessions to end concurrently.
+      unsigned int            gc_jobs;
+      /// Sessions whose driver has exited are stale.
+      bool                    gc_orphans;
+      /// Report stale sessions without ending them.
+      bool                    dry_run;
       /// Options as a key=value list.
       ::schroot::string_list  useroptions;
       /// Options in a string-string map.
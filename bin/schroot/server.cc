@@ -0,0 +1,657 @@
+/* Copyright © 2005-2013  Roger Leigh <rleigh@codelibre.net>
+ *
+ * schroot is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * schroot is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ *********************************************************************/
+
+#include <config.h>
+
+#include <schroot/log.h>
+#include <schroot/session.h>
+
+#include <bin/schroot/main.h>
+#include <bin/schroot/server.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <memory>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <boost/format.hpp>
+
+using std::endl;
+using boost::format;
+using schroot::_;
+using schroot::N_;
+
+namespace schroot
+{
+
+  template<>
+  error<bin::schroot::server::error_code>::map_type
+  error<bin::schroot::server::error_code>::error_strings =
+    {
+      {bin::schroot::server::SOCKET_INVALID, N_("Standard input is not a sequenced packet socket")},
+      {bin::schroot::server::SIGNAL_SET,     N_("Failed to set signal handler")},
+      {bin::schroot::server::CHILD_FORK,     N_("Failed to fork child")},
+      // TRANSLATORS: %4% = exit status or signal
+      {bin::schroot::server::CHILD_FAILED,   N_("Request terminated abnormally: %4%")}
+    };
+
+}
+
+namespace bin
+{
+  namespace schroot
+  {
+
+    namespace
+    {
+
+      /// The write end of the pipe used to signal child exit.
+      int sigchld_fd = -1;
+
+      /**
+       * Handle SIGCHLD by waking the server.
+       *
+       * @param ignore the signal number.
+       */
+      void
+      sigchld_handler (int ignore)
+      {
+        int saved_errno = errno;
+        if (write(sigchld_fd, "", 1) == -1)
+          {
+            // The pipe is full, so the server will already wake.
+          }
+        errno = saved_errno;
+      }
+
+      /**
+       * Send a result.  If the result is too large to send in one
+       * message, the earliest diagnostics are omitted, and the text
+       * of the last is truncated, so that the exit status is always
+       * returned.
+       *
+       * @param sock the socket to send the result to.
+       * @param id the request identifier.
+       * @param res the result.
+       */
+      void
+      send_result (int                              sock,
+                   unsigned long                    id,
+                   const ::schroot::client::result& res)
+      {
+        ::schroot::client::result truncated(res);
+        std::size_t omitted = 0;
+
+        for (;;)
+          {
+            ::schroot::client::result sent(truncated);
+            if (omitted)
+              {
+                ::schroot::client::diagnostic note;
+                note.level = ::schroot::LOG_LEVEL_WARNING;
+                // TRANSLATORS: %1% = number of messages
+                note.message = (format(_("%1% earlier messages were omitted"))
+                                % omitted).str();
+                sent.diagnostics.insert(sent.diagnostics.begin(), note);
+              }
+
+            ::schroot::client_protocol::message msg
+              (::schroot::client_protocol::encode_result(id, sent));
+            std::size_t size =
+              ::schroot::client_protocol::serialise(msg).size();
+            if (size <= ::schroot::client_protocol::max_message_size ||
+                truncated.diagnostics.empty())
+              {
+                ::schroot::client_protocol::send(sock, msg);
+                return;
+              }
+
+            std::size_t excess =
+              size - ::schroot::client_protocol::max_message_size;
+            ::schroot::client::diagnostic& last(truncated.diagnostics.back());
+            if (truncated.diagnostics.size() > 1 ||
+                excess >= last.message.size())
+              {
+                truncated.diagnostics.erase(truncated.diagnostics.begin());
+                ++omitted;
+              }
+            else
+              last.message.resize(last.message.size() - excess);
+          }
+      }
+
+      /**
+       * Collect warnings and errors logged while carrying out a
+       * request.  Each is sent over a socket as it is logged, so that
+       * messages logged by child processes of the request, for
+       * example when running a command fails, are also collected.
+       */
+      class diagnostic_sink : public ::schroot::log_sink
+      {
+      public:
+        /**
+         * The constructor.
+         *
+         * @param sock the non-blocking socket to send diagnostics
+         * to.
+         */
+        diagnostic_sink (int sock):
+          sock(sock)
+        {
+        }
+
+        virtual void
+        write (const ::schroot::log_record& record)
+        {
+          if (record.level < ::schroot::LOG_LEVEL_WARNING)
+            return;
+
+          ::schroot::client::diagnostic diag;
+          diag.level = record.level;
+          diag.message = record.message;
+          diag.fields.insert(record.fields.begin(), record.fields.end());
+
+          ::schroot::client::result res;
+          res.diagnostics.push_back(diag);
+
+          try
+            {
+              send_result(this->sock, 0, res);
+            }
+          catch (const std::exception&)
+            {
+              // Messages are dropped rather than blocking if too
+              // many are logged.
+            }
+        }
+
+      private:
+        /// The socket to send diagnostics to.
+        int sock;
+      };
+
+      /**
+       * Read all messages which are available without blocking.
+       *
+       * @param sock the non-blocking socket to read from.
+       * @returns the diagnostics received.
+       */
+      std::vector<::schroot::client::diagnostic>
+      read_diagnostics (int sock)
+      {
+        std::vector<::schroot::client::diagnostic> diagnostics;
+
+        try
+          {
+            ::schroot::client_protocol::message msg;
+            std::vector<int> fds;
+            while (::schroot::client_protocol::receive(sock, msg, fds))
+              {
+                unsigned long id;
+                ::schroot::client::result res
+                  (::schroot::client_protocol::decode_result(msg, id));
+                diagnostics.insert(diagnostics.end(),
+                                   res.diagnostics.begin(),
+                                   res.diagnostics.end());
+              }
+          }
+        catch (const std::exception&)
+          {
+            // No more messages.
+          }
+
+        return diagnostics;
+      }
+
+      /**
+       * Read a session name written to a pipe.  The name is the last
+       * line written.
+       *
+       * @param fd the non-blocking pipe to read from.
+       * @returns the session name.
+       */
+      std::string
+      read_session_name (int fd)
+      {
+        std::string output;
+        char buf[BUFSIZ];
+        ssize_t count;
+        while ((count = read(fd, buf, sizeof(buf))) > 0)
+          output.append(buf, static_cast<std::string::size_type>(count));
+
+        while (!output.empty() && output[output.size() - 1] == '\n')
+          output.erase(output.size() - 1);
+        std::string::size_type pos = output.rfind('\n');
+        if (pos != std::string::npos)
+          output = output.substr(pos + 1);
+        return output;
+      }
+
+      /**
+       * Connect file descriptors in a request child.  The passed
+       * descriptors and the socket are moved out of the way first,
+       * so that a descriptor may be moved to the number of another.
+       * Standard input, output and error are connected to /dev/null
+       * unless passed.
+       *
+       * @param fds the mapping of target descriptors to received
+       * descriptors.
+       * @param sock the socket connected to the client; this is
+       * updated if moved.
+       * @returns false on failure.
+       */
+      bool
+      connect_fds (const std::map<int, int>& fds,
+                   int&                      sock)
+      {
+        int base = 3;
+        for (const auto& fd : fds)
+          base = std::max(base, fd.first + 1);
+
+        int high_sock = fcntl(sock, F_DUPFD_CLOEXEC, base);
+        if (high_sock == -1)
+          return false;
+        close(sock);
+        sock = high_sock;
+
+        std::map<int, int> moved;
+        for (const auto& fd : fds)
+          {
+            int high = fcntl(fd.second, F_DUPFD_CLOEXEC, base);
+            if (high == -1)
+              return false;
+            close(fd.second);
+            moved.insert(std::make_pair(fd.first, high));
+          }
+
+        for (const auto& fd : moved)
+          {
+            if (dup2(fd.second, fd.first) == -1)
+              return false;
+            close(fd.second);
+          }
+
+        for (int fd = STDIN_FILENO; fd <= STDERR_FILENO; ++fd)
+          {
+            if (moved.find(fd) != moved.end())
+              continue;
+            int null = open("/dev/null",
+                            (fd == STDIN_FILENO) ? O_RDONLY : O_WRONLY);
+            if (null == -1)
+              return false;
+            if (null != fd)
+              {
+                if (dup2(null, fd) == -1)
+                  return false;
+                close(null);
+              }
+          }
+
+        return true;
+      }
+
+      /**
+       * Format the exit status of a child for display.
+       *
+       * @param status the status returned by waitpid.
+       * @returns the formatted status.
+       */
+      std::string
+      describe_status (int status)
+      {
+        if (WIFSIGNALED(status))
+          // TRANSLATORS: %1% = signal name
+          return (format(_("killed by %1%")) % strsignal(WTERMSIG(status))).str();
+        // TRANSLATORS: %1% = exit status
+        return (format(_("exit status %1%")) % WEXITSTATUS(status)).str();
+      }
+
+    }
+
+    server::server (int sock):
+      sock(sock),
+      children()
+    {
+    }
+
+    server::~server ()
+    {
+    }
+
+    int
+    server::run ()
+    {
+      int type;
+      socklen_t length = sizeof(type);
+      if (getsockopt(this->sock, SOL_SOCKET, SO_TYPE, &type, &length) == -1 ||
+          type != SOCK_SEQPACKET)
+        throw error(SOCKET_INVALID);
+
+      // Request children must not inherit the socket once they run a
+      // command.
+      fcntl(this->sock, F_SETFD, FD_CLOEXEC);
+
+      int wake[2];
+      if (pipe2(wake, O_CLOEXEC|O_NONBLOCK) == -1)
+        throw error(SIGNAL_SET, strerror(errno));
+      sigchld_fd = wake[1];
+
+      struct sigaction new_sa, old_sa;
+      sigemptyset(&new_sa.sa_mask);
+      new_sa.sa_flags = SA_NOCLDSTOP;
+      new_sa.sa_handler = sigchld_handler;
+      if (sigaction(SIGCHLD, &new_sa, &old_sa) != 0)
+        throw error(SIGNAL_SET, strerror(errno));
+
+      bool open = true;
+      while (open || !this->children.empty())
+        {
+          struct pollfd pfds[2];
+          pfds[0].fd = wake[0];
+          pfds[0].events = POLLIN;
+          pfds[1].fd = this->sock;
+          pfds[1].events = POLLIN;
+
+          if (poll(pfds, open ? 2 : 1, -1) == -1)
+            {
+              if (errno == EINTR)
+                continue;
+              ::schroot::log_error() << format(_("Failed to poll: %1%"))
+                % strerror(errno) << endl;
+              break;
+            }
+
+          if (pfds[0].revents)
+            {
+              char buf[64];
+              while (read(wake[0], buf, sizeof(buf)) > 0)
+                ;
+              reap();
+            }
+
+          if (open && pfds[1].revents)
+            {
+              ::schroot::client_protocol::message msg;
+              std::vector<int> fds;
+              try
+                {
+                  if (::schroot::client_protocol::receive(this->sock, msg, fds))
+                    start_request(msg, fds);
+                  else
+                    open = false;
+                }
+              catch (const std::exception& e)
+                {
+                  // An invalid message is discarded, and later
+                  // requests are still served unless the socket has
+                  // failed.
+                  ::schroot::log_exception_error(e);
+                  if (pfds[1].revents & (POLLERR|POLLNVAL))
+                    open = false;
+                }
+            }
+        }
+
+      sigaction(SIGCHLD, &old_sa, 0);
+      sigchld_fd = -1;
+      close(wake[0]);
+      close(wake[1]);
+
+      return EXIT_SUCCESS;
+    }
+
+    void
+    server::start_request (const ::schroot::client_protocol::message& msg,
+                           const std::vector<int>&                    fds)
+    {
+      unsigned long id = 0;
+      ::schroot::client::request req;
+      try
+        {
+          req = ::schroot::client_protocol::decode_request(msg, id);
+          if (req.fds.size() != fds.size())
+            throw ::schroot::client::error(::schroot::client::REQUEST_INVALID);
+        }
+      catch (const std::exception& e)
+        {
+          for (const auto& fd : fds)
+            close(fd);
+          send_failure(id, e);
+          return;
+        }
+
+      // Descriptors are sent in order of their target.
+      auto received = fds.begin();
+      for (auto& fd : req.fds)
+        fd.second = *received++;
+
+      ::schroot::log_flush();
+      pid_t pid = fork();
+      if (pid == -1)
+        {
+          int saved_errno = errno;
+          for (const auto& fd : fds)
+            close(fd);
+          send_failure(id, error(CHILD_FORK, strerror(saved_errno)));
+          return;
+        }
+      else if (pid == 0)
+        {
+          signal(SIGCHLD, SIG_DFL);
+          close(sigchld_fd);
+
+          ::schroot::client::result res;
+          if (connect_fds(req.fds, this->sock))
+            run_request(req, res);
+
+          std::cout << std::flush;
+          std::cerr << std::flush;
+          ::schroot::log_flush();
+
+          try
+            {
+              send_result(this->sock, id, res);
+            }
+          catch (const std::exception&)
+            {
+              _exit(EXIT_FAILURE);
+            }
+          _exit(EXIT_SUCCESS);
+        }
+
+      for (const auto& fd : fds)
+        close(fd);
+      this->children.insert(std::make_pair(pid, id));
+    }
+
+    void
+    server::run_request (const ::schroot::client::request& req,
+                         ::schroot::client::result&        res)
+    {
+      int diagnostics[2];
+      if (socketpair(AF_UNIX, SOCK_SEQPACKET|SOCK_CLOEXEC|SOCK_NONBLOCK,
+                     0, diagnostics) == -1)
+        {
+          ::schroot::log_error() << strerror(errno) << endl;
+          return;
+        }
+      ::schroot::log_add_sink
+          (::schroot::log_sink::ptr(new diagnostic_sink(diagnostics[1])));
+
+      // The name of a new session is written to standard output, and
+      // is returned in the result instead.
+      int name[2] = { -1, -1 };
+      if (req.operation == ::schroot::session::OPERATION_BEGIN)
+        {
+          if (pipe2(name, O_CLOEXEC|O_NONBLOCK) == -1 ||
+              dup2(name[1], STDOUT_FILENO) == -1)
+            {
+              ::schroot::log_error() << strerror(errno) << endl;
+              return;
+            }
+          close(name[1]);
+        }
+
+      if (!req.environment.empty())
+        {
+          clearenv();
+          for (const auto& var : req.environment)
+            putenv(strdup(var.c_str()));
+        }
+
+      ::schroot::string_list args;
+      args.push_back("schroot");
+
+      if (req.operation == ::schroot::session::OPERATION_BEGIN)
+        args.push_back("--begin-session");
+      else if (req.operation == ::schroot::session::OPERATION_RECOVER)
+        args.push_back("--recover-session");
+      else if (req.operation == ::schroot::session::OPERATION_RUN)
+        args.push_back("--run-session");
+      else if (req.operation == ::schroot::session::OPERATION_END)
+        args.push_back("--end-session");
+      else
+        args.push_back("--automatic-session");
+
+      if (req.operation == ::schroot::session::OPERATION_AUTOMATIC ||
+          req.operation == ::schroot::session::OPERATION_BEGIN)
+        {
+          if (!req.chroot.empty())
+            {
+              args.push_back("--chroot");
+              args.push_back(req.chroot);
+            }
+          if (req.operation == ::schroot::session::OPERATION_BEGIN &&
+              !req.session.empty())
+            {
+              args.push_back("--session-name");
+              args.push_back(req.session);
+            }
+        }
+      else if (!req.session.empty())
+        {
+          args.push_back("--chroot");
+          args.push_back(req.session);
+        }
+
+      if (!req.user.empty())
+        {
+          args.push_back("--user");
+          args.push_back(req.user);
+        }
+      if (!req.directory.empty())
+        {
+          args.push_back("--directory");
+          args.push_back(req.directory);
+        }
+      if (req.preserve_environment)
+        args.push_back("--preserve-environment");
+      for (const auto& option : req.options)
+        {
+          args.push_back("--option");
+          args.push_back(option.first + '=' + option.second);
+        }
+      if (!req.command.empty())
+        {
+          args.push_back("--");
+          args.insert(args.end(), req.command.begin(), req.command.end());
+        }
+
+      std::vector<char *> argv;
+      for (auto& arg : args)
+        argv.push_back(&arg[0]);
+      argv.push_back(0);
+
+      try
+        {
+          options::ptr opts(new options);
+          main kit(opts);
+          res.status = kit.run(static_cast<int>(args.size()), &argv[0]);
+        }
+      catch (const std::exception& e)
+        {
+          ::schroot::log_exception_error(e);
+          res.status = EXIT_FAILURE;
+        }
+
+      std::cout << std::flush;
+      ::schroot::log_flush();
+
+      if (name[0] != -1)
+        {
+          if (res.status == EXIT_SUCCESS)
+            res.session = read_session_name(name[0]);
+          close(name[0]);
+        }
+
+      res.diagnostics = read_diagnostics(diagnostics[0]);
+    }
+
+    void
+    server::reap ()
+    {
+      int status;
+      pid_t pid;
+      while ((pid = waitpid(-1, &status, WNOHANG)) > 0)
+        {
+          auto child = this->children.find(pid);
+          if (child == this->children.end())
+            continue;
+
+          // The child exits successfully once it has sent the result.
+          if (!WIFEXITED(status) || WEXITSTATUS(status) != EXIT_SUCCESS)
+            send_failure(child->second,
+                         error(CHILD_FAILED, describe_status(status)));
+          this->children.erase(child);
+        }
+    }
+
+    void
+    server::send_failure (unsigned long         id,
+                          const std::exception& e)
+    {
+      ::schroot::client::diagnostic diag;
+      diag.level = ::schroot::LOG_LEVEL_ERROR;
+      diag.message = e.what();
+
+      ::schroot::client::result res;
+      res.diagnostics.push_back(diag);
+
+      try
+        {
+          ::schroot::client_protocol::send
+              (this->sock, ::schroot::client_protocol::encode_result(id, res));
+        }
+      catch (const std::exception& send_error)
+        {
+          ::schroot::log_exception_error(send_error);
+        }
+    }
+
+  }
+}
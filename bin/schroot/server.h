@@ -0,0 +1,131 @@
+/* Copyright © 2005-2013  Roger Leigh <rleigh@codelibre.net>
+ *
+ * schroot is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * schroot is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ *********************************************************************/
+
+#ifndef SCHROOT_SERVER_H
+#define SCHROOT_SERVER_H
+
+#include <schroot/client.h>
+#include <schroot/client-protocol.h>
+#include <schroot/custom-error.h>
+
+#include <map>
+#include <vector>
+
+#include <sys/types.h>
+
+namespace bin
+{
+  namespace schroot
+  {
+
+    /**
+     * Serve session requests from a ::schroot::client.  Requests
+     * are received on a socket, and each is carried out in a child
+     * process by running schroot with the equivalent options.  The
+     * server exits once the client has closed the socket and all
+     * outstanding requests have completed.
+     */
+    class server
+    {
+    public:
+      /// Error codes.
+      enum error_code
+        {
+          SOCKET_INVALID, ///< Not a sequenced packet socket.
+          SIGNAL_SET,     ///< Failed to set signal handler.
+          CHILD_FORK,     ///< Failed to fork child.
+          CHILD_FAILED    ///< Request terminated abnormally.
+        };
+
+      /// Exception type.
+      typedef ::schroot::custom_error<error_code> error;
+
+      /**
+       * The constructor.
+       *
+       * @param sock the socket connected to the client.
+       */
+      server (int sock);
+
+      /// The destructor.
+      virtual ~server ();
+
+      /**
+       * Serve requests until the client closes the socket.
+       *
+       * @returns the exit status.
+       */
+      int
+      run ();
+
+    private:
+      /**
+       * Start a child process to carry out a request.
+       *
+       * @param msg the request message.
+       * @param fds the file descriptors received with the request.
+       */
+      void
+      start_request (const ::schroot::client_protocol::message& msg,
+                     const std::vector<int>&                    fds);
+
+      /**
+       * Carry out a request.  This is run in the child process.
+       * Warnings and errors are added to the result as they are
+       * logged.
+       *
+       * @param req the request.
+       * @param res the result.
+       */
+      void
+      run_request (const ::schroot::client::request& req,
+                   ::schroot::client::result&        res);
+
+      /**
+       * Reap exited children, and report any request which did not
+       * send a result as failed.
+       */
+      void
+      reap ();
+
+      /**
+       * Send a failure result.
+       *
+       * @param id the request identifier.
+       * @param e the reason for the failure.
+       */
+      void
+      send_failure (unsigned long         id,
+                    const std::exception& e);
+
+      /// The socket connected to the client.
+      int                            sock;
+      /// Running requests (child process to request identifier).
+      std::map<pid_t, unsigned long> children;
+    };
+
+  }
+}
+
+#endif /* SCHROOT_SERVER_H */
+
+/*
+ * Local Variables:
+ * mode:C++
+ * End:
+ */
@@ -658,8 +658,11 @@ INPUT                  = @PROJECT_SOURCE_DIR@/bin/schroot \
                          @PROJECT_SOURCE_DIR@/lib/bin-common \
                          @PROJECT_SOURCE_DIR@/lib/dchroot-common \
                          @PROJECT_SOURCE_DIR@/lib/schroot-common \
+                         @PROJECT_SOURCE_DIR@/libexec/copyfiles \
+                         @PROJECT_SOURCE_DIR@/libexec/killprocs \
                          @PROJECT_SOURCE_DIR@/libexec/listmounts \
-                         @PROJECT_SOURCE_DIR@/libexec/mount
+                         @PROJECT_SOURCE_DIR@/libexec/mount \
+                         @PROJECT_SOURCE_DIR@/libexec/nssdatabases
 
 # This tag can be used to specify the character encoding of the source files
 # that doxygen parses. Internally doxygen uses the UTF-8 encoding, which is
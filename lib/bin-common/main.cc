@@ -20,6 +20,8 @@
 
 #include <schroot/i18n.h>
 #include <schroot/log.h>
+#include <schroot/metrics.h>
+#include <schroot/trace.h>
 #include <schroot/types.h>
 #include <schroot/feature.h>
 
@@ -119,7 +121,13 @@ namespace bin
           if (this->use_syslog)
             openlog(this->program_name.c_str(), LOG_PID|LOG_NDELAY, LOG_AUTHPRIV);
 
-          int status = run_impl();
+          int status;
+          {
+            schroot::trace::span span(this->program_name);
+            status = run_impl();
+          }
+
+          schroot::metrics::flush();
 
           closelog();
 
@@ -127,6 +135,7 @@ namespace bin
         }
       catch (const std::exception& e)
         {
+          schroot::metrics::flush();
           schroot::log_exception_error(e);
 
           try
@@ -20,12 +20,16 @@
 
 #include <schroot/i18n.h>
 #include <schroot/log.h>
+#include <schroot/log-sink.h>
+#include <schroot/trace.h>
 
 #include <bin-common/options.h>
 
 #include <cstdlib>
 #include <iostream>
 
+#include <fcntl.h>
+
 #include <boost/format.hpp>
 #include <boost/program_options.hpp>
 
@@ -54,7 +58,10 @@ namespace bin
       positional(),
       visible(),
       global(),
-      vm()
+      vm(),
+      debug_level(),
+      log_json_fd(-1),
+      trace_file()
     {
     }
 
@@ -99,7 +106,13 @@ namespace bin
         ("quiet,q",
          _("Show less output"))
         ("verbose,v",
-         _("Show more output"));
+         _("Show more output"))
+        ("log-json-fd", opt::value<int>(&this->log_json_fd),
+         _("Also log messages as JSON lines to the specified file descriptor"))
+        ("log-journal",
+         _("Also log messages to the systemd journal"))
+        ("trace", opt::value<std::string>(&this->trace_file),
+         _("Append trace events to the specified file"));
 
       hidden.add_options()
         ("debug", opt::value<std::string>(&this->debug_level),
@@ -166,6 +179,32 @@ namespace bin
         }
       else
         schroot::debug_log_level = schroot::DEBUG_NONE;
+
+      if (vm.count("log-json-fd"))
+        {
+          if (this->log_json_fd < 0 ||
+              fcntl(this->log_json_fd, F_GETFD) < 0)
+            throw error(_("Invalid log file descriptor"));
+          schroot::log_add_sink
+            (std::make_shared<schroot::log_json_sink>(this->log_json_fd));
+        }
+
+      if (vm.count("log-journal"))
+        schroot::log_add_sink(std::make_shared<schroot::log_journal_sink>());
+
+      if (vm.count("trace"))
+        schroot::trace::open(this->trace_file);
+      else
+        {
+          try
+            {
+              schroot::trace::open_environment();
+            }
+          catch (const std::runtime_error& e)
+            {
+              schroot::log_exception_warning(e);
+            }
+        }
     }
 
     void
@@ -142,6 +142,10 @@ namespace bin
     private:
       /// Debug level string.
       std::string debug_level;
+      /// File descriptor for JSON log messages.
+      int         log_json_fd;
+      /// File to write trace events to.
+      std::string trace_file;
     };
 
   }
@@ -22,6 +22,7 @@
 #include <bin-common/options.h>
 
 #include <schroot/config.h>
+#include <schroot/i18n.h>
 #include <schroot/log.h>
 
 #include <cstdlib>
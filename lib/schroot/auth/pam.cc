@@ -21,6 +21,7 @@
 #include <schroot/auth/pam.h>
 #include <schroot/auth/pam-conv.h>
 #include <schroot/feature.h>
+#include <schroot/trace.h>
 
 #include <cassert>
 #include <cerrno>
@@ -201,6 +202,7 @@ namespace schroot
           reinterpret_cast<void *>(this->conv.get())
         };
 
+      trace::span span("pam_start");
       int pam_status;
 
       if ((pam_status =
@@ -219,6 +221,7 @@ namespace schroot
     {
       if (this->pamh) // PAM must be initialised
         {
+          trace::span span("pam_end");
           int pam_status;
 
           if ((pam_status =
@@ -239,6 +242,7 @@ namespace schroot
       assert(!this->user.empty());
       assert(this->pamh != 0); // PAM must be initialised
 
+      trace::span span("pam_authenticate");
       int pam_status;
 
       if ((pam_status =
@@ -362,6 +366,7 @@ namespace schroot
     {
       assert(this->pamh != 0); // PAM must be initialised
 
+      trace::span span("pam_acct_mgmt");
       int pam_status;
 
       if ((pam_status =
@@ -381,6 +386,7 @@ namespace schroot
     {
       assert(this->pamh != 0); // PAM must be initialised
 
+      trace::span span("pam_setcred", "establish");
       int pam_status;
 
       if ((pam_status =
@@ -405,6 +411,7 @@ namespace schroot
     {
       assert(this->pamh != 0); // PAM must be initialised
 
+      trace::span span("pam_setcred", "delete");
       int pam_status;
 
       if ((pam_status =
@@ -422,6 +429,7 @@ namespace schroot
     {
       assert(this->pamh != 0); // PAM must be initialised
 
+      trace::span span("pam_open_session");
       int pam_status;
 
       if ((pam_status =
@@ -439,6 +447,7 @@ namespace schroot
     {
       assert(this->pamh != 0); // PAM must be initialised
 
+      trace::span span("pam_close_session");
       int pam_status;
 
       if ((pam_status =
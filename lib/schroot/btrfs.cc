@@ -0,0 +1,157 @@
+/* Copyright © 2005-2013  Roger Leigh <rleigh@codelibre.net>
+ *
+ * schroot is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * schroot is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ *********************************************************************/
+
+#include <config.h>
+
+#include <schroot/btrfs.h>
+#include <schroot/util.h>
+
+#include <cerrno>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+#include <linux/btrfs.h>
+
+namespace schroot
+{
+
+  template<>
+  error<btrfs::error_code>::map_type
+  error<btrfs::error_code>::error_strings =
+    {
+      // TRANSLATORS: %1% = subvolume name
+      {btrfs::NAME_INVALID,      N_("Invalid subvolume name ‘%1%’")},
+      {btrfs::SUBVOLUME_OPEN,    N_("Failed to open subvolume")},
+      {btrfs::DIRECTORY_OPEN,    N_("Failed to open snapshot directory")},
+      {btrfs::SNAPSHOT_CREATE,   N_("Failed to create snapshot")},
+      {btrfs::SUBVOLUME_DESTROY, N_("Failed to delete subvolume")}
+    };
+
+  namespace
+  {
+
+    /**
+     * Split a subvolume path into its parent directory and name, and
+     * open the parent directory.
+     *
+     * @param path the subvolume path.
+     * @param name the subvolume name (returned).
+     * @returns an open file descriptor for the parent directory, or
+     * -1 on failure, with errno set.
+     */
+    int
+    open_parent (const std::string& path,
+                 std::string&       name)
+    {
+      name = basename(path);
+      if (name.empty() || name == "." || name == ".." ||
+          name.size() > BTRFS_SUBVOL_NAME_MAX)
+        throw btrfs::error(name, btrfs::NAME_INVALID);
+
+      return open(dirname(path).c_str(), O_RDONLY|O_DIRECTORY|O_CLOEXEC);
+    }
+
+  }
+
+  void
+  btrfs::create_snapshot (const std::string& source,
+                          const std::string& snapshot,
+                          bool               readonly)
+  {
+    int srcfd = open(source.c_str(), O_RDONLY|O_DIRECTORY|O_CLOEXEC);
+    if (srcfd < 0)
+      throw error(source, SUBVOLUME_OPEN, strerror(errno));
+
+    std::string name;
+    int dirfd;
+    try
+      {
+        dirfd = open_parent(snapshot, name);
+      }
+    catch (const error& e)
+      {
+        close(srcfd);
+        throw;
+      }
+    if (dirfd < 0)
+      {
+        int saved_errno = errno;
+        close(srcfd);
+        throw error(dirname(snapshot), DIRECTORY_OPEN, strerror(saved_errno));
+      }
+
+    struct btrfs_ioctl_vol_args_v2 args;
+    std::memset(&args, 0, sizeof(args));
+    args.fd = srcfd;
+    if (readonly)
+      args.flags |= BTRFS_SUBVOL_RDONLY;
+    std::strncpy(args.name, name.c_str(), BTRFS_SUBVOL_NAME_MAX);
+
+    int status = ioctl(dirfd, BTRFS_IOC_SNAP_CREATE_V2, &args);
+    int saved_errno = errno;
+
+    close(dirfd);
+    close(srcfd);
+
+    if (status < 0)
+      throw error(snapshot, SNAPSHOT_CREATE, strerror(saved_errno));
+  }
+
+  bool
+  btrfs::destroy_subvolume (const std::string& subvolume)
+  {
+    std::string name;
+    int dirfd = open_parent(subvolume, name);
+    if (dirfd < 0)
+      {
+        if (errno == ENOENT)
+          return false;
+        throw error(dirname(subvolume), DIRECTORY_OPEN, strerror(errno));
+      }
+
+    struct btrfs_ioctl_vol_args_v2 args;
+    std::memset(&args, 0, sizeof(args));
+    std::strncpy(args.name, name.c_str(), BTRFS_SUBVOL_NAME_MAX);
+
+    int status = ioctl(dirfd, BTRFS_IOC_SNAP_DESTROY_V2, &args);
+    if (status < 0 && (errno == ENOTTY || errno == EOPNOTSUPP))
+      {
+        // Kernels older than 5.7 only support the original ioctl.
+        struct btrfs_ioctl_vol_args oldargs;
+        std::memset(&oldargs, 0, sizeof(oldargs));
+        std::strncpy(oldargs.name, name.c_str(), BTRFS_PATH_NAME_MAX);
+        status = ioctl(dirfd, BTRFS_IOC_SNAP_DESTROY, &oldargs);
+      }
+    int saved_errno = errno;
+
+    close(dirfd);
+
+    if (status < 0)
+      {
+        if (saved_errno == ENOENT)
+          return false;
+        throw error(subvolume, SUBVOLUME_DESTROY, strerror(saved_errno));
+      }
+
+    return true;
+  }
+
+}
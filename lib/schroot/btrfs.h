@@ -0,0 +1,90 @@
+/* Copyright © 2005-2013  Roger Leigh <rleigh@codelibre.net>
+ *
+ * schroot is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * schroot is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ *********************************************************************/
+
+#ifndef SCHROOT_BTRFS_H
+#define SCHROOT_BTRFS_H
+
+#include <schroot/custom-error.h>
+
+#include <string>
+
+namespace schroot
+{
+
+  /**
+   * Btrfs subvolume operations.  These use the Btrfs ioctl interface
+   * directly, rather than running btrfs(8), so that creating and
+   * deleting a snapshot does not require forking and executing an
+   * external program.  This is a Linux only feature.
+   */
+  class btrfs
+  {
+  public:
+    /// Error codes.
+    enum error_code
+      {
+        NAME_INVALID,      ///< Invalid subvolume name.
+        SUBVOLUME_OPEN,    ///< Failed to open subvolume.
+        DIRECTORY_OPEN,    ///< Failed to open parent directory.
+        SNAPSHOT_CREATE,   ///< Failed to create snapshot.
+        SUBVOLUME_DESTROY  ///< Failed to delete subvolume.
+      };
+
+    /// Exception type.
+    typedef custom_error<error_code> error;
+
+    /**
+     * Create a snapshot of a subvolume.  The snapshot is created
+     * using BTRFS_IOC_SNAP_CREATE_V2.
+     *
+     * @param source the absolute path of the subvolume to snapshot.
+     * @param snapshot the absolute path of the snapshot to create.
+     * The parent directory must exist, and be on the same
+     * filesystem as the source subvolume.
+     * @param readonly true to create a read-only snapshot, or false
+     * for a writable snapshot.
+     */
+    static void
+    create_snapshot (const std::string& source,
+                     const std::string& snapshot,
+                     bool               readonly = false);
+
+    /**
+     * Delete a subvolume.  The subvolume is deleted using
+     * BTRFS_IOC_SNAP_DESTROY_V2, falling back to
+     * BTRFS_IOC_SNAP_DESTROY for kernels which do not support it.
+     * The kernel detaches the subvolume immediately; the space it
+     * used is released later by the Btrfs cleaner.
+     *
+     * @param subvolume the absolute path of the subvolume to delete.
+     * @returns true if the subvolume was deleted, or false if it did
+     * not exist.
+     */
+    static bool
+    destroy_subvolume (const std::string& subvolume);
+  };
+
+}
+
+#endif /* SCHROOT_BTRFS_H */
+
+/*
+ * Local Variables:
+ * mode:C++
+ * End:
+ */
@@ -22,6 +22,7 @@
 #include <schroot/chroot/config.h>
 #include <schroot/chroot/facet/facet.h>
 #include <schroot/chroot/facet/factory.h>
+#include <schroot/chroot/facet/lock-setup.h>
 #ifdef SCHROOT_FEATURE_PERSONALITY
 #include <schroot/chroot/facet/personality.h>
 #endif // SCHROOT_FEATURE_PERSONALITY
@@ -75,6 +76,7 @@ namespace schroot
       {chroot::chroot::NAME_INVALID,      N_("Invalid name")},
       {chroot::chroot::SCRIPT_CONFIG_CV,  N_("Could not set profile name from script configuration path ‘%1%’")},
 
+      {chroot::chroot::SESSION_RENAME,    N_("Failed to rename session")},
       // TRANSLATORS: unlink refers to the C function which removes a file
       {chroot::chroot::SESSION_UNLINK,    N_("Failed to unlink session file")},
       {chroot::chroot::SESSION_WRITE,     N_("Failed to write session file")},
@@ -84,6 +86,30 @@ namespace schroot
   namespace chroot
   {
 
+    namespace
+    {
+
+      /**
+       * Get the untranslated title for the details of a chroot.
+       *
+       * @param chroot the chroot.
+       * @returns the title.
+       */
+      std::string
+      details_title (const chroot& chroot)
+      {
+        std::string title(N_("Chroot"));
+
+        if (chroot.get_facet<facet::session>())
+          title = N_("Session");
+        if (chroot.get_facet<facet::source>())
+          title = N_("Source");
+
+        return title;
+      }
+
+    }
+
     chroot::chroot ():
       std::enable_shared_from_this<chroot>(),
       name(),
@@ -584,6 +610,32 @@ namespace schroot
                        bool       lock,
                        int        status)
     {
+      // Other facets are locked before the storage, and unlocked in
+      // reverse order.  The storage is always unlocked last, since
+      // this removes the information for a stopped session.
+      if (lock)
+        {
+          for (const auto& current : facets)
+            {
+              facet::lock_setup::ptr plock
+                (std::dynamic_pointer_cast<facet::lock_setup>(current));
+              if (plock)
+                plock->setup_lock(type, lock, status);
+            }
+        }
+      else
+        {
+          for (auto current = facets.rbegin();
+               current != facets.rend();
+               ++current)
+            {
+              facet::lock_setup::ptr plock
+                (std::dynamic_pointer_cast<facet::lock_setup>(*current));
+              if (plock)
+                plock->setup_lock(type, lock, status);
+            }
+        }
+
       get_facet_strict<facet::storage>()->setup_lock(type, lock, status);
     }
 
@@ -601,38 +653,38 @@ namespace schroot
     void
     chroot::get_details (format_detail& detail) const
     {
-      detail.add(_("Name"), get_name());
+      detail.add(N_("Name"), get_name());
 
       detail
-        .add(_("Description"), get_description())
-        .add(_("Type"), get_chroot_type())
-        .add(_("Message Verbosity"), get_verbosity_string())
-        .add(_("Users"), get_users())
-        .add(_("Groups"), get_groups())
-        .add(_("Root Users"), get_root_users())
-        .add(_("Root Groups"), get_root_groups())
-        .add(_("Aliases"), get_aliases())
-        .add(_("Preserve Environment"), get_preserve_environment())
-        .add(_("Default Shell"), get_default_shell())
-        .add(_("Environment Filter"), get_environment_filter())
-        .add(_("Run Setup Scripts"), get_run_setup_scripts())
-        .add(_("Configuration Profile"), get_profile())
-        .add(_("Script Configuration"), get_script_config())
-        .add(_("Session Managed"),
+        .add(N_("Description"), get_description())
+        .add(N_("Type"), get_chroot_type())
+        .add(N_("Message Verbosity"), get_verbosity_string())
+        .add(N_("Users"), get_users())
+        .add(N_("Groups"), get_groups())
+        .add(N_("Root Users"), get_root_users())
+        .add(N_("Root Groups"), get_root_groups())
+        .add(N_("Aliases"), get_aliases())
+        .add(N_("Preserve Environment"), get_preserve_environment())
+        .add(N_("Default Shell"), get_default_shell())
+        .add(N_("Environment Filter"), get_environment_filter())
+        .add(N_("Run Setup Scripts"), get_run_setup_scripts())
+        .add(N_("Configuration Profile"), get_profile())
+        .add(N_("Script Configuration"), get_script_config())
+        .add(N_("Session Managed"),
              static_cast<bool>(get_session_flags() & facet::facet::SESSION_CREATE))
-        .add(_("Session Cloned"),
+        .add(N_("Session Cloned"),
              static_cast<bool>(get_session_flags() & facet::facet::SESSION_CLONE))
-        .add(_("Session Purged"),
+        .add(N_("Session Purged"),
              static_cast<bool>(get_session_flags() & facet::facet::SESSION_PURGE));
 
       if (!get_command_prefix().empty())
-        detail.add(_("Command Prefix"), get_command_prefix());
+        detail.add(N_("Command Prefix"), get_command_prefix());
 
       /* Non user-settable properties are listed last. */
       if (!get_mount_location().empty())
-        detail.add(_("Mount Location"), get_mount_location());
+        detail.add(N_("Mount Location"), get_mount_location());
       if (!get_path().empty())
-        detail.add(_("Path"), get_path());
+        detail.add(N_("Path"), get_path());
 
       for (const auto& facet : facets)
         facet->get_details(detail);
@@ -641,18 +693,21 @@ namespace schroot
     void
     chroot::print_details (std::ostream& stream) const
     {
-      std::string title(_("Chroot"));
+      format_detail fmt(details_title(*this), stream.getloc());
+
+      get_details(fmt);
 
-      if (get_facet<facet::session>())
-        title = _("Session");
-      if (get_facet<facet::source>())
-        title = _("Source");
+      stream << fmt;
+    }
 
-      format_detail fmt(title, stream.getloc());
+    void
+    chroot::print_details_json (std::ostream& stream) const
+    {
+      format_detail fmt(details_title(*this), std::locale::classic());
 
       get_details(fmt);
 
-      stream << fmt;
+      fmt.print_json(stream);
     }
 
     string_list
@@ -91,6 +91,7 @@ namespace schroot
           LOCATION_ABS,     ///< Location must have an absolute path.
           NAME_INVALID,     ///< Invalid name.
           SCRIPT_CONFIG_CV, ///< Could not set profile from script configuration path.
+          SESSION_RENAME,   ///< Failed to rename session.
           SESSION_UNLINK,   ///< Failed to unlink session file.
           SESSION_WRITE,    ///< Failed to write session file.
           VERBOSITY_INVALID ///< Message verbosity is invalid.
@@ -753,6 +754,15 @@ namespace schroot
       void
       print_details (std::ostream& stream) const;
 
+      /**
+       * Print detailed information about the chroot to a stream as a
+       * single-line JSON object, using stable keys.
+       *
+       * @param stream the stream to output to.
+       */
+      void
+      print_details_json (std::ostream& stream) const;
+
       /**
        * Copy the chroot properties into a keyfile.  The keyfile group
        * with the name of the chroot will be set; if it already exists,
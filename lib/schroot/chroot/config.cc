@@ -26,6 +26,7 @@
 #include <schroot/fdstream.h>
 #include <schroot/keyfile-reader.h>
 #include <schroot/lock.h>
+#include <schroot/trace.h>
 
 #include <cassert>
 #include <cerrno>
@@ -527,6 +528,7 @@ namespace schroot
                        const std::string& file)
     {
       log_debug(DEBUG_NOTICE) << "Loading data file: " << file << endl;
+      trace::span span("load_config_file", file);
 
       // stat filename (in case it's a pipe and open(2) blocks)
       stat file_status1(file);
@@ -563,7 +565,7 @@ namespace schroot
 
       try
         {
-          file_lock lock(fd);
+          ofd_lock lock(fd);
           lock.set_lock(lock::LOCK_SHARED, 2);
           parse_data(chroot_namespace, input);
           lock.unset_lock();
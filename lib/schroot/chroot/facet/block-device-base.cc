@@ -103,7 +103,7 @@ namespace schroot
       block_device_base::get_details (format_detail& detail) const
       {
         if (!this->device.empty())
-          detail.add(_("Device"), get_device());
+          detail.add(N_("Device"), get_device());
       }
 
       void
@@ -22,13 +22,15 @@
 #include <schroot/chroot/facet/directory.h>
 #include <schroot/chroot/facet/factory.h>
 #include <schroot/chroot/facet/mountable.h>
-#include <schroot/chroot/facet/session-clonable.h>
 #include <schroot/chroot/facet/session.h>
-#include <schroot/chroot/facet/source-clonable.h>
+#include <schroot/btrfs.h>
 #include <schroot/format-detail.h>
+#include <schroot/log.h>
 
 #include <cassert>
 #include <cerrno>
+#include <cstdio>
+#include <cstring>
 
 #include <boost/format.hpp>
 
@@ -58,8 +60,7 @@ namespace schroot
       }
 
       btrfs_snapshot::btrfs_snapshot ():
-        facet(),
-        storage(),
+        snapshot_base(),
         source_subvolume(),
         snapshot_directory(),
         snapshot_name()
@@ -67,10 +68,7 @@ namespace schroot
       }
 
       btrfs_snapshot::btrfs_snapshot (const btrfs_snapshot& rhs):
-        facet(rhs),
-        storage(rhs),
-        session_setup(rhs),
-        source_setup(rhs),
+        snapshot_base(rhs),
         source_subvolume(rhs.source_subvolume),
         snapshot_directory(rhs.snapshot_directory),
         snapshot_name(rhs.snapshot_name)
@@ -81,19 +79,6 @@ namespace schroot
       {
       }
 
-      void
-      btrfs_snapshot::set_chroot (chroot& chroot,
-                                  bool    copy)
-      {
-        facet::set_chroot(chroot, copy);
-
-        if (!copy && !owner->get_facet<session_clonable>())
-          owner->add_facet(session_clonable::create());
-
-        if (!copy && !owner->get_facet<source_clonable>())
-          owner->add_facet(source_clonable::create());
-      }
-
       std::string const&
       btrfs_snapshot::get_name () const
       {
@@ -157,12 +142,6 @@ namespace schroot
         this->snapshot_name = snapshot_name;
       }
 
-      std::string
-      btrfs_snapshot::get_path () const
-      {
-        return owner->get_mount_location();
-      }
-
       void
       btrfs_snapshot::setup_env (environment& env) const
       {
@@ -171,40 +150,59 @@ namespace schroot
         env.add("CHROOT_BTRFS_SNAPSHOT_NAME", get_snapshot_name());
       }
 
+      std::string const&
+      btrfs_snapshot::get_snapshot_path () const
+      {
+        return get_snapshot_name();
+      }
+
+      reclaim::item_type
+      btrfs_snapshot::get_reclaim_type () const
+      {
+        return reclaim::BTRFS_SUBVOLUME;
+      }
+
       void
-      btrfs_snapshot::setup_lock (chroot::setup_type type,
-                                  bool               lock,
-                                  int                status)
+      btrfs_snapshot::create_snapshot ()
       {
-        /* Create or unlink session information. */
-        if ((type == chroot::SETUP_START && lock == true) ||
-            (type == chroot::SETUP_STOP && lock == false && status == 0))
+        log_debug(DEBUG_INFO)
+          << format("Creating snapshot %1% from subvolume %2%")
+          % get_snapshot_name() % get_source_subvolume() << endl;
+
+        try
           {
-            bool start = (type == chroot::SETUP_START);
-            owner->get_facet_strict<session>()->setup_session_info(start);
+            btrfs::create_snapshot(get_source_subvolume(),
+                                   get_snapshot_name());
+          }
+        catch (const btrfs::error& e)
+          {
+            throw error(owner->get_name(), e);
           }
       }
 
-      facet::session_flags
-      btrfs_snapshot::get_session_flags () const
+      bool
+      btrfs_snapshot::destroy_snapshot ()
       {
-        session_flags flags = SESSION_NOFLAGS;
-
-        if (owner->get_facet<session>())
-          flags = flags | SESSION_PURGE;
-
-        return flags;
+        try
+          {
+            return btrfs::destroy_subvolume(get_snapshot_name());
+          }
+        catch (const btrfs::error& e)
+          {
+            throw error(owner->get_name(), e);
+          }
       }
 
       void
       btrfs_snapshot::get_details (format_detail& detail) const
       {
         if (!this->get_source_subvolume().empty())
-          detail.add(_("Btrfs Source Subvolume"), get_source_subvolume());
+          detail.add(N_("Btrfs Source Subvolume"), get_source_subvolume());
         if (!this->get_snapshot_directory().empty())
-          detail.add(_("Btrfs Snapshot Directory"), get_snapshot_directory());
+          detail.add(N_("Btrfs Snapshot Directory"), get_snapshot_directory());
         if (!this->get_snapshot_name().empty())
-          detail.add(_("Btrfs Snapshot Name"), get_snapshot_name());
+          detail.add(N_("Btrfs Snapshot Name"), get_snapshot_name());
+        detail.add(N_("Btrfs Asynchronous Reclaim"), get_async_reclaim());
       }
 
       void
@@ -213,6 +211,7 @@ namespace schroot
         used_keys.push_back("btrfs-source-subvolume");
         used_keys.push_back("btrfs-snapshot-directory");
         used_keys.push_back("btrfs-snapshot-name");
+        used_keys.push_back("btrfs-async-reclaim");
       }
 
       void
@@ -237,6 +236,11 @@ namespace schroot
                                     &btrfs_snapshot::get_snapshot_name,
                                     keyfile, owner->get_name(),
                                     "btrfs-snapshot-name");
+
+        keyfile::set_object_value(static_cast<const snapshot_base&>(*this),
+                                  &snapshot_base::get_async_reclaim,
+                                  keyfile, owner->get_name(),
+                                  "btrfs-async-reclaim");
       }
 
       void
@@ -263,6 +267,11 @@ namespace schroot
                                   issession ?
                                   keyfile::PRIORITY_REQUIRED :
                                   keyfile::PRIORITY_DISALLOWED);
+
+        keyfile::get_object_value(static_cast<snapshot_base&>(*this),
+                                  &snapshot_base::set_async_reclaim,
+                                  keyfile, owner->get_name(), "btrfs-async-reclaim",
+                                  keyfile::PRIORITY_OPTIONAL);
       }
 
       void
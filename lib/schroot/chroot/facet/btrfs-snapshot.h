@@ -20,10 +20,7 @@
 #define SCHROOT_CHROOT_FACET_BTRFS_SNAPSHOT_H
 
 #include <schroot/chroot/chroot.h>
-#include <schroot/chroot/facet/facet.h>
-#include <schroot/chroot/facet/storage.h>
-#include <schroot/chroot/facet/session-setup.h>
-#include <schroot/chroot/facet/source-setup.h>
+#include <schroot/chroot/facet/snapshot-base.h>
 
 namespace schroot
 {
@@ -36,11 +33,10 @@ namespace schroot
        * A chroot stored on a Btrfs subvolume.
        *
        * A snapshot subvolume will be created and mounted on demand.
+       * Snapshots are created when a session is started, and deleted
+       * when the session is ended, using the Btrfs ioctl interface.
        */
-      class btrfs_snapshot : public facet,
-                             public storage,
-                             public session_setup,
-                             public source_setup
+      class btrfs_snapshot : public snapshot_base
       {
       public:
         /// Exception type.
@@ -59,10 +55,6 @@ namespace schroot
         /// The copy constructor.
         btrfs_snapshot (const btrfs_snapshot& rhs);
 
-        void
-        set_chroot (chroot& chroot,
-                    bool    copy);
-
         friend class chroot;
 
       public:
@@ -84,8 +76,8 @@ namespace schroot
         clone () const;
 
         /**
-         * Get the source subvolume path.  This is used by "btrfs
-         * subvolume snapshot".
+         * Get the source subvolume path.  This is the subvolume from
+         * which session snapshots are created.
          *
          * @returns the source subvolume.
          */
@@ -93,8 +85,8 @@ namespace schroot
         get_source_subvolume () const;
 
         /**
-         * Set the source subvolume path.  This is used by "btrfs
-         * subvolume snapshot".
+         * Set the source subvolume path.  This is the subvolume from
+         * which session snapshots are created.
          *
          * @param source_subvolume the source subvolume.
          */
@@ -118,8 +110,8 @@ namespace schroot
         set_snapshot_directory (const std::string& snapshot_directory);
 
         /**
-         * Get the snapshot name.  This is used by "btrfs subvolume
-         * snapshot", and is the full path to the snapshot.
+         * Get the snapshot name.  This is the full path to the
+         * snapshot.
          *
          * @returns the name.
          */
@@ -127,29 +119,18 @@ namespace schroot
         get_snapshot_name () const;
 
         /**
-         * Set the snapshot name.  This is used by "btrfs subvolume
-         * snapshot", and is the full path to the snapshot.
+         * Set the snapshot name.  This is the full path to the
+         * snapshot.
          *
          * @param snapshot_name the snapshot name.
          */
         void
         set_snapshot_name (const std::string& snapshot_name);
 
-        virtual std::string
-        get_path () const;
-
         virtual void
         setup_env (environment& env) const;
 
-        virtual session_flags
-        get_session_flags () const;
-
       protected:
-        virtual void
-        setup_lock (chroot::setup_type type,
-                    bool               lock,
-                    int                status);
-
         virtual void
         get_details (format_detail& detail) const;
 
@@ -172,6 +153,18 @@ namespace schroot
         virtual void
         chroot_source_setup (const chroot& parent);
 
+        virtual std::string const&
+        get_snapshot_path () const;
+
+        virtual reclaim::item_type
+        get_reclaim_type () const;
+
+        virtual void
+        create_snapshot ();
+
+        virtual bool
+        destroy_snapshot ();
+
       private:
         /// Btrfs source subvolume
         std::string source_subvolume;
@@ -0,0 +1,715 @@
+/* Copyright © 2005-2013  Roger Leigh <rleigh@codelibre.net>
+ *
+ * schroot is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * schroot is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ *********************************************************************/
+
+#include <config.h>
+
+#include <schroot/chroot/chroot.h>
+#include <schroot/chroot/facet/cgroup.h>
+#include <schroot/chroot/facet/factory.h>
+#include <schroot/chroot/facet/session.h>
+#include <schroot/feature.h>
+#include <schroot/format-detail.h>
+#include <schroot/log.h>
+#include <schroot/util.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstring>
+
+#include <fcntl.h>
+#include <linux/magic.h>
+#include <poll.h>
+#include <sys/stat.h>
+#include <sys/vfs.h>
+#include <unistd.h>
+
+#include <boost/format.hpp>
+
+using std::endl;
+using boost::format;
+
+namespace schroot
+{
+  namespace chroot
+  {
+    namespace facet
+    {
+
+      namespace
+      {
+
+        feature feature_cgroup
+        ("CGROUP",
+         N_("Linux cgroup v2 resource control"));
+
+        const factory::facet_info cgroup_info =
+          {
+            "cgroup",
+            N_("Linux cgroup v2 resource control"),
+            true,
+            []() -> facet::ptr { return cgroup::create(); }
+          };
+
+        factory cgroup_register(cgroup_info);
+
+        /// The root of the cgroup v2 hierarchy.
+        const std::string cgroup_root("/sys/fs/cgroup");
+
+        /// Time to wait for killed processes to exit (milliseconds).
+        const int kill_timeout = 10000;
+
+        /**
+         * Read the contents of a cgroup interface file.
+         *
+         * @param file the file to read.
+         * @param contents the file contents.
+         * @returns true on success, or false on failure, with errno
+         * set.
+         */
+        bool
+        read_file (const std::string& file,
+                   std::string&       contents)
+        {
+          int fd = open(file.c_str(), O_RDONLY|O_CLOEXEC);
+          if (fd < 0)
+            return false;
+
+          contents.clear();
+          char buf[4096];
+          ssize_t len;
+          while ((len = read(fd, buf, sizeof(buf))) > 0)
+            contents.append(buf, len);
+          int saved_errno = errno;
+          close(fd);
+          errno = saved_errno;
+          return len == 0;
+        }
+
+        /**
+         * Write to a cgroup interface file.  Each write is a single
+         * operation on the file.
+         *
+         * @param file the file to write.
+         * @param value the value to write.
+         * @returns true on success, or false on failure, with errno
+         * set.
+         */
+        bool
+        write_file (const std::string& file,
+                    const std::string& value)
+        {
+          int fd = open(file.c_str(), O_WRONLY|O_CLOEXEC);
+          if (fd < 0)
+            return false;
+
+          ssize_t len = write(fd, value.c_str(), value.size());
+          int saved_errno = errno;
+          close(fd);
+          errno = saved_errno;
+          return len == static_cast<ssize_t>(value.size());
+        }
+
+        /**
+         * Enable controllers for the children of a cgroup.
+         *
+         * @param dir the cgroup directory.
+         * @param controllers the controllers to enable.
+         */
+        void
+        enable_controllers (const std::string& dir,
+                            const string_list& controllers)
+        {
+          std::string available;
+          std::string enabled;
+          if (!read_file(dir + "/cgroup.controllers", available) ||
+              !read_file(dir + "/cgroup.subtree_control", enabled))
+            throw cgroup::error(dir, cgroup::CGROUP_CREATE, strerror(errno));
+
+          string_list available_list = split_string(available, " \n");
+          string_list enabled_list = split_string(enabled, " \n");
+
+          for (const auto& controller : controllers)
+            {
+              if (std::find(enabled_list.begin(), enabled_list.end(),
+                            controller) != enabled_list.end())
+                continue;
+
+              if (std::find(available_list.begin(), available_list.end(),
+                            controller) == available_list.end())
+                throw cgroup::error(controller, cgroup::CGROUP_CONTROLLER);
+
+              if (!write_file(dir + "/cgroup.subtree_control",
+                              "+" + controller))
+                throw cgroup::error(dir, cgroup::CGROUP_CONTROLLER,
+                                    strerror(errno));
+            }
+        }
+
+      }
+
+      template<>
+      error<cgroup::error_code>::map_type
+      error<cgroup::error_code>::error_strings =
+        {
+          // TRANSLATORS: %1% = directory
+          {schroot::chroot::facet::cgroup::CGROUP_FS,
+           N_("%1%: Not a cgroup v2 filesystem")},
+          // TRANSLATORS: %1% = cgroup name
+          {schroot::chroot::facet::cgroup::CGROUP_PARENT,
+           N_("Invalid parent cgroup ‘%1%’")},
+          // TRANSLATORS: %1% = directory
+          {schroot::chroot::facet::cgroup::CGROUP_PATH,
+           N_("Invalid session cgroup ‘%1%’")},
+          // TRANSLATORS: %1% = controller name, e.g. "memory"
+          {schroot::chroot::facet::cgroup::CGROUP_CONTROLLER,
+           N_("cgroup controller ‘%1%’ is not available")},
+          // TRANSLATORS: %1% = directory
+          {schroot::chroot::facet::cgroup::CGROUP_CREATE,
+           N_("%1%: Failed to create cgroup")},
+          // TRANSLATORS: %1% = file
+          {schroot::chroot::facet::cgroup::CGROUP_LIMIT,
+           N_("%1%: Failed to set cgroup resource limit")},
+          // TRANSLATORS: %1% = directory
+          {schroot::chroot::facet::cgroup::CGROUP_ATTACH,
+           N_("%1%: Failed to add process to cgroup")},
+          // TRANSLATORS: %1% = directory
+          {schroot::chroot::facet::cgroup::CGROUP_KILL,
+           N_("%1%: Failed to kill processes in cgroup")},
+          // TRANSLATORS: %1% = directory
+          {schroot::chroot::facet::cgroup::CGROUP_KILL_TIMEOUT,
+           N_("%1%: Timed out waiting for processes in cgroup to exit")},
+          // TRANSLATORS: %1% = directory
+          {schroot::chroot::facet::cgroup::CGROUP_REMOVE,
+           N_("%1%: Failed to remove cgroup")}
+        };
+
+      cgroup::cgroup ():
+        facet(),
+        cgroup_enable(false),
+        cgroup_parent("schroot"),
+        cgroup_path(),
+        cgroup_cpu_max(),
+        cgroup_cpu_weight(),
+        cgroup_memory_max(),
+        cgroup_memory_high(),
+        cgroup_io_max(),
+        cgroup_pids_max()
+      {
+      }
+
+      cgroup::~cgroup ()
+      {
+      }
+
+      cgroup::ptr
+      cgroup::create ()
+      {
+        return ptr(new cgroup());
+      }
+
+      facet::ptr
+      cgroup::clone () const
+      {
+        return ptr(new cgroup(*this));
+      }
+
+      std::string const&
+      cgroup::get_name () const
+      {
+        return cgroup_info.name;
+      }
+
+      bool
+      cgroup::get_cgroup_enable () const
+      {
+        return this->cgroup_enable;
+      }
+
+      void
+      cgroup::set_cgroup_enable (bool enable)
+      {
+        this->cgroup_enable = enable;
+      }
+
+      std::string const&
+      cgroup::get_cgroup_parent () const
+      {
+        return this->cgroup_parent;
+      }
+
+      void
+      cgroup::set_cgroup_parent (const std::string& parent)
+      {
+        string_list components = split_string(parent, "/");
+        if (components.empty())
+          throw error(parent, CGROUP_PARENT);
+        for (const auto& component : components)
+          if (component == "." || component == "..")
+            throw error(parent, CGROUP_PARENT);
+
+        this->cgroup_parent = string_list_to_string(components, "/");
+      }
+
+      std::string const&
+      cgroup::get_cgroup_cpu_max () const
+      {
+        return this->cgroup_cpu_max;
+      }
+
+      void
+      cgroup::set_cgroup_cpu_max (const std::string& limit)
+      {
+        this->cgroup_cpu_max = limit;
+      }
+
+      std::string const&
+      cgroup::get_cgroup_cpu_weight () const
+      {
+        return this->cgroup_cpu_weight;
+      }
+
+      void
+      cgroup::set_cgroup_cpu_weight (const std::string& weight)
+      {
+        this->cgroup_cpu_weight = weight;
+      }
+
+      std::string const&
+      cgroup::get_cgroup_memory_max () const
+      {
+        return this->cgroup_memory_max;
+      }
+
+      void
+      cgroup::set_cgroup_memory_max (const std::string& limit)
+      {
+        this->cgroup_memory_max = limit;
+      }
+
+      std::string const&
+      cgroup::get_cgroup_memory_high () const
+      {
+        return this->cgroup_memory_high;
+      }
+
+      void
+      cgroup::set_cgroup_memory_high (const std::string& limit)
+      {
+        this->cgroup_memory_high = limit;
+      }
+
+      string_list const&
+      cgroup::get_cgroup_io_max () const
+      {
+        return this->cgroup_io_max;
+      }
+
+      void
+      cgroup::set_cgroup_io_max (const string_list& limits)
+      {
+        this->cgroup_io_max = limits;
+      }
+
+      std::string const&
+      cgroup::get_cgroup_pids_max () const
+      {
+        return this->cgroup_pids_max;
+      }
+
+      void
+      cgroup::set_cgroup_pids_max (const std::string& limit)
+      {
+        this->cgroup_pids_max = limit;
+      }
+
+      std::string
+      cgroup::get_cgroup_path () const
+      {
+        // Only sessions have a cgroup.
+        if (!this->cgroup_enable || !owner->get_facet<session>())
+          return std::string();
+
+        // Sessions created without a saved path.
+        if (this->cgroup_path.empty())
+          return cgroup_root + '/' + this->cgroup_parent + '/' +
+            owner->get_name();
+
+        return this->cgroup_path;
+      }
+
+      void
+      cgroup::set_cgroup_path (const std::string& path)
+      {
+        if (path.compare(0, cgroup_root.size() + 1, cgroup_root + '/') != 0)
+          throw error(path, CGROUP_PATH);
+
+        string_list components =
+          split_string(path.substr(cgroup_root.size()), "/");
+        if (components.empty())
+          throw error(path, CGROUP_PATH);
+        for (const auto& component : components)
+          if (component == "." || component == "..")
+            throw error(path, CGROUP_PATH);
+
+        this->cgroup_path = cgroup_root + '/' +
+          string_list_to_string(components, "/");
+      }
+
+      void
+      cgroup::setup_lock (chroot::setup_type type,
+                          bool               lock,
+                          int                status)
+      {
+        if (get_cgroup_path().empty())
+          return;
+
+        try
+          {
+            if (type == chroot::SETUP_START && lock == true)
+              create_cgroup();
+            else if (type == chroot::SETUP_RECOVER && lock == true)
+              {
+                kill_cgroup();
+                create_cgroup();
+              }
+            else if (type == chroot::SETUP_STOP && lock == true)
+              {
+                // Kill before the setup scripts unmount the chroot.
+                if (!kill_cgroup())
+                  log_warning()
+                    << format(_("%1%: cgroup does not exist; processes in the session were not killed"))
+                    % get_cgroup_path() << endl;
+              }
+            else if (type == chroot::SETUP_STOP && lock == false)
+              {
+                try
+                  {
+                    remove_cgroup();
+                  }
+                catch (const error& e)
+                  {
+                    // The session is already gone; only the empty
+                    // cgroup is left behind.
+                    log_exception_warning(e);
+                  }
+              }
+          }
+        catch (const error& e)
+          {
+            throw chroot::error(owner->get_name(), e);
+          }
+      }
+
+      void
+      cgroup::create_cgroup () const
+      {
+        struct statfs fs;
+        if (statfs(cgroup_root.c_str(), &fs) < 0 ||
+            fs.f_type != CGROUP2_SUPER_MAGIC)
+          throw error(cgroup_root, CGROUP_FS);
+
+        string_list controllers;
+        if (!this->cgroup_cpu_max.empty() || !this->cgroup_cpu_weight.empty())
+          controllers.push_back("cpu");
+        if (!this->cgroup_io_max.empty())
+          controllers.push_back("io");
+        if (!this->cgroup_memory_max.empty() ||
+            !this->cgroup_memory_high.empty())
+          controllers.push_back("memory");
+        if (!this->cgroup_pids_max.empty())
+          controllers.push_back("pids");
+
+        /* Controllers must be enabled in every ancestor of the
+           session cgroup.  The parent groups are shared by all
+           sessions, and may already exist. */
+        std::string dir(cgroup_root);
+        for (const auto& component : split_string(this->cgroup_parent, "/"))
+          {
+            enable_controllers(dir, controllers);
+            dir += '/' + component;
+            if (mkdir(dir.c_str(), 0755) < 0 && errno != EEXIST)
+              throw error(dir, CGROUP_CREATE, strerror(errno));
+          }
+        enable_controllers(dir, controllers);
+
+        std::string path(get_cgroup_path());
+        log_debug(DEBUG_INFO) << "Creating cgroup " << path << endl;
+        if (mkdir(path.c_str(), 0755) < 0 && errno != EEXIST)
+          throw error(path, CGROUP_CREATE, strerror(errno));
+
+        std::vector<std::pair<std::string,std::string>> limits =
+          {
+            {"cpu.max", this->cgroup_cpu_max},
+            {"cpu.weight", this->cgroup_cpu_weight},
+            {"memory.high", this->cgroup_memory_high},
+            {"memory.max", this->cgroup_memory_max},
+            {"pids.max", this->cgroup_pids_max}
+          };
+        for (const auto& device : this->cgroup_io_max)
+          limits.push_back(std::make_pair("io.max", device));
+
+        for (const auto& limit : limits)
+          {
+            if (limit.second.empty())
+              continue;
+
+            std::string file(path + '/' + limit.first);
+            log_debug(DEBUG_INFO) << "Setting " << file << " to "
+                                  << limit.second << endl;
+            if (!write_file(file, limit.second))
+              throw error(file, CGROUP_LIMIT, strerror(errno));
+          }
+      }
+
+      bool
+      cgroup::kill_cgroup () const
+      {
+        std::string path(get_cgroup_path());
+
+        int events = open((path + "/cgroup.events").c_str(),
+                          O_RDONLY|O_CLOEXEC);
+        if (events < 0)
+          {
+            if (errno == ENOENT)
+              return false;
+            throw error(path, CGROUP_KILL, strerror(errno));
+          }
+
+        log_debug(DEBUG_INFO) << "Killing processes in cgroup " << path << endl;
+
+        // cgroup.kill is not available before Linux 5.14.
+        bool kill_file = write_file(path + "/cgroup.kill", "1");
+        if (!kill_file && errno != ENOENT)
+          {
+            int saved_errno = errno;
+            close(events);
+            throw error(path, CGROUP_KILL, strerror(saved_errno));
+          }
+
+        /* cgroup.events is modified when the last process exits, so
+           there is no need to scan for processes or poll. */
+        auto deadline = std::chrono::steady_clock::now() +
+          std::chrono::milliseconds(kill_timeout);
+        while (true)
+          {
+            char buf[256];
+            ssize_t len = pread(events, buf, sizeof(buf) - 1, 0);
+            if (len < 0)
+              {
+                int saved_errno = errno;
+                close(events);
+                throw error(path, CGROUP_KILL, strerror(saved_errno));
+              }
+            buf[len] = '\0';
+            if (strstr(buf, "populated 0") != nullptr)
+              break;
+
+            if (!kill_file)
+              {
+                std::string procs;
+                if (read_file(path + "/cgroup.procs", procs))
+                  for (const auto& pid : split_string(procs, "\n"))
+                    ::kill(static_cast<pid_t>(std::stol(pid)), SIGKILL);
+              }
+
+            int remaining = static_cast<int>
+              (std::chrono::duration_cast<std::chrono::milliseconds>
+               (deadline - std::chrono::steady_clock::now()).count());
+            if (remaining <= 0)
+              {
+                close(events);
+                throw error(path, CGROUP_KILL_TIMEOUT);
+              }
+
+            struct pollfd pfd = { events, POLLPRI, 0 };
+            poll(&pfd, 1, kill_file ? remaining : std::min(remaining, 100));
+          }
+
+        close(events);
+        return true;
+      }
+
+      void
+      cgroup::remove_cgroup () const
+      {
+        std::string path(get_cgroup_path());
+
+        log_debug(DEBUG_INFO) << "Removing cgroup " << path << endl;
+        if (rmdir(path.c_str()) < 0 && errno != ENOENT)
+          throw error(path, CGROUP_REMOVE, strerror(errno));
+      }
+
+      void
+      cgroup::attach () const
+      {
+        std::string path(get_cgroup_path());
+        if (path.empty())
+          return;
+
+        // "0" is the writing process.
+        if (!write_file(path + "/cgroup.procs", "0"))
+          throw error(path, CGROUP_ATTACH, strerror(errno));
+      }
+
+      void
+      cgroup::setup_env (environment& env) const
+      {
+        env.add("CHROOT_CGROUP", get_cgroup_path());
+      }
+
+      void
+      cgroup::get_details (format_detail& detail) const
+      {
+        detail.add(N_("cgroup"), get_cgroup_enable());
+        if (get_cgroup_enable())
+          {
+            detail.add(N_("cgroup Parent"), get_cgroup_parent());
+            detail.add(N_("cgroup CPU Maximum"), get_cgroup_cpu_max());
+            detail.add(N_("cgroup CPU Weight"), get_cgroup_cpu_weight());
+            detail.add(N_("cgroup Memory Maximum"), get_cgroup_memory_max());
+            detail.add(N_("cgroup Memory High"), get_cgroup_memory_high());
+            detail.add(N_("cgroup I/O Maximum"), get_cgroup_io_max());
+            detail.add(N_("cgroup Process Maximum"), get_cgroup_pids_max());
+          }
+      }
+
+      void
+      cgroup::get_used_keys (string_list& used_keys) const
+      {
+        used_keys.push_back("cgroup.enable");
+        used_keys.push_back("cgroup.parent");
+        used_keys.push_back("cgroup.path");
+        used_keys.push_back("cgroup.cpu.max");
+        used_keys.push_back("cgroup.cpu.weight");
+        used_keys.push_back("cgroup.memory.max");
+        used_keys.push_back("cgroup.memory.high");
+        used_keys.push_back("cgroup.io.max");
+        used_keys.push_back("cgroup.pids.max");
+      }
+
+      void
+      cgroup::get_keyfile (keyfile& keyfile) const
+      {
+        keyfile::set_object_value(*this, &cgroup::get_cgroup_enable,
+                                  keyfile, owner->get_name(),
+                                  "cgroup.enable");
+
+        keyfile::set_object_value(*this, &cgroup::get_cgroup_parent,
+                                  keyfile, owner->get_name(),
+                                  "cgroup.parent");
+
+        if (owner->get_facet<session>() && !this->cgroup_path.empty())
+          keyfile::set_object_value(*this, &cgroup::get_cgroup_path,
+                                    keyfile, owner->get_name(),
+                                    "cgroup.path");
+
+        keyfile::set_object_value(*this, &cgroup::get_cgroup_cpu_max,
+                                  keyfile, owner->get_name(),
+                                  "cgroup.cpu.max");
+
+        keyfile::set_object_value(*this, &cgroup::get_cgroup_cpu_weight,
+                                  keyfile, owner->get_name(),
+                                  "cgroup.cpu.weight");
+
+        keyfile::set_object_value(*this, &cgroup::get_cgroup_memory_max,
+                                  keyfile, owner->get_name(),
+                                  "cgroup.memory.max");
+
+        keyfile::set_object_value(*this, &cgroup::get_cgroup_memory_high,
+                                  keyfile, owner->get_name(),
+                                  "cgroup.memory.high");
+
+        keyfile::set_object_list_value(*this, &cgroup::get_cgroup_io_max,
+                                       keyfile, owner->get_name(),
+                                       "cgroup.io.max");
+
+        keyfile::set_object_value(*this, &cgroup::get_cgroup_pids_max,
+                                  keyfile, owner->get_name(),
+                                  "cgroup.pids.max");
+      }
+
+      void
+      cgroup::set_keyfile (const keyfile& keyfile)
+      {
+        keyfile::get_object_value(*this, &cgroup::set_cgroup_enable,
+                                  keyfile, owner->get_name(),
+                                  "cgroup.enable",
+                                  keyfile::PRIORITY_OPTIONAL);
+
+        keyfile::get_object_value(*this, &cgroup::set_cgroup_parent,
+                                  keyfile, owner->get_name(),
+                                  "cgroup.parent",
+                                  keyfile::PRIORITY_OPTIONAL);
+
+        keyfile::get_object_value(*this, &cgroup::set_cgroup_path,
+                                  keyfile, owner->get_name(),
+                                  "cgroup.path",
+                                  owner->get_facet<session>() ?
+                                  keyfile::PRIORITY_OPTIONAL :
+                                  keyfile::PRIORITY_DISALLOWED);
+
+        keyfile::get_object_value(*this, &cgroup::set_cgroup_cpu_max,
+                                  keyfile, owner->get_name(),
+                                  "cgroup.cpu.max",
+                                  keyfile::PRIORITY_OPTIONAL);
+
+        keyfile::get_object_value(*this, &cgroup::set_cgroup_cpu_weight,
+                                  keyfile, owner->get_name(),
+                                  "cgroup.cpu.weight",
+                                  keyfile::PRIORITY_OPTIONAL);
+
+        keyfile::get_object_value(*this, &cgroup::set_cgroup_memory_max,
+                                  keyfile, owner->get_name(),
+                                  "cgroup.memory.max",
+                                  keyfile::PRIORITY_OPTIONAL);
+
+        keyfile::get_object_value(*this, &cgroup::set_cgroup_memory_high,
+                                  keyfile, owner->get_name(),
+                                  "cgroup.memory.high",
+                                  keyfile::PRIORITY_OPTIONAL);
+
+        keyfile::get_object_list_value(*this, &cgroup::set_cgroup_io_max,
+                                       keyfile, owner->get_name(),
+                                       "cgroup.io.max",
+                                       keyfile::PRIORITY_OPTIONAL);
+
+        keyfile::get_object_value(*this, &cgroup::set_cgroup_pids_max,
+                                  keyfile, owner->get_name(),
+                                  "cgroup.pids.max",
+                                  keyfile::PRIORITY_OPTIONAL);
+      }
+
+      void
+      cgroup::chroot_session_setup (const chroot&      parent,
+                                    const std::string& session_id,
+                                    const std::string& alias,
+                                    const std::string& user,
+                                    bool               root)
+      {
+        /* Fix the cgroup path now, since a pooled session is renamed
+           after its cgroup has been created. */
+        if (this->cgroup_enable)
+          set_cgroup_path(cgroup_root + '/' + this->cgroup_parent + '/' +
+                          session_id);
+      }
+
+    }
+  }
+}
@@ -0,0 +1,346 @@
+/* Copyright © 2005-2013  Roger Leigh <rleigh@codelibre.net>
+ *
+ * schroot is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * schroot is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ *********************************************************************/
+
+#ifndef SCHROOT_CHROOT_FACET_CGROUP_H
+#define SCHROOT_CHROOT_FACET_CGROUP_H
+
+#include <schroot/chroot/facet/facet.h>
+#include <schroot/chroot/facet/lock-setup.h>
+#include <schroot/chroot/facet/session-setup.h>
+
+namespace schroot
+{
+  namespace chroot
+  {
+    namespace facet
+    {
+
+      /**
+       * Chroot support for cgroup v2 resource control.
+       *
+       * Each session is given its own control group beneath a common
+       * parent group.  Resource limits are applied to the group, and
+       * every command run in the session is placed in it.  When the
+       * session is ended, all processes remaining in the group are
+       * killed using cgroup.kill, and the group is removed.
+       */
+      class cgroup : public facet,
+                     public session_setup,
+                     public lock_setup
+      {
+      public:
+        /// A shared_ptr to a chroot facet object.
+        typedef std::shared_ptr<cgroup> ptr;
+
+        /// A shared_ptr to a const chroot facet object.
+        typedef std::shared_ptr<const cgroup> const_ptr;
+
+        /// Error codes.
+        enum error_code
+          {
+            CGROUP_FS,           ///< No cgroup v2 filesystem
+            CGROUP_PARENT,       ///< Invalid parent cgroup
+            CGROUP_PATH,         ///< Invalid session cgroup path
+            CGROUP_CONTROLLER,   ///< Controller is not available
+            CGROUP_CREATE,       ///< Could not create cgroup
+            CGROUP_LIMIT,        ///< Could not set resource limit
+            CGROUP_ATTACH,       ///< Could not add process to cgroup
+            CGROUP_KILL,         ///< Could not kill processes in cgroup
+            CGROUP_KILL_TIMEOUT, ///< Timed out killing processes in cgroup
+            CGROUP_REMOVE        ///< Could not remove cgroup
+          };
+
+        /// Exception type.
+        typedef custom_error<error_code> error;
+
+      private:
+        /// The constructor.
+        cgroup ();
+
+      public:
+        /// The destructor.
+        virtual ~cgroup ();
+
+        /**
+         * Create a chroot facet.
+         *
+         * @returns a shared_ptr to the new chroot facet.
+         */
+        static ptr
+        create ();
+
+        virtual facet::ptr
+        clone () const;
+
+        virtual std::string const&
+        get_name () const;
+
+        /**
+         * Is a cgroup created for each session?
+         *
+         * @returns true if enabled, otherwise false.
+         */
+        bool
+        get_cgroup_enable () const;
+
+        /**
+         * Set whether a cgroup is created for each session.
+         *
+         * @param enable true to enable, otherwise false.
+         */
+        void
+        set_cgroup_enable (bool enable);
+
+        /**
+         * Get the parent cgroup.  This is relative to the root of the
+         * cgroup v2 hierarchy.
+         *
+         * @returns the parent cgroup.
+         */
+        std::string const&
+        get_cgroup_parent () const;
+
+        /**
+         * Set the parent cgroup.  This is relative to the root of the
+         * cgroup v2 hierarchy; it will be created if it does not
+         * exist.  It must not contain any processes.
+         *
+         * @param parent the parent cgroup.
+         */
+        void
+        set_cgroup_parent (const std::string& parent);
+
+        /**
+         * Get the CPU bandwidth limit (cpu.max).
+         *
+         * @returns the limit, or an empty string if unset.
+         */
+        std::string const&
+        get_cgroup_cpu_max () const;
+
+        /**
+         * Set the CPU bandwidth limit (cpu.max).
+         *
+         * @param limit the quota and period, or an empty string to
+         * leave unset.
+         */
+        void
+        set_cgroup_cpu_max (const std::string& limit);
+
+        /**
+         * Get the CPU weight (cpu.weight).
+         *
+         * @returns the weight, or an empty string if unset.
+         */
+        std::string const&
+        get_cgroup_cpu_weight () const;
+
+        /**
+         * Set the CPU weight (cpu.weight).
+         *
+         * @param weight the weight, or an empty string to leave
+         * unset.
+         */
+        void
+        set_cgroup_cpu_weight (const std::string& weight);
+
+        /**
+         * Get the memory limit (memory.max).
+         *
+         * @returns the limit, or an empty string if unset.
+         */
+        std::string const&
+        get_cgroup_memory_max () const;
+
+        /**
+         * Set the memory limit (memory.max).
+         *
+         * @param limit the limit, or an empty string to leave unset.
+         */
+        void
+        set_cgroup_memory_max (const std::string& limit);
+
+        /**
+         * Get the memory throttling limit (memory.high).
+         *
+         * @returns the limit, or an empty string if unset.
+         */
+        std::string const&
+        get_cgroup_memory_high () const;
+
+        /**
+         * Set the memory throttling limit (memory.high).
+         *
+         * @param limit the limit, or an empty string to leave unset.
+         */
+        void
+        set_cgroup_memory_high (const std::string& limit);
+
+        /**
+         * Get the I/O limits (io.max).
+         *
+         * @returns a list of limits, one per device.
+         */
+        string_list const&
+        get_cgroup_io_max () const;
+
+        /**
+         * Set the I/O limits (io.max).
+         *
+         * @param limits a list of limits, one per device.
+         */
+        void
+        set_cgroup_io_max (const string_list& limits);
+
+        /**
+         * Get the process limit (pids.max).
+         *
+         * @returns the limit, or an empty string if unset.
+         */
+        std::string const&
+        get_cgroup_pids_max () const;
+
+        /**
+         * Set the process limit (pids.max).
+         *
+         * @param limit the limit, or an empty string to leave unset.
+         */
+        void
+        set_cgroup_pids_max (const std::string& limit);
+
+        /**
+         * Get the path of the session cgroup.  This is fixed when the
+         * session is created, and is not changed if the session is
+         * later renamed.
+         *
+         * @returns the path, or an empty string if cgroups are not
+         * enabled.
+         */
+        std::string
+        get_cgroup_path () const;
+
+        /**
+         * Set the path of the session cgroup.  This must be below the
+         * root of the cgroup v2 hierarchy.
+         *
+         * @param path the path of the session cgroup.
+         */
+        void
+        set_cgroup_path (const std::string& path);
+
+        /**
+         * Create, or kill and remove, the session cgroup.  The
+         * cgroup is created and its limits applied when the session
+         * is started or recovered.  Any processes remaining in it are
+         * killed before the session is stopped, and it is removed
+         * once the setup scripts have completed.
+         *
+         * @param type the type of setup being performed
+         * @param lock true to lock, false to unlock
+         * @param status the exit status of the setup commands (0 for
+         * success, nonzero for failure).
+         */
+        virtual void
+        setup_lock (chroot::setup_type type,
+                    bool               lock,
+                    int                status);
+
+        /**
+         * Add the calling process to the session cgroup.  All of its
+         * children will also be created in the cgroup.
+         */
+        void
+        attach () const;
+
+        virtual void
+        setup_env (environment& env) const;
+
+        virtual void
+        get_details (format_detail& detail) const;
+
+        virtual void
+        get_used_keys (string_list& used_keys) const;
+
+        virtual void
+        get_keyfile (keyfile& keyfile) const;
+
+        virtual void
+        set_keyfile (const keyfile& keyfile);
+
+        virtual void
+        chroot_session_setup (const chroot&      parent,
+                              const std::string& session_id,
+                              const std::string& alias,
+                              const std::string& user,
+                              bool               root);
+
+      private:
+        /**
+         * Create the session cgroup and its parents, and apply the
+         * resource limits.
+         */
+        void
+        create_cgroup () const;
+
+        /**
+         * Kill all processes in the session cgroup, and wait for
+         * them to exit.
+         *
+         * @returns true if the cgroup was found, or false if it does
+         * not exist.
+         */
+        bool
+        kill_cgroup () const;
+
+        /**
+         * Remove the session cgroup.
+         */
+        void
+        remove_cgroup () const;
+
+        /// Create a cgroup for each session?
+        bool        cgroup_enable;
+        /// Parent cgroup.
+        std::string cgroup_parent;
+        /// Session cgroup path.
+        std::string cgroup_path;
+        /// cpu.max limit.
+        std::string cgroup_cpu_max;
+        /// cpu.weight value.
+        std::string cgroup_cpu_weight;
+        /// memory.max limit.
+        std::string cgroup_memory_max;
+        /// memory.high limit.
+        std::string cgroup_memory_high;
+        /// io.max limits.
+        string_list cgroup_io_max;
+        /// pids.max limit.
+        std::string cgroup_pids_max;
+      };
+
+    }
+  }
+}
+
+#endif /* SCHROOT_CHROOT_FACET_CGROUP_H */
+
+/*
+ * Local Variables:
+ * mode:C++
+ * End:
+ */
@@ -76,7 +76,7 @@ namespace schroot
       void
       directory_base::get_details (format_detail& detail) const
       {
-        detail.add(_("Directory"), get_directory());
+        detail.add(N_("Directory"), get_directory());
       }
 
       void
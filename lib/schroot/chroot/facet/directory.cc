@@ -23,7 +23,10 @@
 #include <schroot/chroot/facet/fsunion.h>
 #include <schroot/chroot/facet/session.h>
 #include <schroot/chroot/facet/session-clonable.h>
+#include <schroot/chroot/facet/source.h>
 #include <schroot/format-detail.h>
+#include <schroot/lease.h>
+#include <schroot/log.h>
 #include <schroot/util.h>
 
 #include <cassert>
@@ -78,6 +81,14 @@ namespace schroot
       }
 #endif // SCHROOT_FEATURE_BTRFSSNAP
 
+#ifdef SCHROOT_FEATURE_REFLINK
+      directory::directory (const reflink_clone& rhs):
+        directory_base()
+      {
+        set_directory(rhs.get_source_directory());
+      }
+#endif // SCHROOT_FEATURE_REFLINK
+
       void
       directory::set_chroot (chroot& chroot,
                              bool    copy)
@@ -113,6 +124,14 @@ namespace schroot
       }
 #endif // SCHROOT_FEATURE_BTRFSSNAP
 
+#ifdef SCHROOT_FEATURE_REFLINK
+      directory::ptr
+      directory::create (const reflink_clone& rhs)
+      {
+        return ptr(new directory(rhs));
+      }
+#endif // SCHROOT_FEATURE_REFLINK
+
       facet::ptr
       directory::clone () const
       {
@@ -130,6 +149,39 @@ namespace schroot
                              bool               lock,
                              int                status)
       {
+#ifdef SCHROOT_FEATURE_UNION
+        // A source session may modify the directory, which may be a
+        // union underlay layer of other sessions.
+        if (owner->get_facet<source>() && owner->get_facet<session>())
+          {
+            lease layer(fsunion::get_layer_lease_name(get_directory()));
+            if (type == chroot::SETUP_START && lock == true)
+              {
+                try
+                  {
+                    layer.acquire(lease::LEASE_EXCLUSIVE, owner->get_name(),
+                                  owner->get_facet_strict<source>()->
+                                  get_lease_timeout());
+                  }
+                catch (const lease::error& e)
+                  {
+                    throw chroot::error(owner->get_name(), e);
+                  }
+              }
+            else if (type == chroot::SETUP_STOP && lock == false && status == 0)
+              {
+                try
+                  {
+                    layer.release(owner->get_name());
+                  }
+                catch (const lease::error& e)
+                  {
+                    log_exception_warning(e);
+                  }
+              }
+          }
+#endif // SCHROOT_FEATURE_UNION
+
         /* Create or unlink session information. */
         if ((type == chroot::SETUP_START && lock == true) ||
             (type == chroot::SETUP_STOP && lock == false && status == 0))
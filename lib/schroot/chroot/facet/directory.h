@@ -24,6 +24,9 @@
 #ifdef SCHROOT_FEATURE_BTRFSSNAP
 #include <schroot/chroot/facet/btrfs-snapshot.h>
 #endif
+#ifdef SCHROOT_FEATURE_REFLINK
+#include <schroot/chroot/facet/reflink-clone.h>
+#endif
 
 namespace schroot
 {
@@ -59,6 +62,11 @@ namespace schroot
         directory (const btrfs_snapshot& rhs);
 #endif // SCHROOT_FEATURE_BTRFSSNAP
 
+#ifdef SCHROOT_FEATURE_REFLINK
+        /// The copy constructor.
+        directory (const reflink_clone& rhs);
+#endif // SCHROOT_FEATURE_REFLINK
+
         void
         set_chroot (chroot& chroot,
                     bool    copy);
@@ -67,6 +75,9 @@ namespace schroot
 #ifdef SCHROOT_FEATURE_BTRFSSNAP
         friend class btrfs_snapshot;
 #endif // SCHROOT_FEATURE_BTRFSSNAP
+#ifdef SCHROOT_FEATURE_REFLINK
+        friend class reflink_clone;
+#endif // SCHROOT_FEATURE_REFLINK
 
       public:
         /// The destructor.
@@ -93,6 +104,16 @@ namespace schroot
         create (const btrfs_snapshot& rhs);
 #endif // SCHROOT_FEATURE_BTRFSSNAP
 
+#ifdef SCHROOT_FEATURE_REFLINK
+        /**
+         * Create a chroot facet from a reflink clone.
+         *
+         * @returns a shared_ptr to the new chroot facet.
+         */
+        static ptr
+        create (const reflink_clone& rhs);
+#endif // SCHROOT_FEATURE_REFLINK
+
         virtual facet::ptr
         clone () const;
 
@@ -100,6 +121,17 @@ namespace schroot
         get_path () const;
 
       protected:
+        /**
+         * Create or remove the session information.  A source
+         * session also holds an exclusive lease on its directory as
+         * a union underlay layer (see fsunion::setup_lock()), from
+         * when it is started until it is successfully stopped.
+         *
+         * @param type the type of setup being performed.
+         * @param lock true to lock, false to unlock.
+         * @param status the exit status of the setup commands (0 for
+         * success, nonzero for failure).
+         */
         virtual void
         setup_lock (chroot::setup_type type,
                     bool               lock,
@@ -25,9 +25,12 @@
 #include <schroot/chroot/facet/session.h>
 #include <schroot/chroot/facet/source-clonable.h>
 #include <schroot/format-detail.h>
+#include <schroot/reclaim.h>
 
 #include <cassert>
 #include <cerrno>
+#include <cstdio>
+#include <cstring>
 
 #include <boost/format.hpp>
 
@@ -198,10 +201,46 @@ namespace schroot
           {
 
             bool start = (type == chroot::SETUP_START);
-            owner->get_facet_strict<session>()->setup_session_info(start);
+            session::ptr psess(owner->get_facet_strict<session>());
+
+            /* The unpack directory of an ending session was left in
+               place by the setup scripts.  Queue it for deletion
+               before the session information is removed, so that it
+               is never left behind unrecorded. */
+            if (!start && psess->get_ending())
+              {
+                try
+                  {
+                    reclaim queue;
+                    if (queue.defer(reclaim::DIRECTORY_TREE,
+                                    std::string(SCHROOT_FILE_UNPACK_DIR) +
+                                    "/" + owner->get_name()))
+                      queue.run_background();
+                  }
+                catch (const reclaim::error& e)
+                  {
+                    throw error(owner->get_name(), e);
+                  }
+              }
+
+            psess->setup_session_info(start);
           }
       }
 
+      void
+      file::rename_session (const std::string& session_id)
+      {
+        // The unpack location is derived from the session name.
+        std::string old_location(std::string(SCHROOT_FILE_UNPACK_DIR) + "/" +
+                                 owner->get_name());
+        std::string new_location(std::string(SCHROOT_FILE_UNPACK_DIR) + "/" +
+                                 session_id);
+
+        if (rename(old_location.c_str(), new_location.c_str()) != 0 &&
+            errno != ENOENT)
+          throw error(old_location, chroot::SESSION_RENAME, strerror(errno));
+      }
+
       facet::session_flags
       file::get_session_flags () const
       {
@@ -218,10 +257,10 @@ namespace schroot
       {
         if (!this->filename.empty())
           detail
-            .add(_("File"), get_filename())
-            .add(_("File Repack"), this->repack);
+            .add(N_("File"), get_filename())
+            .add(N_("File Repack"), this->repack);
         if (!get_location().empty())
-          detail.add(_("Location"), get_location());
+          detail.add(N_("Location"), get_location());
       }
 
       void
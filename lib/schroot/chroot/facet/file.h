@@ -143,6 +143,9 @@ namespace schroot
         virtual session_flags
         get_session_flags () const;
 
+        virtual void
+        rename_session (const std::string& session_id);
+
       protected:
         virtual void
         setup_lock (chroot::setup_type type,
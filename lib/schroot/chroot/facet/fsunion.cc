@@ -25,8 +25,13 @@
 #include <schroot/chroot/facet/fsunion.h>
 #include <schroot/chroot/facet/source-clonable.h>
 #include <schroot/feature.h>
+#include <schroot/lease.h>
+#include <schroot/log.h>
+#include <schroot/reclaim.h>
 
+#include <algorithm>
 #include <cassert>
+#include <cstdlib>
 
 using boost::format;
 using std::endl;
@@ -41,7 +46,15 @@ namespace schroot
       // TRANSLATORS: %1% = chroot fs type
       {chroot::facet::fsunion::FSUNION_TYPE_UNKNOWN, N_("Unknown filesystem union type ‘%1%’")},
       {chroot::facet::fsunion::FSUNION_OVERLAY_ABS,  N_("Union overlay must have an absolute path")},
-      {chroot::facet::fsunion::FSUNION_UNDERLAY_ABS, N_("Union underlay must have an absolute path")}
+      {chroot::facet::fsunion::FSUNION_UNDERLAY_ABS, N_("Union underlay must have an absolute path")},
+      // TRANSLATORS: %1% = tmpfs size
+      {chroot::facet::fsunion::FSUNION_TMPFS_SIZE,   N_("Invalid tmpfs size ‘%1%’")},
+      {chroot::facet::fsunion::FSUNION_LAYER_ABS,    N_("Union layer must have an absolute path")},
+      // TRANSLATORS: %1% = directory
+      {chroot::facet::fsunion::FSUNION_LAYER_INVALID, N_("Union layer ‘%1%’ may not contain ‘:’ or ‘,’")},
+      // TRANSLATORS: %1% = directory
+      {chroot::facet::fsunion::FSUNION_LAYER_DUPLICATE, N_("Union layer ‘%1%’ is listed more than once")},
+      {chroot::facet::fsunion::FSUNION_LAYER_LOCK,   N_("Failed to lock union layer")}
     };
 
   namespace chroot
@@ -70,7 +83,11 @@ namespace schroot
         facet(),
         union_type("none"),
         union_overlay_directory(SCHROOT_OVERLAY_DIR),
-        union_underlay_directory(SCHROOT_UNDERLAY_DIR)
+        union_underlay_directory(SCHROOT_UNDERLAY_DIR),
+        union_overlay_tmpfs(false),
+        union_overlay_tmpfs_size(),
+        union_overlay_volatile(false),
+        union_underlay_layers()
       {
       }
 
@@ -134,6 +151,218 @@ namespace schroot
         this->union_underlay_directory = directory;
       }
 
+      bool
+      fsunion::get_union_overlay_tmpfs () const
+      {
+        return this->union_overlay_tmpfs;
+      }
+
+      void
+      fsunion::set_union_overlay_tmpfs (bool tmpfs)
+      {
+        this->union_overlay_tmpfs = tmpfs;
+      }
+
+      std::string const&
+      fsunion::get_union_overlay_tmpfs_size () const
+      {
+        return this->union_overlay_tmpfs_size;
+      }
+
+      void
+      fsunion::set_union_overlay_tmpfs_size (const std::string& size)
+      {
+        // A number, optionally followed by a unit suffix or %.
+        std::string::size_type digits = size.find_first_not_of("0123456789");
+        if (!size.empty() &&
+            (digits == 0 ||
+             (digits != std::string::npos &&
+              (digits != size.size() - 1 ||
+               std::string("kKmMgG%").find(size[digits]) == std::string::npos))))
+          throw error(size, FSUNION_TMPFS_SIZE);
+
+        this->union_overlay_tmpfs_size = size;
+      }
+
+      bool
+      fsunion::get_union_overlay_volatile () const
+      {
+        return this->union_overlay_volatile;
+      }
+
+      void
+      fsunion::set_union_overlay_volatile (bool volatile_overlay)
+      {
+        this->union_overlay_volatile = volatile_overlay;
+      }
+
+      string_list const&
+      fsunion::get_union_underlay_layers () const
+      {
+        return this->union_underlay_layers;
+      }
+
+      void
+      fsunion::set_union_underlay_layers (const string_list& layers)
+      {
+        for (string_list::const_iterator pos = layers.begin();
+             pos != layers.end();
+             ++pos)
+          {
+            if (!is_absname(*pos))
+              throw error(*pos, FSUNION_LAYER_ABS);
+            // Used as overlay mount option separators.
+            if (pos->find_first_of(":,") != std::string::npos)
+              throw error(*pos, FSUNION_LAYER_INVALID);
+            if (std::find(layers.begin(), pos, *pos) != pos)
+              throw error(*pos, FSUNION_LAYER_DUPLICATE);
+          }
+
+        this->union_underlay_layers = layers;
+      }
+
+      std::string
+      fsunion::get_layer_lease_name (const std::string& directory)
+      {
+        std::string path(directory);
+        char *resolved = realpath(directory.c_str(), 0);
+        if (resolved)
+          {
+            path = resolved;
+            free(resolved);
+          }
+
+        // Lease names may not contain ‘/’, and may not clash with
+        // chroot names, which may not contain ‘:’.
+        std::string name("layer:");
+        for (const auto c : path)
+          {
+            if (c == '%')
+              name += "%25";
+            else if (c == '/')
+              name += "%2F";
+            else
+              name += c;
+          }
+
+        return name;
+      }
+
+      void
+      fsunion::setup_lock (chroot::setup_type type,
+                           bool               lock,
+                           int                status)
+      {
+        session::const_ptr psess(owner->get_facet<session>());
+        if (!psess || !get_union_configured())
+          return;
+
+        if (lock && type == chroot::SETUP_START)
+          {
+            // Wait for a source session modifying a layer for as
+            // long as for one modifying the chroot itself.
+            unsigned int timeout = 0;
+            if (psess->get_parent_chroot())
+              {
+                source_clonable::const_ptr pclone
+                  (psess->get_parent_chroot()->get_facet<source_clonable>());
+                if (pclone)
+                  timeout = pclone->get_source_lease_timeout();
+              }
+            acquire_layer_leases(timeout);
+          }
+        else if (lock && type == chroot::SETUP_RECOVER)
+          acquire_layer_leases(0);
+        else if (!lock && type == chroot::SETUP_STOP && status == 0)
+          {
+            reclaim_overlay();
+            release_layer_leases();
+          }
+      }
+
+      void
+      fsunion::acquire_layer_leases (unsigned int timeout)
+      {
+        // Lease in a consistent order, whatever the stacking order.
+        string_list layers(this->union_underlay_layers);
+        std::sort(layers.begin(), layers.end());
+
+        string_list acquired;
+        for (const auto& layer : layers)
+          {
+            lease layer_lease(get_layer_lease_name(layer));
+            try
+              {
+                lease::ticket_list tickets(layer_lease.get_tickets());
+                if (std::none_of(tickets.begin(), tickets.end(),
+                                 [this](const lease::ticket& t)
+                                 { return t.session == owner->get_name(); }))
+                  {
+                    layer_lease.acquire(lease::LEASE_SHARED,
+                                        owner->get_name(), timeout);
+                    acquired.push_back(layer);
+                  }
+              }
+            catch (const lease::error& e)
+              {
+                for (const auto& held : acquired)
+                  {
+                    try
+                      {
+                        lease(get_layer_lease_name(held)).
+                          release(owner->get_name());
+                      }
+                    catch (const lease::error& release_error)
+                      {
+                        log_exception_warning(release_error);
+                      }
+                  }
+                throw chroot::error
+                  (owner->get_name(),
+                   error(layer, FSUNION_LAYER_LOCK, e.what()));
+              }
+          }
+      }
+
+      void
+      fsunion::release_layer_leases ()
+      {
+        for (const auto& layer : this->union_underlay_layers)
+          {
+            try
+              {
+                lease(get_layer_lease_name(layer)).release(owner->get_name());
+              }
+            catch (const lease::error& e)
+              {
+                // The leases are discarded once the session no
+                // longer exists.
+                log_exception_warning(e);
+              }
+          }
+      }
+
+      void
+      fsunion::reclaim_overlay ()
+      {
+        session::const_ptr psess(owner->get_facet<session>());
+        if (!psess || !psess->get_ending() ||
+            !get_union_configured() || get_union_overlay_tmpfs())
+          return;
+
+        try
+          {
+            reclaim queue;
+            if (queue.defer(reclaim::DIRECTORY_TREE,
+                            get_union_overlay_directory()))
+              queue.run_background();
+          }
+        catch (const reclaim::error& e)
+          {
+            throw chroot::error(owner->get_name(), e);
+          }
+      }
+
       std::string const&
       fsunion::get_union_type () const
       {
@@ -144,6 +373,7 @@ namespace schroot
       fsunion::set_union_type (const std::string& type)
       {
         if (type == "aufs" ||
+            type == "overlay" ||
             type == "overlayfs" ||
             type == "unionfs" ||
             type == "none")
@@ -188,6 +418,14 @@ namespace schroot
                     get_union_overlay_directory());
             env.add("CHROOT_UNION_UNDERLAY_DIRECTORY",
                     get_union_underlay_directory());
+            env.add("CHROOT_UNION_OVERLAY_TMPFS",
+                    get_union_overlay_tmpfs());
+            env.add("CHROOT_UNION_OVERLAY_TMPFS_SIZE",
+                    get_union_overlay_tmpfs_size());
+            env.add("CHROOT_UNION_OVERLAY_VOLATILE",
+                    get_union_overlay_volatile());
+            env.add("CHROOT_UNION_UNDERLAY_LAYERS",
+                    string_list_to_string(get_union_underlay_layers(), ":"));
           }
       }
 
@@ -205,18 +443,28 @@ namespace schroot
       void
       fsunion::get_details (format_detail& detail) const
       {
-        detail.add(_("Filesystem Union Type"), get_union_type());
+        detail.add(N_("Filesystem Union Type"), get_union_type());
         if (get_union_configured())
           {
             if (!this->union_mount_options.empty())
-              detail.add(_("Filesystem Union Mount Options"),
+              detail.add(N_("Filesystem Union Mount Options"),
                          get_union_mount_options());
             if (!this->union_overlay_directory.empty())
-              detail.add(_("Filesystem Union Overlay Directory"),
+              detail.add(N_("Filesystem Union Overlay Directory"),
                          get_union_overlay_directory());
             if (!this->union_underlay_directory.empty())
-              detail.add(_("Filesystem Union Underlay Directory"),
+              detail.add(N_("Filesystem Union Underlay Directory"),
                          get_union_underlay_directory());
+            detail.add(N_("Filesystem Union Overlay In Memory"),
+                       get_union_overlay_tmpfs());
+            if (!this->union_overlay_tmpfs_size.empty())
+              detail.add(N_("Filesystem Union Overlay Memory Size"),
+                         get_union_overlay_tmpfs_size());
+            detail.add(N_("Filesystem Union Overlay Volatile"),
+                       get_union_overlay_volatile());
+            if (!this->union_underlay_layers.empty())
+              detail.add(N_("Filesystem Union Underlay Layers"),
+                         get_union_underlay_layers());
           }
       }
 
@@ -227,6 +475,10 @@ namespace schroot
         used_keys.push_back("union-mount-options");
         used_keys.push_back("union-overlay-directory");
         used_keys.push_back("union-underlay-directory");
+        used_keys.push_back("union-overlay-tmpfs");
+        used_keys.push_back("union-overlay-tmpfs-size");
+        used_keys.push_back("union-overlay-volatile");
+        used_keys.push_back("union-underlay-layers");
       }
 
       void
@@ -251,6 +503,26 @@ namespace schroot
                                       &fsunion::get_union_underlay_directory,
                                       keyfile, owner->get_name(),
                                       "union-underlay-directory");
+
+            keyfile::set_object_value(*this,
+                                      &fsunion::get_union_overlay_tmpfs,
+                                      keyfile, owner->get_name(),
+                                      "union-overlay-tmpfs");
+
+            keyfile::set_object_value(*this,
+                                      &fsunion::get_union_overlay_tmpfs_size,
+                                      keyfile, owner->get_name(),
+                                      "union-overlay-tmpfs-size");
+
+            keyfile::set_object_value(*this,
+                                      &fsunion::get_union_overlay_volatile,
+                                      keyfile, owner->get_name(),
+                                      "union-overlay-volatile");
+
+            keyfile::set_object_list_value(*this,
+                                           &fsunion::get_union_underlay_layers,
+                                           keyfile, owner->get_name(),
+                                           "union-underlay-layers");
           }
       }
 
@@ -283,6 +555,30 @@ namespace schroot
                                   (is_session && get_union_configured()) ?
                                   keyfile::PRIORITY_REQUIRED :
                                   keyfile::PRIORITY_OPTIONAL);
+
+        keyfile::get_object_value(*this,
+                                  &fsunion::set_union_overlay_tmpfs,
+                                  keyfile, owner->get_name(),
+                                  "union-overlay-tmpfs",
+                                  keyfile::PRIORITY_OPTIONAL);
+
+        keyfile::get_object_value(*this,
+                                  &fsunion::set_union_overlay_tmpfs_size,
+                                  keyfile, owner->get_name(),
+                                  "union-overlay-tmpfs-size",
+                                  keyfile::PRIORITY_OPTIONAL);
+
+        keyfile::get_object_value(*this,
+                                  &fsunion::set_union_overlay_volatile,
+                                  keyfile, owner->get_name(),
+                                  "union-overlay-volatile",
+                                  keyfile::PRIORITY_OPTIONAL);
+
+        keyfile::get_object_list_value(*this,
+                                       &fsunion::set_union_underlay_layers,
+                                       keyfile, owner->get_name(),
+                                       "union-underlay-layers",
+                                       keyfile::PRIORITY_OPTIONAL);
       }
 
       void
@@ -22,9 +22,12 @@
 
 #include <schroot/chroot/chroot.h>
 #include <schroot/chroot/facet/facet.h>
+#include <schroot/chroot/facet/lock-setup.h>
 #include <schroot/chroot/facet/session-setup.h>
 #include <schroot/chroot/facet/source-setup.h>
 
+#include <memory>
+
 namespace schroot
 {
   namespace chroot
@@ -43,15 +46,21 @@ namespace schroot
        */
       class fsunion : public facet,
                       public session_setup,
-                      public source_setup
+                      public source_setup,
+                      public lock_setup
       {
       public:
         /// Error codes.
         enum error_code
           {
-            FSUNION_TYPE_UNKNOWN, ///< Unknown filesystem union type.
-            FSUNION_OVERLAY_ABS,  ///< Union overlay must have an absolute path.
-            FSUNION_UNDERLAY_ABS  ///< Union underlay must have an absolute path.
+            FSUNION_TYPE_UNKNOWN,    ///< Unknown filesystem union type.
+            FSUNION_OVERLAY_ABS,     ///< Union overlay must have an absolute path.
+            FSUNION_UNDERLAY_ABS,    ///< Union underlay must have an absolute path.
+            FSUNION_TMPFS_SIZE,      ///< Invalid tmpfs size.
+            FSUNION_LAYER_ABS,       ///< Union layer must have an absolute path.
+            FSUNION_LAYER_INVALID,   ///< Union layer contains invalid characters.
+            FSUNION_LAYER_DUPLICATE, ///< Union layer is listed more than once.
+            FSUNION_LAYER_LOCK       ///< Failed to lock union layer.
           };
 
         /// Exception type.
@@ -105,7 +114,8 @@ namespace schroot
         /**
          * Set the filesystem union type.
          *
-         * Currently supported values are aufs, unionfs and none.
+         * Currently supported values are aufs, overlay, overlayfs,
+         * unionfs and none.
          *
          * @param union_type the filesystem type.
          **/
@@ -168,6 +178,125 @@ namespace schroot
         virtual void
         set_union_underlay_directory (const std::string& directory);
 
+        /**
+         * Get whether the union overlay directory is a tmpfs.
+         *
+         * @returns true if the overlay is held in memory, otherwise
+         * false.
+         */
+        virtual bool
+        get_union_overlay_tmpfs () const;
+
+        /**
+         * Set whether the union overlay directory is a tmpfs.  If
+         * true, a tmpfs is mounted on the overlay directory for each
+         * session, so that changes made in the session are held in
+         * memory and discarded by unmounting it when the session ends.
+         *
+         * @param tmpfs true to hold the overlay in memory, otherwise
+         * false.
+         */
+        virtual void
+        set_union_overlay_tmpfs (bool tmpfs);
+
+        /**
+         * Get the union overlay tmpfs size.
+         *
+         * @returns the tmpfs size, or an empty string for the tmpfs
+         * default.
+         */
+        virtual std::string const&
+        get_union_overlay_tmpfs_size () const;
+
+        /**
+         * Set the union overlay tmpfs size.  This is used as the
+         * tmpfs size mount option: a number of bytes with an optional
+         * k, m or g suffix, or a percentage of physical memory.
+         *
+         * @param size the tmpfs size, or an empty string for the
+         * tmpfs default.
+         */
+        virtual void
+        set_union_overlay_tmpfs_size (const std::string& size);
+
+        /**
+         * Get whether the union overlay is volatile.
+         *
+         * @returns true if the overlay is volatile, otherwise false.
+         */
+        virtual bool
+        get_union_overlay_volatile () const;
+
+        /**
+         * Set whether the union overlay is volatile.  A volatile
+         * overlay does not sync changes made in the session to the
+         * overlay directory.  This is only supported by the overlay
+         * union type.
+         *
+         * @param volatile_overlay true if the overlay is volatile,
+         * otherwise false.
+         */
+        virtual void
+        set_union_overlay_volatile (bool volatile_overlay);
+
+        /**
+         * Get the union underlay layers.
+         *
+         * @returns the read-only layers stacked beneath the chroot,
+         * bottom-most first.
+         */
+        virtual string_list const&
+        get_union_underlay_layers () const;
+
+        /**
+         * Set the union underlay layers.  These are additional
+         * read-only directories stacked beneath the chroot directory
+         * in the union, bottom-most first, so that common base layers
+         * may be shared between several chroots.  This is only
+         * supported by the overlay union type.
+         *
+         * @param layers the underlay layer directories.
+         */
+        virtual void
+        set_union_underlay_layers (const string_list& layers);
+
+        /**
+         * Get the name of the lease on a union underlay layer.  The
+         * directory is resolved, so that every path to the same
+         * directory names the same lease.
+         *
+         * @param directory the layer directory.
+         * @returns the lease name.
+         */
+        static std::string
+        get_layer_lease_name (const std::string& directory);
+
+        /**
+         * Lock or unlock the union underlay layers of a session.  A
+         * session holds a shared lease on every layer from when it
+         * is started until it is successfully stopped, so that a
+         * layer is never modified while it is mounted.  A layer is
+         * modified only by a source session of the chroot whose
+         * directory it is, which holds an exclusive lease on the
+         * layer for its lifetime.  The leases are held by the
+         * session, so they outlive the process which began it.  A
+         * recovered session reacquires any leases it no longer
+         * holds, but only if they are immediately available.
+         *
+         * The overlay directory of an ending session is queued for
+         * reclaim when it is stopped, while the session information
+         * still exists.
+         *
+         * @param type the type of setup being performed.
+         * @param lock true to lock, false to unlock.
+         * @param status the exit status of the setup commands (0 for
+         * success, nonzero for failure).
+         */
+        virtual void
+        setup_lock (chroot::setup_type type,
+                    bool               lock,
+                    int                status);
+
         virtual void
         setup_env (environment& env) const;
 
@@ -197,6 +326,33 @@ namespace schroot
         chroot_source_setup (const chroot& parent);
 
       private:
+        /**
+         * Acquire a shared lease on each union underlay layer not
+         * already held by the session.
+         *
+         * @param timeout the time to wait for each lease, in seconds.
+         */
+        void
+        acquire_layer_leases (unsigned int timeout);
+
+        /**
+         * Release the leases held by the session on the union
+         * underlay layers.
+         */
+        void
+        release_layer_leases ();
+
+        /**
+         * Queue the overlay directory of an ending session for
+         * reclaim.  The setup scripts leave a disk-backed overlay in
+         * place when the session is ending; this must be done before
+         * the session information is removed, so that the overlay is
+         * never left behind unrecorded.  Nothing is done if the
+         * session is not ending, or the overlay is a tmpfs.
+         */
+        void
+        reclaim_overlay ();
+
         /// filesystem union type.
         std::string union_type;
         /// Union mount options (branch configuration).
@@ -205,6 +361,14 @@ namespace schroot
         std::string union_overlay_directory;
         /// Union read-only underlay directory.
         std::string union_underlay_directory;
+        /// Hold the union overlay directory in a tmpfs?
+        bool union_overlay_tmpfs;
+        /// Union overlay tmpfs size.
+        std::string union_overlay_tmpfs_size;
+        /// Mount the union overlay without syncing?
+        bool union_overlay_volatile;
+        /// Union read-only underlay layers.
+        string_list union_underlay_layers;
       };
 
     }
@@ -0,0 +1,83 @@
+/* Copyright © 2005-2013  Roger Leigh <rleigh@codelibre.net>
+ *
+ * schroot is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * schroot is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ *********************************************************************/
+
+#ifndef SCHROOT_CHROOT_FACET_LOCK_SETUP_H
+#define SCHROOT_CHROOT_FACET_LOCK_SETUP_H
+
+#include <schroot/chroot/chroot.h>
+
+#include <memory>
+
+namespace schroot
+{
+  namespace chroot
+  {
+    namespace facet
+    {
+
+      /**
+       * Locking of a chroot by facets other than its storage.  When
+       * a chroot is locked, each facet implementing this interface
+       * is locked in turn before the storage; when it is unlocked,
+       * they are unlocked in reverse order, again before the
+       * storage.  Unlocking the storage of a stopped session removes
+       * the session information, so it is always done last.
+       */
+      class lock_setup
+      {
+      public:
+        /// A shared_ptr to a chroot lock_setup object.
+        typedef std::shared_ptr<lock_setup> ptr;
+
+        /// A shared_ptr to a const chroot lock_setup object.
+        typedef std::shared_ptr<const lock_setup> const_ptr;
+
+      protected:
+        /// The constructor.
+        lock_setup ();
+
+      public:
+        /// The destructor.
+        virtual ~lock_setup ();
+
+        /**
+         * Lock or unlock the facet.
+         *
+         * @param type the type of setup being performed.
+         * @param lock true to lock, false to unlock.
+         * @param status the exit status of the setup commands (0 for
+         * success, nonzero for failure).
+         */
+        virtual void
+        setup_lock (chroot::setup_type type,
+                    bool               lock,
+                    int                status) = 0;
+
+      };
+
+    }
+  }
+}
+
+#endif /* SCHROOT_CHROOT_FACET_LOCK_SETUP_H */
+
+/*
+ * Local Variables:
+ * mode:C++
+ * End:
+ */
@@ -25,6 +25,7 @@
 #include <schroot/chroot/facet/session.h>
 #include <schroot/chroot/facet/session-clonable.h>
 #include <schroot/format-detail.h>
+#include <schroot/log.h>
 
 #include <cassert>
 #include <cerrno>
@@ -61,6 +62,15 @@ namespace schroot
         storage(),
         session_setup(),
         filename()
+#ifdef SCHROOT_FEATURE_LOOPDEV
+        ,
+        device(),
+        read_only(false),
+        direct_io(true),
+        partscan(false),
+        autoclear(true),
+        attachment()
+#endif // SCHROOT_FEATURE_LOOPDEV
       {
       }
 
@@ -69,6 +79,15 @@ namespace schroot
         storage(rhs),
         session_setup(rhs),
         filename(rhs.filename)
+#ifdef SCHROOT_FEATURE_LOOPDEV
+        ,
+        device(rhs.device),
+        read_only(rhs.read_only),
+        direct_io(rhs.direct_io),
+        partscan(rhs.partscan),
+        autoclear(rhs.autoclear),
+        attachment(rhs.attachment)
+#endif // SCHROOT_FEATURE_LOOPDEV
       {
       }
 
@@ -141,10 +160,79 @@ namespace schroot
         return path;
       }
 
+#ifdef SCHROOT_FEATURE_LOOPDEV
+      std::string const&
+      loopback::get_loop_device () const
+      {
+        return this->device;
+      }
+
+      void
+      loopback::set_loop_device (const std::string& device)
+      {
+        if (!device.empty() && !is_absname(device))
+          throw error(device, chroot::DEVICE_ABS);
+
+        this->device = device;
+      }
+
+      bool
+      loopback::get_loop_read_only () const
+      {
+        return this->read_only;
+      }
+
+      void
+      loopback::set_loop_read_only (bool read_only)
+      {
+        this->read_only = read_only;
+      }
+
+      bool
+      loopback::get_loop_direct_io () const
+      {
+        return this->direct_io;
+      }
+
+      void
+      loopback::set_loop_direct_io (bool direct_io)
+      {
+        this->direct_io = direct_io;
+      }
+
+      bool
+      loopback::get_loop_partscan () const
+      {
+        return this->partscan;
+      }
+
+      void
+      loopback::set_loop_partscan (bool partscan)
+      {
+        this->partscan = partscan;
+      }
+
+      bool
+      loopback::get_loop_autoclear () const
+      {
+        return this->autoclear;
+      }
+
+      void
+      loopback::set_loop_autoclear (bool autoclear)
+      {
+        this->autoclear = autoclear;
+      }
+#endif // SCHROOT_FEATURE_LOOPDEV
+
       void
       loopback::setup_env (environment& env) const
       {
         env.add("CHROOT_FILE", get_filename());
+#ifdef SCHROOT_FEATURE_LOOPDEV
+        env.add("CHROOT_LOOP_DEVICE", get_loop_device());
+        env.add("CHROOT_LOOP_READ_ONLY", get_loop_read_only());
+#endif // SCHROOT_FEATURE_LOOPDEV
       }
 
       void
@@ -166,6 +254,55 @@ namespace schroot
               throw error(this->filename, chroot::FILE_NOTREG);
           }
 
+#ifdef SCHROOT_FEATURE_LOOPDEV
+        try
+          {
+            if ((type == chroot::SETUP_START ||
+                 type == chroot::SETUP_RECOVER) && lock == true)
+              {
+                /* Attach the file before the setup scripts mount it,
+                   and hold the device open until they have done so,
+                   so that an automatically cleared device is not
+                   detached in between. */
+                int flags = loop_device::FLAG_NONE;
+                if (get_loop_read_only())
+                  flags |= loop_device::FLAG_READ_ONLY;
+                if (get_loop_direct_io())
+                  flags |= loop_device::FLAG_DIRECT_IO;
+                if (get_loop_partscan())
+                  flags |= loop_device::FLAG_PARTSCAN;
+                if (get_loop_autoclear())
+                  flags |= loop_device::FLAG_AUTOCLEAR;
+
+                this->attachment = std::make_shared<loop_device>
+                  (get_filename(), flags);
+                set_loop_device(this->attachment->get_device());
+
+                if (this->attachment->get_shared())
+                  log_debug(DEBUG_INFO)
+                    << format("Sharing loop device %1% attached to %2%")
+                    % get_loop_device() % get_filename() << endl;
+                else
+                  log_debug(DEBUG_INFO)
+                    << format("Attached %1% to loop device %2%")
+                    % get_filename() % get_loop_device() << endl;
+              }
+            else if (lock == false)
+              {
+                this->attachment.reset();
+
+                /* Detach once the setup scripts have unmounted it. */
+                if (type == chroot::SETUP_STOP && status == 0 &&
+                    !get_loop_autoclear() && !get_loop_device().empty())
+                  loop_device::detach(get_loop_device(), get_filename());
+              }
+          }
+        catch (const loop_device::error& e)
+          {
+            throw error(owner->get_name(), e);
+          }
+#endif // SCHROOT_FEATURE_LOOPDEV
+
         /* Create or unlink session information. */
         if ((type == chroot::SETUP_START && lock == true) ||
             (type == chroot::SETUP_STOP && lock == false && status == 0))
@@ -179,13 +316,28 @@ namespace schroot
       loopback::get_details (format_detail& detail) const
       {
         if (!this->filename.empty())
-          detail.add(_("File"), get_filename());
+          detail.add(N_("File"), get_filename());
+#ifdef SCHROOT_FEATURE_LOOPDEV
+        if (!this->device.empty())
+          detail.add(N_("Loop Device"), get_loop_device());
+        detail.add(N_("Loop Device Read Only"), get_loop_read_only());
+        detail.add(N_("Loop Device Direct I/O"), get_loop_direct_io());
+        detail.add(N_("Loop Device Partition Scan"), get_loop_partscan());
+        detail.add(N_("Loop Device Automatic Detach"), get_loop_autoclear());
+#endif // SCHROOT_FEATURE_LOOPDEV
       }
 
       void
       loopback::get_used_keys (string_list& used_keys) const
       {
         used_keys.push_back("file");
+#ifdef SCHROOT_FEATURE_LOOPDEV
+        used_keys.push_back("loop-device");
+        used_keys.push_back("loop-read-only");
+        used_keys.push_back("loop-direct-io");
+        used_keys.push_back("loop-partscan");
+        used_keys.push_back("loop-autoclear");
+#endif // SCHROOT_FEATURE_LOOPDEV
       }
 
       void
@@ -193,6 +345,31 @@ namespace schroot
       {
         keyfile::set_object_value(*this, &loopback::get_filename,
                                   keyfile, owner->get_name(), "file");
+
+#ifdef SCHROOT_FEATURE_LOOPDEV
+        bool issession = static_cast<bool>(owner->get_facet<session>());
+
+        if (issession && !get_loop_device().empty())
+          keyfile::set_object_value(*this, &loopback::get_loop_device,
+                                    keyfile, owner->get_name(),
+                                    "loop-device");
+
+        keyfile::set_object_value(*this, &loopback::get_loop_read_only,
+                                  keyfile, owner->get_name(),
+                                  "loop-read-only");
+
+        keyfile::set_object_value(*this, &loopback::get_loop_direct_io,
+                                  keyfile, owner->get_name(),
+                                  "loop-direct-io");
+
+        keyfile::set_object_value(*this, &loopback::get_loop_partscan,
+                                  keyfile, owner->get_name(),
+                                  "loop-partscan");
+
+        keyfile::set_object_value(*this, &loopback::get_loop_autoclear,
+                                  keyfile, owner->get_name(),
+                                  "loop-autoclear");
+#endif // SCHROOT_FEATURE_LOOPDEV
       }
 
       void
@@ -201,6 +378,32 @@ namespace schroot
         keyfile::get_object_value(*this, &loopback::set_filename,
                                   keyfile, owner->get_name(), "file",
                                   keyfile::PRIORITY_REQUIRED);
+
+#ifdef SCHROOT_FEATURE_LOOPDEV
+        bool issession = static_cast<bool>(owner->get_facet<session>());
+
+        keyfile::get_object_value(*this, &loopback::set_loop_device,
+                                  keyfile, owner->get_name(), "loop-device",
+                                  issession ?
+                                  keyfile::PRIORITY_OPTIONAL :
+                                  keyfile::PRIORITY_DISALLOWED);
+
+        keyfile::get_object_value(*this, &loopback::set_loop_read_only,
+                                  keyfile, owner->get_name(), "loop-read-only",
+                                  keyfile::PRIORITY_OPTIONAL);
+
+        keyfile::get_object_value(*this, &loopback::set_loop_direct_io,
+                                  keyfile, owner->get_name(), "loop-direct-io",
+                                  keyfile::PRIORITY_OPTIONAL);
+
+        keyfile::get_object_value(*this, &loopback::set_loop_partscan,
+                                  keyfile, owner->get_name(), "loop-partscan",
+                                  keyfile::PRIORITY_OPTIONAL);
+
+        keyfile::get_object_value(*this, &loopback::set_loop_autoclear,
+                                  keyfile, owner->get_name(), "loop-autoclear",
+                                  keyfile::PRIORITY_OPTIONAL);
+#endif // SCHROOT_FEATURE_LOOPDEV
       }
 
       void
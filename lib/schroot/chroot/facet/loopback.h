@@ -23,6 +23,9 @@
 #include <schroot/chroot/facet/facet.h>
 #include <schroot/chroot/facet/session-setup.h>
 #include <schroot/chroot/facet/storage.h>
+#ifdef SCHROOT_FEATURE_LOOPDEV
+#include <schroot/loop-device.h>
+#endif // SCHROOT_FEATURE_LOOPDEV
 
 namespace schroot
 {
@@ -100,6 +103,100 @@ namespace schroot
         virtual std::string
         get_path () const;
 
+#ifdef SCHROOT_FEATURE_LOOPDEV
+        /**
+         * Get the loop device the file is attached to.  This is only
+         * set for active sessions.
+         *
+         * @returns the loop device name.
+         */
+        std::string const&
+        get_loop_device () const;
+
+        /**
+         * Set the loop device the file is attached to.
+         *
+         * @param device the loop device name.
+         */
+        void
+        set_loop_device (const std::string& device);
+
+        /**
+         * Get whether the file is attached read-only.
+         *
+         * @returns true if read-only, otherwise false.
+         */
+        bool
+        get_loop_read_only () const;
+
+        /**
+         * Set whether the file is attached read-only.  Read-only
+         * attachments are shared between all sessions using the
+         * file, and are mounted read-only.
+         *
+         * @param read_only true to attach read-only, otherwise false.
+         */
+        void
+        set_loop_read_only (bool read_only);
+
+        /**
+         * Get whether direct I/O is used on the file.
+         *
+         * @returns true if direct I/O is used, otherwise false.
+         */
+        bool
+        get_loop_direct_io () const;
+
+        /**
+         * Set whether direct I/O is used on the file.  Direct I/O
+         * bypasses the page cache of the filesystem containing the
+         * file, so that its contents are not cached twice.  It is
+         * silently disabled if the filesystem does not support it.
+         *
+         * @param direct_io true to use direct I/O, otherwise false.
+         */
+        void
+        set_loop_direct_io (bool direct_io);
+
+        /**
+         * Get whether the loop device is scanned for partitions.
+         *
+         * @returns true to scan for partitions, otherwise false.
+         */
+        bool
+        get_loop_partscan () const;
+
+        /**
+         * Set whether the loop device is scanned for partitions.
+         *
+         * @param partscan true to scan for partitions, otherwise
+         * false.
+         */
+        void
+        set_loop_partscan (bool partscan);
+
+        /**
+         * Get whether the loop device is detached automatically.
+         *
+         * @returns true to detach automatically, otherwise false.
+         */
+        bool
+        get_loop_autoclear () const;
+
+        /**
+         * Set whether the loop device is detached automatically.  If
+         * true, the kernel detaches the loop device once the last
+         * session using it has unmounted it.  Otherwise, each session
+         * detaches it when ending, and the kernel defers this until
+         * any other sessions have unmounted it.
+         *
+         * @param autoclear true to detach automatically, otherwise
+         * false.
+         */
+        void
+        set_loop_autoclear (bool autoclear);
+#endif // SCHROOT_FEATURE_LOOPDEV
+
         virtual void
         setup_env (environment& env) const;
 
@@ -131,6 +228,20 @@ namespace schroot
       private:
         /// The file to use.
         std::string filename;
+#ifdef SCHROOT_FEATURE_LOOPDEV
+        /// The attached loop device.
+        std::string device;
+        /// Attach read-only?
+        bool read_only;
+        /// Use direct I/O?
+        bool direct_io;
+        /// Scan for partitions?
+        bool partscan;
+        /// Detach automatically?
+        bool autoclear;
+        /// The loop device, held open while the setup scripts run.
+        std::shared_ptr<loop_device> attachment;
+#endif // SCHROOT_FEATURE_LOOPDEV
       };
 
     }
@@ -133,11 +133,11 @@ namespace schroot
       mountable::get_details (format_detail& detail) const
       {
         if (!get_mount_device().empty())
-          detail.add(_("Mount Device"), get_mount_device());
+          detail.add(N_("Mount Device"), get_mount_device());
         if (!get_mount_options().empty())
-          detail.add(_("Mount Options"), get_mount_options());
+          detail.add(N_("Mount Options"), get_mount_options());
         if (!get_location().empty())
-          detail.add(_("Location"), get_location());
+          detail.add(N_("Location"), get_location());
       }
 
       void
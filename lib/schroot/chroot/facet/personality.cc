@@ -93,7 +93,7 @@ namespace schroot
       {
         // TRANSLATORS: "Personality" is the Linux kernel personality
         // (process execution domain).  See schroot.conf(5).
-        detail.add(_("Personality"), get_persona().get_name());
+        detail.add(N_("Personality"), get_persona().get_name());
       }
 
       void
@@ -0,0 +1,328 @@
+/* Copyright © 2005-2013  Roger Leigh <rleigh@codelibre.net>
+ *
+ * schroot is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * schroot is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ *********************************************************************/
+
+
+#include <config.h>
+
+#include <schroot/chroot/facet/reflink-clone.h>
+#include <schroot/chroot/facet/directory.h>
+#include <schroot/chroot/facet/factory.h>
+#include <schroot/chroot/facet/session.h>
+#include <schroot/format-detail.h>
+#include <schroot/log.h>
+#include <schroot/reclaim.h>
+#include <schroot/reflink.h>
+
+#include <cassert>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+
+#include <boost/format.hpp>
+
+using std::endl;
+using boost::format;
+
+namespace schroot
+{
+  namespace chroot
+  {
+    namespace facet
+    {
+
+      namespace
+      {
+
+        const factory::facet_info reflink_clone_info =
+          {
+            "reflink-clone",
+            N_("Support for ‘reflink-clone’ chroots"),
+            false,
+            []() -> facet::ptr { return reflink_clone::create(); }
+          };
+
+        factory reflink_clone_register(reflink_clone_info);
+
+      }
+
+      reflink_clone::reflink_clone ():
+        snapshot_base(),
+        source_directory(),
+        clone_directory(),
+        clone_name(),
+        clone_jobs(0)
+      {
+      }
+
+      reflink_clone::reflink_clone (const reflink_clone& rhs):
+        snapshot_base(rhs),
+        source_directory(rhs.source_directory),
+        clone_directory(rhs.clone_directory),
+        clone_name(rhs.clone_name),
+        clone_jobs(rhs.clone_jobs)
+      {
+      }
+
+      reflink_clone::~reflink_clone ()
+      {
+      }
+
+      std::string const&
+      reflink_clone::get_name () const
+      {
+        return reflink_clone_info.name;
+      }
+
+      reflink_clone::ptr
+      reflink_clone::create ()
+      {
+        return ptr(new reflink_clone());
+      }
+
+      facet::ptr
+      reflink_clone::clone () const
+      {
+        return ptr(new reflink_clone(*this));
+      }
+
+      std::string const&
+      reflink_clone::get_source_directory () const
+      {
+        return this->source_directory;
+      }
+
+      void
+      reflink_clone::set_source_directory (const std::string& source_directory)
+      {
+        if (!is_absname(source_directory))
+          throw error(source_directory, chroot::DIRECTORY_ABS);
+
+        this->source_directory = source_directory;
+      }
+
+      std::string const&
+      reflink_clone::get_clone_directory () const
+      {
+        return this->clone_directory;
+      }
+
+      void
+      reflink_clone::set_clone_directory (const std::string& clone_directory)
+      {
+        if (!is_absname(clone_directory))
+          throw error(clone_directory, chroot::DIRECTORY_ABS);
+
+        this->clone_directory = clone_directory;
+      }
+
+      std::string const&
+      reflink_clone::get_clone_name () const
+      {
+        return this->clone_name;
+      }
+
+      void
+      reflink_clone::set_clone_name (const std::string& clone_name)
+      {
+        if (!is_absname(clone_name))
+          throw error(clone_name, chroot::DIRECTORY_ABS);
+
+        this->clone_name = clone_name;
+      }
+
+      unsigned int
+      reflink_clone::get_clone_jobs () const
+      {
+        return this->clone_jobs;
+      }
+
+      void
+      reflink_clone::set_clone_jobs (unsigned int clone_jobs)
+      {
+        this->clone_jobs = clone_jobs;
+      }
+
+      void
+      reflink_clone::setup_env (environment& env) const
+      {
+        env.add("CHROOT_REFLINK_SOURCE_DIRECTORY", get_source_directory());
+        env.add("CHROOT_REFLINK_CLONE_DIRECTORY", get_clone_directory());
+        env.add("CHROOT_REFLINK_CLONE_NAME", get_clone_name());
+      }
+
+      std::string const&
+      reflink_clone::get_snapshot_path () const
+      {
+        return get_clone_name();
+      }
+
+      reclaim::item_type
+      reflink_clone::get_reclaim_type () const
+      {
+        return reclaim::DIRECTORY_TREE;
+      }
+
+      void
+      reflink_clone::create_snapshot ()
+      {
+        log_debug(DEBUG_INFO)
+          << format("Creating clone %1% from directory %2%")
+          % get_clone_name() % get_source_directory() << endl;
+
+        try
+          {
+            reflink::clone_tree(get_source_directory(), get_clone_name(),
+                                get_clone_jobs());
+          }
+        catch (const reflink::error& e)
+          {
+            throw error(owner->get_name(), e);
+          }
+      }
+
+      bool
+      reflink_clone::destroy_snapshot ()
+      {
+        try
+          {
+            return reclaim::remove_tree(get_clone_name());
+          }
+        catch (const reclaim::error& e)
+          {
+            throw error(owner->get_name(), e);
+          }
+      }
+
+      void
+      reflink_clone::get_details (format_detail& detail) const
+      {
+        if (!this->get_source_directory().empty())
+          detail.add(N_("Reflink Source Directory"), get_source_directory());
+        if (!this->get_clone_directory().empty())
+          detail.add(N_("Reflink Clone Directory"), get_clone_directory());
+        if (!this->get_clone_name().empty())
+          detail.add(N_("Reflink Clone Name"), get_clone_name());
+        detail.add(N_("Reflink Clone Jobs"), get_clone_jobs());
+        detail.add(N_("Reflink Asynchronous Reclaim"), get_async_reclaim());
+      }
+
+      void
+      reflink_clone::get_used_keys (string_list& used_keys) const
+      {
+        used_keys.push_back("reflink-source-directory");
+        used_keys.push_back("reflink-clone-directory");
+        used_keys.push_back("reflink-clone-name");
+        used_keys.push_back("reflink-clone-jobs");
+        used_keys.push_back("reflink-async-reclaim");
+      }
+
+      void
+      reflink_clone::get_keyfile (keyfile& keyfile) const
+      {
+        bool issession = static_cast<bool>(owner->get_facet<session>());
+
+        if (!issession)
+          keyfile::set_object_value(*this,
+                                    &reflink_clone::get_source_directory,
+                                    keyfile, owner->get_name(),
+                                    "reflink-source-directory");
+
+        if (!issession)
+          keyfile::set_object_value(*this,
+                                    &reflink_clone::get_clone_directory,
+                                    keyfile, owner->get_name(),
+                                    "reflink-clone-directory");
+
+        if (issession)
+          keyfile::set_object_value(*this,
+                                    &reflink_clone::get_clone_name,
+                                    keyfile, owner->get_name(),
+                                    "reflink-clone-name");
+
+        keyfile::set_object_value(*this,
+                                  &reflink_clone::get_clone_jobs,
+                                  keyfile, owner->get_name(),
+                                  "reflink-clone-jobs");
+
+        keyfile::set_object_value(static_cast<const snapshot_base&>(*this),
+                                  &snapshot_base::get_async_reclaim,
+                                  keyfile, owner->get_name(),
+                                  "reflink-async-reclaim");
+      }
+
+      void
+      reflink_clone::set_keyfile (const keyfile& keyfile)
+      {
+        bool issession = static_cast<bool>(owner->get_facet<session>());
+
+        keyfile::get_object_value(*this, &reflink_clone::set_source_directory,
+                                  keyfile, owner->get_name(), "reflink-source-directory",
+                                  issession ?
+                                  keyfile::PRIORITY_DISALLOWED :
+                                  keyfile::PRIORITY_REQUIRED
+                                  ); // Only needed for creating clone, not using clone
+
+        keyfile::get_object_value(*this, &reflink_clone::set_clone_directory,
+                                  keyfile, owner->get_name(), "reflink-clone-directory",
+                                  issession ?
+                                  keyfile::PRIORITY_DISALLOWED :
+                                  keyfile::PRIORITY_REQUIRED
+                                  ); // Only needed for creating clone, not using clone
+
+        keyfile::get_object_value(*this, &reflink_clone::set_clone_name,
+                                  keyfile, owner->get_name(), "reflink-clone-name",
+                                  issession ?
+                                  keyfile::PRIORITY_REQUIRED :
+                                  keyfile::PRIORITY_DISALLOWED);
+
+        keyfile::get_object_value(*this, &reflink_clone::set_clone_jobs,
+                                  keyfile, owner->get_name(), "reflink-clone-jobs",
+                                  keyfile::PRIORITY_OPTIONAL);
+
+        keyfile::get_object_value(static_cast<snapshot_base&>(*this),
+                                  &snapshot_base::set_async_reclaim,
+                                  keyfile, owner->get_name(), "reflink-async-reclaim",
+                                  keyfile::PRIORITY_OPTIONAL);
+      }
+
+      void
+      reflink_clone::chroot_session_setup (const chroot&      parent,
+                                           const std::string& session_id,
+                                           const std::string& alias,
+                                           const std::string& user,
+                                           bool               root)
+      {
+        // Reflink clones need the clone name specifying.
+        if (!get_clone_directory().empty())
+          {
+            std::string clonename(get_clone_directory());
+            clonename += "/" + owner->get_name();
+            set_clone_name(clonename);
+          }
+      }
+
+      void
+      reflink_clone::chroot_source_setup (const chroot& parent)
+      {
+        storage::ptr source_directory(directory::create(*this));
+        owner->replace_facet<storage>(source_directory);
+      }
+
+    }
+  }
+}
@@ -0,0 +1,209 @@
+/* Copyright © 2005-2013  Roger Leigh <rleigh@codelibre.net>
+ *
+ * schroot is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * schroot is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ *********************************************************************/
+
+
+#ifndef SCHROOT_CHROOT_FACET_REFLINK_CLONE_H
+#define SCHROOT_CHROOT_FACET_REFLINK_CLONE_H
+
+#include <schroot/chroot/chroot.h>
+#include <schroot/chroot/facet/snapshot-base.h>
+
+namespace schroot
+{
+  namespace chroot
+  {
+    namespace facet
+    {
+
+      /**
+       * A chroot cloned from a directory using reflinks.
+       *
+       * The source directory tree is cloned into a new directory
+       * when a session is started, and the clone is deleted when the
+       * session is ended.  On filesystems supporting reflinks, such
+       * as XFS and Btrfs, the clone shares its data with the source
+       * directory until modified.
+       */
+      class reflink_clone : public snapshot_base
+      {
+      public:
+        /// Exception type.
+        typedef chroot::error error;
+
+        /// A shared_ptr to a chroot facet object.
+        typedef std::shared_ptr<reflink_clone> ptr;
+
+        /// A shared_ptr to a const chroot facet object.
+        typedef std::shared_ptr<const reflink_clone> const_ptr;
+
+      protected:
+        /// The constructor.
+        reflink_clone ();
+
+        /// The copy constructor.
+        reflink_clone (const reflink_clone& rhs);
+
+        friend class chroot;
+
+      public:
+        /// The destructor.
+        virtual ~reflink_clone ();
+
+        virtual std::string const&
+        get_name () const;
+
+        /**
+         * Create a chroot facet.
+         *
+         * @returns a shared_ptr to the new chroot facet.
+         */
+        static ptr
+        create ();
+
+        facet::ptr
+        clone () const;
+
+        /**
+         * Get the source directory.  This is the directory from which
+         * session clones are created.
+         *
+         * @returns the source directory.
+         */
+        std::string const&
+        get_source_directory () const;
+
+        /**
+         * Set the source directory.  This is the directory from which
+         * session clones are created.
+         *
+         * @param source_directory the source directory.
+         */
+        void
+        set_source_directory (const std::string& source_directory);
+
+        /**
+         * Get the clone directory.  Session clones are created in
+         * this directory, which must be on the same filesystem as
+         * the source directory for data to be shared.
+         *
+         * @returns the directory.
+         */
+        std::string const&
+        get_clone_directory () const;
+
+        /**
+         * Set the clone directory.
+         *
+         * @param clone_directory the clone directory.
+         */
+        void
+        set_clone_directory (const std::string& clone_directory);
+
+        /**
+         * Get the clone name.  This is the full path to the clone.
+         *
+         * @returns the name.
+         */
+        std::string const&
+        get_clone_name () const;
+
+        /**
+         * Set the clone name.  This is the full path to the clone.
+         *
+         * @param clone_name the clone name.
+         */
+        void
+        set_clone_name (const std::string& clone_name);
+
+        /**
+         * Get the number of threads used to clone the source directory.
+         *
+         * @returns the number of threads, or 0 to use one per CPU.
+         */
+        unsigned int
+        get_clone_jobs () const;
+
+        /**
+         * Set the number of threads used to clone the source directory.
+         *
+         * @param clone_jobs the number of threads, or 0 to use one
+         * per CPU.
+         */
+        void
+        set_clone_jobs (unsigned int clone_jobs);
+
+        virtual void
+        setup_env (environment& env) const;
+
+      protected:
+        virtual void
+        get_details (format_detail& detail) const;
+
+        virtual void
+        get_used_keys (string_list& used_keys) const;
+
+        virtual void
+        get_keyfile (keyfile& keyfile) const;
+
+        virtual void
+        set_keyfile (const keyfile& keyfile);
+
+        virtual void
+        chroot_session_setup (const chroot&      parent,
+                              const std::string& session_id,
+                              const std::string& alias,
+                              const std::string& user,
+                              bool               root);
+
+        virtual void
+        chroot_source_setup (const chroot& parent);
+
+        virtual std::string const&
+        get_snapshot_path () const;
+
+        virtual reclaim::item_type
+        get_reclaim_type () const;
+
+        virtual void
+        create_snapshot ();
+
+        virtual bool
+        destroy_snapshot ();
+
+      private:
+        /// Source directory
+        std::string source_directory;
+        /// Clone directory
+        std::string clone_directory;
+        /// Clone name
+        std::string clone_name;
+        /// Number of cloning threads
+        unsigned int clone_jobs;
+      };
+
+    }
+  }
+}
+
+#endif /* SCHROOT_CHROOT_FACET_REFLINK_CLONE_H */
+
+/*
+ * Local Variables:
+ * mode:C++
+ * End:
+ */
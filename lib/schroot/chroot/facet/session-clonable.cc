@@ -57,7 +57,8 @@ namespace schroot
       }
 
       session_clonable::session_clonable ():
-        facet()
+        facet(),
+        session_pool_size(0)
       {
       }
 
@@ -83,6 +84,51 @@ namespace schroot
         return session_clonable_info.name;
       }
 
+      unsigned int
+      session_clonable::get_session_pool_size () const
+      {
+        return this->session_pool_size;
+      }
+
+      void
+      session_clonable::set_session_pool_size (unsigned int size)
+      {
+        this->session_pool_size = size;
+      }
+
+      void
+      session_clonable::get_details (format_detail& detail) const
+      {
+        if (get_session_pool_size() > 0)
+          detail.add(N_("Session Pool Size"), get_session_pool_size());
+      }
+
+      void
+      session_clonable::get_used_keys (string_list& used_keys) const
+      {
+        used_keys.push_back("session-pool-size");
+      }
+
+      void
+      session_clonable::get_keyfile (keyfile& keyfile) const
+      {
+        if (get_session_pool_size() > 0)
+          keyfile::set_object_value(*this,
+                                    &session_clonable::get_session_pool_size,
+                                    keyfile, owner->get_name(),
+                                    "session-pool-size");
+      }
+
+      void
+      session_clonable::set_keyfile (const keyfile& keyfile)
+      {
+        keyfile::get_object_value(*this,
+                                  &session_clonable::set_session_pool_size,
+                                  keyfile, owner->get_name(),
+                                  "session-pool-size",
+                                  keyfile::PRIORITY_OPTIONAL);
+      }
+
       chroot::ptr
       session_clonable::clone_session (const std::string& session_id,
                                        const std::string& alias,
@@ -108,24 +154,7 @@ namespace schroot
         clone->set_description
           (clone->get_description() + ' ' + _("(session chroot)"));
 
-        string_list empty_list;
-        string_list allowed_users;
-        if (!user.empty())
-          allowed_users.push_back(user);
-
-        if (root)
-          {
-            clone->set_users(empty_list);
-            clone->set_root_users(allowed_users);
-          }
-        else
-          {
-            clone->set_users(allowed_users);
-            clone->set_root_users(empty_list);
-          }
-        clone->set_groups(empty_list);
-        clone->set_root_groups(empty_list);
-        clone->set_aliases(empty_list);
+        psess->set_session_user(user, root);
 
         log_debug(DEBUG_INFO)
           << format("Cloned session %1%")
@@ -69,6 +69,36 @@ namespace schroot
         virtual session_flags
         get_session_flags () const;
 
+        /**
+         * Get the session pool size.  This is the number of sessions
+         * which will be kept set up in advance, ready to be claimed
+         * when a new session is begun.
+         *
+         * @returns the pool size (0 if pooling is disabled).
+         */
+        unsigned int
+        get_session_pool_size () const;
+
+        /**
+         * Set the session pool size.
+         *
+         * @param size the pool size (0 to disable pooling).
+         */
+        void
+        set_session_pool_size (unsigned int size);
+
+        virtual void
+        get_details (format_detail& detail) const;
+
+        virtual void
+        get_used_keys (string_list& used_keys) const;
+
+        virtual void
+        get_keyfile (keyfile& keyfile) const;
+
+        virtual void
+        set_keyfile (const keyfile& keyfile);
+
         /**
          * Clone a session chroot.
          *
@@ -83,6 +113,10 @@ namespace schroot
                        const std::string& alias,
                        const std::string& user,
                        bool               root) const;
+
+      private:
+        /// Number of sessions to set up in advance.
+        unsigned int session_pool_size;
       };
 
     }
@@ -27,6 +27,8 @@
 #include <schroot/lock.h>
 #include <schroot/fdstream.h>
 #include <schroot/format-detail.h>
+#include <schroot/metrics.h>
+#include <schroot/util.h>
 
 #include <cassert>
 
@@ -65,6 +67,9 @@ namespace schroot
         facet(),
         original_chroot_name(),
         selected_chroot_name(),
+        driver_pid(0),
+        driver_start_time(0),
+        ending(false),
         parent_chroot(parent_chroot)
       {
       }
@@ -124,6 +129,84 @@ namespace schroot
         this->selected_chroot_name = shortname;
       }
 
+      void
+      session::set_session_user (const std::string& user,
+                                 bool               root)
+      {
+        string_list empty_list;
+        string_list allowed_users;
+        if (!user.empty())
+          allowed_users.push_back(user);
+
+        if (root)
+          {
+            owner->set_users(empty_list);
+            owner->set_root_users(allowed_users);
+          }
+        else
+          {
+            owner->set_users(allowed_users);
+            owner->set_root_users(empty_list);
+          }
+        owner->set_groups(empty_list);
+        owner->set_root_groups(empty_list);
+        owner->set_aliases(empty_list);
+      }
+
+      pid_t
+      session::get_driver_pid () const
+      {
+        return this->driver_pid;
+      }
+
+      void
+      session::set_driver_pid (pid_t pid)
+      {
+        this->driver_pid = pid;
+      }
+
+      unsigned long long
+      session::get_driver_start_time () const
+      {
+        return this->driver_start_time;
+      }
+
+      void
+      session::set_driver_start_time (unsigned long long start_time)
+      {
+        this->driver_start_time = start_time;
+      }
+
+      void
+      session::set_driver (pid_t pid)
+      {
+        this->driver_pid = pid;
+        this->driver_start_time = process_start_time(pid);
+      }
+
+      bool
+      session::driver_alive () const
+      {
+        // The init process is not a driver; it is the parent of
+        // processes which have been orphaned.
+        if (this->driver_pid <= 1 || this->driver_start_time == 0)
+          return true;
+
+        return process_start_time(this->driver_pid) == this->driver_start_time;
+      }
+
+      bool
+      session::get_ending () const
+      {
+        return this->ending;
+      }
+
+      void
+      session::set_ending (bool ending)
+      {
+        this->ending = ending;
+      }
+
       const chroot::ptr&
       session::get_parent_chroot() const
       {
@@ -134,7 +217,7 @@ namespace schroot
       session::setup_session_info (bool start)
       {
         /* Create or unlink session information. */
-        std::string file = std::string(SCHROOT_SESSION_DIR) + "/" + owner->get_name();
+        std::string file = get_session_info_file();
 
         if (start)
           {
@@ -151,7 +234,7 @@ namespace schroot
 #endif
             output.imbue(std::locale::classic());
 
-            file_lock lock(fd);
+            ofd_lock lock(fd);
             try
               {
                 lock.set_lock(lock::LOCK_EXCLUSIVE, 2);
@@ -173,14 +256,78 @@ namespace schroot
               {
                 throw error(file, chroot::FILE_UNLOCK, e);
               }
+
+            metrics::session_begin(owner->get_name(),
+                                   get_original_name().empty() ?
+                                   owner->get_name() : get_original_name());
           }
         else /* start == false */
           {
             if (unlink(file.c_str()) != 0)
               throw error(file, chroot::SESSION_UNLINK, strerror(errno));
+
+            metrics::session_end(owner->get_name());
+          }
+      }
+
+      void
+      session::update_session_info ()
+      {
+        std::string file = get_session_info_file();
+        // Hidden files are not valid session names, so a partially
+        // written file is never loaded as a session.
+        std::string tmpfile = std::string(SCHROOT_SESSION_DIR) + "/." +
+          owner->get_name() + ".new";
+
+        int fd = open(tmpfile.c_str(), O_CREAT|O_TRUNC|O_WRONLY, 0664);
+        if (fd < 0)
+          throw error(tmpfile, chroot::SESSION_WRITE, strerror(errno));
+
+        {
+          // Create a stream from the file descriptor.  The fd will be
+          // closed when the stream is destroyed.
+#ifdef BOOST_IOSTREAMS_CLOSE_HANDLE_OLD
+          fdostream output(fd, true);
+#else
+          fdostream output(fd, boost::iostreams::close_handle);
+#endif
+          output.imbue(std::locale::classic());
+
+          keyfile details;
+          owner->get_keyfile(details);
+          output << keyfile_writer(details);
+          output.flush();
+          if (!output)
+            {
+              unlink(tmpfile.c_str());
+              throw error(tmpfile, chroot::SESSION_WRITE);
+            }
+        }
+
+        if (rename(tmpfile.c_str(), file.c_str()) != 0)
+          {
+            int saved_errno = errno;
+            unlink(tmpfile.c_str());
+            throw error(file, chroot::SESSION_WRITE, strerror(saved_errno));
           }
       }
 
+      std::string
+      session::get_session_info_file () const
+      {
+        return std::string(SCHROOT_SESSION_DIR) + "/" + owner->get_name();
+      }
+
+      void
+      session::touch_session_info () const
+      {
+        std::string file = get_session_info_file();
+        if (utimensat(AT_FDCWD, file.c_str(), nullptr, 0) != 0)
+          log_debug(DEBUG_WARNING)
+            << "Failed to update session file " << file << ": "
+            << strerror(errno) << endl;
+      }
+
       facet::session_flags
       session::get_session_flags () const
       {
@@ -202,17 +349,26 @@ namespace schroot
 
         if (!get_selected_name().empty())
           env.add("CHROOT_ALIAS", get_selected_name());
+
+        // Storage of an ending session is queued for reclaim in the
+        // background, rather than removed by the setup scripts.
+        env.add("CHROOT_SESSION_RECLAIM",
+                get_ending() ? "deferred" : "immediate");
       }
 
       void
       session::get_details (format_detail& detail) const
       {
         if (!get_original_name().empty())
-          detail.add(_("Original Chroot Name"), get_original_name());
+          detail.add(N_("Original Chroot Name"), get_original_name());
         if (!get_original_name().empty())
-          detail.add(_("Selected Chroot Name"), get_selected_name());
+          detail.add(N_("Selected Chroot Name"), get_selected_name());
         if (!owner->get_name().empty())
-          detail.add(_("Session ID"), owner->get_name());
+          detail.add(N_("Session ID"), owner->get_name());
+        if (get_driver_pid() > 0)
+          detail.add(N_("Session Driver PID"), get_driver_pid());
+        if (get_ending())
+          detail.add(N_("Session Ending"), get_ending());
       }
 
       void
@@ -225,6 +381,9 @@ namespace schroot
         used_keys.push_back("source-root-groups");
         used_keys.push_back("original-name");
         used_keys.push_back("selected-name");
+        used_keys.push_back("driver-pid");
+        used_keys.push_back("driver-start-time");
+        used_keys.push_back("ending");
       }
 
       void
@@ -237,6 +396,22 @@ namespace schroot
         keyfile::set_object_value(*this, &session::get_selected_name,
                                   keyfile, owner->get_name(),
                                   "selected-name");
+
+        if (get_driver_pid() > 0)
+          {
+            keyfile::set_object_value(*this, &session::get_driver_pid,
+                                      keyfile, owner->get_name(),
+                                      "driver-pid");
+
+            keyfile::set_object_value(*this, &session::get_driver_start_time,
+                                      keyfile, owner->get_name(),
+                                      "driver-start-time");
+          }
+
+        if (get_ending())
+          keyfile::set_object_value(*this, &session::get_ending,
+                                    keyfile, owner->get_name(),
+                                    "ending");
       }
 
       void
@@ -251,6 +426,21 @@ namespace schroot
                                   keyfile, owner->get_name(),
                                   "selected-name",
                                   keyfile::PRIORITY_OPTIONAL);
+
+        keyfile::get_object_value(*this, &session::set_driver_pid,
+                                  keyfile, owner->get_name(),
+                                  "driver-pid",
+                                  keyfile::PRIORITY_OPTIONAL);
+
+        keyfile::get_object_value(*this, &session::set_driver_start_time,
+                                  keyfile, owner->get_name(),
+                                  "driver-start-time",
+                                  keyfile::PRIORITY_OPTIONAL);
+
+        keyfile::get_object_value(*this, &session::set_ending,
+                                  keyfile, owner->get_name(),
+                                  "ending",
+                                  keyfile::PRIORITY_OPTIONAL);
       }
 
     }
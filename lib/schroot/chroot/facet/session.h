@@ -113,6 +113,90 @@ namespace schroot
         void
         set_selected_name (const std::string& name);
 
+        /**
+         * Restrict access to the session to a single user.  All
+         * other users, groups and aliases are removed.
+         *
+         * @param user the user permitted to use the session.
+         * @param root true if the user has root access, otherwise
+         * false.
+         */
+        void
+        set_session_user (const std::string& user,
+                          bool               root);
+
+        /**
+         * Get the process ID of the session driver, the process which
+         * began the session.
+         *
+         * @returns the process ID, or 0 if unknown.
+         */
+        pid_t
+        get_driver_pid () const;
+
+        /**
+         * Set the process ID of the session driver.
+         *
+         * @param pid the process ID.
+         */
+        void
+        set_driver_pid (pid_t pid);
+
+        /**
+         * Get the start time of the session driver, to detect reuse
+         * of its process ID.
+         *
+         * @returns the start time (see process_start_time()), or 0 if
+         * unknown.
+         */
+        unsigned long long
+        get_driver_start_time () const;
+
+        /**
+         * Set the start time of the session driver.
+         *
+         * @param start_time the start time.
+         */
+        void
+        set_driver_start_time (unsigned long long start_time);
+
+        /**
+         * Set the session driver to an existing process, recording
+         * its process ID and start time.
+         *
+         * @param pid the process ID.
+         */
+        void
+        set_driver (pid_t pid);
+
+        /**
+         * Check if the session driver is still running.
+         *
+         * @returns true if the driver is running or unknown, or false
+         * if it has exited.
+         */
+        bool
+        driver_alive () const;
+
+        /**
+         * Check if the session is ending.  An ending session has been
+         * detached by an asynchronous session end; its storage is
+         * reclaimed in the background.
+         *
+         * @returns true if the session is ending, otherwise false.
+         */
+        bool
+        get_ending () const;
+
+        /**
+         * Set whether the session is ending.
+         *
+         * @param ending true if the session is ending, otherwise
+         * false.
+         */
+        void
+        set_ending (bool ending);
+
         /**
          * Get parent chroot.
          *
@@ -130,6 +214,31 @@ namespace schroot
         void
         setup_session_info (bool start);
 
+        /**
+         * Rewrite the persistent session information, to record a
+         * change of session state.  The file is replaced atomically,
+         * so that it is never seen partially written.
+         */
+        void
+        update_session_info ();
+
+        /**
+         * Get the file containing the persistent session information.
+         *
+         * @returns the filename.
+         */
+        std::string
+        get_session_info_file () const;
+
+        /**
+         * Record use of the session by updating the modification time
+         * of the persistent session information.  This is used to
+         * determine how long a session has been idle.  Failure is not
+         * an error.
+         */
+        void
+        touch_session_info () const;
+
         virtual session_flags
         get_session_flags () const;
 
@@ -153,6 +262,12 @@ namespace schroot
         std::string  original_chroot_name;
         /// Selected chroot name.
         std::string  selected_chroot_name;
+        /// Session driver process ID.
+        pid_t        driver_pid;
+        /// Session driver start time.
+        unsigned long long driver_start_time;
+        /// Session ending.
+        bool         ending;
         /// Parent chroot.
         const chroot::ptr parent_chroot;
       };
@@ -0,0 +1,172 @@
+/* Copyright © 2005-2013  Roger Leigh <rleigh@codelibre.net>
+ *
+ * schroot is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * schroot is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ *********************************************************************/
+
+#include <config.h>
+
+#include <schroot/chroot/facet/snapshot-base.h>
+#include <schroot/chroot/facet/session-clonable.h>
+#include <schroot/chroot/facet/session.h>
+#include <schroot/chroot/facet/source-clonable.h>
+#include <schroot/log.h>
+
+#include <boost/format.hpp>
+
+using std::endl;
+using boost::format;
+
+namespace schroot
+{
+  namespace chroot
+  {
+    namespace facet
+    {
+
+      snapshot_base::snapshot_base ():
+        facet(),
+        storage(),
+        async_reclaim(false)
+      {
+      }
+
+      snapshot_base::snapshot_base (const snapshot_base& rhs):
+        facet(rhs),
+        storage(rhs),
+        session_setup(rhs),
+        source_setup(rhs),
+        async_reclaim(rhs.async_reclaim)
+      {
+      }
+
+      snapshot_base::~snapshot_base ()
+      {
+      }
+
+      void
+      snapshot_base::set_chroot (chroot& chroot,
+                                 bool    copy)
+      {
+        facet::set_chroot(chroot, copy);
+
+        if (!copy && !owner->get_facet<session_clonable>())
+          owner->add_facet(session_clonable::create());
+
+        if (!copy && !owner->get_facet<source_clonable>())
+          owner->add_facet(source_clonable::create());
+      }
+
+      bool
+      snapshot_base::get_async_reclaim () const
+      {
+        return this->async_reclaim;
+      }
+
+      void
+      snapshot_base::set_async_reclaim (bool async_reclaim)
+      {
+        this->async_reclaim = async_reclaim;
+      }
+
+      std::string
+      snapshot_base::get_path () const
+      {
+        return owner->get_mount_location();
+      }
+
+      facet::session_flags
+      snapshot_base::get_session_flags () const
+      {
+        session_flags flags = SESSION_NOFLAGS;
+
+        if (owner->get_facet<session>())
+          flags = flags | SESSION_PURGE;
+
+        return flags;
+      }
+
+      void
+      snapshot_base::setup_lock (chroot::setup_type type,
+                                 bool               lock,
+                                 int                status)
+      {
+        /* Create or unlink session information. */
+        if ((type == chroot::SETUP_START && lock == true) ||
+            (type == chroot::SETUP_STOP && lock == false && status == 0))
+          {
+            bool start = (type == chroot::SETUP_START);
+
+            /* Delete the snapshot once the setup scripts have
+               unmounted it, but before removing the session
+               information, so that a failed deletion may be retried
+               by ending the session again. */
+            if (!start)
+              delete_snapshot();
+
+            owner->get_facet_strict<session>()->setup_session_info(start);
+
+            /* Create the snapshot before the setup scripts mount it.
+               Session information is written first, so that the
+               snapshot is always recorded for cleanup. */
+            if (start)
+              create_snapshot();
+          }
+      }
+
+      void
+      snapshot_base::delete_snapshot ()
+      {
+        const std::string& path(get_snapshot_path());
+        bool deleted;
+
+        try
+          {
+            session::const_ptr psess(owner->get_facet<session>());
+            if (get_async_reclaim() || (psess && psess->get_ending()))
+              {
+                /* Detach the snapshot by renaming it out of the way,
+                   so that the session name may be reused at once,
+                   and queue it for deletion. */
+                log_debug(DEBUG_INFO)
+                  << format("Queueing %1% for deletion") % path << endl;
+
+                reclaim queue;
+                deleted = queue.defer(get_reclaim_type(), path);
+                if (deleted)
+                  queue.run_background();
+              }
+            else
+              {
+                log_debug(DEBUG_INFO)
+                  << format("Deleting %1%") % path << endl;
+
+                deleted = destroy_snapshot();
+              }
+          }
+        catch (const reclaim::error& e)
+          {
+            throw error(owner->get_name(), e);
+          }
+
+        if (!deleted)
+          log_warning()
+            << format(_("%1% does not exist (it may have been removed previously)"))
+            % path << endl;
+      }
+
+    }
+  }
+}
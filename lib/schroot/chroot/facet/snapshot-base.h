@@ -0,0 +1,163 @@
+/* Copyright © 2005-2013  Roger Leigh <rleigh@codelibre.net>
+ *
+ * schroot is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * schroot is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ *********************************************************************/
+
+#ifndef SCHROOT_CHROOT_FACET_SNAPSHOT_BASE_H
+#define SCHROOT_CHROOT_FACET_SNAPSHOT_BASE_H
+
+#include <schroot/chroot/chroot.h>
+#include <schroot/chroot/facet/facet.h>
+#include <schroot/chroot/facet/storage.h>
+#include <schroot/chroot/facet/session-setup.h>
+#include <schroot/chroot/facet/source-setup.h>
+#include <schroot/reclaim.h>
+
+namespace schroot
+{
+  namespace chroot
+  {
+    namespace facet
+    {
+
+      /**
+       * A base class for chroots whose sessions use a snapshot of
+       * the source chroot.
+       *
+       * The snapshot is created when a session is started, before
+       * the setup scripts mount it, and deleted when the session is
+       * ended, after the setup scripts have unmounted it.  Deletion
+       * may be deferred to the reclaim queue.
+       *
+       * This class doesn't implement a chroot (get_chroot_type is not
+       * implemented).  btrfs-snapshot and reflink-clone chroots
+       * inherit from this class.
+       */
+      class snapshot_base : public facet,
+                            public storage,
+                            public session_setup,
+                            public source_setup
+      {
+      public:
+        /// Exception type.
+        typedef chroot::error error;
+
+      protected:
+        /// The constructor.
+        snapshot_base ();
+
+        /// The copy constructor.
+        snapshot_base (const snapshot_base& rhs);
+
+        void
+        set_chroot (chroot& chroot,
+                    bool    copy);
+
+        friend class chroot;
+
+      public:
+        /// The destructor.
+        virtual ~snapshot_base ();
+
+        /**
+         * Get whether snapshot deletion is asynchronous.  If true,
+         * ending a session detaches the snapshot and queues it for
+         * deletion by a background process, rather than waiting for
+         * the deletion to complete.
+         *
+         * @returns true if reclaim is asynchronous, otherwise false.
+         */
+        bool
+        get_async_reclaim () const;
+
+        /**
+         * Set whether snapshot deletion is asynchronous.
+         *
+         * @param async_reclaim true if reclaim is asynchronous,
+         * otherwise false.
+         */
+        void
+        set_async_reclaim (bool async_reclaim);
+
+        virtual std::string
+        get_path () const;
+
+        virtual session_flags
+        get_session_flags () const;
+
+      protected:
+        virtual void
+        setup_lock (chroot::setup_type type,
+                    bool               lock,
+                    int                status);
+
+        /**
+         * Get the full path to the session snapshot.
+         *
+         * @returns the path.
+         */
+        virtual std::string const&
+        get_snapshot_path () const = 0;
+
+        /**
+         * Get the type of reclaim queue item used to defer deletion
+         * of the session snapshot.
+         *
+         * @returns the item type.
+         */
+        virtual reclaim::item_type
+        get_reclaim_type () const = 0;
+
+        /**
+         * Create the session snapshot from the source chroot.  No
+         * partial snapshot may be left behind on failure.
+         */
+        virtual void
+        create_snapshot () = 0;
+
+        /**
+         * Delete the session snapshot now.
+         *
+         * @returns true if the snapshot was deleted, or false if it
+         * did not exist.
+         */
+        virtual bool
+        destroy_snapshot () = 0;
+
+      private:
+        /**
+         * Delete the session snapshot, or queue it for deletion if
+         * asynchronous reclaim is enabled or the session is ending
+         * asynchronously.
+         */
+        void
+        delete_snapshot ();
+
+        /// Delete snapshot asynchronously?
+        bool async_reclaim;
+      };
+
+    }
+  }
+}
+
+#endif /* SCHROOT_CHROOT_FACET_SNAPSHOT_BASE_H */
+
+/*
+ * Local Variables:
+ * mode:C++
+ * End:
+ */
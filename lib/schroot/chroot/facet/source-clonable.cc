@@ -21,8 +21,11 @@
 #include <schroot/chroot/chroot.h>
 #include <schroot/chroot/facet/factory.h>
 #include <schroot/chroot/facet/session.h>
+#include <schroot/chroot/facet/session-clonable.h>
 #include <schroot/chroot/facet/source-clonable.h>
 #include <schroot/chroot/facet/source.h>
+#include <schroot/lease.h>
+#include <schroot/log.h>
 #ifdef SCHROOT_FEATURE_UNION
 #include <schroot/chroot/facet/fsunion.h>
 #endif // SCHROOT_FEATURE_UNION
@@ -60,7 +63,8 @@ namespace schroot
         source_users(),
         source_groups(),
         source_root_users(),
-        source_root_groups()
+        source_root_groups(),
+        source_lease_timeout(600)
       {
       }
 
@@ -146,6 +150,18 @@ namespace schroot
         this->source_root_groups = groups;
       }
 
+      unsigned int
+      source_clonable::get_source_lease_timeout () const
+      {
+        return this->source_lease_timeout;
+      }
+
+      void
+      source_clonable::set_source_lease_timeout (unsigned int timeout)
+      {
+        this->source_lease_timeout = timeout;
+      }
+
       facet::session_flags
       source_clonable::get_session_flags () const
       {
@@ -164,16 +180,39 @@ namespace schroot
         used_keys.push_back("source-groups");
         used_keys.push_back("source-root-users");
         used_keys.push_back("source-root-groups");
+        used_keys.push_back("source-lease-timeout");
       }
 
       void
       source_clonable::get_details (format_detail& detail) const
       {
         detail
-          .add(_("Source Users"), get_source_users())
-          .add(_("Source Groups"), get_source_groups())
-          .add(_("Source Root Users"), get_source_root_users())
-          .add(_("Source Root Groups"), get_source_root_groups());
+          .add(N_("Source Users"), get_source_users())
+          .add(N_("Source Groups"), get_source_groups())
+          .add(N_("Source Root Users"), get_source_root_users())
+          .add(N_("Source Root Groups"), get_source_root_groups())
+          .add(N_("Source Lease Timeout"), get_source_lease_timeout());
+
+        // Sessions do not take leases, so only report the state for
+        // the chroot itself.
+        if (owner->get_facet<session>())
+          return;
+
+        string_list holders;
+        string_list waiters;
+        try
+          {
+            for (const auto& t : lease(owner->get_name()).get_tickets())
+              (t.granted ? holders : waiters).push_back(lease::describe(t));
+          }
+        catch (const lease::error& e)
+          {
+            log_exception_warning(e);
+          }
+
+        detail
+          .add(N_("Source Lease Holders"), holders)
+          .add(N_("Source Lease Waiters"), waiters);
       }
 
       void
@@ -198,6 +237,10 @@ namespace schroot
         keyfile::set_object_list_value(*this, &source_clonable::get_source_root_groups,
                                        keyfile, owner->get_name(),
                                        "source-root-groups");
+
+        keyfile::set_object_value(*this, &source_clonable::get_source_lease_timeout,
+                                  keyfile, owner->get_name(),
+                                  "source-lease-timeout");
       }
 
       void
@@ -227,6 +270,11 @@ namespace schroot
                                        keyfile, owner->get_name(),
                                        "source-root-groups",
                                        keyfile::PRIORITY_OPTIONAL);
+
+        keyfile::get_object_value(*this, &source_clonable::set_source_lease_timeout,
+                                  keyfile, owner->get_name(),
+                                  "source-lease-timeout",
+                                  keyfile::PRIORITY_OPTIONAL);
       }
 
       chroot::ptr
@@ -244,7 +292,15 @@ namespace schroot
         clone->set_aliases(clone->get_aliases());
 
         clone->remove_facet<source_clonable>();
-        clone->add_facet(source::create());
+        source::ptr psrc(source::create());
+        psrc->set_lease_timeout(get_source_lease_timeout());
+        clone->add_facet(psrc);
+
+        // A pooled source session would hold the exclusive lease on
+        // the source while idle, so source sessions are never pooled.
+        session_clonable::ptr psc(clone->get_facet<session_clonable>());
+        if (psc)
+          psc->set_session_pool_size(0);
 
         chroot::facet_list& facets = clone->get_facets();
 
@@ -165,6 +165,22 @@ namespace schroot
         virtual void
         set_source_root_groups (const string_list& groups);
 
+        /**
+         * Get the time to wait for a lease on the source chroot.
+         *
+         * @returns the time in seconds.
+         */
+        virtual unsigned int
+        get_source_lease_timeout () const;
+
+        /**
+         * Set the time to wait for a lease on the source chroot.
+         *
+         * @param timeout the time in seconds.
+         */
+        virtual void
+        set_source_lease_timeout (unsigned int timeout);
+
         virtual session_flags
         get_session_flags () const;
 
@@ -191,6 +207,8 @@ namespace schroot
         string_list   source_root_users;
         /// Groups allowed to access the source chroot as root.
         string_list   source_root_groups;
+        /// Time to wait for a lease on the source chroot.
+        unsigned int  source_lease_timeout;
       };
 
     }
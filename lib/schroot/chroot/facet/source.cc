@@ -50,7 +50,8 @@ namespace schroot
       }
 
       source::source ():
-        facet()
+        facet(),
+        lease_timeout(600)
       {
       }
 
@@ -76,6 +77,18 @@ namespace schroot
         return source_info.name;
       }
 
+      unsigned int
+      source::get_lease_timeout () const
+      {
+        return this->lease_timeout;
+      }
+
+      void
+      source::set_lease_timeout (unsigned int timeout)
+      {
+        this->lease_timeout = timeout;
+      }
+
     }
   }
 }
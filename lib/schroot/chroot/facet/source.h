@@ -66,6 +66,26 @@ namespace schroot
 
         virtual std::string const&
         get_name () const;
+
+        /**
+         * Get the time to wait for a lease on the source chroot.
+         *
+         * @returns the time in seconds.
+         */
+        virtual unsigned int
+        get_lease_timeout () const;
+
+        /**
+         * Set the time to wait for a lease on the source chroot.
+         *
+         * @param timeout the time in seconds.
+         */
+        virtual void
+        set_lease_timeout (unsigned int timeout);
+
+      private:
+        /// Time to wait for a lease on the source chroot.
+        unsigned int lease_timeout;
       };
 
     }
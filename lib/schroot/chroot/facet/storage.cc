@@ -42,6 +42,11 @@ namespace schroot
       {
       }
 
+      void
+      storage::rename_session (const std::string& session_id)
+      {
+      }
+
     }
   }
 }
@@ -69,6 +69,20 @@ namespace schroot
                    bool               lock,
                    int                status);
 
+        /**
+         * Rename the storage for a session.  This is used when a
+         * session which has already been set up is renamed, for
+         * example when it is claimed from a session pool.  Storage
+         * located using the session name, rather than a path
+         * recorded in the session information, must be moved to
+         * match the new name.  The session name has not yet been
+         * changed when this is called.
+         *
+         * @param session_id the new session name.
+         */
+        virtual void
+        rename_session (const std::string& session_id);
+
       };
 
     }
@@ -25,7 +25,14 @@
 
 #include <boost/format.hpp>
 
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+
+#include <fcntl.h>
 #include <sched.h>
+#include <sys/mount.h>
+#include <unistd.h>
 
 using boost::format;
 
@@ -63,7 +70,10 @@ namespace schroot
         {
           // TRANSLATORS: %1% = the name of the context being unshared
           {schroot::chroot::facet::unshare::UNSHARE,
-           N_("Could not unshare ‘%1%’ process execution context")}
+           N_("Could not unshare ‘%1%’ process execution context")},
+          // TRANSLATORS: %1% = the name of the ID map file
+          {schroot::chroot::facet::unshare::ID_MAP,
+           N_("Could not write user namespace ID map ‘%1%’")}
         };
 
       unshare::unshare ():
@@ -71,7 +81,11 @@ namespace schroot
         unshare_net(false),
         unshare_sysvipc(false),
         unshare_sysvsem(false),
-        unshare_uts(false)
+        unshare_uts(false),
+        unshare_pid(false),
+        unshare_mount(false),
+        unshare_cgroup(false),
+        unshare_user(false)
       {
       }
 
@@ -145,6 +159,54 @@ namespace schroot
         this->unshare_uts = unshare_uts;
       }
 
+      bool
+      unshare::get_unshare_pid () const
+      {
+        return this->unshare_pid;
+      }
+
+      void
+      unshare::set_unshare_pid (bool unshare_pid)
+      {
+        this->unshare_pid = unshare_pid;
+      }
+
+      bool
+      unshare::get_unshare_mount () const
+      {
+        return this->unshare_mount;
+      }
+
+      void
+      unshare::set_unshare_mount (bool unshare_mount)
+      {
+        this->unshare_mount = unshare_mount;
+      }
+
+      bool
+      unshare::get_unshare_cgroup () const
+      {
+        return this->unshare_cgroup;
+      }
+
+      void
+      unshare::set_unshare_cgroup (bool unshare_cgroup)
+      {
+        this->unshare_cgroup = unshare_cgroup;
+      }
+
+      bool
+      unshare::get_unshare_user () const
+      {
+        return this->unshare_user;
+      }
+
+      void
+      unshare::set_unshare_user (bool unshare_user)
+      {
+        this->unshare_user = unshare_user;
+      }
+
       void
       unshare::do_unshare () const
       {
@@ -182,6 +244,127 @@ namespace schroot
 #endif
       }
 
+      bool
+      unshare::get_unshare_child () const
+      {
+        return (this->unshare_pid || this->unshare_mount ||
+                this->unshare_cgroup || this->unshare_user);
+      }
+
+      int
+      unshare::begin_pid_namespace () const
+      {
+        int fd = -1;
+#ifdef CLONE_NEWPID
+        if (this->unshare_pid)
+          {
+            // Keep a reference to the current namespace, to return to.
+            fd = open("/proc/self/ns/pid", O_RDONLY|O_CLOEXEC);
+            if (fd < 0)
+              throw error("PID", UNSHARE, strerror(errno));
+
+            log_debug(DEBUG_INFO) << "Unsharing PID namespace" << std::endl;
+            if (::unshare(CLONE_NEWPID) < 0)
+              {
+                int saved_errno = errno;
+                close(fd);
+                throw error("PID", UNSHARE, strerror(saved_errno));
+              }
+          }
+#endif
+        return fd;
+      }
+
+      void
+      unshare::end_pid_namespace (int fd) const
+      {
+#ifdef CLONE_NEWPID
+        if (fd >= 0)
+          {
+            int status = setns(fd, CLONE_NEWPID);
+            int saved_errno = errno;
+            close(fd);
+            if (status < 0)
+              throw error("PID", UNSHARE, strerror(saved_errno));
+          }
+#endif
+      }
+
+      void
+      unshare::do_unshare_child (const std::string& location) const
+      {
+#ifdef CLONE_NEWNS
+        if (this->unshare_mount)
+          {
+            log_debug(DEBUG_INFO) << "Unsharing mount namespace" << std::endl;
+            if (::unshare(CLONE_NEWNS) < 0)
+              throw error("MOUNT", UNSHARE, strerror(errno));
+            // Receive mounts from the host, but don't propagate ours.
+            if (mount(nullptr, "/", nullptr, MS_REC|MS_SLAVE, nullptr) < 0)
+              throw error("MOUNT", UNSHARE, strerror(errno));
+
+            std::string proc(location + "/proc");
+            if (this->unshare_pid && access(proc.c_str(), F_OK) == 0)
+              {
+                log_debug(DEBUG_INFO) << "Mounting " << proc << std::endl;
+                if (mount("proc", proc.c_str(), "proc",
+                          MS_NOSUID|MS_NODEV|MS_NOEXEC, nullptr) < 0)
+                  throw error("PID", UNSHARE, strerror(errno));
+              }
+          }
+#endif
+#ifdef CLONE_NEWCGROUP
+        // With a user namespace, the cgroup namespace is unshared
+        // along with it by do_unshare_user.
+        if (this->unshare_cgroup && !this->unshare_user)
+          {
+            log_debug(DEBUG_INFO) << "Unsharing cgroup namespace" << std::endl;
+            if (::unshare(CLONE_NEWCGROUP) < 0)
+              throw error("CGROUP", UNSHARE, strerror(errno));
+          }
+#endif
+      }
+
+      void
+      unshare::do_unshare_user () const
+      {
+#ifdef CLONE_NEWUSER
+        if (this->unshare_user)
+          {
+            // Namespaces unshared in the same call are owned by the
+            // new user namespace, which is created first.
+            int flags = CLONE_NEWUSER;
+#ifdef CLONE_NEWNS
+            if (this->unshare_mount)
+              flags |= CLONE_NEWNS;
+#endif
+#ifdef CLONE_NEWCGROUP
+            if (this->unshare_cgroup)
+              flags |= CLONE_NEWCGROUP;
+#endif
+
+            log_debug(DEBUG_INFO) << "Unsharing user namespace" << std::endl;
+            if (::unshare(flags) < 0)
+              throw error("USER", UNSHARE, strerror(errno));
+          }
+#endif
+      }
+
+      void
+      unshare::map_user_namespace (pid_t pid) const
+      {
+        const char *maps[] = { "uid_map", "gid_map" };
+        for (const char *map : maps)
+          {
+            std::string file((format("/proc/%1%/%2%") % pid % map).str());
+            std::ofstream output(file.c_str());
+            output << "0 0 4294967295\n";
+            output.close();
+            if (!output)
+              throw error(file, ID_MAP);
+          }
+      }
+
       void
       unshare::setup_env (environment& env) const
       {
@@ -189,15 +372,23 @@ namespace schroot
         env.add("UNSHARE_SYSVIPC", get_unshare_sysvipc());
         env.add("UNSHARE_SYSVSEM", get_unshare_sysvsem());
         env.add("UNSHARE_UTS", get_unshare_uts());
+        env.add("UNSHARE_PID", get_unshare_pid());
+        env.add("UNSHARE_MOUNT", get_unshare_mount());
+        env.add("UNSHARE_CGROUP", get_unshare_cgroup());
+        env.add("UNSHARE_USER", get_unshare_user());
       }
 
       void
       unshare::get_details (format_detail& detail) const
       {
-        detail.add(_("Unshare Networking"), get_unshare_net());
-        detail.add(_("Unshare System V IPC"), get_unshare_sysvipc());
-        detail.add(_("Unshare System V Semaphores"), get_unshare_sysvsem());
-        detail.add(_("Unshare UTS namespace"), get_unshare_uts());
+        detail.add(N_("Unshare Networking"), get_unshare_net());
+        detail.add(N_("Unshare System V IPC"), get_unshare_sysvipc());
+        detail.add(N_("Unshare System V Semaphores"), get_unshare_sysvsem());
+        detail.add(N_("Unshare UTS namespace"), get_unshare_uts());
+        detail.add(N_("Unshare PID namespace"), get_unshare_pid());
+        detail.add(N_("Unshare mount namespace"), get_unshare_mount());
+        detail.add(N_("Unshare cgroup namespace"), get_unshare_cgroup());
+        detail.add(N_("Unshare user namespace"), get_unshare_user());
       }
 
       void
@@ -207,6 +398,10 @@ namespace schroot
         used_keys.push_back("unshare.sysvipc");
         used_keys.push_back("unshare.sysvsem");
         used_keys.push_back("unshare.uts");
+        used_keys.push_back("unshare.pid");
+        used_keys.push_back("unshare.mount");
+        used_keys.push_back("unshare.cgroup");
+        used_keys.push_back("unshare.user");
       }
 
       void
@@ -220,6 +415,14 @@ namespace schroot
                                   keyfile, owner->get_name(), "unshare.sysvsem");
         keyfile::set_object_value(*this, &unshare::get_unshare_uts,
                                   keyfile, owner->get_name(), "unshare.uts");
+        keyfile::set_object_value(*this, &unshare::get_unshare_pid,
+                                  keyfile, owner->get_name(), "unshare.pid");
+        keyfile::set_object_value(*this, &unshare::get_unshare_mount,
+                                  keyfile, owner->get_name(), "unshare.mount");
+        keyfile::set_object_value(*this, &unshare::get_unshare_cgroup,
+                                  keyfile, owner->get_name(), "unshare.cgroup");
+        keyfile::set_object_value(*this, &unshare::get_unshare_user,
+                                  keyfile, owner->get_name(), "unshare.user");
       }
 
       void
@@ -237,6 +440,18 @@ namespace schroot
         keyfile::get_object_value(*this, &unshare::set_unshare_uts,
                                   keyfile, owner->get_name(), "unshare.uts",
                                   keyfile::PRIORITY_OPTIONAL);
+        keyfile::get_object_value(*this, &unshare::set_unshare_pid,
+                                  keyfile, owner->get_name(), "unshare.pid",
+                                  keyfile::PRIORITY_OPTIONAL);
+        keyfile::get_object_value(*this, &unshare::set_unshare_mount,
+                                  keyfile, owner->get_name(), "unshare.mount",
+                                  keyfile::PRIORITY_OPTIONAL);
+        keyfile::get_object_value(*this, &unshare::set_unshare_cgroup,
+                                  keyfile, owner->get_name(), "unshare.cgroup",
+                                  keyfile::PRIORITY_OPTIONAL);
+        keyfile::get_object_value(*this, &unshare::set_unshare_user,
+                                  keyfile, owner->get_name(), "unshare.user",
+                                  keyfile::PRIORITY_OPTIONAL);
       }
 
     }
@@ -21,6 +21,8 @@
 
 #include <schroot/chroot/facet/facet.h>
 
+#include <sys/types.h>
+
 namespace schroot
 {
   namespace chroot
@@ -43,7 +45,8 @@ namespace schroot
         /// Error codes.
         enum error_code
           {
-            UNSHARE ///< Could not unshare process execution context
+            UNSHARE, ///< Could not unshare process execution context
+            ID_MAP   ///< Could not write user namespace ID map
           };
 
         /// Exception type.
@@ -136,11 +139,152 @@ namespace schroot
         set_unshare_uts (bool unshare);
 
         /**
-         * Unshare process execution context.
+         * Get unshare PID namespace status.
+         *
+         * @returns true if the PID namespace will be unshared,
+         * otherwise false.
+         */
+        bool
+        get_unshare_pid () const;
+
+        /**
+         * Set unshare PID namespace status.
+         *
+         * @param unshare true to unshare the PID namespace, otherwise
+         * false.
+         */
+        void
+        set_unshare_pid (bool unshare);
+
+        /**
+         * Get unshare mount namespace status.
+         *
+         * @returns true if the mount namespace will be unshared,
+         * otherwise false.
+         */
+        bool
+        get_unshare_mount () const;
+
+        /**
+         * Set unshare mount namespace status.
+         *
+         * @param unshare true to unshare the mount namespace,
+         * otherwise false.
+         */
+        void
+        set_unshare_mount (bool unshare);
+
+        /**
+         * Get unshare cgroup namespace status.
+         *
+         * @returns true if the cgroup namespace will be unshared,
+         * otherwise false.
+         */
+        bool
+        get_unshare_cgroup () const;
+
+        /**
+         * Set unshare cgroup namespace status.
+         *
+         * @param unshare true to unshare the cgroup namespace,
+         * otherwise false.
+         */
+        void
+        set_unshare_cgroup (bool unshare);
+
+        /**
+         * Get unshare user namespace status.
+         *
+         * @returns true if the user namespace will be unshared,
+         * otherwise false.
+         */
+        bool
+        get_unshare_user () const;
+
+        /**
+         * Set unshare user namespace status.
+         *
+         * @param unshare true to unshare the user namespace,
+         * otherwise false.
+         */
+        void
+        set_unshare_user (bool unshare);
+
+        /**
+         * Unshare the execution contexts shared by the session
+         * process and its setup scripts (networking, System V IPC
+         * and semaphores, and UTS).
          */
         void
         do_unshare () const;
 
+        /**
+         * Are any namespaces unshared by the command process only?
+         * These are the PID, mount, cgroup and user namespaces,
+         * which must not be entered by the setup scripts.
+         *
+         * @returns true if a namespace is unshared by the command
+         * process, otherwise false.
+         */
+        bool
+        get_unshare_child () const;
+
+        /**
+         * Create a PID namespace for the next child process.  The
+         * calling process remains in its current PID namespace, and
+         * must call end_pid_namespace once the child has been
+         * created.
+         *
+         * @returns a file descriptor for the original PID namespace,
+         * or -1 if the PID namespace is not unshared.
+         */
+        int
+        begin_pid_namespace () const;
+
+        /**
+         * Create child processes in the original PID namespace again.
+         *
+         * @param fd the file descriptor returned by
+         * begin_pid_namespace.
+         */
+        void
+        end_pid_namespace (int fd) const;
+
+        /**
+         * Unshare the mount and cgroup namespaces for the command
+         * process.  Mounts made in the new mount namespace are not
+         * propagated to the host.  If the PID namespace is also
+         * unshared, a new /proc is mounted inside the chroot, so that
+         * only the processes in the session are visible.  If the user
+         * namespace is also unshared, the cgroup namespace is left to
+         * do_unshare_user.
+         *
+         * @param location the path of the chroot.
+         */
+        void
+        do_unshare_child (const std::string& location) const;
+
+        /**
+         * Unshare the user namespace for the command process.  The
+         * mount and cgroup namespaces, if unshared, are unshared again
+         * in the same call, so that they are owned by the new user
+         * namespace.  The process must then wait for its parent to
+         * call map_user_namespace.
+         */
+        void
+        do_unshare_user () const;
+
+        /**
+         * Map the user and group IDs of a process which has unshared
+         * its user namespace.  All IDs are mapped to themselves, so
+         * that file ownership is unchanged, but the privileges of the
+         * process are confined to the namespace.
+         *
+         * @param pid the process to map.
+         */
+        void
+        map_user_namespace (pid_t pid) const;
+
         virtual void
         setup_env (environment& env) const;
 
@@ -163,8 +307,16 @@ namespace schroot
         bool unshare_sysvipc;
         /// Unshare System V SEM.
         bool unshare_sysvsem;
-        /// Unshare System V SEM.
+        /// Unshare UTS namespace.
         bool unshare_uts;
+        /// Unshare PID namespace.
+        bool unshare_pid;
+        /// Unshare mount namespace.
+        bool unshare_mount;
+        /// Unshare cgroup namespace.
+        bool unshare_cgroup;
+        /// Unshare user namespace.
+        bool unshare_user;
       };
 
     }
@@ -165,9 +165,9 @@ namespace schroot
                              this->root_modifiable_keys.end());
         std::sort(rootkeys.begin(), rootkeys.end());
 
-        detail.add(_("User Modifiable Keys"), userkeys);
-        detail.add(_("Root Modifiable Keys"), rootkeys);
-        detail.add(_("User Data"), "");
+        detail.add(N_("User Modifiable Keys"), userkeys);
+        detail.add(N_("Root Modifiable Keys"), rootkeys);
+        detail.add_section(N_("User Data"));
 
         string_list keys;
         for (const auto& item : data)
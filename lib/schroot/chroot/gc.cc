@@ -0,0 +1,179 @@
+/* Copyright © 2005-2013  Roger Leigh <rleigh@codelibre.net>
+ *
+ * schroot is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * schroot is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ *********************************************************************/
+
+#include <config.h>
+
+#include <schroot/chroot/gc.h>
+#include <schroot/chroot/facet/session.h>
+#include <schroot/log.h>
+#include <schroot/reaper.h>
+#include <schroot/util.h>
+
+#include <vector>
+
+#include <boost/format.hpp>
+
+using std::endl;
+using boost::format;
+
+namespace schroot
+{
+  namespace chroot
+  {
+
+    gc::gc ():
+      idle_time(default_idle_time),
+      orphans(false)
+    {
+    }
+
+    gc::~gc ()
+    {
+    }
+
+    time_t
+    gc::get_idle_time () const
+    {
+      return this->idle_time;
+    }
+
+    void
+    gc::set_idle_time (time_t idle_time)
+    {
+      this->idle_time = idle_time;
+    }
+
+    bool
+    gc::get_orphans () const
+    {
+      return this->orphans;
+    }
+
+    void
+    gc::set_orphans (bool orphans)
+    {
+      this->orphans = orphans;
+    }
+
+    bool
+    gc::check (const chroot::ptr& session,
+               candidate&         stale) const
+    {
+      facet::session::const_ptr psess
+        (session->get_facet<facet::session>());
+      if (!psess)
+        return false;
+
+      time_t last_used;
+      try
+        {
+          last_used = stat(psess->get_session_info_file()).mtime();
+        }
+      catch (const std::runtime_error& e)
+        {
+          // The session was ended while checking.
+          log_debug(DEBUG_INFO) << e.what() << endl;
+          return false;
+        }
+
+      return check(session, last_used, stale);
+    }
+
+    bool
+    gc::check (const chroot::ptr& session,
+               time_t             last_used,
+               candidate&         stale) const
+    {
+      facet::session::const_ptr psess
+        (session->get_facet<facet::session>());
+      if (!psess)
+        return false;
+
+      time_t now = time(nullptr);
+      stale.session = session;
+      stale.idle = (now > last_used) ? now - last_used : 0;
+
+      if (psess->get_ending() && !psess->driver_alive())
+        stale.why = STALE_ENDING;
+      else if (stale.idle >= this->idle_time)
+        stale.why = STALE_IDLE;
+      else if (this->orphans && !psess->driver_alive())
+        stale.why = STALE_ORPHANED;
+      else
+        return false;
+
+      // A session in use is never stale.  If the session is not
+      // mounted, its mount location may not exist, in which case no
+      // processes can be running inside it.
+      std::string path(session->get_path());
+      try
+        {
+          if (!path.empty() && stat(path).is_directory())
+            {
+              reaper procs(path);
+              std::vector<pid_t> pids(procs.find());
+              if (!pids.empty())
+                {
+                  log_debug(DEBUG_INFO)
+                    << "Session " << session->get_name() << " has "
+                    << pids.size() << " running processes" << endl;
+                  return false;
+                }
+            }
+        }
+      catch (const stat::error& e)
+        {
+          log_debug(DEBUG_INFO) << e.what() << endl;
+        }
+      catch (const reaper::error& e)
+        {
+          // Processes can't be found, for example if the session
+          // root is the host root, so the session must be assumed
+          // to be in use.
+          log_exception_warning(e);
+          return false;
+        }
+
+      return true;
+    }
+
+    std::string
+    gc::describe (const candidate& stale)
+    {
+      if (stale.why == STALE_ORPHANED)
+        {
+          facet::session::const_ptr psess
+            (stale.session->get_facet_strict<facet::session>());
+          // TRANSLATORS: %1% = process ID
+          format fmt(_("session driver (PID %1%) has exited"));
+          fmt % psess->get_driver_pid();
+          return fmt.str();
+        }
+      else if (stale.why == STALE_ENDING)
+        return _("session end was interrupted");
+      else if (stale.why == STALE_POOL)
+        return _("pooled session is out of date or surplus");
+
+      // TRANSLATORS: %1% = number of seconds
+      format fmt(_("idle for %1% seconds"));
+      fmt % stale.idle;
+      return fmt.str();
+    }
+
+  }
+}
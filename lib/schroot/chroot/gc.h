@@ -0,0 +1,170 @@
+/* Copyright © 2005-2013  Roger Leigh <rleigh@codelibre.net>
+ *
+ * schroot is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * schroot is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ *********************************************************************/
+
+#ifndef SCHROOT_CHROOT_GC_H
+#define SCHROOT_CHROOT_GC_H
+
+#include <schroot/chroot/chroot.h>
+
+#include <ctime>
+#include <string>
+
+namespace schroot
+{
+  namespace chroot
+  {
+
+    /**
+     * Stale session garbage collection.
+     *
+     * Sessions which were not ended, for example because the host
+     * crashed or because the program which began them was killed,
+     * remain in the session directory along with their mounts and
+     * storage.  A session is stale if no processes are running inside
+     * it, and either it has not been used for longer than the idle
+     * time, or (optionally) the process which began it has exited.
+     * The idle time of a session is the time since it was begun or
+     * last run or recovered, which is recorded in the modification
+     * time of its session file.  A session which was being ended
+     * asynchronously is stale as soon as the process ending it has
+     * exited, so that an interrupted end is completed.
+     */
+    class gc
+    {
+    public:
+      /// The reason a session is stale.
+      enum reason
+        {
+          STALE_IDLE,     ///< The session has been idle too long.
+          STALE_ORPHANED, ///< The session driver has exited.
+          STALE_ENDING,   ///< The session was not completely ended.
+          STALE_POOL      ///< The pooled session is out of date or surplus.
+        };
+
+      /// A stale session.
+      struct candidate
+      {
+        /// The session.
+        chroot::ptr session;
+        /// The reason the session is stale.
+        reason      why;
+        /// The time in seconds since the session was last used.
+        time_t      idle;
+      };
+
+      /// The default idle time (one day).
+      static const time_t default_idle_time = 86400;
+
+      /// The constructor.
+      gc ();
+
+      /// The destructor.
+      virtual ~gc ();
+
+      /**
+       * Get the idle time after which a session is stale.
+       *
+       * @returns the idle time in seconds.
+       */
+      time_t
+      get_idle_time () const;
+
+      /**
+       * Set the idle time after which a session is stale.
+       *
+       * @param idle_time the idle time in seconds.
+       */
+      void
+      set_idle_time (time_t idle_time);
+
+      /**
+       * Get whether sessions whose driver has exited are stale.
+       *
+       * @returns true if orphaned sessions are stale, otherwise
+       * false.
+       */
+      bool
+      get_orphans () const;
+
+      /**
+       * Set whether sessions whose driver has exited are stale,
+       * regardless of how long they have been idle.  This is not the
+       * default, because a session is commonly begun by a short-lived
+       * process such as a shell script.
+       *
+       * @param orphans true if orphaned sessions are stale, otherwise
+       * false.
+       */
+      void
+      set_orphans (bool orphans);
+
+      /**
+       * Check if a session is stale.
+       *
+       * @param session the session to check.  Chroots which are not
+       * sessions are never stale.
+       * @param stale the candidate to fill in if the session is
+       * stale.
+       * @returns true if the session is stale, otherwise false.
+       */
+      bool
+      check (const chroot::ptr& session,
+             candidate&         stale) const;
+
+      /**
+       * Check if a session is stale, given the time it was last
+       * used.
+       *
+       * @param session the session to check.  Chroots which are not
+       * sessions are never stale.
+       * @param last_used the time the session was last used.
+       * @param stale the candidate to fill in if the session is
+       * stale.
+       * @returns true if the session is stale, otherwise false.
+       */
+      bool
+      check (const chroot::ptr& session,
+             time_t             last_used,
+             candidate&         stale) const;
+
+      /**
+       * Describe why a session is stale.
+       *
+       * @param stale the stale session.
+       * @returns a translated description.
+       */
+      static std::string
+      describe (const candidate& stale);
+
+    private:
+      /// The idle time after which a session is stale.
+      time_t idle_time;
+      /// Consider sessions whose driver has exited to be stale.
+      bool   orphans;
+    };
+
+  }
+}
+
+#endif /* SCHROOT_CHROOT_GC_H */
+
+/*
+ * Local Variables:
+ * mode:C++
+ * End:
+ */
@@ -0,0 +1,412 @@
+/* Copyright © 2005-2013  Roger Leigh <rleigh@codelibre.net>
+ *
+ * schroot is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * schroot is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ *********************************************************************/
+
+#include <config.h>
+
+#include <schroot/chroot/config.h>
+#include <schroot/chroot/pool.h>
+#include <schroot/chroot/facet/session.h>
+#include <schroot/chroot/facet/session-clonable.h>
+#include <schroot/chroot/facet/storage.h>
+#include <schroot/keyfile-writer.h>
+#include <schroot/log.h>
+#include <schroot/util.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <locale>
+#include <sstream>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <boost/format.hpp>
+
+using std::endl;
+using boost::format;
+
+namespace schroot
+{
+
+  template<>
+  error<chroot::pool::error_code>::map_type
+  error<chroot::pool::error_code>::error_strings =
+    {
+      {chroot::pool::POOL_OPEN,    N_("Failed to open session pool")},
+      {chroot::pool::POOL_LOCK,    N_("Failed to lock session pool")},
+      // TRANSLATORS: %1% = session name
+      {chroot::pool::MEMBER_ADD,   N_("Failed to add session ‘%1%’ to pool")},
+      // TRANSLATORS: %1% = session name
+      {chroot::pool::MEMBER_CLAIM, N_("Failed to claim session ‘%1%’ from pool")},
+      // TRANSLATORS: %1% = session name
+      {chroot::pool::MEMBER_LOAD,  N_("Failed to load pool session ‘%1%’")},
+      {chroot::pool::GENERATION,   N_("Failed to update session pool generation")}
+    };
+
+  namespace chroot
+  {
+
+    namespace
+    {
+
+      /**
+       * Get the file recording the number of times a pool has been
+       * invalidated.
+       *
+       * @param source_name the name of the chroot providing the pool.
+       * @param directory the pool directory.
+       * @returns the filename.
+       */
+      std::string
+      generation_file (const std::string& source_name,
+                       const std::string& directory)
+      {
+        return directory + "/." + source_name + ".generation";
+      }
+
+      /**
+       * Get the number of times a pool has been invalidated.
+       *
+       * @param file the generation file.
+       * @returns the count, or 0 if the pool was never invalidated.
+       */
+      unsigned long
+      read_generation (const std::string& file)
+      {
+        unsigned long count = 0;
+        std::ifstream input(file.c_str());
+        if (!(input >> count))
+          count = 0;
+        return count;
+      }
+
+    }
+
+    pool::pool (const chroot::ptr& source):
+      source(source),
+      directory(SCHROOT_POOL_DIR),
+      lock_fd(-1),
+      refill_lock()
+    {
+    }
+
+    pool::pool (const chroot::ptr& source,
+                const std::string& directory):
+      source(source),
+      directory(directory),
+      lock_fd(-1),
+      refill_lock()
+    {
+    }
+
+    pool::~pool ()
+    {
+      unlock();
+    }
+
+    unsigned int
+    pool::get_size () const
+    {
+      facet::session_clonable::const_ptr psess
+        (this->source->get_facet<facet::session_clonable>());
+
+      return psess ? psess->get_session_pool_size() : 0;
+    }
+
+    std::string
+    pool::get_generation () const
+    {
+      // The pool size may change without invalidating the members.
+      keyfile kf;
+      kf << this->source;
+      kf.remove_key(this->source->get_name(), "session-pool-size");
+
+      std::ostringstream state;
+      state.imbue(std::locale::classic());
+      state << keyfile_writer(kf) << '\0'
+            << read_generation(generation_file(this->source->get_name(),
+                                               this->directory));
+
+      // FNV-1a.
+      uint32_t hash = 2166136261U;
+      for (const auto& c : state.str())
+        {
+          hash ^= static_cast<unsigned char>(c);
+          hash *= 16777619U;
+        }
+
+      return (format("%08x") % hash).str();
+    }
+
+    void
+    pool::invalidate (const std::string& source_name)
+    {
+      invalidate(source_name, SCHROOT_POOL_DIR);
+    }
+
+    void
+    pool::invalidate (const std::string& source_name,
+                      const std::string& directory)
+    {
+      std::string file(generation_file(source_name, directory));
+      std::string temp(file + ".new");
+      unsigned long count = read_generation(file) + 1;
+
+      {
+        std::ofstream output(temp.c_str(), std::ios::trunc);
+        output << count << '\n';
+        if (!output)
+          {
+            unlink(temp.c_str());
+            throw error(file, GENERATION);
+          }
+      }
+      // Concurrent invalidations may write the same count, but the
+      // generation changes either way.
+      if (rename(temp.c_str(), file.c_str()) != 0)
+        {
+          int saved_errno = errno;
+          unlink(temp.c_str());
+          throw error(file, GENERATION, strerror(saved_errno));
+        }
+
+      log_debug(DEBUG_INFO)
+        << format("Invalidated pool for %1%") % source_name << endl;
+    }
+
+    std::string
+    pool::get_member_prefix () const
+    {
+      return this->source->get_name() + "-pool-";
+    }
+
+    string_list
+    pool::get_members () const
+    {
+      string_list members;
+      const std::string prefix(get_member_prefix() + get_generation() + '-');
+
+      for (const auto& member : get_all_members())
+        if (member.compare(0, prefix.size(), prefix) == 0)
+          members.push_back(member);
+
+      return members;
+    }
+
+    string_list
+    pool::get_surplus_members () const
+    {
+      string_list surplus;
+      const std::string prefix(get_member_prefix() + get_generation() + '-');
+      string_list::size_type current = 0;
+
+      for (const auto& member : get_all_members())
+        if (member.compare(0, prefix.size(), prefix) != 0 ||
+            ++current > get_size())
+          surplus.push_back(member);
+
+      return surplus;
+    }
+
+    string_list
+    pool::get_all_members () const
+    {
+      string_list members;
+      const std::string prefix(get_member_prefix());
+
+      DIR *dir = opendir(this->directory.c_str());
+      if (dir == 0)
+        throw error(this->directory, POOL_OPEN, strerror(errno));
+
+      struct dirent *de;
+      while ((de = readdir(dir)) != 0)
+        {
+          std::string name(de->d_name);
+          // Hidden files are locks and claimed members.
+          if (name[0] != '.' && name.compare(0, prefix.size(), prefix) == 0)
+            members.push_back(name);
+        }
+      closedir(dir);
+
+      std::sort(members.begin(), members.end());
+
+      return members;
+    }
+
+    std::string
+    pool::create_member_name () const
+    {
+      return get_member_prefix() + get_generation() + '-' +
+        unique_identifier();
+    }
+
+    void
+    pool::add (const chroot::ptr& member)
+    {
+      std::string file(std::string(SCHROOT_SESSION_DIR) + "/" +
+                       member->get_name());
+      std::string poolfile(this->directory + "/" + member->get_name());
+
+      if (rename(file.c_str(), poolfile.c_str()) != 0)
+        throw error(member->get_name(), MEMBER_ADD, strerror(errno));
+
+      log_debug(DEBUG_INFO)
+        << format("Added session %1% to pool for %2%")
+        % member->get_name() % this->source->get_name() << endl;
+    }
+
+    chroot::ptr
+    pool::claim (const std::string& session_id,
+                 const std::string& alias,
+                 const std::string& user,
+                 bool               root)
+    {
+      for (const auto& member : get_members())
+        {
+          chroot::ptr session(claim_member(member, session_id, alias,
+                                           user, root));
+          if (session)
+            return session;
+        }
+
+      return chroot::ptr();
+    }
+
+    chroot::ptr
+    pool::claim_member (const std::string& member,
+                        const std::string& session_id,
+                        const std::string& alias,
+                        const std::string& user,
+                        bool               root)
+    {
+      std::string file(this->directory + "/" + member);
+      std::string claimed(this->directory + "/." + member + ".claim");
+
+      // Only one process can successfully rename the member, so
+      // this is the point at which the member is claimed.
+      if (rename(file.c_str(), claimed.c_str()) != 0)
+        {
+          if (errno == ENOENT) // Claimed by another process.
+            return chroot::ptr();
+          throw error(member, MEMBER_CLAIM, strerror(errno));
+        }
+
+      chroot::ptr session;
+      try
+        {
+          config members;
+          members.add("session", claimed);
+          session = members.find_chroot_in_namespace("session", member);
+        }
+      catch (const std::runtime_error& e)
+        {
+          throw error(member, MEMBER_LOAD, e);
+        }
+      if (!session)
+        throw error(member, MEMBER_LOAD);
+
+      facet::session::ptr psess
+        (session->get_facet_strict<facet::session>());
+      facet::storage::ptr pstore
+        (session->get_facet_strict<facet::storage>());
+
+      psess->set_selected_name(alias);
+      psess->set_session_user(user, root);
+
+      try
+        {
+          pstore->rename_session(session_id);
+          session->set_name(session_id);
+          psess->setup_session_info(true);
+        }
+      catch (const std::runtime_error& e)
+        {
+          // Return the member to the pool.
+          if (session->get_name() != member)
+            {
+              try
+                {
+                  pstore->rename_session(member);
+                }
+              catch (const std::runtime_error& discard)
+                {
+                }
+              session->set_name(member);
+            }
+          rename(claimed.c_str(), file.c_str());
+          throw error(member, MEMBER_CLAIM, e);
+        }
+
+      if (unlink(claimed.c_str()) != 0)
+        log_exception_warning(error(member, MEMBER_CLAIM, strerror(errno)));
+
+      log_debug(DEBUG_INFO)
+        << format("Claimed pool session %1% as %2%")
+        % member % session_id << endl;
+
+      return session;
+    }
+
+    bool
+    pool::lock ()
+    {
+      if (this->refill_lock)
+        return true;
+
+      std::string file(this->directory + "/." + this->source->get_name() +
+                       ".lock");
+
+      this->lock_fd = open(file.c_str(), O_CREAT|O_RDWR|O_CLOEXEC, 0600);
+      if (this->lock_fd < 0)
+        throw error(file, POOL_LOCK, strerror(errno));
+
+      std::unique_ptr<ofd_lock> lck(new ofd_lock(this->lock_fd));
+      try
+        {
+          lck->set_lock(lock::LOCK_EXCLUSIVE, 0);
+        }
+      catch (const lock::error& e)
+        {
+          close(this->lock_fd);
+          this->lock_fd = -1;
+          return false;
+        }
+
+      this->refill_lock = std::move(lck);
+      return true;
+    }
+
+    void
+    pool::unlock ()
+    {
+      if (this->refill_lock)
+        {
+          // The lock is released on destruction.
+          this->refill_lock.reset();
+          close(this->lock_fd);
+          this->lock_fd = -1;
+        }
+    }
+
+  }
+}
@@ -0,0 +1,264 @@
+/* Copyright © 2005-2013  Roger Leigh <rleigh@codelibre.net>
+ *
+ * schroot is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * schroot is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ *********************************************************************/
+
+#ifndef SCHROOT_CHROOT_POOL_H
+#define SCHROOT_CHROOT_POOL_H
+
+#include <schroot/chroot/chroot.h>
+#include <schroot/custom-error.h>
+#include <schroot/lock.h>
+#include <schroot/types.h>
+
+#include <memory>
+#include <string>
+
+namespace schroot
+{
+  namespace chroot
+  {
+
+    /**
+     * A pool of pre-provisioned sessions.
+     *
+     * A session-clonable chroot may keep a number of sessions set up
+     * in advance (see session_clonable::get_session_pool_size()).
+     * These pool members are ordinary sessions, but their session
+     * information is stored in the pool directory rather than the
+     * session directory, so that they are not visible as sessions.
+     * Beginning a session claims a member from the pool, renaming it
+     * to the requested session name and transferring it to the
+     * requesting user, which avoids running the setup-start scripts
+     * on the critical path.  The pool is then refilled in the
+     * background.
+     *
+     * Each member is named for the generation of the pool it was set
+     * up in.  The generation changes when the configuration of the
+     * source chroot changes, or when the pool is invalidated, for
+     * example because a source chroot session modified the chroot.
+     * Members of an older generation are never claimed, and are
+     * discarded when the pool is refilled or garbage collected.
+     */
+    class pool
+    {
+    public:
+      /// Error codes.
+      enum error_code
+        {
+          POOL_OPEN,    ///< Failed to open session pool.
+          POOL_LOCK,    ///< Failed to lock session pool.
+          MEMBER_ADD,   ///< Failed to add session to pool.
+          MEMBER_CLAIM, ///< Failed to claim session from pool.
+          MEMBER_LOAD,  ///< Failed to load pool session.
+          GENERATION    ///< Failed to update pool generation.
+        };
+
+      /// Exception type.
+      typedef custom_error<error_code> error;
+
+      /**
+       * The constructor.  The default pool directory will be used.
+       *
+       * @param source the session-clonable chroot providing the
+       * pool.
+       */
+      pool (const chroot::ptr& source);
+
+      /**
+       * The constructor.
+       *
+       * @param source the session-clonable chroot providing the
+       * pool.
+       * @param directory the directory containing pool members.
+       */
+      pool (const chroot::ptr& source,
+            const std::string& directory);
+
+      /// The destructor.
+      virtual ~pool ();
+
+      /**
+       * Get the configured pool size.
+       *
+       * @returns the number of sessions to keep in the pool.
+       */
+      unsigned int
+      get_size () const;
+
+      /**
+       * Get the current generation of the pool.  This is derived from
+       * the configuration of the source chroot (other than the pool
+       * size) and the number of times the pool has been invalidated.
+       *
+       * @returns the generation.
+       */
+      std::string
+      get_generation () const;
+
+      /**
+       * Invalidate the pool of a chroot in the default pool directory.
+       * All current members become stale.
+       *
+       * @param source_name the name of the chroot providing the pool.
+       */
+      static void
+      invalidate (const std::string& source_name);
+
+      /**
+       * Invalidate the pool of a chroot.  All current members become
+       * stale.
+       *
+       * @param source_name the name of the chroot providing the pool.
+       * @param directory the directory containing pool members.
+       */
+      static void
+      invalidate (const std::string& source_name,
+                  const std::string& directory);
+
+      /**
+       * Get the names of the sessions of the current generation in
+       * the pool.
+       *
+       * @returns a list of session names.
+       */
+      string_list
+      get_members () const;
+
+      /**
+       * Get the names of the sessions in the pool which are not
+       * needed: members of an older generation, and current members
+       * in excess of the pool size.
+       *
+       * @returns a list of session names.
+       */
+      string_list
+      get_surplus_members () const;
+
+      /**
+       * Create a name for a new pool member of the current
+       * generation.
+       *
+       * @returns a unique session name.
+       */
+      std::string
+      create_member_name () const;
+
+      /**
+       * Add a session to the pool.  The session must have been set
+       * up with a name from create_member_name(); its session
+       * information is moved from the session directory into the
+       * pool.
+       *
+       * @param member the session to add.
+       */
+      void
+      add (const chroot::ptr& member);
+
+      /**
+       * Claim a session from the pool.  The session is atomically
+       * removed from the pool, so that concurrent claims will never
+       * obtain the same session.  It is then renamed and restricted
+       * to the specified user, and its session information is
+       * written to the session directory.
+       *
+       * @param session_id the name for the claimed session.
+       * @param alias the alias used to select the chroot.
+       * @param user the user creating the session.
+       * @param root true if the user has root access, otherwise
+       * false.
+       * @returns the claimed session, or a null pointer if the pool
+       * is empty.
+       */
+      chroot::ptr
+      claim (const std::string& session_id,
+             const std::string& alias,
+             const std::string& user,
+             bool               root);
+
+      /**
+       * Claim a specific session from the pool, as for claim().  This
+       * is used to remove surplus members.
+       *
+       * @param member the name of the pool member.
+       * @param session_id the name for the claimed session.
+       * @param alias the alias used to select the chroot.
+       * @param user the user creating the session.
+       * @param root true if the user has root access, otherwise
+       * false.
+       * @returns the claimed session, or a null pointer if the member
+       * was claimed by another process.
+       */
+      chroot::ptr
+      claim_member (const std::string& member,
+                    const std::string& session_id,
+                    const std::string& alias,
+                    const std::string& user,
+                    bool               root);
+
+      /**
+       * Lock the pool for refilling.  Only a single process may
+       * refill a pool at once.
+       *
+       * @returns true if the lock was acquired, or false if the pool
+       * is already locked by another process.
+       */
+      bool
+      lock ();
+
+      /**
+       * Unlock the pool.
+       */
+      void
+      unlock ();
+
+    private:
+      /**
+       * Get the prefix common to all pool member names.
+       *
+       * @returns the prefix.
+       */
+      std::string
+      get_member_prefix () const;
+
+      /**
+       * Get the names of all sessions in the pool, of any generation.
+       *
+       * @returns a list of session names.
+       */
+      string_list
+      get_all_members () const;
+
+      /// The chroot providing the pool.
+      chroot::ptr source;
+      /// The pool directory.
+      std::string directory;
+      /// The lock file descriptor.
+      int lock_fd;
+      /// The lock held while refilling.
+      std::unique_ptr<ofd_lock> refill_lock;
+    };
+
+  }
+}
+
+#endif /* SCHROOT_CHROOT_POOL_H */
+
+/*
+ * Local Variables:
+ * mode:C++
+ * End:
+ */
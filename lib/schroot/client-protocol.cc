@@ -0,0 +1,444 @@
+/* Copyright © 2005-2013  Roger Leigh <rleigh@codelibre.net>
+ *
+ * schroot is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * schroot is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ *********************************************************************/
+
+
+#include <config.h>
+
+#include <schroot/client-protocol.h>
+
+#include <algorithm>
+#include <cassert>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <map>
+
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+namespace schroot
+{
+
+  const std::size_t client_protocol::max_message_size = 65536;
+
+  const std::size_t client_protocol::max_message_fds = 64;
+
+  namespace
+  {
+
+    /// Session operation names, used in messages.
+    const std::map<schroot::session::operation, std::string> operation_names =
+      {
+        {schroot::session::OPERATION_AUTOMATIC, "automatic"},
+        {schroot::session::OPERATION_BEGIN,     "begin"},
+        {schroot::session::OPERATION_RECOVER,   "recover"},
+        {schroot::session::OPERATION_END,       "end"},
+        {schroot::session::OPERATION_RUN,       "run"}
+      };
+
+    /// Message severity names, used in messages.
+    const std::map<log_level, std::string> level_names =
+      {
+        {LOG_LEVEL_DEBUG,   "debug"},
+        {LOG_LEVEL_INFO,    "info"},
+        {LOG_LEVEL_WARNING, "warning"},
+        {LOG_LEVEL_ERROR,   "error"}
+      };
+
+    /**
+     * Parse a non-negative integer message field.
+     *
+     * @param field the field.
+     * @returns the value.
+     */
+    unsigned long
+    parse_number (const client_protocol::message::value_type& field)
+    {
+      const std::string& value(field.second);
+      if (value.empty() ||
+          value.find_first_not_of("0123456789") != std::string::npos)
+        throw client::error(client::MESSAGE_INVALID, field.first);
+
+      errno = 0;
+      unsigned long number = std::strtoul(value.c_str(), 0, 10);
+      if (errno)
+        throw client::error(client::MESSAGE_INVALID, field.first);
+      return number;
+    }
+
+    /**
+     * Split a "name=value" string.
+     *
+     * @param field the message field containing the string.
+     * @returns the name and value.
+     */
+    std::pair<std::string, std::string>
+    split_value (const client_protocol::message::value_type& field)
+    {
+      std::string::size_type pos = field.second.find('=');
+      if (pos == 0 || pos == std::string::npos)
+        throw client::error(client::MESSAGE_INVALID, field.first);
+      return std::make_pair(field.second.substr(0, pos),
+                            field.second.substr(pos + 1));
+    }
+
+    /**
+     * Close file descriptors.
+     *
+     * @param fds the file descriptors to close.
+     */
+    void
+    close_fds (const std::vector<int>& fds)
+    {
+      for (const auto& fd : fds)
+        close(fd);
+    }
+
+  }
+
+  client_protocol::message
+  client_protocol::encode_request (unsigned long          id,
+                                   const client::request& req)
+  {
+    message msg;
+    msg.push_back(std::make_pair("id", std::to_string(id)));
+
+    auto op = operation_names.find(req.operation);
+    if (op == operation_names.end())
+      throw client::error(client::REQUEST_INVALID);
+    msg.push_back(std::make_pair("operation", op->second));
+
+    if (!req.chroot.empty())
+      msg.push_back(std::make_pair("chroot", req.chroot));
+    if (!req.session.empty())
+      msg.push_back(std::make_pair("session", req.session));
+    if (!req.user.empty())
+      msg.push_back(std::make_pair("user", req.user));
+    if (!req.directory.empty())
+      msg.push_back(std::make_pair("directory", req.directory));
+    if (req.preserve_environment)
+      msg.push_back(std::make_pair("preserve-environment", "true"));
+    for (const auto& arg : req.command)
+      msg.push_back(std::make_pair("command", arg));
+    for (const auto& var : req.environment)
+      {
+        if (var.find('=') == std::string::npos)
+          throw client::error(client::REQUEST_INVALID);
+        msg.push_back(std::make_pair("environment", var));
+      }
+    for (const auto& option : req.options)
+      msg.push_back(std::make_pair("option",
+                                   option.first + '=' + option.second));
+    for (const auto& fd : req.fds)
+      msg.push_back(std::make_pair("fd", std::to_string(fd.first)));
+
+    return msg;
+  }
+
+  client::request
+  client_protocol::decode_request (const message& msg,
+                                   unsigned long& id)
+  {
+    client::request req;
+    bool have_id = false;
+
+    for (const auto& field : msg)
+      {
+        if (field.first == "id")
+          {
+            id = parse_number(field);
+            have_id = true;
+          }
+        else if (field.first == "operation")
+          {
+            auto op = std::find_if(operation_names.begin(),
+                                   operation_names.end(),
+                                   [&field] (const std::pair<const schroot::session::operation, std::string>& name)
+                                   { return name.second == field.second; });
+            if (op == operation_names.end())
+              throw client::error(client::MESSAGE_INVALID, field.first);
+            req.operation = op->first;
+          }
+        else if (field.first == "chroot")
+          req.chroot = field.second;
+        else if (field.first == "session")
+          req.session = field.second;
+        else if (field.first == "user")
+          req.user = field.second;
+        else if (field.first == "directory")
+          req.directory = field.second;
+        else if (field.first == "preserve-environment")
+          req.preserve_environment = (field.second == "true");
+        else if (field.first == "command")
+          req.command.push_back(field.second);
+        else if (field.first == "environment")
+          {
+            split_value(field);
+            req.environment.push_back(field.second);
+          }
+        else if (field.first == "option")
+          req.options.insert(split_value(field));
+        else if (field.first == "fd")
+          {
+            unsigned long fd = parse_number(field);
+            if (fd > static_cast<unsigned long>(std::numeric_limits<int>::max()))
+              throw client::error(client::MESSAGE_INVALID, field.first);
+            req.fds.insert(std::make_pair(static_cast<int>(fd), -1));
+          }
+        else
+          throw client::error(client::MESSAGE_INVALID, field.first);
+      }
+
+    if (!have_id)
+      throw client::error(client::MESSAGE_INVALID, "id");
+
+    return req;
+  }
+
+  client_protocol::message
+  client_protocol::encode_result (unsigned long         id,
+                                  const client::result& res)
+  {
+    message msg;
+    msg.push_back(std::make_pair("id", std::to_string(id)));
+    msg.push_back(std::make_pair("status", std::to_string(res.status)));
+    if (!res.session.empty())
+      msg.push_back(std::make_pair("session", res.session));
+
+    for (const auto& diag : res.diagnostics)
+      {
+        auto level = level_names.find(diag.level);
+        assert(level != level_names.end());
+        msg.push_back(std::make_pair("diagnostic", level->second));
+        msg.push_back(std::make_pair("message", diag.message));
+        for (const auto& field : diag.fields)
+          msg.push_back(std::make_pair("field",
+                                       field.first + '=' + field.second));
+      }
+
+    return msg;
+  }
+
+  client::result
+  client_protocol::decode_result (const message& msg,
+                                  unsigned long& id)
+  {
+    client::result res;
+    bool have_id = false;
+    bool have_status = false;
+
+    for (const auto& field : msg)
+      {
+        if (field.first == "id")
+          {
+            id = parse_number(field);
+            have_id = true;
+          }
+        else if (field.first == "status")
+          {
+            res.status = static_cast<int>(parse_number(field));
+            have_status = true;
+          }
+        else if (field.first == "session")
+          res.session = field.second;
+        else if (field.first == "diagnostic")
+          {
+            auto level = std::find_if(level_names.begin(),
+                                      level_names.end(),
+                                      [&field] (const std::pair<const log_level, std::string>& name)
+                                      { return name.second == field.second; });
+            if (level == level_names.end())
+              throw client::error(client::MESSAGE_INVALID, field.first);
+
+            client::diagnostic diag;
+            diag.level = level->first;
+            res.diagnostics.push_back(diag);
+          }
+        else if (field.first == "message" && !res.diagnostics.empty())
+          res.diagnostics.back().message = field.second;
+        else if (field.first == "field" && !res.diagnostics.empty())
+          res.diagnostics.back().fields.insert(split_value(field));
+        else
+          throw client::error(client::MESSAGE_INVALID, field.first);
+      }
+
+    if (!have_id)
+      throw client::error(client::MESSAGE_INVALID, "id");
+    if (!have_status)
+      throw client::error(client::MESSAGE_INVALID, "status");
+
+    return res;
+  }
+
+  std::string
+  client_protocol::serialise (const message& msg)
+  {
+    std::string data;
+    for (const auto& field : msg)
+      {
+        if (field.first.empty() ||
+            field.first.find_first_of("=", 0) != std::string::npos ||
+            field.first.find('\0') != std::string::npos ||
+            field.second.find('\0') != std::string::npos)
+          throw client::error(client::MESSAGE_INVALID, field.first);
+
+        data += field.first;
+        data += '=';
+        data += field.second;
+        data += '\0';
+      }
+    return data;
+  }
+
+  client_protocol::message
+  client_protocol::deserialise (const std::string& data)
+  {
+    message msg;
+
+    std::string::size_type pos = 0;
+    while (pos < data.size())
+      {
+        std::string::size_type end = data.find('\0', pos);
+        if (end == std::string::npos)
+          throw client::error(client::MESSAGE_INVALID, data.substr(pos));
+
+        std::string::size_type sep = data.find('=', pos);
+        if (sep == pos || sep >= end)
+          throw client::error(client::MESSAGE_INVALID, data.substr(pos, end - pos));
+
+        msg.push_back(std::make_pair(data.substr(pos, sep - pos),
+                                     data.substr(sep + 1, end - sep - 1)));
+        pos = end + 1;
+      }
+
+    return msg;
+  }
+
+  void
+  client_protocol::send (int                     sock,
+                         const message&          msg,
+                         const std::vector<int>& fds)
+  {
+    std::string data(serialise(msg));
+    if (data.size() > max_message_size || fds.size() > max_message_fds)
+      throw client::error(client::MESSAGE_SEND, strerror(EMSGSIZE));
+
+    struct iovec iov;
+    iov.iov_base = &data[0];
+    iov.iov_len = data.size();
+
+    std::vector<char> control(CMSG_SPACE(sizeof(int) * max_message_fds));
+
+    struct msghdr hdr;
+    std::memset(&hdr, 0, sizeof(hdr));
+    hdr.msg_iov = &iov;
+    hdr.msg_iovlen = 1;
+
+    if (!fds.empty())
+      {
+        hdr.msg_control = &control[0];
+        hdr.msg_controllen = CMSG_SPACE(sizeof(int) * fds.size());
+
+        struct cmsghdr *cmsg = CMSG_FIRSTHDR(&hdr);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(int) * fds.size());
+        std::memcpy(CMSG_DATA(cmsg), &fds[0], sizeof(int) * fds.size());
+      }
+
+    ssize_t sent;
+    while ((sent = sendmsg(sock, &hdr, MSG_NOSIGNAL)) == -1 && errno == EINTR)
+      ;
+    if (sent == -1)
+      throw client::error(client::MESSAGE_SEND, strerror(errno));
+  }
+
+  bool
+  client_protocol::receive (int               sock,
+                            message&          msg,
+                            std::vector<int>& fds)
+  {
+    msg.clear();
+    fds.clear();
+
+    std::string data(max_message_size, '\0');
+    struct iovec iov;
+    iov.iov_base = &data[0];
+    iov.iov_len = data.size();
+
+    std::vector<char> control(CMSG_SPACE(sizeof(int) * max_message_fds));
+
+    struct msghdr hdr;
+    std::memset(&hdr, 0, sizeof(hdr));
+    hdr.msg_iov = &iov;
+    hdr.msg_iovlen = 1;
+    hdr.msg_control = &control[0];
+    hdr.msg_controllen = control.size();
+
+    ssize_t received;
+    while ((received = recvmsg(sock, &hdr, MSG_CMSG_CLOEXEC)) == -1 &&
+           errno == EINTR)
+      ;
+    if (received == -1)
+      throw client::error(client::MESSAGE_RECEIVE, strerror(errno));
+
+    for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(&hdr);
+         cmsg != 0;
+         cmsg = CMSG_NXTHDR(&hdr, cmsg))
+      {
+        if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS)
+          {
+            std::size_t count = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+            std::size_t offset = fds.size();
+            fds.resize(offset + count);
+            std::memcpy(&fds[offset], CMSG_DATA(cmsg), sizeof(int) * count);
+          }
+      }
+
+    if (hdr.msg_flags & (MSG_TRUNC|MSG_CTRUNC))
+      {
+        close_fds(fds);
+        fds.clear();
+        throw client::error(client::MESSAGE_RECEIVE, strerror(EMSGSIZE));
+      }
+
+    if (received == 0)
+      {
+        close_fds(fds);
+        fds.clear();
+        return false;
+      }
+
+    data.resize(static_cast<std::string::size_type>(received));
+    try
+      {
+        msg = deserialise(data);
+      }
+    catch (const std::exception&)
+      {
+        close_fds(fds);
+        fds.clear();
+        throw;
+      }
+
+    return true;
+  }
+
+}
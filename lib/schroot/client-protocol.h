@@ -0,0 +1,154 @@
+/* Copyright © 2005-2013  Roger Leigh <rleigh@codelibre.net>
+ *
+ * schroot is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * schroot is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ *********************************************************************/
+
+#ifndef SCHROOT_CLIENT_PROTOCOL_H
+#define SCHROOT_CLIENT_PROTOCOL_H
+
+#include <schroot/client.h>
+
+#include <cstddef>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace schroot
+{
+
+  /**
+   * The protocol used between a client and the helper.  Requests and
+   * results are sent as messages over a sequenced packet socket.
+   * This is internal to schroot, and may change between releases;
+   * it is not installed.
+   */
+  class client_protocol
+  {
+  public:
+    /**
+     * A protocol message.  Each field is a name and a value, and
+     * names may be repeated to form lists.
+     */
+    typedef std::vector<std::pair<std::string, std::string>> message;
+
+    /// The maximum size of a message, in bytes.
+    static const std::size_t max_message_size;
+
+    /// The maximum number of file descriptors sent with a message.
+    static const std::size_t max_message_fds;
+
+    /**
+     * Encode a request as a message.
+     *
+     * @param id the request identifier.
+     * @param req the request.
+     * @returns the message.
+     */
+    static message
+    encode_request (unsigned long          id,
+                    const client::request& req);
+
+    /**
+     * Decode a request from a message.  The file descriptors to pass
+     * are returned with their targets, but with the descriptor
+     * numbers set to -1.
+     *
+     * @param msg the message.
+     * @param id the request identifier.
+     * @returns the request.
+     */
+    static client::request
+    decode_request (const message& msg,
+                    unsigned long& id);
+
+    /**
+     * Encode a result as a message.
+     *
+     * @param id the request identifier.
+     * @param res the result.
+     * @returns the message.
+     */
+    static message
+    encode_result (unsigned long         id,
+                   const client::result& res);
+
+    /**
+     * Decode a result from a message.
+     *
+     * @param msg the message.
+     * @param id the request identifier.
+     * @returns the result.
+     */
+    static client::result
+    decode_result (const message& msg,
+                   unsigned long& id);
+
+    /**
+     * Convert a message to its wire format.  Each field is written as
+     * "name=value", terminated by a NUL character.
+     *
+     * @param msg the message.
+     * @returns the message data.
+     */
+    static std::string
+    serialise (const message& msg);
+
+    /**
+     * Convert a message from its wire format.
+     *
+     * @param data the message data.
+     * @returns the message.
+     */
+    static message
+    deserialise (const std::string& data);
+
+    /**
+     * Send a message over a socket, together with file descriptors.
+     *
+     * @param sock the socket.
+     * @param msg the message.
+     * @param fds file descriptors to send.
+     */
+    static void
+    send (int                     sock,
+          const message&          msg,
+          const std::vector<int>& fds = std::vector<int>());
+
+    /**
+     * Receive a message from a socket, together with file
+     * descriptors.  Received file descriptors are close-on-exec.
+     *
+     * @param sock the socket.
+     * @param msg the message received.
+     * @param fds file descriptors received.
+     * @returns true if a message was received, or false at end of
+     * file.
+     */
+    static bool
+    receive (int               sock,
+             message&          msg,
+             std::vector<int>& fds);
+  };
+
+}
+
+#endif /* SCHROOT_CLIENT_PROTOCOL_H */
+
+/*
+ * Local Variables:
+ * mode:C++
+ * End:
+ */
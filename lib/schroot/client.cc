@@ -0,0 +1,388 @@
+/* Copyright © 2005-2013  Roger Leigh <rleigh@codelibre.net>
+ *
+ * schroot is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * schroot is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ *********************************************************************/
+
+#include <config.h>
+
+#include <schroot/client.h>
+#include <schroot/client-protocol.h>
+#include <schroot/util.h>
+
+#include <cerrno>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <utility>
+
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace schroot
+{
+
+  template<>
+  error<client::error_code>::map_type
+  error<client::error_code>::error_strings =
+    {
+      // TRANSLATORS: %1% = program
+      {client::HELPER_START,    N_("%1%: Failed to start helper")},
+      {client::HELPER_EXIT,     N_("Helper exited")},
+      {client::MESSAGE_SEND,    N_("Failed to send message")},
+      {client::MESSAGE_RECEIVE, N_("Failed to receive message")},
+      // TRANSLATORS: %4% = message field
+      {client::MESSAGE_INVALID, N_("Invalid message field ‘%4%’")},
+      {client::REQUEST_INVALID, N_("Invalid request")}
+    };
+
+  client::request::request ():
+    operation(schroot::session::OPERATION_AUTOMATIC),
+    chroot(),
+    session(),
+    user(),
+    command(),
+    environment(),
+    preserve_environment(false),
+    directory(),
+    options(),
+    fds()
+  {
+  }
+
+  client::result::result ():
+    session(),
+    status(EXIT_FAILURE),
+    diagnostics()
+  {
+  }
+
+  std::string
+  client::result::get_error () const
+  {
+    for (const auto& diag : this->diagnostics)
+      if (diag.level == LOG_LEVEL_ERROR)
+        return diag.message;
+    return std::string();
+  }
+
+  client::handle::handle ():
+    st()
+  {
+  }
+
+  client::handle::handle (std::shared_ptr<state> st):
+    st(st)
+  {
+  }
+
+  bool
+  client::handle::valid () const
+  {
+    return static_cast<bool>(this->st);
+  }
+
+  bool
+  client::handle::ready () const
+  {
+    if (!this->st)
+      throw error(REQUEST_INVALID);
+
+    std::lock_guard<std::mutex> guard(this->st->lock);
+    return this->st->complete;
+  }
+
+  const client::result&
+  client::handle::wait () const
+  {
+    if (!this->st)
+      throw error(REQUEST_INVALID);
+
+    std::unique_lock<std::mutex> guard(this->st->lock);
+    this->st->done.wait(guard, [this] { return this->st->complete; });
+    return this->st->res;
+  }
+
+  bool
+  client::handle::wait_for (unsigned int timeout) const
+  {
+    if (!this->st)
+      throw error(REQUEST_INVALID);
+
+    std::unique_lock<std::mutex> guard(this->st->lock);
+    return this->st->done.wait_for(guard,
+                                   std::chrono::milliseconds(timeout),
+                                   [this] { return this->st->complete; });
+  }
+
+  client::client ():
+    sock(-1),
+    helper(-1),
+    lock(),
+    pending(),
+    next_id(1),
+    connected(false),
+    reader()
+  {
+    start(SCHROOT_PROGRAM);
+  }
+
+  client::client (const std::string& helper):
+    sock(-1),
+    helper(-1),
+    lock(),
+    pending(),
+    next_id(1),
+    connected(false),
+    reader()
+  {
+    start(helper);
+  }
+
+  client::~client ()
+  {
+    // The helper completes outstanding requests, and then exits when
+    // it reads end of file.
+    shutdown(this->sock, SHUT_WR);
+
+    if (this->reader.joinable())
+      this->reader.join();
+
+    close(this->sock);
+
+    int status;
+    while (waitpid(this->helper, &status, 0) == -1 && errno == EINTR)
+      ;
+  }
+
+  void
+  client::start (const std::string& helper)
+  {
+    int fds[2];
+    if (socketpair(AF_UNIX, SOCK_SEQPACKET|SOCK_CLOEXEC, 0, fds) == -1)
+      throw error(helper, HELPER_START, strerror(errno));
+
+    // Prepare arguments before forking, since only async-signal-safe
+    // functions may be used in the child of a threaded process.
+    std::string arg0("schroot");
+    std::string arg1("--serve");
+    char *argv[] = { &arg0[0], &arg1[0], 0 };
+
+    this->helper = fork();
+    if (this->helper == -1)
+      {
+        int saved_errno = errno;
+        close(fds[0]);
+        close(fds[1]);
+        throw error(helper, HELPER_START, strerror(saved_errno));
+      }
+    else if (this->helper == 0)
+      {
+        // The helper receives requests on standard input.
+        if (dup2(fds[1], STDIN_FILENO) == -1)
+          _exit(EXIT_FAILURE);
+        execv(helper.c_str(), argv);
+        _exit(EXIT_FAILURE);
+      }
+
+    close(fds[1]);
+    this->sock = fds[0];
+    this->connected = true;
+
+    this->reader = std::thread(&client::read_results, this);
+  }
+
+  client::handle
+  client::submit (const request&  req,
+                  const callback& cb)
+  {
+    for (const auto& fd : req.fds)
+      if (fd.first < 0 || fd.second < 0)
+        throw error(REQUEST_INVALID);
+    if (req.fds.size() > client_protocol::max_message_fds)
+      throw error(REQUEST_INVALID);
+
+    std::vector<int> fds;
+    for (const auto& fd : req.fds)
+      fds.push_back(fd.second);
+
+    std::shared_ptr<handle::state> st(new handle::state);
+    st->complete = false;
+    st->cb = cb;
+
+    std::lock_guard<std::mutex> guard(this->lock);
+    if (!this->connected)
+      throw error(HELPER_EXIT);
+
+    unsigned long id = this->next_id++;
+    client_protocol::message msg(client_protocol::encode_request(id, req));
+
+    this->pending.insert(std::make_pair(id, st));
+    try
+      {
+        client_protocol::send(this->sock, msg, fds);
+      }
+    catch (const std::exception&)
+      {
+        this->pending.erase(id);
+        throw;
+      }
+
+    return handle(st);
+  }
+
+  client::handle
+  client::begin (const std::string& chroot,
+                 const std::string& session,
+                 const callback&    cb)
+  {
+    request req;
+    req.operation = schroot::session::OPERATION_BEGIN;
+    req.chroot = chroot;
+    req.session = session;
+    return submit(req, cb);
+  }
+
+  client::handle
+  client::run (const std::string&        session,
+               const string_list&        command,
+               const std::map<int, int>& fds,
+               const callback&           cb)
+  {
+    request req;
+    req.operation = schroot::session::OPERATION_RUN;
+    req.session = session;
+    req.command = command;
+    req.fds = fds;
+    return submit(req, cb);
+  }
+
+  client::handle
+  client::end (const std::string& session,
+               const callback&    cb)
+  {
+    request req;
+    req.operation = schroot::session::OPERATION_END;
+    req.session = session;
+    return submit(req, cb);
+  }
+
+  std::size_t
+  client::get_pending () const
+  {
+    std::lock_guard<std::mutex> guard(this->lock);
+    return this->pending.size();
+  }
+
+  chroot::config::ptr
+  client::get_config () const
+  {
+    chroot::config::ptr config(new chroot::config);
+    config->add("chroot", SCHROOT_CONF);
+    config->add("chroot", SCHROOT_CONF_CHROOT_D);
+    config->add("session", SCHROOT_SESSION_DIR);
+    return config;
+  }
+
+  void
+  client::read_results ()
+  {
+    result failure;
+    diagnostic diag;
+    diag.level = LOG_LEVEL_ERROR;
+
+    try
+      {
+        client_protocol::message msg;
+        std::vector<int> fds;
+        while (client_protocol::receive(this->sock, msg, fds))
+          {
+            // No file descriptors are returned with results.
+            for (const auto& fd : fds)
+              close(fd);
+
+            unsigned long id = 0;
+            result res;
+            try
+              {
+                res = client_protocol::decode_result(msg, id);
+              }
+            catch (const error& e)
+              {
+                log_exception_warning(e);
+                continue;
+              }
+
+            std::shared_ptr<handle::state> st;
+            {
+              std::lock_guard<std::mutex> guard(this->lock);
+              auto pos = this->pending.find(id);
+              // A request may already have been completed, if the
+              // helper reported the failure of a request after its
+              // result was sent.
+              if (pos == this->pending.end())
+                continue;
+              st = pos->second;
+              this->pending.erase(pos);
+            }
+            complete(st, res);
+          }
+        diag.message = error(HELPER_EXIT).what();
+      }
+    catch (const std::exception& e)
+      {
+        diag.message = e.what();
+      }
+    failure.diagnostics.push_back(diag);
+
+    // Fail any requests which will now never complete.
+    std::map<unsigned long, std::shared_ptr<handle::state>> incomplete;
+    {
+      std::lock_guard<std::mutex> guard(this->lock);
+      this->connected = false;
+      std::swap(incomplete, this->pending);
+    }
+    for (const auto& request : incomplete)
+      complete(request.second, failure);
+  }
+
+  void
+  client::complete (const std::shared_ptr<handle::state>& st,
+                    const result&                         res)
+  {
+    callback cb;
+    {
+      std::lock_guard<std::mutex> guard(st->lock);
+      st->res = res;
+      st->complete = true;
+      std::swap(cb, st->cb);
+    }
+    st->done.notify_all();
+
+    if (cb)
+      {
+        try
+          {
+            cb(st->res);
+          }
+        catch (const std::exception& e)
+          {
+            log_exception_warning(e);
+          }
+      }
+  }
+
+}
@@ -0,0 +1,383 @@
+/* Copyright © 2005-2013  Roger Leigh <rleigh@codelibre.net>
+ *
+ * schroot is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * schroot is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ *********************************************************************/
+
+#ifndef SCHROOT_CLIENT_H
+#define SCHROOT_CLIENT_H
+
+#include <schroot/chroot/config.h>
+#include <schroot/custom-error.h>
+#include <schroot/log.h>
+#include <schroot/session.h>
+#include <schroot/types.h>
+
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/types.h>
+
+namespace schroot
+{
+
+  /**
+   * Programmatic control of sessions.
+   *
+   * Beginning, running and ending sessions requires privileges, so
+   * a client does not perform session operations itself.  Instead,
+   * it starts a single helper process, the setuid schroot program
+   * run with --serve, and sends requests to it over a socket.  Each
+   * request is carried out in a child of the helper exactly as if
+   * schroot had been run with the equivalent options, including
+   * authentication of the calling user, so the privilege boundary is
+   * unchanged.  Because the helper is started only once, and results
+   * are returned as structured data rather than printed, the cost of
+   * starting schroot and parsing its output is not paid for every
+   * operation.
+   *
+   * Requests are carried out concurrently, and may be submitted
+   * without waiting for earlier requests to complete.  Operations on
+   * the same session must be ordered by the caller, for example by
+   * waiting for a session to begin before running commands in it.
+   * Each request returns a handle which may be waited upon, and a
+   * callback may be run on completion.  Callbacks are run by a
+   * thread owned by the client, and must not block.
+   *
+   * The chroots and sessions available may be listed and queried
+   * using the configuration returned by get_config().
+   */
+  class client
+  {
+  public:
+    /// Error codes.
+    enum error_code
+      {
+        HELPER_START,     ///< Failed to start helper.
+        HELPER_EXIT,      ///< Helper exited.
+        MESSAGE_SEND,     ///< Failed to send message.
+        MESSAGE_RECEIVE,  ///< Failed to receive message.
+        MESSAGE_INVALID,  ///< Invalid message.
+        REQUEST_INVALID   ///< Invalid request.
+      };
+
+    /// Exception type.
+    typedef custom_error<error_code> error;
+
+    /// A request.
+    struct request
+    {
+      /// The constructor.
+      request ();
+
+      /// The session operation.
+      schroot::session::operation operation;
+      /// The chroot to begin a session in, or to run automatically.
+      std::string        chroot;
+      /**
+       * The session to run, recover or end.  When beginning a
+       * session, the name to give the new session; a name is
+       * generated if empty.
+       */
+      std::string        session;
+      /// The user to run as; the calling user if empty.
+      std::string        user;
+      /// The command to run; a login shell if empty.
+      string_list        command;
+      /**
+       * The environment, as NAME=VALUE strings.  If empty, the
+       * environment of the client when the helper was started is
+       * used.
+       */
+      string_list        environment;
+      /// Preserve the environment inside the chroot.
+      bool               preserve_environment;
+      /// The working directory inside the chroot.
+      std::string        directory;
+      /// User options (see --option).
+      string_map         options;
+      /**
+       * File descriptors to pass to the session, as a mapping from
+       * the descriptor number in the session to a descriptor in the
+       * caller.  Standard input, output and error are connected to
+       * /dev/null unless mapped.  When beginning a session, the
+       * session name is returned in the result, and standard output
+       * is not used.
+       */
+      std::map<int, int> fds;
+    };
+
+    /// A message logged while carrying out a request.
+    struct diagnostic
+    {
+      /// The message severity.
+      log_level   level;
+      /// The message text.
+      std::string message;
+      /// Structured fields (see log_context), for example "chroot".
+      string_map  fields;
+    };
+
+    /// The result of a request.
+    struct result
+    {
+      /// The constructor.
+      result ();
+
+      /// The session name, when beginning a session.
+      std::string             session;
+      /**
+       * The exit status: 0 on success, 1 on failure, or the exit
+       * status of the command run.
+       */
+      int                     status;
+      /// Warnings and errors logged while carrying out the request.
+      std::vector<diagnostic> diagnostics;
+
+      /**
+       * Get the first error logged.
+       *
+       * @returns the error message, or an empty string if no error
+       * was logged.
+       */
+      std::string
+      get_error () const;
+    };
+
+    /// A completion callback.
+    typedef std::function<void (const result&)> callback;
+
+    /// A handle to wait upon the completion of a request.
+    class handle
+    {
+    public:
+      /// The constructor.  The handle is not valid.
+      handle ();
+
+      /**
+       * Check if the handle refers to a request.
+       *
+       * @returns true if valid, otherwise false.
+       */
+      bool
+      valid () const;
+
+      /**
+       * Check if the request has completed.
+       *
+       * @returns true if completed, otherwise false.
+       */
+      bool
+      ready () const;
+
+      /**
+       * Wait for the request to complete.
+       *
+       * @returns the result.
+       */
+      const result&
+      wait () const;
+
+      /**
+       * Wait for the request to complete, with a timeout.
+       *
+       * @param timeout the time to wait, in milliseconds.
+       * @returns true if completed, or false if the timeout expired.
+       */
+      bool
+      wait_for (unsigned int timeout) const;
+
+    private:
+      friend class client;
+
+      /// Request state shared with the client.
+      struct state
+      {
+        /// The state lock.
+        std::mutex              lock;
+        /// Signalled on completion.
+        std::condition_variable done;
+        /// Has the request completed?
+        bool                    complete;
+        /// The result.
+        result                  res;
+        /// The completion callback.
+        callback                cb;
+      };
+
+      /**
+       * The constructor.
+       *
+       * @param st the request state.
+       */
+      handle (std::shared_ptr<state> st);
+
+      /// The request state.
+      std::shared_ptr<state> st;
+    };
+
+    /**
+     * The constructor.  The installed schroot program is used as the
+     * helper.
+     */
+    client ();
+
+    /**
+     * The constructor.
+     *
+     * @param helper the path to the schroot program.
+     */
+    client (const std::string& helper);
+
+    /**
+     * The destructor.  Waits for outstanding requests to complete,
+     * and for the helper to exit.
+     */
+    virtual ~client ();
+
+    client (const client& rhs) = delete;
+    client& operator = (const client& rhs) = delete;
+
+    /**
+     * Submit a request.
+     *
+     * @param req the request.
+     * @param cb a callback to run on completion.
+     * @returns a handle for the request.
+     */
+    handle
+    submit (const request&  req,
+            const callback& cb = callback());
+
+    /**
+     * Begin a session.
+     *
+     * @param chroot the chroot to begin a session in.
+     * @param session the session name; a name is generated if
+     * empty.
+     * @param cb a callback to run on completion.
+     * @returns a handle for the request.
+     */
+    handle
+    begin (const std::string& chroot,
+           const std::string& session = std::string(),
+           const callback&    cb = callback());
+
+    /**
+     * Run a command in a session.
+     *
+     * @param session the session.
+     * @param command the command to run.
+     * @param fds file descriptors to pass (see request::fds).
+     * @param cb a callback to run on completion.
+     * @returns a handle for the request.
+     */
+    handle
+    run (const std::string&        session,
+         const string_list&        command,
+         const std::map<int, int>& fds = std::map<int, int>(),
+         const callback&           cb = callback());
+
+    /**
+     * End a session.
+     *
+     * @param session the session.
+     * @param cb a callback to run on completion.
+     * @returns a handle for the request.
+     */
+    handle
+    end (const std::string& session,
+         const callback&    cb = callback());
+
+    /**
+     * Get the number of requests which have not completed.
+     *
+     * @returns the number of requests.
+     */
+    std::size_t
+    get_pending () const;
+
+    /**
+     * Get the chroot configuration.  The chroots and sessions which
+     * exist are loaded into the "chroot", "source" and "session"
+     * namespaces, and may be listed and queried using the
+     * chroot::config interface.  The configuration is read directly
+     * rather than by the helper, and is not updated as sessions
+     * begin and end; get it again to see the current sessions.
+     *
+     * @returns the chroot configuration.
+     */
+    chroot::config::ptr
+    get_config () const;
+
+  private:
+    /**
+     * Start the helper.
+     *
+     * @param helper the path to the schroot program.
+     */
+    void
+    start (const std::string& helper);
+
+    /**
+     * Receive results from the helper until it exits.  This is run
+     * by the reader thread.
+     */
+    void
+    read_results ();
+
+    /**
+     * Complete a request.
+     *
+     * @param st the request state.
+     * @param res the result.
+     */
+    static void
+    complete (const std::shared_ptr<handle::state>& st,
+              const result&                         res);
+
+    /// The socket connected to the helper.
+    int                                               sock;
+    /// The helper process.
+    pid_t                                             helper;
+    /// The lock protecting the pending requests.
+    mutable std::mutex                                lock;
+    /// Requests which have not completed, by identifier.
+    std::map<unsigned long,
+             std::shared_ptr<handle::state>>          pending;
+    /// The next request identifier.
+    unsigned long                                     next_id;
+    /// Is the helper still running?
+    bool                                              connected;
+    /// The thread receiving results.
+    std::thread                                       reader;
+  };
+
+}
+
+#endif /* SCHROOT_CLIENT_H */
+
+/*
+ * Local Variables:
+ * mode:C++
+ * End:
+ */
@@ -33,15 +33,27 @@
 /* Set if personality support is present */
 #cmakedefine SCHROOT_FEATURE_PERSONALITY 1
 
+/* Set if unshare support is present */
+#cmakedefine SCHROOT_FEATURE_UNSHARE 1
+
+/* Set if cgroup support is present */
+#cmakedefine SCHROOT_FEATURE_CGROUP 1
+
 /* Set if the block-device chroot type is present */
 #cmakedefine SCHROOT_FEATURE_BLOCKDEV 1
 
 /* Set if the btrfs-snapshot chroot type is present */
 #cmakedefine SCHROOT_FEATURE_BTRFSSNAP 1
 
+/* Set if the reflink-clone chroot type is present */
+#cmakedefine SCHROOT_FEATURE_REFLINK 1
+
 /* Set if the loopback chroot type is present */
 #cmakedefine SCHROOT_FEATURE_LOOPBACK 1
 
+/* Set if native loop device management is present */
+#cmakedefine SCHROOT_FEATURE_LOOPDEV 1
+
 /* Set if the union filesystem type is present */
 #cmakedefine SCHROOT_FEATURE_UNION 1
 
@@ -76,8 +88,15 @@
 #cmakedefine SCHROOT_FILE_UNPACK_DIR "${SCHROOT_FILE_UNPACK_DIR}"
 #cmakedefine SCHROOT_OVERLAY_DIR "${SCHROOT_OVERLAY_DIR}"
 #cmakedefine SCHROOT_UNDERLAY_DIR "${SCHROOT_UNDERLAY_DIR}"
+#cmakedefine SCHROOT_RECLAIM_DIR "${SCHROOT_RECLAIM_DIR}"
+#cmakedefine SCHROOT_POOL_DIR "${SCHROOT_POOL_DIR}"
+#cmakedefine SCHROOT_LEASE_DIR "${SCHROOT_LEASE_DIR}"
+#cmakedefine SCHROOT_COPYFILES_DIR "${SCHROOT_COPYFILES_DIR}"
+#cmakedefine SCHROOT_NSS_DIR "${SCHROOT_NSS_DIR}"
+#cmakedefine SCHROOT_METRICS_DIR "${SCHROOT_METRICS_DIR}"
 #cmakedefine SCHROOT_SYSCONF_DIR "${SCHROOT_SYSCONF_DIR}"
 #cmakedefine SCHROOT_CONF "${SCHROOT_CONF}"
+#cmakedefine SCHROOT_PROGRAM "${SCHROOT_PROGRAM}"
 #cmakedefine SCHROOT_CONF_CHROOT_D "${SCHROOT_CONF_CHROOT_D}"
 #cmakedefine SCHROOT_CONF_SETUP_D "${SCHROOT_CONF_SETUP_D}"
 #cmakedefine SCHROOT_SETUP_DATA_DIR "${SCHROOT_SETUP_DATA_DIR}"
@@ -0,0 +1,508 @@
+/* Copyright © 2005-2013  Roger Leigh <rleigh@codelibre.net>
+ *
+ * schroot is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * schroot is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ *********************************************************************/
+
+#include <config.h>
+
+#include <schroot/copyfiles.h>
+#include <schroot/log.h>
+#include <schroot/reflink.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include <boost/format.hpp>
+
+using std::endl;
+using boost::format;
+
+namespace schroot
+{
+
+  template<>
+  error<copyfiles::error_code>::map_type
+  error<copyfiles::error_code>::error_strings =
+    {
+      {copyfiles::FILE_MISSING, N_("Not copying nonexistent file")},
+      {copyfiles::FILE_READ,    N_("Failed to read file")},
+      {copyfiles::LIST_OPEN,    N_("Failed to open file list")}
+    };
+
+  namespace
+  {
+
+    /// Maximum number of digests to cache.
+    const std::size_t cache_size = 4096;
+
+    /// Time after which the use of a cache entry is recorded again.
+    const time_t cache_touch = 24 * 60 * 60;
+
+    const uint64_t prime1 = 11400714785074694791ULL;
+    const uint64_t prime2 = 14029467366897019727ULL;
+    const uint64_t prime3 =  1609587929392839161ULL;
+    const uint64_t prime4 =  9650029242287828579ULL;
+    const uint64_t prime5 =  2870177450012600261ULL;
+
+    inline uint64_t
+    rotl (uint64_t x,
+          int      r)
+    {
+      return (x << r) | (x >> (64 - r));
+    }
+
+    inline uint64_t
+    read64 (const unsigned char *p)
+    {
+      uint64_t v;
+      memcpy(&v, p, sizeof(v));
+      return v;
+    }
+
+    inline uint32_t
+    read32 (const unsigned char *p)
+    {
+      uint32_t v;
+      memcpy(&v, p, sizeof(v));
+      return v;
+    }
+
+    inline uint64_t
+    xxh64_round (uint64_t acc,
+                 uint64_t input)
+    {
+      acc += input * prime2;
+      acc = rotl(acc, 31);
+      return acc * prime1;
+    }
+
+    inline uint64_t
+    xxh64_merge (uint64_t acc,
+                 uint64_t val)
+    {
+      acc ^= xxh64_round(0, val);
+      return acc * prime1 + prime4;
+    }
+
+    /**
+     * Compute the XXH64 hash of a buffer, with a seed of zero.
+     * Input is read in host byte order.
+     *
+     * @param data the data to hash.
+     * @param len the length of the data.
+     * @returns the hash.
+     */
+    uint64_t
+    xxh64 (const unsigned char *data,
+           std::size_t          len)
+    {
+      const unsigned char *p = data;
+      const unsigned char *end = data + len;
+      uint64_t h;
+
+      if (len >= 32)
+        {
+          uint64_t v1 = prime1 + prime2;
+          uint64_t v2 = prime2;
+          uint64_t v3 = 0;
+          uint64_t v4 = -prime1;
+
+          for (; p + 32 <= end; p += 32)
+            {
+              v1 = xxh64_round(v1, read64(p));
+              v2 = xxh64_round(v2, read64(p + 8));
+              v3 = xxh64_round(v3, read64(p + 16));
+              v4 = xxh64_round(v4, read64(p + 24));
+            }
+
+          h = rotl(v1, 1) + rotl(v2, 7) + rotl(v3, 12) + rotl(v4, 18);
+          h = xxh64_merge(h, v1);
+          h = xxh64_merge(h, v2);
+          h = xxh64_merge(h, v3);
+          h = xxh64_merge(h, v4);
+        }
+      else
+        h = prime5;
+
+      h += static_cast<uint64_t>(len);
+
+      for (; p + 8 <= end; p += 8)
+        {
+          h ^= xxh64_round(0, read64(p));
+          h = rotl(h, 27) * prime1 + prime4;
+        }
+      if (p + 4 <= end)
+        {
+          h ^= static_cast<uint64_t>(read32(p)) * prime1;
+          h = rotl(h, 23) * prime2 + prime3;
+          p += 4;
+        }
+      for (; p < end; ++p)
+        {
+          h ^= (*p) * prime5;
+          h = rotl(h, 11) * prime1;
+        }
+
+      h ^= h >> 33;
+      h *= prime2;
+      h ^= h >> 29;
+      h *= prime3;
+      h ^= h >> 32;
+
+      return h;
+    }
+
+    /**
+     * Get the status of a file.  Only the fields used to identify
+     * the file and its contents are requested from statx(2); the
+     * others are zero.
+     *
+     * @param file the file.
+     * @param follow true to follow a symbolic link, otherwise false.
+     * @param status the status of the file.
+     * @returns true on success, or false on failure, setting errno.
+     */
+    bool
+    get_status (const std::string& file,
+                bool               follow,
+                struct ::stat&     status)
+    {
+      struct ::statx extended;
+      if (statx(AT_FDCWD, file.c_str(), follow ? 0 : AT_SYMLINK_NOFOLLOW,
+                STATX_TYPE|STATX_MODE|STATX_INO|STATX_SIZE|
+                STATX_MTIME|STATX_CTIME,
+                &extended) != 0)
+        return false;
+
+      memset(&status, 0, sizeof(status));
+      status.st_dev = makedev(extended.stx_dev_major, extended.stx_dev_minor);
+      status.st_ino = extended.stx_ino;
+      status.st_mode = extended.stx_mode;
+      status.st_size = extended.stx_size;
+      status.st_mtim.tv_sec = extended.stx_mtime.tv_sec;
+      status.st_mtim.tv_nsec = extended.stx_mtime.tv_nsec;
+      status.st_ctim.tv_sec = extended.stx_ctime.tv_sec;
+      status.st_ctim.tv_nsec = extended.stx_ctime.tv_nsec;
+      return true;
+    }
+
+  }
+
+  copyfiles::copyfiles ():
+    cache_file(std::string(SCHROOT_COPYFILES_DIR) + "/digests"),
+    cache(),
+    modified(false),
+    verbose(false)
+  {
+    load();
+  }
+
+  copyfiles::copyfiles (const std::string& cache_file):
+    cache_file(cache_file),
+    cache(),
+    modified(false),
+    verbose(false)
+  {
+    load();
+  }
+
+  copyfiles::~copyfiles ()
+  {
+  }
+
+  bool
+  copyfiles::get_verbose () const
+  {
+    return this->verbose;
+  }
+
+  void
+  copyfiles::set_verbose (bool verbose)
+  {
+    this->verbose = verbose;
+  }
+
+  void
+  copyfiles::load ()
+  {
+    std::ifstream input(this->cache_file.c_str());
+    std::string line;
+    while (std::getline(input, line))
+      {
+        std::istringstream fields(line);
+        dev_t dev;
+        ino_t ino;
+        off_t size;
+        time_t mtime, ctime;
+        long mtime_ns, ctime_ns;
+        entry value;
+        if (fields >> dev >> ino >> size >> mtime >> mtime_ns
+            >> ctime >> ctime_ns >> std::hex >> value.digest
+            >> std::dec >> value.used)
+          this->cache[std::make_tuple(dev, ino, size, mtime, mtime_ns,
+                                      ctime, ctime_ns)] = value;
+      }
+  }
+
+  void
+  copyfiles::save ()
+  {
+    if (!this->modified)
+      return;
+
+    // Keep the most recently used entries.
+    std::vector<cache_type::const_iterator> entries;
+    for (auto pos = this->cache.begin(); pos != this->cache.end(); ++pos)
+      entries.push_back(pos);
+    if (entries.size() > cache_size)
+      {
+        std::nth_element(entries.begin(), entries.begin() + cache_size,
+                         entries.end(),
+                         [] (const cache_type::const_iterator& a,
+                             const cache_type::const_iterator& b)
+                         { return a->second.used > b->second.used; });
+        entries.resize(cache_size);
+      }
+
+    std::ostringstream output;
+    for (const auto& pos : entries)
+      {
+        const key_type& key(pos->first);
+        output << std::get<0>(key) << ' ' << std::get<1>(key) << ' '
+               << std::get<2>(key) << ' ' << std::get<3>(key) << ' '
+               << std::get<4>(key) << ' ' << std::get<5>(key) << ' '
+               << std::get<6>(key) << ' '
+               << std::hex << pos->second.digest << std::dec << ' '
+               << pos->second.used << '\n';
+      }
+    std::string contents(output.str());
+
+    /* The cache is replaced atomically.  Concurrent writers may
+       lose each other's entries, which will be recomputed. */
+    std::string::size_type slash = this->cache_file.rfind('/');
+    if (slash != std::string::npos && slash != 0)
+      mkdir(this->cache_file.substr(0, slash).c_str(), 0755);
+
+    std::vector<char> temp(this->cache_file.begin(), this->cache_file.end());
+    const char *suffix = ".XXXXXX";
+    temp.insert(temp.end(), suffix, suffix + strlen(suffix) + 1);
+    int fd = mkostemp(&temp[0], O_CLOEXEC);
+    bool ok = fd >= 0;
+    if (ok)
+      {
+        ok = write(fd, contents.c_str(), contents.size()) ==
+          static_cast<ssize_t>(contents.size());
+        ok = (close(fd) == 0) && ok;
+        ok = ok && rename(&temp[0], this->cache_file.c_str()) == 0;
+        if (!ok)
+          unlink(&temp[0]);
+      }
+
+    if (!ok)
+      log_warning() << format(_("%1%: Failed to write digest cache: %2%"))
+        % this->cache_file % strerror(errno) << endl;
+    else
+      this->modified = false;
+  }
+
+  uint64_t
+  copyfiles::digest (const std::string& file)
+  {
+    int fd = open(file.c_str(), O_RDONLY|O_CLOEXEC);
+    if (fd < 0)
+      throw error(file, FILE_READ, strerror(errno));
+
+    struct ::stat status;
+    if (fstat(fd, &status) < 0)
+      {
+        int saved_errno = errno;
+        close(fd);
+        throw error(file, FILE_READ, strerror(saved_errno));
+      }
+
+    std::size_t len = status.st_size;
+    if (len == 0)
+      {
+        close(fd);
+        return xxh64(nullptr, 0);
+      }
+
+    void *data = mmap(nullptr, len, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data != MAP_FAILED)
+      {
+        close(fd);
+        uint64_t h = xxh64(static_cast<const unsigned char *>(data), len);
+        munmap(data, len);
+        return h;
+      }
+
+    // Files such as those in /proc can't be mapped.
+    std::vector<unsigned char> contents;
+    unsigned char buf[65536];
+    ssize_t count;
+    while ((count = read(fd, buf, sizeof(buf))) != 0)
+      {
+        if (count < 0)
+          {
+            if (errno == EINTR)
+              continue;
+            int saved_errno = errno;
+            close(fd);
+            throw error(file, FILE_READ, strerror(saved_errno));
+          }
+        contents.insert(contents.end(), buf, buf + count);
+      }
+    close(fd);
+
+    return xxh64(contents.data(), contents.size());
+  }
+
+  uint64_t
+  copyfiles::get_digest (const std::string&   file,
+                         const struct ::stat& status)
+  {
+    cache_type::iterator pos = this->cache.find(make_key(status));
+    if (pos != this->cache.end())
+      {
+        time_t now = time(nullptr);
+        if (now - pos->second.used > cache_touch)
+          {
+            pos->second.used = now;
+            this->modified = true;
+          }
+        return pos->second.digest;
+      }
+
+    uint64_t value = digest(file);
+    set_digest(status, value);
+    return value;
+  }
+
+  copyfiles::key_type
+  copyfiles::make_key (const struct ::stat& status)
+  {
+    return std::make_tuple(status.st_dev, status.st_ino, status.st_size,
+                           status.st_mtim.tv_sec, status.st_mtim.tv_nsec,
+                           status.st_ctim.tv_sec, status.st_ctim.tv_nsec);
+  }
+
+  void
+  copyfiles::set_digest (const struct ::stat& status,
+                         uint64_t             digest)
+  {
+    entry value;
+    value.digest = digest;
+    value.used = time(nullptr);
+    this->cache[make_key(status)] = value;
+    this->modified = true;
+  }
+
+  bool
+  copyfiles::copy (const std::string& source,
+                   const std::string& destination)
+  {
+    struct ::stat source_status;
+    if (!get_status(source, true, source_status))
+      throw error(source, FILE_MISSING, strerror(errno));
+
+    struct ::stat destination_status;
+    bool exists = get_status(destination, false, destination_status);
+
+    if (exists &&
+        source_status.st_dev == destination_status.st_dev &&
+        source_status.st_ino == destination_status.st_ino)
+      return false;
+
+    if (!S_ISREG(source_status.st_mode))
+      {
+        // Copy non-regular file directly.
+        if (this->verbose)
+          log_info() << format(_("Copying ‘%1%’ to ‘%2%’"))
+            % source % destination << endl;
+
+        reflink::copy_special(source, destination);
+        return true;
+      }
+
+    // Copy if the destination is a symlink, or the sizes differ.
+    if (exists && S_ISREG(destination_status.st_mode) &&
+        source_status.st_size == destination_status.st_size &&
+        get_digest(source, source_status) ==
+        get_digest(destination, destination_status))
+      return false;
+
+    if (this->verbose)
+      log_info() << format(_("Copying ‘%1%’ to ‘%2%’"))
+        % source % destination << endl;
+
+    // NOTE: This is a non-standard GNU extension.
+    char *rpath = realpath(source.c_str(), nullptr);
+    if (rpath == nullptr)
+      throw error(source, FILE_MISSING, strerror(errno));
+    std::string real_source(rpath);
+    free(rpath);
+
+    reflink::copy_file(real_source, destination);
+
+    // Record the copy, so that it is not read next time.
+    if (get_status(destination, false, destination_status))
+      set_digest(destination_status, get_digest(source, source_status));
+
+    return true;
+  }
+
+  unsigned int
+  copyfiles::copy_list (const std::string& list,
+                        const std::string& root)
+  {
+    std::ifstream input(list.c_str());
+    if (!input)
+      throw error(list, LIST_OPEN, strerror(errno));
+
+    unsigned int count = 0;
+    std::string file;
+    while (std::getline(input, file))
+      {
+        if (file.empty() || file[0] == '#')
+          continue;
+
+        if (file[0] != '/')
+          {
+            log_warning() << format(_("Not copying file with relative path: %1%"))
+              % file << endl;
+            continue;
+          }
+
+        if (copy(file, root + file))
+          ++count;
+      }
+
+    return count;
+  }
+
+}
@@ -0,0 +1,210 @@
+/* Copyright © 2005-2013  Roger Leigh <rleigh@codelibre.net>
+ *
+ * schroot is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * schroot is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ *********************************************************************/
+
+#ifndef SCHROOT_COPYFILES_H
+#define SCHROOT_COPYFILES_H
+
+#include <schroot/custom-error.h>
+
+#include <cstdint>
+#include <ctime>
+#include <map>
+#include <string>
+#include <tuple>
+
+#include <sys/stat.h>
+
+namespace schroot
+{
+
+  /**
+   * Copy files from the host into a chroot, if they differ.
+   *
+   * Files are compared using a fast non-cryptographic digest of
+   * their contents (XXH64).  Digests are cached, keyed by the device,
+   * inode, size and modification and change times of each file, so
+   * that a file which has not changed since its digest was recorded
+   * is not read.  An unchanged file costs a statx(2) of both the
+   * source and the destination and two cache lookups: the
+   * destination is checked as well as the source, since it may have
+   * been modified within the chroot since it was copied.  Files are
+   * copied with reflink::copy_file, preserving ownership,
+   * permissions, extended attributes and timestamps.
+   */
+  class copyfiles
+  {
+  public:
+    /// Error codes.
+    enum error_code
+      {
+        FILE_MISSING, ///< File does not exist.
+        FILE_READ,    ///< Failed to read file.
+        LIST_OPEN     ///< Failed to open file list.
+      };
+
+    /// Exception type.
+    typedef custom_error<error_code> error;
+
+    /**
+     * The constructor.  The default digest cache will be used.
+     */
+    copyfiles ();
+
+    /**
+     * The constructor.
+     *
+     * @param cache_file the file to cache digests in.
+     */
+    copyfiles (const std::string& cache_file);
+
+    /// The destructor.
+    virtual ~copyfiles ();
+
+    /**
+     * Get the verbosity level.
+     *
+     * @returns true if verbose, otherwise false.
+     */
+    bool
+    get_verbose () const;
+
+    /**
+     * Set the verbosity level.
+     *
+     * @param verbose true to log each file copied, otherwise false.
+     */
+    void
+    set_verbose (bool verbose);
+
+    /**
+     * Copy a file, if the source and destination differ.  Symbolic
+     * links to regular files in the source are followed.  Files
+     * which are not regular files, including symbolic links to
+     * them, are always copied as cp -a would, using
+     * reflink::copy_special.
+     *
+     * @param source the file to copy.
+     * @param destination the path to copy to.
+     * @returns true if the file was copied, or false if it was
+     * unchanged.
+     */
+    bool
+    copy (const std::string& source,
+          const std::string& destination);
+
+    /**
+     * Copy the files listed in a file into a chroot.  The list
+     * contains one absolute path per line.  Blank lines and lines
+     * beginning with ‘#’ are ignored.
+     *
+     * @param list the file containing the list of files.
+     * @param root the root directory of the chroot.
+     * @returns the number of files copied.
+     */
+    unsigned int
+    copy_list (const std::string& list,
+               const std::string& root);
+
+    /**
+     * Write the digest cache, if it has changed.  Failure to write
+     * the cache is not an error, but is logged.
+     */
+    void
+    save ();
+
+    /**
+     * Compute the digest of a file.
+     *
+     * @param file the file to read.
+     * @returns the XXH64 digest of the file contents.
+     */
+    static uint64_t
+    digest (const std::string& file);
+
+  private:
+    /// Digest cache key: device, inode, size, mtime and ctime.
+    typedef std::tuple<dev_t, ino_t, off_t,
+                       time_t, long, time_t, long> key_type;
+
+    /// Digest cache entry.
+    struct entry
+    {
+      /// The file digest.
+      uint64_t digest;
+      /// The time the entry was last used.
+      time_t   used;
+    };
+
+    /// Digest cache.
+    typedef std::map<key_type, entry> cache_type;
+
+    /**
+     * Load the digest cache.
+     */
+    void
+    load ();
+
+    /**
+     * Get the digest of a file, using the cache if possible.
+     *
+     * @param file the file.
+     * @param status the status of the file.
+     * @returns the digest.
+     */
+    uint64_t
+    get_digest (const std::string& file,
+                const struct ::stat& status);
+
+    /**
+     * Record the digest of a file in the cache.
+     *
+     * @param status the status of the file.
+     * @param digest the digest.
+     */
+    void
+    set_digest (const struct ::stat& status,
+                uint64_t             digest);
+
+    /**
+     * Get the digest cache key for a file.
+     *
+     * @param status the status of the file.
+     * @returns the key.
+     */
+    static key_type
+    make_key (const struct ::stat& status);
+
+    /// The digest cache file.
+    std::string cache_file;
+    /// The digest cache.
+    cache_type  cache;
+    /// Has the cache been modified?
+    bool        modified;
+    /// Log each file copied.
+    bool        verbose;
+  };
+
+}
+
+#endif /* SCHROOT_COPYFILES_H */
+
+/*
+ * Local Variables:
+ * mode:C++
+ * End:
+ */
@@ -136,8 +136,8 @@ namespace schroot
                   error_type error,
                   D const&   detail,
                   E const&   detail2):
-      schroot::error<T>(format_error(context, nullptr, nullptr, error, detail, detail2, nullptr),
-                        format_reason(context, nullptr, nullptr, error, detail, detail2, nullptr))
+      schroot::error<T>(this->format_error(context, nullptr, nullptr, error, detail, detail2, nullptr),
+                        this->format_reason(context, nullptr, nullptr, error, detail, detail2, nullptr))
     {
     }
 
@@ -20,6 +20,7 @@
 
 #include <schroot/environment.h>
 
+#include <algorithm>
 #include <cstring>
 
 using boost::format;
@@ -27,14 +28,117 @@ using boost::format;
 namespace schroot
 {
 
+  namespace
+  {
+
+    /**
+     * Split a filter of the form ^(NAME|PREFIX.*|...)$ into names and
+     * prefixes.
+     *
+     * @param pattern the filter regex.
+     * @param names the names matched.
+     * @param prefixes the prefixes matched.
+     * @returns true if the filter is of this form, or false if the
+     * regex must be used.
+     */
+    bool
+    compile_filter (const std::string&               pattern,
+                    std::unordered_set<std::string>& names,
+                    std::vector<std::string>&        prefixes)
+    {
+      if (pattern.size() < 2 ||
+          pattern[0] != '^' || pattern[pattern.size() - 1] != '$')
+        return false;
+
+      std::string body(pattern.substr(1, pattern.size() - 2));
+      if (body.size() >= 2 &&
+          body[0] == '(' && body[body.size() - 1] == ')')
+        body = body.substr(1, body.size() - 2);
+      // ^A|B$ is (^A)|(B$), not ^(A|B)$.
+      else if (body.find('|') != std::string::npos)
+        return false;
+
+      std::string::size_type start = 0;
+      while (true)
+        {
+          std::string::size_type end = body.find('|', start);
+          std::string alternative(body.substr(start, end - start));
+
+          bool prefix = false;
+          if (alternative.size() >= 2 &&
+              alternative.compare(alternative.size() - 2, 2, ".*") == 0)
+            {
+              alternative.erase(alternative.size() - 2);
+              prefix = true;
+            }
+
+          if (alternative.empty() && !prefix)
+            return false;
+          for (const auto& chr : alternative)
+            if (!((chr >= 'A' && chr <= 'Z') ||
+                  (chr >= 'a' && chr <= 'z') ||
+                  (chr >= '0' && chr <= '9') ||
+                  chr == '_'))
+              return false;
+
+          if (prefix)
+            prefixes.push_back(alternative);
+          else
+            names.insert(alternative);
+
+          if (end == std::string::npos)
+            break;
+          start = end + 1;
+        }
+
+      return true;
+    }
+
+  }
+
+  environment::envp::envp (const environment& env):
+    data(),
+    strings()
+  {
+    std::string::size_type length = 0;
+    for (const auto& item : env)
+      length += item.first.size() + item.second.size() + 2;
+    this->data.resize(length);
+    this->strings.reserve(env.size() + 1);
+
+    char *pos = this->data.data();
+    for (const auto& item : env)
+      {
+        this->strings.push_back(pos);
+        pos = std::copy(item.first.begin(), item.first.end(), pos);
+        *pos++ = '=';
+        pos = std::copy(item.second.begin(), item.second.end(), pos);
+        *pos++ = '\0';
+      }
+    this->strings.push_back(nullptr);
+  }
+
+  char **
+  environment::envp::get ()
+  {
+    return this->strings.data();
+  }
+
   environment::environment ():
     std::map<std::string,std::string>(),
-    filter()
+    filter(),
+    filter_literal(false),
+    filter_names(),
+    filter_prefixes()
   {
   }
 
   environment::environment (char **environment):
-    std::map<std::string,std::string>()
+    std::map<std::string,std::string>(),
+    filter(),
+    filter_literal(false),
+    filter_names(),
+    filter_prefixes()
   {
     add(environment);
   }
@@ -47,6 +151,11 @@ namespace schroot
   environment::set_filter (const regex& filter)
   {
     this->filter = filter;
+    this->filter_names.clear();
+    this->filter_prefixes.clear();
+    this->filter_literal = compile_filter(filter.str(),
+                                          this->filter_names,
+                                          this->filter_prefixes);
   }
 
   regex const&
@@ -55,6 +164,23 @@ namespace schroot
     return this->filter;
   }
 
+  bool
+  environment::is_filtered (const std::string& name) const
+  {
+    if (this->filter_literal)
+      {
+        if (this->filter_names.find(name) != this->filter_names.end())
+          return true;
+        for (const auto& prefix : this->filter_prefixes)
+          if (name.compare(0, prefix.size(), prefix) == 0)
+            return true;
+        return false;
+      }
+
+    return !this->filter.str().empty() &&
+      regex_search(name, this->filter);
+  }
+
   void
   environment::add (char **environment)
   {
@@ -93,21 +219,29 @@ namespace schroot
   void
   environment::add (const value_type& value)
   {
-    remove(value);
+    iterator pos = lower_bound(value.first);
+    bool exists = pos != end() && pos->first == value.first;
+
     if (!value.first.empty() && !value.second.empty())
       {
-        if (this->filter.str().empty() ||
-            !regex_search(value.first, this->filter))
+        if (!is_filtered(value.first))
           {
-            insert(value);
+            if (exists)
+              pos->second = value.second;
+            else
+              insert(pos, value);
             log_debug(DEBUG_NOTICE) << "Inserted into environment: "
                                     << value.first << '=' << value.second
                                     << std::endl;
+            return;
           }
         else
           log_debug(DEBUG_INFO) << "Filtered from environment: " << value.first
                                 << std::endl;
       }
+
+    if (exists)
+      erase(pos);
   }
 
   void
@@ -170,4 +304,10 @@ namespace schroot
     return ret;
   }
 
+  environment::envp
+  environment::get_envp () const
+  {
+    return envp(*this);
+  }
+
 }
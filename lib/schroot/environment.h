@@ -26,6 +26,8 @@
 #include <map>
 #include <string>
 #include <sstream>
+#include <unordered_set>
+#include <vector>
 
 #include <boost/format.hpp>
 
@@ -40,6 +42,46 @@ namespace schroot
   public:
     using std::map<std::string, std::string>::value_type;
 
+    /**
+     * Environment variables as a string vector, suitable for use as
+     * an envp argument with execve.  The strings are stored in a
+     * single contiguous buffer, which is freed on destruction.
+     */
+    class envp
+    {
+    public:
+      /**
+       * The constructor.
+       *
+       * @param env the environment to copy.
+       */
+      envp (const environment& env);
+
+      /// The move constructor.
+      envp (envp&& rhs) = default;
+
+      /// Not copyable.
+      envp (const envp& rhs) = delete;
+
+      /// Not copyable.
+      envp&
+      operator = (const envp& rhs) = delete;
+
+      /**
+       * Get the string vector.
+       *
+       * @returns a null-terminated array of "name=value" strings.
+       */
+      char **
+      get ();
+
+    private:
+      /// The "name=value" strings, each null-terminated.
+      std::vector<char>   data;
+      /// Pointers to each string in data, and a terminating null.
+      std::vector<char *> strings;
+    };
+
     /// The constructor.
     environment ();
 
@@ -61,6 +103,10 @@ namespace schroot
      *
      * If the regex contains errors, an exception will be thrown.
      *
+     * A filter of the form ^(NAME|PREFIX.*|...)$, such as the
+     * default environment-filter, is matched using a hashed set of
+     * names and a list of prefixes rather than the regex.
+     *
      * @param filter the filter regex.
      */
     void
@@ -74,6 +120,15 @@ namespace schroot
     regex const&
     get_filter () const;
 
+    /**
+     * Check if an environment variable name is matched by the filter.
+     *
+     * @param name the environment variable name.
+     * @returns true if the name is filtered, otherwise false.
+     */
+    bool
+    is_filtered (const std::string& name) const;
+
     /**
      * Add environment variables.  Any existing variables sharing the
      * name of a new value will be replaced.
@@ -225,6 +280,16 @@ namespace schroot
     char **
     get_strv () const;
 
+    /**
+     * Get the environment variables as an envp block.  This is
+     * preferred to get_strv(), since only two allocations are made,
+     * however many variables there are.
+     *
+     * @returns the envp block.
+     */
+    envp
+    get_envp () const;
+
     /**
      * Add variables to the environment.
      *
@@ -310,7 +375,13 @@ namespace schroot
 
   private:
     /// Filter regex.
-    regex filter;
+    regex                           filter;
+    /// Is the filter matched using filter_names and filter_prefixes?
+    bool                            filter_literal;
+    /// Names matched by the filter.
+    std::unordered_set<std::string> filter_names;
+    /// Name prefixes matched by the filter.
+    std::vector<std::string>        filter_prefixes;
   };
 
 }
@@ -21,6 +21,7 @@
 #include <schroot/format-detail.h>
 #include <schroot/i18n.h>
 #include <schroot/log.h>
+#include <schroot/log-sink.h>
 
 #include <boost/format.hpp>
 
@@ -42,10 +43,18 @@ namespace schroot
   format_detail&
   format_detail::add (const std::string& name,
                       const std::string& value)
+  {
+    return add_item(name, value, std::string());
+  }
+
+  format_detail&
+  format_detail::add_item (const std::string& name,
+                           const std::string& value,
+                           const std::string& json)
   {
     for (const auto& item : this->items)
       {
-        if (item.first == name)
+        if (item.name == name)
           {
             log_debug(DEBUG_WARNING) << "format_detail: name \""
                                      << name << "\" is already added"
@@ -54,7 +63,11 @@ namespace schroot
           }
       }
 
-    this->items.push_back(value_type(name, value));
+    value_type item;
+    item.name = name;
+    item.value = value;
+    item.json = json.empty() ? json_string(value) : json;
+    this->items.push_back(item);
     log_debug(DEBUG_INFO) << "format_detail: added name \""
                           << name << "\""
                           << std::endl;
@@ -72,14 +85,84 @@ namespace schroot
     else
       desc = _("false");
 
-    return add(name, std::string(desc));
+    return add_item(name, std::string(desc), value ? "true" : "false");
   }
 
   format_detail&
   format_detail::add (const std::string& name,
                       const string_list& value)
   {
-    return add(name, string_list_to_string(value, " "));
+    std::string json("[");
+    for (auto pos = value.begin(); pos != value.end(); ++pos)
+      {
+        if (pos != value.begin())
+          json += ',';
+        json += json_string(*pos);
+      }
+    json += ']';
+
+    return add_item(name, string_list_to_string(value, " "), json);
+  }
+
+  format_detail&
+  format_detail::add_section (const std::string& name)
+  {
+    return add_item(name, std::string(), "{}");
+  }
+
+  std::string
+  format_detail::get_key (const std::string& name)
+  {
+    std::string key;
+    bool separator = false;
+
+    for (const auto c : name)
+      {
+        if (c == ' ')
+          separator = !key.empty();
+        else if ((c >= 'a' && c <= 'z') || (c >= '0' && c <= '9') ||
+                 (c >= 'A' && c <= 'Z'))
+          {
+            if (separator)
+              key += '-';
+            separator = false;
+            key += (c >= 'A' && c <= 'Z') ? c - 'A' + 'a' : c;
+          }
+      }
+
+    return key;
+  }
+
+  void
+  format_detail::print_json (std::ostream& stream) const
+  {
+    stream << "{\"kind\":" << json_string(get_key(this->title));
+
+    for (auto pos = this->items.begin(); pos != this->items.end();)
+      {
+        stream << ',' << json_string(get_key(pos->name)) << ':';
+        ++pos;
+
+        // A section groups the following indented sub-items into an
+        // object, keeping their names verbatim.
+        if ((pos - 1)->json == "{}")
+          {
+            stream << '{';
+            for (bool first = true;
+                 pos != this->items.end() && pos->name.compare(0, 2, "  ") == 0;
+                 ++pos, first = false)
+              {
+                if (!first)
+                  stream << ',';
+                stream << json_string(pos->name.substr(2)) << ':' << pos->json;
+              }
+            stream << '}';
+          }
+        else
+          stream << (pos - 1)->json;
+      }
+
+    stream << '}';
   }
 
   std::string
@@ -88,7 +171,7 @@ namespace schroot
     // TRANSLATORS: %1% = title of section
     // TRANSLATORS: Please format the --- as a continuous line, e.g. U+2500
     boost::format fmt(_("─── %1% ───"));
-    fmt %this->title;
+    fmt % gettext(this->title);
 
     return fmt.str();
   }
@@ -19,21 +19,28 @@
 #ifndef SCHROOT_FORMAT_DETAIL_H
 #define SCHROOT_FORMAT_DETAIL_H
 
+#include <schroot/i18n.h>
 #include <schroot/types.h>
 #include <schroot/util.h>
 
+#include <cmath>
 #include <cwchar>
 #include <iomanip>
 #include <locale>
 #include <ostream>
 #include <sstream>
 #include <string>
+#include <type_traits>
 
 namespace schroot
 {
 
   /**
    * Format names and values for output.
+   *
+   * The title and names are untranslated message IDs (marked with
+   * N_()), which are translated when printed as text.  The message
+   * IDs also provide stable keys for machine-readable (JSON) output.
    */
   class format_detail
   {
@@ -82,6 +89,17 @@ namespace schroot
     add (const std::string& name,
          const string_list& value);
 
+    /**
+     * Add a section.  The names of the name-value pairs following a
+     * section must be indented with two spaces, and are output as
+     * an object in JSON output.
+     *
+     * @param name the name.
+     * @returns a reference to the format_detail object.
+     */
+    format_detail&
+    add_section (const std::string& name);
+
     /**
      * Add a name-value pair.
      *
@@ -97,10 +115,83 @@ namespace schroot
       std::ostringstream varstring;
       varstring.imbue(this->locale);
       varstring << value;
-      return add(name, varstring.str());
+
+      return add_item(name, varstring.str(),
+                      json_number(value, std::is_arithmetic<T>()));
     }
 
+    /**
+     * Get the stable key for a name or title.  The key is the
+     * untranslated name in lower case, with spaces replaced by
+     * hyphens and other punctuation removed, for example "Loop Device
+     * Direct I/O" becomes "loop-device-direct-io".
+     *
+     * @param name the name.
+     * @returns the key.
+     */
+    static std::string
+    get_key (const std::string& name);
+
+    /**
+     * Print the title and name-value pairs as a single-line JSON
+     * object.  The title is stored in the "kind" key, and each name
+     * is stored using its stable key.
+     *
+     * @param stream the stream to output to.
+     */
+    void
+    print_json (std::ostream& stream) const;
+
   private:
+    /**
+     * Add a name-value pair.
+     *
+     * @param name the name.
+     * @param value the value, formatted for text output.
+     * @param json the value, formatted as JSON.  If empty, the value
+     * is output as a JSON string.
+     * @returns a reference to the format_detail object.
+     */
+    format_detail&
+    add_item (const std::string& name,
+              const std::string& value,
+              const std::string& json);
+
+    /**
+     * Format a number as JSON, in the C locale.  JSON has no
+     * representation of NaN or infinity, which are output as null.
+     *
+     * @param value the value.
+     * @returns the JSON value.
+     */
+    template<typename T>
+    static std::string
+    json_number (T const&       value,
+                 std::true_type)
+    {
+      if (!std::isfinite(static_cast<long double>(value)))
+        return "null";
+
+      std::ostringstream jsonstring;
+      jsonstring.imbue(std::locale::classic());
+      jsonstring << value;
+      return jsonstring.str();
+    }
+
+    /**
+     * Format a value which is not a number as JSON.
+     *
+     * @returns an empty string, so that the value is output as a JSON
+     * string.
+     */
+    template<typename T>
+    static std::string
+    json_number (T const&,
+                 std::false_type)
+    {
+      return std::string();
+    }
+
     /**
      * Get the title of the chroot.  The title is formatted for
      * output.
@@ -128,7 +219,7 @@ namespace schroot
 
       for (const auto& item : rhs.items)
         {
-          std::wstring wide = widen_string(item.first, loc);
+          std::wstring wide = widen_string(gettext(item.name), loc);
           int width = wcswidth(wide.c_str(), wide.length());
 
           if (max_width < width)
@@ -147,18 +238,26 @@ namespace schroot
           std::wostringstream ws;
           ws.imbue(loc);
 
-          std::wstring wide = widen_string(item.first, loc);
+          std::wstring wide = widen_string(gettext(item.name), loc);
           ws << L"  " << std::setw(max_width) << std::left << wide;
 
-          stream << narrow_string(ws.str(), loc) << item.second << '\n';
+          stream << narrow_string(ws.str(), loc) << item.value << '\n';
         }
 
       return stream;
     }
 
   private:
-    /// Name and value pairs.
-    typedef std::pair<std::string,std::string> value_type;
+    /// A name and its text and JSON values.
+    struct value_type
+    {
+      /// The untranslated name.
+      std::string name;
+      /// The value formatted for text output.
+      std::string value;
+      /// The value formatted as JSON.
+      std::string json;
+    };
     /// List of name and value pairs.
     typedef std::vector<value_type> list_type;
 
@@ -0,0 +1,148 @@
+/* Copyright © 2005-2013  Roger Leigh <rleigh@codelibre.net>
+ *
+ * schroot is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * schroot is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ *********************************************************************/
+
+#include <config.h>
+
+#include <schroot/identity.h>
+#include <schroot/log.h>
+#include <schroot/util.h>
+
+#include <cerrno>
+#include <cstring>
+#include <vector>
+
+#include <unistd.h>
+
+using std::endl;
+
+namespace schroot
+{
+
+  template<>
+  error<identity::error_code>::map_type
+  error<identity::error_code>::error_strings =
+    {
+      // TRANSLATORS: A supplementary group is the list of additional
+      // system groups a user belongs to, in addition to their default
+      // group.
+      {identity::GROUP_GET_SUP,  N_("Failed to get supplementary groups")},
+      // TRANSLATORS: A supplementary group is the list of additional
+      // system groups a user belongs to, in addition to their default
+      // group.
+      {identity::GROUP_GET_SUPC, N_("Failed to get supplementary group count")}
+    };
+
+  identity::identity ():
+    uid(getuid()),
+    gid(getgid()),
+    groups(),
+    group_ids(),
+    group_ids_lock()
+  {
+    this->groups.insert(this->gid);
+
+    int supp_group_count = getgroups(0, 0);
+    if (supp_group_count < 0)
+      throw error(GROUP_GET_SUPC, strerror(errno));
+    if (supp_group_count > 0)
+      {
+        std::vector<gid_t> supp_groups(supp_group_count);
+        supp_group_count = getgroups(supp_group_count, &supp_groups[0]);
+        if (supp_group_count < 1)
+          throw error(GROUP_GET_SUP, strerror(errno));
+        this->groups.insert(supp_groups.begin(),
+                            supp_groups.begin() + supp_group_count);
+      }
+  }
+
+  identity::~identity ()
+  {
+  }
+
+  identity&
+  identity::current ()
+  {
+    static identity self;
+    return self;
+  }
+
+  uid_t
+  identity::get_uid () const
+  {
+    return this->uid;
+  }
+
+  gid_t
+  identity::get_gid () const
+  {
+    return this->gid;
+  }
+
+  const identity::gid_set&
+  identity::get_groups () const
+  {
+    return this->groups;
+  }
+
+  bool
+  identity::is_group_member (gid_t gid) const
+  {
+    return this->groups.find(gid) != this->groups.end();
+  }
+
+  bool
+  identity::is_group_member (const std::string& groupname)
+  {
+    gid_t gid;
+    return get_group_gid(groupname, gid) && is_group_member(gid);
+  }
+
+  bool
+  identity::get_group_gid (const std::string& groupname,
+                           gid_t&             gid)
+  {
+    std::lock_guard<std::mutex> guard(this->group_ids_lock);
+
+    auto pos = this->group_ids.find(groupname);
+    if (pos == this->group_ids.end())
+      {
+        errno = 0;
+        schroot::group grp(groupname);
+        group_entry entry(false, 0);
+        if (!grp)
+          {
+            if (errno != 0)
+              {
+                // A transient failure; don't memoise it.
+                log_debug(DEBUG_INFO) << "Group " << groupname
+                                      << " not found: " << strerror(errno) << endl;
+                gid = 0;
+                return false;
+              }
+            log_debug(DEBUG_INFO) << "Group " << groupname << " not found" << endl;
+          }
+        else
+          entry = group_entry(true, grp.gr_gid);
+        pos = this->group_ids.insert(std::make_pair(groupname, entry)).first;
+      }
+
+    gid = pos->second.second;
+    return pos->second.first;
+  }
+
+}
@@ -0,0 +1,161 @@
+/* Copyright © 2005-2013  Roger Leigh <rleigh@codelibre.net>
+ *
+ * schroot is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * schroot is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ *********************************************************************/
+
+#ifndef SCHROOT_IDENTITY_H
+#define SCHROOT_IDENTITY_H
+
+#include <schroot/custom-error.h>
+
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+
+#include <sys/types.h>
+
+namespace schroot
+{
+
+  /**
+   * The identity of the calling user.
+   *
+   * The real user and group IDs and supplementary groups of the
+   * process are resolved once, and group name lookups are memoised,
+   * so that checking group membership for many chroots costs a
+   * single NSS lookup per distinct group name, followed by a hashed
+   * set lookup.  Group name lookups may be made from multiple
+   * threads.
+   */
+  class identity
+  {
+  public:
+    /// Error codes.
+    enum error_code
+      {
+        GROUP_GET_SUP,  ///< Failed to get supplementary groups.
+        GROUP_GET_SUPC  ///< Failed to get supplementary group count
+      };
+
+    /// Exception type.
+    typedef custom_error<error_code> error;
+
+    /// A set of group IDs.
+    typedef std::unordered_set<gid_t> gid_set;
+
+    /**
+     * The constructor.  The identity of the current process is
+     * resolved.
+     */
+    identity ();
+
+    /// The destructor.
+    virtual ~identity ();
+
+    /**
+     * Get the identity of the current process.  This is resolved on
+     * first use, and shared by all callers.
+     *
+     * @returns the identity.
+     */
+    static identity&
+    current ();
+
+    /**
+     * Get the real user ID.
+     *
+     * @returns the user ID.
+     */
+    uid_t
+    get_uid () const;
+
+    /**
+     * Get the real group ID.
+     *
+     * @returns the group ID.
+     */
+    gid_t
+    get_gid () const;
+
+    /**
+     * Get the real group ID and supplementary group IDs.
+     *
+     * @returns the group IDs.
+     */
+    const gid_set&
+    get_groups () const;
+
+    /**
+     * Check group membership by group ID.
+     *
+     * @param gid the group ID to check for.
+     * @returns true if the user is a member of the group, otherwise
+     * false.
+     */
+    bool
+    is_group_member (gid_t gid) const;
+
+    /**
+     * Check group membership by group name.
+     *
+     * @param groupname the group to check for.
+     * @returns true if the user is a member of the group, otherwise
+     * false.  Groups which do not exist have no members.
+     */
+    bool
+    is_group_member (const std::string& groupname);
+
+    /**
+     * Look up the group ID of a group.  The result is memoised if
+     * the group exists or was definitively not found; lookups which
+     * failed with an error, for example because a network name
+     * service was unavailable, are retried by later calls.
+     *
+     * @param groupname the group to look up.
+     * @param gid the group ID of the group.
+     * @returns true if the group exists, otherwise false.
+     */
+    bool
+    get_group_gid (const std::string& groupname,
+                   gid_t&             gid);
+
+  private:
+    /// Memoised group lookup result.
+    typedef std::pair<bool, gid_t> group_entry;
+
+    /// The real user ID.
+    uid_t                                        uid;
+    /// The real group ID.
+    gid_t                                        gid;
+    /// The real group ID and supplementary group IDs.
+    gid_set                                      groups;
+    /// Group IDs by group name.
+    std::unordered_map<std::string, group_entry> group_ids;
+    /// Lock protecting group_ids.
+    std::mutex                                   group_ids_lock;
+  };
+
+}
+
+#endif /* SCHROOT_IDENTITY_H */
+
+/*
+ * Local Variables:
+ * mode:C++
+ * End:
+ */
@@ -0,0 +1,538 @@
+/* Copyright © 2005-2013  Roger Leigh <rleigh@codelibre.net>
+ *
+ * schroot is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * schroot is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ *********************************************************************/
+
+
+#include <config.h>
+
+#include <schroot/lease.h>
+#include <schroot/fdstream.h>
+#include <schroot/keyfile.h>
+#include <schroot/keyfile-reader.h>
+#include <schroot/keyfile-writer.h>
+#include <schroot/lock.h>
+#include <schroot/log.h>
+#include <schroot/metrics.h>
+#include <schroot/trace.h>
+#include <schroot/util.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <memory>
+
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+
+#include <boost/format.hpp>
+
+using std::endl;
+using boost::format;
+
+namespace schroot
+{
+
+  template<>
+  error<lease::error_code>::map_type
+  error<lease::error_code>::error_strings =
+    {
+      {lease::LEASE_LOCK,    N_("Failed to lock lease")},
+      {lease::LEASE_READ,    N_("Failed to read lease")},
+      {lease::LEASE_WRITE,   N_("Failed to write lease")},
+      {lease::LEASE_INVALID, N_("Invalid lease")},
+      // TRANSLATORS: %4% = ticket number
+      {lease::LEASE_TICKET,  N_("Lease ticket %4% no longer exists")},
+      // TRANSLATORS: %4% = time in seconds
+      // TRANSLATORS: %5% = list of lease holders and waiters
+      {lease::LEASE_TIMEOUT, N_("Timed out after %4% seconds waiting for lease behind %5%")}
+    };
+
+  namespace
+  {
+
+    /// The keyfile group holding the next ticket number.
+    const std::string lease_group("lease");
+
+    /// Time to wait for the lease state lock, in seconds.
+    const unsigned int state_lock_timeout = 10;
+
+    /// Initial delay between checks for a queued ticket, in seconds.
+    const double retry_delay_initial = 0.01;
+
+    /// Maximum delay between checks for a queued ticket, in seconds.
+    const double retry_delay_max = 0.25;
+
+    /**
+     * Sleep without using signals.
+     *
+     * @param seconds the time to sleep for.
+     */
+    void
+    sleep_for (double seconds)
+    {
+      struct timespec delay;
+      delay.tv_sec = static_cast<time_t>(seconds);
+      delay.tv_nsec = static_cast<long>((seconds - delay.tv_sec) * 1e9);
+      while (nanosleep(&delay, &delay) < 0 && errno == EINTR);
+    }
+
+    /**
+     * An exclusive lock on the lease state, held for the lifetime of
+     * the object.
+     */
+    class state_lock
+    {
+    public:
+      /**
+       * The constructor.
+       *
+       * @param file the lock file.
+       */
+      state_lock (const std::string& file):
+        fd(open(file.c_str(), O_CREAT|O_RDWR|O_CLOEXEC, 0600)),
+        lck()
+      {
+        if (this->fd < 0)
+          throw lease::error(file, lease::LEASE_LOCK, strerror(errno));
+
+        try
+          {
+            this->lck.reset(new ofd_lock(this->fd));
+            this->lck->set_lock(lock::LOCK_EXCLUSIVE, state_lock_timeout);
+          }
+        catch (const lock::error& e)
+          {
+            this->lck.reset();
+            close(this->fd);
+            throw lease::error(file, lease::LEASE_LOCK, e);
+          }
+      }
+
+      /// The destructor.
+      ~state_lock ()
+      {
+        this->lck.reset();
+        close(this->fd);
+      }
+
+    private:
+      /// The lock file descriptor.
+      int                       fd;
+      /// The lock.
+      std::unique_ptr<ofd_lock> lck;
+    };
+
+    /**
+     * Describe the tickets ahead of a ticket in the queue.
+     *
+     * @param tickets the current tickets.
+     * @param number the ticket number.
+     * @returns a description of each earlier ticket.
+     */
+    std::string
+    describe_ahead (const lease::ticket_list& tickets,
+                    unsigned long             number)
+    {
+      string_list ahead;
+      for (const auto& t : tickets)
+        if (t.number != number && (t.granted || t.number < number))
+          ahead.push_back(lease::describe(t));
+
+      return string_list_to_string(ahead, ", ");
+    }
+
+  }
+
+  lease::lease (const std::string& name):
+    name(name),
+    directory(SCHROOT_LEASE_DIR)
+  {
+  }
+
+  lease::lease (const std::string& name,
+                const std::string& directory):
+    name(name),
+    directory(directory)
+  {
+  }
+
+  lease::~lease ()
+  {
+  }
+
+  std::string const&
+  lease::get_name () const
+  {
+    return this->name;
+  }
+
+  unsigned long
+  lease::acquire (mode               lease_mode,
+                  const std::string& session,
+                  unsigned int       timeout)
+  {
+    const std::string mode_name(get_mode_name(lease_mode));
+    trace::span span("lease_wait", mode_name);
+    double start = metrics::now();
+    double delay = retry_delay_initial;
+    unsigned long number;
+
+    {
+      state_lock guard(get_file(".lock"));
+
+      ticket_list tickets;
+      number = read_state(tickets);
+
+      ticket t;
+      t.number = number;
+      t.lease_mode = lease_mode;
+      t.granted = false;
+      t.pid = getpid();
+      t.start_time = process_start_time(t.pid);
+      t.session = session;
+      tickets.push_back(t);
+
+      bool granted = grant(tickets, number);
+      if (!granted && timeout == 0)
+        throw error(this->name, LEASE_TIMEOUT, timeout,
+                    describe_ahead(tickets, number));
+
+      write_state(tickets, number + 1);
+      if (granted)
+        return number;
+
+      log_debug(DEBUG_INFO)
+        << format("Waiting for %1% lease on %2% behind %3%")
+        % mode_name % this->name % describe_ahead(tickets, number) << endl;
+    }
+
+    while (true)
+      {
+        double elapsed = metrics::now() - start;
+        if (elapsed >= timeout)
+          {
+            state_lock guard(get_file(".lock"));
+
+            ticket_list tickets;
+            unsigned long next = read_state(tickets);
+            std::string ahead(describe_ahead(tickets, number));
+            tickets.erase(std::remove_if(tickets.begin(), tickets.end(),
+                                         [number](const ticket& t)
+                                         { return t.number == number; }),
+                          tickets.end());
+            write_state(tickets, next);
+
+            metrics::observe("schroot_lease_wait_seconds",
+                             {{"mode", mode_name}}, elapsed);
+            metrics::increment("schroot_lease_timeouts_total",
+                               {{"mode", mode_name}});
+            throw error(this->name, LEASE_TIMEOUT, timeout, ahead);
+          }
+
+        sleep_for(std::min(delay, timeout - elapsed));
+        delay = std::min(delay * 2, retry_delay_max);
+
+        state_lock guard(get_file(".lock"));
+
+        ticket_list tickets;
+        unsigned long next = read_state(tickets);
+        if (std::none_of(tickets.begin(), tickets.end(),
+                         [number](const ticket& t)
+                         { return t.number == number; }))
+          throw error(this->name, LEASE_TICKET, number);
+
+        if (grant(tickets, number))
+          {
+            write_state(tickets, next);
+            break;
+          }
+      }
+
+    metrics::observe("schroot_lease_wait_seconds",
+                     {{"mode", mode_name}}, metrics::now() - start);
+
+    return number;
+  }
+
+  void
+  lease::release (unsigned long number)
+  {
+    state_lock guard(get_file(".lock"));
+
+    ticket_list tickets;
+    unsigned long next = read_state(tickets);
+    tickets.erase(std::remove_if(tickets.begin(), tickets.end(),
+                                 [number](const ticket& t)
+                                 { return t.number == number; }),
+                  tickets.end());
+    write_state(tickets, next);
+  }
+
+  void
+  lease::release (const std::string& session)
+  {
+    // Avoid creating lease state for chroots which have none.
+    if (access(get_file("").c_str(), F_OK) != 0)
+      return;
+
+    state_lock guard(get_file(".lock"));
+
+    ticket_list tickets;
+    unsigned long next = read_state(tickets);
+    tickets.erase(std::remove_if(tickets.begin(), tickets.end(),
+                                 [&session](const ticket& t)
+                                 { return t.session == session; }),
+                  tickets.end());
+    write_state(tickets, next);
+  }
+
+  lease::ticket_list
+  lease::get_tickets () const
+  {
+    // The state is replaced atomically, so may be read without
+    // locking.
+    ticket_list tickets;
+    read_state(tickets);
+    return tickets;
+  }
+
+  std::string
+  lease::get_mode_name (mode lease_mode)
+  {
+    return lease_mode == LEASE_EXCLUSIVE ? "exclusive" : "shared";
+  }
+
+  std::string
+  lease::describe (const ticket& t)
+  {
+    format fmt(t.session.empty() ?
+               // TRANSLATORS: %1% = process ID
+               // TRANSLATORS: %2% = lease mode ("shared" or "exclusive")
+               _("PID %1% (%2%)") :
+               // TRANSLATORS: %1% = session name
+               // TRANSLATORS: %2% = lease mode ("shared" or "exclusive")
+               _("session %1% (%2%)"));
+    if (t.session.empty())
+      fmt % t.pid;
+    else
+      fmt % t.session;
+    fmt % get_mode_name(t.lease_mode);
+
+    std::string description(fmt.str());
+    if (!t.granted)
+      description += ' ' + std::string(_("waiting"));
+
+    return description;
+  }
+
+  std::string
+  lease::get_file (const std::string& suffix) const
+  {
+    if (suffix.empty())
+      return this->directory + "/" + this->name;
+    else
+      return this->directory + "/." + this->name + suffix;
+  }
+
+  unsigned long
+  lease::read_state (ticket_list& tickets) const
+  {
+    std::string file(get_file(""));
+    unsigned long next = 1;
+
+    tickets.clear();
+
+    int fd = open(file.c_str(), O_RDONLY|O_CLOEXEC);
+    if (fd < 0)
+      {
+        if (errno == ENOENT)
+          return next;
+        throw error(file, LEASE_READ, strerror(errno));
+      }
+
+#ifdef BOOST_IOSTREAMS_CLOSE_HANDLE_OLD
+    fdistream input(fd, true);
+#else
+    fdistream input(fd, boost::iostreams::close_handle);
+#endif
+    input.imbue(std::locale::classic());
+
+    keyfile state;
+    try
+      {
+        keyfile_reader(state, input);
+      }
+    catch (const std::runtime_error& e)
+      {
+        throw error(file, LEASE_INVALID, e);
+      }
+
+    if (!state.get_value(lease_group, "next-ticket", next))
+      throw error(file, LEASE_INVALID);
+
+    for (const auto& group : state.get_groups())
+      {
+        if (group == lease_group)
+          continue;
+
+        ticket t;
+        std::string mode_name;
+        char *end;
+        t.number = std::strtoul(group.c_str(), &end, 10);
+        if (group.empty() || *end != '\0' ||
+            !state.get_value(group, "mode", mode_name) ||
+            !state.get_value(group, "granted", t.granted) ||
+            !state.get_value(group, "pid", t.pid) ||
+            !state.get_value(group, "start-time", t.start_time) ||
+            (mode_name != "shared" && mode_name != "exclusive"))
+          throw error(file, LEASE_INVALID);
+        t.lease_mode = mode_name == "exclusive" ? LEASE_EXCLUSIVE : LEASE_SHARED;
+        state.get_value(group, "session", t.session);
+
+        if (stale(t))
+          log_debug(DEBUG_NOTICE)
+            << format("Discarding stale lease ticket %1% on %2%")
+            % describe(t) % this->name << endl;
+        else
+          tickets.push_back(t);
+      }
+
+    std::sort(tickets.begin(), tickets.end(),
+              [](const ticket& a, const ticket& b)
+              { return a.number < b.number; });
+
+    return next;
+  }
+
+  void
+  lease::write_state (const ticket_list& tickets,
+                      unsigned long      next) const
+  {
+    std::string file(get_file(""));
+
+    // Remove the state once the last ticket has gone, so that idle
+    // chroots leave nothing behind.
+    if (tickets.empty())
+      {
+        if (unlink(file.c_str()) != 0 && errno != ENOENT)
+          throw error(file, LEASE_WRITE, strerror(errno));
+        return;
+      }
+
+    std::string tmpfile(get_file(".new"));
+
+    int fd = open(tmpfile.c_str(), O_CREAT|O_TRUNC|O_WRONLY|O_CLOEXEC, 0644);
+    if (fd < 0)
+      throw error(tmpfile, LEASE_WRITE, strerror(errno));
+
+    {
+      // Create a stream from the file descriptor.  The fd will be
+      // closed when the stream is destroyed.
+#ifdef BOOST_IOSTREAMS_CLOSE_HANDLE_OLD
+      fdostream output(fd, true);
+#else
+      fdostream output(fd, boost::iostreams::close_handle);
+#endif
+      output.imbue(std::locale::classic());
+
+      keyfile state;
+      state.set_value(lease_group, "next-ticket", next);
+      for (const auto& t : tickets)
+        {
+          std::string group(std::to_string(t.number));
+          state.set_value(group, "mode", get_mode_name(t.lease_mode));
+          state.set_value(group, "granted", t.granted);
+          state.set_value(group, "pid", t.pid);
+          state.set_value(group, "start-time", t.start_time);
+          if (!t.session.empty())
+            state.set_value(group, "session", t.session);
+        }
+      output << keyfile_writer(state);
+      output.flush();
+      if (!output)
+        {
+          unlink(tmpfile.c_str());
+          throw error(tmpfile, LEASE_WRITE);
+        }
+    }
+
+    if (rename(tmpfile.c_str(), file.c_str()) != 0)
+      {
+        int saved_errno = errno;
+        unlink(tmpfile.c_str());
+        throw error(file, LEASE_WRITE, strerror(saved_errno));
+      }
+  }
+
+  bool
+  lease::grant (ticket_list&  tickets,
+                unsigned long number)
+  {
+    ticket_list::iterator self =
+      std::find_if(tickets.begin(), tickets.end(),
+                   [number](const ticket& t)
+                   { return t.number == number; });
+    if (self == tickets.end())
+      return false;
+    if (self->granted)
+      return true;
+
+    for (const auto& t : tickets)
+      {
+        if (&t == &*self)
+          continue;
+
+        // An exclusive ticket waits for every other holder, and
+        // every earlier waiter.  A shared ticket waits for every
+        // exclusive holder, and every earlier exclusive waiter, so
+        // that waiting writers are not overtaken by later readers.
+        if (self->lease_mode == LEASE_EXCLUSIVE &&
+            (t.granted || t.number < number))
+          return false;
+        if (t.lease_mode == LEASE_EXCLUSIVE &&
+            (t.granted || t.number < number))
+          return false;
+      }
+
+    self->granted = true;
+    return true;
+  }
+
+  bool
+  lease::stale (const ticket& t)
+  {
+    if (t.start_time != 0)
+      {
+        if (process_start_time(t.pid) == t.start_time)
+          return false;
+      }
+    else if (t.pid > 0 && (kill(t.pid, 0) == 0 || errno == EPERM))
+      return false;
+
+    // The session outlives the process which began it.
+    if (!t.session.empty() &&
+        access((std::string(SCHROOT_SESSION_DIR) + "/" + t.session).c_str(),
+               F_OK) == 0)
+      return false;
+
+    return true;
+  }
+
+}
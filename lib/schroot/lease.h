@@ -0,0 +1,252 @@
+/* Copyright © 2005-2013  Roger Leigh <rleigh@codelibre.net>
+ *
+ * schroot is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * schroot is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ *********************************************************************/
+
+#ifndef SCHROOT_LEASE_H
+#define SCHROOT_LEASE_H
+
+#include <schroot/custom-error.h>
+
+#include <string>
+#include <vector>
+
+#include <sys/types.h>
+
+namespace schroot
+{
+
+  /**
+   * Reader/writer leases on source chroots.
+   *
+   * Sessions cloned from a source chroot read the source data while
+   * they are set up, while source sessions modify it.  A lease
+   * coordinates the two: setting up a clone takes a shared lease,
+   * and a source session takes an exclusive lease for its entire
+   * lifetime, from beginning to ending the session.
+   *
+   * The state of each lease is held in a file in the lease
+   * directory, which lists a ticket for each holder and waiter.
+   * Tickets are granted in order of arrival, except that a shared
+   * ticket is never granted ahead of an earlier exclusive ticket, so
+   * that a waiting source session is not starved by a continual
+   * stream of new clones.  A ticket belonging to a process which no
+   * longer exists is discarded, unless it belongs to a session which
+   * still exists, so that the lease held by a source session
+   * survives the process which began it.
+   */
+  class lease
+  {
+  public:
+    /// Lease mode.
+    enum mode
+      {
+        LEASE_SHARED,   ///< A shared lease.
+        LEASE_EXCLUSIVE ///< An exclusive lease.
+      };
+
+    /// Error codes.
+    enum error_code
+      {
+        LEASE_LOCK,    ///< Failed to lock lease.
+        LEASE_READ,    ///< Failed to read lease.
+        LEASE_WRITE,   ///< Failed to write lease.
+        LEASE_INVALID, ///< Invalid lease.
+        LEASE_TICKET,  ///< Lease ticket no longer exists.
+        LEASE_TIMEOUT  ///< Timed out waiting for lease.
+      };
+
+    /// Exception type.
+    typedef custom_error<error_code> error;
+
+    /// A lease holder or waiter.
+    struct ticket
+    {
+      /// The ticket number, in order of arrival.
+      unsigned long      number;
+      /// The lease mode.
+      mode               lease_mode;
+      /// Has the ticket been granted?
+      bool               granted;
+      /// The process which requested the ticket.
+      pid_t              pid;
+      /// The start time of the process (see process_start_time()).
+      unsigned long long start_time;
+      /// The session holding the ticket, if any.
+      std::string        session;
+    };
+
+    /// A list of tickets.
+    typedef std::vector<ticket> ticket_list;
+
+    /**
+     * The constructor.  The default lease directory will be used.
+     *
+     * @param name the name of the lease (the source chroot name).
+     */
+    lease (const std::string& name);
+
+    /**
+     * The constructor.
+     *
+     * @param name the name of the lease (the source chroot name).
+     * @param directory the directory containing lease state.
+     */
+    lease (const std::string& name,
+           const std::string& directory);
+
+    /// The destructor.
+    virtual ~lease ();
+
+    /**
+     * Get the name of the lease.
+     *
+     * @returns the name.
+     */
+    std::string const&
+    get_name () const;
+
+    /**
+     * Acquire the lease.  If the lease can not be granted
+     * immediately, a ticket is queued and the caller waits until it
+     * is granted.
+     *
+     * @param lease_mode the lease mode.
+     * @param session the session which will hold the lease, or an
+     * empty string if the lease is held only for the lifetime of the
+     * calling process.
+     * @param timeout the time to wait for the lease, in seconds.  If
+     * 0, the lease is acquired only if it is immediately available.
+     * @returns the ticket number, for use with release().
+     */
+    unsigned long
+    acquire (mode               lease_mode,
+             const std::string& session,
+             unsigned int       timeout);
+
+    /**
+     * Release a ticket.  It is not an error if the ticket has already
+     * been discarded.
+     *
+     * @param number the ticket number returned by acquire().
+     */
+    void
+    release (unsigned long number);
+
+    /**
+     * Release all tickets held by a session.  It is not an error if
+     * the session holds no tickets.
+     *
+     * @param session the session.
+     */
+    void
+    release (const std::string& session);
+
+    /**
+     * Get the current holders and waiters, in order of arrival.
+     * Tickets belonging to processes and sessions which no longer
+     * exist are not included.
+     *
+     * @returns a list of tickets.
+     */
+    ticket_list
+    get_tickets () const;
+
+    /**
+     * Get the name of a lease mode.
+     *
+     * @param lease_mode the lease mode.
+     * @returns the mode name.
+     */
+    static std::string
+    get_mode_name (mode lease_mode);
+
+    /**
+     * Describe a ticket for display to the user.
+     *
+     * @param t the ticket to describe.
+     * @returns a description of the holder or waiter.
+     */
+    static std::string
+    describe (const ticket& t);
+
+  private:
+    /**
+     * Get the path of a file holding lease state.
+     *
+     * @param suffix the file suffix, or an empty string for the
+     * file listing the tickets.
+     * @returns the path.
+     */
+    std::string
+    get_file (const std::string& suffix) const;
+
+    /**
+     * Read the lease state, discarding stale tickets.
+     *
+     * @param tickets the list to store the tickets in.
+     * @returns the next ticket number.
+     */
+    unsigned long
+    read_state (ticket_list& tickets) const;
+
+    /**
+     * Write the lease state.  The state is replaced atomically.
+     *
+     * @param tickets the tickets to store.
+     * @param next the next ticket number.
+     */
+    void
+    write_state (const ticket_list& tickets,
+                 unsigned long      next) const;
+
+    /**
+     * Grant a ticket if it is at the front of the queue.
+     *
+     * @param tickets the current tickets.
+     * @param number the ticket to grant.
+     * @returns true if the ticket was granted, or false if it must
+     * continue to wait.
+     */
+    static bool
+    grant (ticket_list&  tickets,
+           unsigned long number);
+
+    /**
+     * Check if a ticket is stale.
+     *
+     * @param t the ticket to check.
+     * @returns true if neither the process nor the session owning
+     * the ticket exists, otherwise false.
+     */
+    static bool
+    stale (const ticket& t);
+
+    /// The lease name.
+    std::string name;
+    /// The lease directory.
+    std::string directory;
+  };
+
+}
+
+#endif /* SCHROOT_LEASE_H */
+
+/*
+ * Local Variables:
+ * mode:C++
+ * End:
+ */
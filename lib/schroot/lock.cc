@@ -20,12 +20,22 @@
 
 #include <schroot/lock.h>
 #include <schroot/log.h>
+#include <schroot/metrics.h>
 #include <schroot/feature.h>
+#include <schroot/trace.h>
 
+#include <algorithm>
 #include <cerrno>
+#include <cstdio>
 #include <cstdlib>
 #include <cstring>
+#include <fstream>
+#include <sstream>
 
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+#include <dirent.h>
+#include <time.h>
 #include <unistd.h>
 
 #include <boost/format.hpp>
@@ -47,6 +57,9 @@ namespace schroot
       // TRANSLATORS: %4% = time in seconds
       {lock::LOCK_TIMEOUT,           N_("Failed to lock file (timed out after %4% seconds)")},
       // TRANSLATORS: %4% = time in seconds
+      // TRANSLATORS: %5% = integer process ID
+      {lock::LOCK_TIMEOUT_HOLDER,    N_("Failed to lock file (timed out after %4% seconds; lock held by PID %5%)")},
+      // TRANSLATORS: %4% = time in seconds
       {lock::UNLOCK_TIMEOUT,         N_("Failed to unlock file (timed out after %4% seconds)")},
       {lock::DEVICE_LOCK,            N_("Failed to lock device")},
       // TRANSLATORS: %4% = time in seconds
@@ -71,6 +84,137 @@ namespace schroot
     alarm_handler (int ignore)
     {
     }
+
+    /// Initial delay between ofd_lock attempts, in seconds.
+    const double retry_delay_initial = 0.001;
+
+    /// Maximum delay between ofd_lock attempts, in seconds.
+    const double retry_delay_max = 0.05;
+
+    /**
+     * Get the name of a lock type, for tracing and metrics.
+     *
+     * @param lock_type the lock type.
+     * @returns the name.
+     */
+    const char *
+    lock_type_name (lock::type lock_type)
+    {
+      return lock_type == lock::LOCK_SHARED ? "shared" :
+        (lock_type == lock::LOCK_EXCLUSIVE ? "exclusive" : "unlock");
+    }
+
+    /**
+     * Describe the holder of a lock, for metrics.  Process IDs are
+     * not used as label values, to keep the number of series bounded.
+     *
+     * @param holder the process ID of the holder, or -1 if held by
+     * another process which was not identified.
+     * @returns "process" if held by the current process (by another
+     * thread or open file description), "other" if held by another
+     * process, or "unknown" if the lock was released.
+     */
+    const char *
+    holder_name (pid_t holder)
+    {
+      if (holder == getpid())
+        return "process";
+      else if (holder != 0)
+        return "other";
+      return "unknown";
+    }
+
+    /**
+     * Sleep without using signals.
+     *
+     * @param seconds the time to sleep for.
+     */
+    void
+    sleep_for (double seconds)
+    {
+      struct timespec delay;
+      delay.tv_sec = static_cast<time_t>(seconds);
+      delay.tv_nsec = static_cast<long>((seconds - delay.tv_sec) * 1e9);
+      while (nanosleep(&delay, &delay) < 0 && errno == EINTR);
+    }
+
+    /**
+     * Check if a lock, in the format of /proc/locks, conflicts with a
+     * lock type on a file.
+     *
+     * @param line the lock description.
+     * @param status the status of the locked file.
+     * @param lock_type the type of lock to check for conflicts.
+     * @returns true if the lock conflicts, otherwise false.
+     */
+    bool
+    lock_conflicts (const std::string&   line,
+                    const struct ::stat& status,
+                    lock::type           lock_type)
+    {
+      // ID: CLASS ADVISORY MODE PID MAJOR:MINOR:INODE START END
+      // Blocked waiters have "->" after the ID, and are skipped
+      // when the PID fails to parse.
+      std::istringstream fields(line);
+      std::string id, lock_class, advisory, mode, file;
+      long pid;
+      if (!(fields >> id >> lock_class >> advisory >> mode >> pid >> file))
+        return false;
+      if (lock_class != "POSIX" && lock_class != "OFDLCK")
+        return false;
+      if (lock_type != lock::LOCK_EXCLUSIVE && mode != "WRITE")
+        return false;
+
+      unsigned int dev_major, dev_minor;
+      unsigned long long inode;
+      return std::sscanf(file.c_str(), "%x:%x:%llu",
+                         &dev_major, &dev_minor, &inode) == 3 &&
+        dev_major == major(status.st_dev) &&
+        dev_minor == minor(status.st_dev) &&
+        inode == status.st_ino;
+    }
+
+    /**
+     * Check if any open file of a process holds a conflicting lock,
+     * using the "lock:" lines of /proc/PID/fdinfo.  This identifies
+     * the holders of open file description locks, which are not
+     * reported by F_OFD_GETLK or /proc/locks.
+     *
+     * @param pid the process to check.
+     * @param status the status of the locked file.
+     * @param lock_type the type of lock to check for conflicts.
+     * @param exclude_fd a file descriptor of the process to skip, or
+     * -1.
+     * @returns true if a conflicting lock is held, otherwise false.
+     */
+    bool
+    process_holds_lock (const std::string&   pid,
+                        const struct ::stat& status,
+                        lock::type           lock_type,
+                        int                  exclude_fd)
+    {
+      std::string dir("/proc/" + pid + "/fdinfo");
+      DIR *dirp = opendir(dir.c_str());
+      if (dirp == nullptr)
+        return false;
+
+      bool found = false;
+      struct dirent *entry;
+      while (!found && (entry = readdir(dirp)) != nullptr)
+        {
+          if (entry->d_name[0] == '.' || atoi(entry->d_name) == exclude_fd)
+            continue;
+
+          std::ifstream info(dir + '/' + entry->d_name);
+          std::string line;
+          while (!found && std::getline(info, line))
+            if (line.compare(0, 5, "lock:") == 0)
+              found = lock_conflicts(line.substr(5), status, lock_type);
+        }
+      closedir(dirp);
+
+      return found;
+    }
   }
 
   lock::lock ():
@@ -159,6 +303,10 @@ namespace schroot
   file_lock::set_lock (lock::type   lock_type,
                        unsigned int timeout)
   {
+    const char *type_name = lock_type_name(lock_type);
+    trace::span span("lock_wait", type_name);
+    double start = timeout != 0 ? metrics::now() : 0;
+
     try
       {
         struct itimerval timeout_timer;
@@ -180,19 +328,31 @@ namespace schroot
         read_lock.l_len = 0; // Lock entire file
         read_lock.l_pid = 0;
 
-        if (fcntl(this->fd,
-                  (timeout != 0) ? F_SETLKW : F_SETLK,
-                  &read_lock) == -1)
+        int status = fcntl(this->fd,
+                           (timeout != 0) ? F_SETLKW : F_SETLK,
+                           &read_lock);
+        int lock_errno = errno;
+
+        if (timeout != 0)
+          metrics::observe("schroot_lock_wait_seconds",
+                           {{"type", type_name}},
+                           metrics::now() - start);
+
+        if (status == -1)
           {
-            if (errno == EINTR)
-              throw error((lock_type == LOCK_SHARED ||
-                           lock_type == LOCK_EXCLUSIVE)
-                          ? LOCK_TIMEOUT : UNLOCK_TIMEOUT,
-                          timeout);
+            if (lock_errno == EINTR)
+              {
+                metrics::increment("schroot_lock_timeouts_total",
+                                   {{"type", type_name}});
+                throw error((lock_type == LOCK_SHARED ||
+                             lock_type == LOCK_EXCLUSIVE)
+                            ? LOCK_TIMEOUT : UNLOCK_TIMEOUT,
+                            timeout);
+              }
             else
               throw error((lock_type == LOCK_SHARED ||
                            lock_type == LOCK_EXCLUSIVE) ? LOCK : UNLOCK,
-                          strerror(errno));
+                          strerror(lock_errno));
           }
 
         if (lock_type == LOCK_SHARED || lock_type == LOCK_EXCLUSIVE)
@@ -215,4 +375,183 @@ namespace schroot
     set_lock(LOCK_NONE, 0);
   }
 
+  ofd_lock::ofd_lock (int fd):
+    lock(),
+    fd(fd),
+    locked(false),
+#ifdef F_OFD_SETLK
+    ofd(true)
+#else
+    ofd(false)
+#endif
+  {
+  }
+
+  ofd_lock::~ofd_lock ()
+  {
+    // Release a lock if held.  Any error is logged, since a
+    // destructor must not throw.
+    if (locked && !try_lock(LOCK_NONE))
+      log_exception_warning(error(UNLOCK, strerror(errno)));
+  }
+
+  bool
+  ofd_lock::try_lock (lock::type lock_type)
+  {
+    struct flock request;
+    request.l_type = lock_type;
+    request.l_whence = SEEK_SET;
+    request.l_start = 0;
+    request.l_len = 0; // Lock entire file
+    request.l_pid = 0;
+
+#ifdef F_OFD_SETLK
+    if (this->ofd)
+      {
+        if (fcntl(this->fd, F_OFD_SETLK, &request) == 0)
+          return true;
+        // Not supported by the running kernel; use POSIX locks.
+        if (errno != EINVAL)
+          return false;
+        this->ofd = false;
+        log_debug(DEBUG_NOTICE) << "Open file description locks unavailable; "
+                                << "using POSIX locks" << std::endl;
+      }
+#endif
+
+    return fcntl(this->fd, F_SETLK, &request) == 0;
+  }
+
+  void
+  ofd_lock::set_lock (lock::type   lock_type,
+                      unsigned int timeout)
+  {
+    const char *type_name = lock_type_name(lock_type);
+    trace::span span("lock_wait", type_name);
+    double start = metrics::now();
+    double delay = retry_delay_initial;
+    bool contended = false;
+
+    while (!try_lock(lock_type))
+      {
+        int lock_errno = errno;
+        bool unlocking = lock_type != LOCK_SHARED &&
+          lock_type != LOCK_EXCLUSIVE;
+
+        if (lock_errno != EAGAIN && lock_errno != EACCES)
+          throw error(unlocking ? UNLOCK : LOCK, strerror(lock_errno));
+
+        if (!contended)
+          {
+            contended = true;
+            pid_t holder = find_holder(lock_type, false);
+            log_debug(DEBUG_INFO) << "Waiting for " << type_name
+                                  << " lock held by PID " << holder
+                                  << std::endl;
+            metrics::increment("schroot_lock_contended_total",
+                               {{"type", type_name},
+                                {"holder", holder_name(holder)}});
+          }
+
+        // Wait on the lock if a timeout was set, otherwise return
+        // immediately.
+        if (timeout == 0)
+          throw error(unlocking ? UNLOCK : LOCK, strerror(lock_errno));
+
+        double elapsed = metrics::now() - start;
+        if (elapsed >= timeout)
+          {
+            metrics::observe("schroot_lock_wait_seconds",
+                             {{"type", type_name}}, elapsed);
+            metrics::increment("schroot_lock_timeouts_total",
+                               {{"type", type_name}});
+            pid_t holder = get_holder(lock_type);
+            if (unlocking)
+              throw error(UNLOCK_TIMEOUT, timeout);
+            else if (holder > 0)
+              throw error(LOCK_TIMEOUT_HOLDER, timeout, holder);
+            else
+              throw error(LOCK_TIMEOUT, timeout);
+          }
+
+        sleep_for(std::min(delay, timeout - elapsed));
+        delay = std::min(delay * 2, retry_delay_max);
+      }
+
+    if (timeout != 0)
+      metrics::observe("schroot_lock_wait_seconds",
+                       {{"type", type_name}},
+                       metrics::now() - start);
+
+    this->locked = lock_type == LOCK_SHARED || lock_type == LOCK_EXCLUSIVE;
+  }
+
+  void
+  ofd_lock::unset_lock ()
+  {
+    set_lock(LOCK_NONE, 0);
+  }
+
+  pid_t
+  ofd_lock::get_holder (lock::type lock_type) const
+  {
+    return find_holder(lock_type, true);
+  }
+
+  pid_t
+  ofd_lock::find_holder (lock::type lock_type,
+                         bool       all_processes) const
+  {
+    struct flock query;
+    query.l_type = lock_type;
+    query.l_whence = SEEK_SET;
+    query.l_start = 0;
+    query.l_len = 0; // Lock entire file
+    query.l_pid = 0;
+
+#ifdef F_OFD_GETLK
+    int command = this->ofd ? F_OFD_GETLK : F_GETLK;
+#else
+    int command = F_GETLK;
+#endif
+    if (fcntl(this->fd, command, &query) == 0)
+      {
+        if (query.l_type == F_UNLCK)
+          return 0;
+        // The holder of a POSIX lock is known; open file description
+        // locks report -1.
+        if (query.l_pid > 0)
+          return query.l_pid;
+      }
+
+    struct ::stat status;
+    if (fstat(this->fd, &status) < 0)
+      return -1;
+
+    pid_t self = getpid();
+    if (process_holds_lock("self", status, lock_type, this->fd))
+      return self;
+
+    if (all_processes)
+      {
+        DIR *dirp = opendir("/proc");
+        if (dirp == nullptr)
+          return -1;
+
+        pid_t holder = -1;
+        struct dirent *entry;
+        while (holder < 0 && (entry = readdir(dirp)) != nullptr)
+          {
+            pid_t pid = atoi(entry->d_name);
+            if (pid > 0 && pid != self &&
+                process_holds_lock(entry->d_name, status, lock_type, -1))
+              holder = pid;
+          }
+        closedir(dirp);
+        return holder;
+      }
+
+    return -1;
+  }
+
 }
@@ -55,6 +55,7 @@ namespace schroot
         LOCK,                 ///< Failed to lock file.
         UNLOCK,               ///< Failed to unlock file.
         LOCK_TIMEOUT,         ///< Failed to lock file (timed out).
+        LOCK_TIMEOUT_HOLDER,  ///< Failed to lock file (timed out; holder known).
         UNLOCK_TIMEOUT,       ///< Failed to unlock file (timed out).
         DEVICE_LOCK,          ///< Failed to lock device.
         DEVICE_LOCK_TIMEOUT,  ///< Failed to lock device (timed out).
@@ -161,6 +162,92 @@ namespace schroot
     bool locked;
   };
 
+  /**
+   * Open file description lock.  Whole-file shared and exclusive
+   * advisory locking based upon Linux open file description
+   * (F_OFD_SETLK) byte region locks.
+   *
+   * Unlike file_lock, the lock is owned by the open file description
+   * rather than the process, so separately opened descriptors
+   * contend for the lock even within a single process, and closing
+   * an unrelated descriptor for the same file does not release it.
+   * Timeouts are implemented by retrying with an increasing delay
+   * rather than by interrupting a blocking wait with SIGALRM, so no
+   * process-wide signal or timer state is used, and locks may be
+   * taken concurrently by multiple threads.  These locks conflict
+   * with POSIX locks taken by file_lock.
+   *
+   * If open file description locks are not supported by the system,
+   * POSIX locks are used instead, with the same timeout handling.
+   */
+  class ofd_lock : public lock
+  {
+  public:
+    /**
+     * The constructor.
+     *
+     * @param fd the file descriptor to lock.
+     */
+    ofd_lock (int fd);
+
+    /// The destructor.
+    virtual ~ofd_lock ();
+
+    virtual void
+    set_lock (lock::type   lock_type,
+              unsigned int timeout);
+
+    virtual void
+    unset_lock ();
+
+    /**
+     * Find the process holding a lock which conflicts with the
+     * specified lock type.  This is intended for reporting only,
+     * since the lock may be released at any time.  The holder of an
+     * open file description lock is found by searching the open
+     * files of every process, so may only be found if permitted to
+     * inspect it.
+     *
+     * @param lock_type the type of lock to check for conflicts.
+     * @returns the process ID of the holder, 0 if there is no
+     * conflicting lock, or -1 if the holder is not known.
+     */
+    pid_t
+    get_holder (lock::type lock_type) const;
+
+  private:
+    /**
+     * Find the process holding a conflicting lock.
+     *
+     * @param lock_type the type of lock to check for conflicts.
+     * @param all_processes search the open files of other processes
+     * if the holder is not the current process; otherwise, -1 is
+     * returned for any holder of an open file description lock in
+     * another process.
+     * @returns the process ID of the holder, 0 if there is no
+     * conflicting lock, or -1 if the holder is not known.
+     */
+    pid_t
+    find_holder (lock::type lock_type,
+                 bool       all_processes) const;
+
+    /**
+     * Try to acquire or release the lock without waiting.
+     *
+     * @param lock_type the type of lock to acquire.
+     * @returns true on success, or false on failure, with errno set.
+     */
+    bool
+    try_lock (lock::type lock_type);
+
+    /// The file descriptor to lock.
+    int fd;
+    /// Is the file locked?
+    bool locked;
+    /// Are open file description locks supported?
+    bool ofd;
+  };
+
 }
 
 #endif /* SCHROOT_LOCK_H */
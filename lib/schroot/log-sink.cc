@@ -0,0 +1,404 @@
+/* Copyright © 2005-2013  Roger Leigh <rleigh@codelibre.net>
+ *
+ * schroot is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * schroot is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ *********************************************************************/
+
+#include <config.h>
+
+#include <schroot/i18n.h>
+#include <schroot/log-sink.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <boost/format.hpp>
+
+using boost::format;
+
+namespace schroot
+{
+
+  namespace
+  {
+
+    /// Maximum amount of data to buffer.
+    const std::string::size_type max_pending = 1024 * 1024;
+
+    /// Maximum time to wait for a file descriptor on flush.
+    const int flush_timeout = 5000;
+
+    const char *
+    level_name (log_level level)
+    {
+      switch (level)
+        {
+        case LOG_LEVEL_DEBUG:
+          return "debug";
+        case LOG_LEVEL_INFO:
+          return "info";
+        case LOG_LEVEL_WARNING:
+          return "warning";
+        case LOG_LEVEL_ERROR:
+        default:
+          return "error";
+        }
+    }
+
+    /// syslog(3) priority of a message.
+    int
+    level_priority (log_level level)
+    {
+      switch (level)
+        {
+        case LOG_LEVEL_DEBUG:
+          return 7;
+        case LOG_LEVEL_INFO:
+          return 6;
+        case LOG_LEVEL_WARNING:
+          return 4;
+        case LOG_LEVEL_ERROR:
+        default:
+          return 3;
+        }
+    }
+
+    const log_field *
+    find_field (const log_record& record,
+                const std::string& name)
+    {
+      for (const auto& field : record.fields)
+        if (field.first == name)
+          return &field;
+      return nullptr;
+    }
+
+    /**
+     * Add a field to a journal message.  Values containing newlines
+     * use the binary form: the name and a newline, followed by the
+     * length as a little-endian 64-bit integer, the value and a
+     * newline.
+     */
+    void
+    journal_field (std::string&       message,
+                   const std::string& name,
+                   const std::string& value)
+    {
+      message += name;
+      if (value.find('\n') == std::string::npos)
+        {
+          message += '=';
+          message += value;
+        }
+      else
+        {
+          message += '\n';
+          uint64_t length = value.size();
+          for (int i = 0; i < 8; ++i)
+            message += static_cast<char>((length >> (8 * i)) & 0xff);
+          message += value;
+        }
+      message += '\n';
+    }
+
+  }
+
+  log_writer::log_writer (int fd):
+    fd(fd),
+    owner(getpid()),
+    pending(),
+    dropped(0)
+  {
+  }
+
+  log_writer::~log_writer ()
+  {
+    flush(true);
+  }
+
+  void
+  log_writer::write (const std::string& data)
+  {
+    // Data buffered by the parent is the parent's to write.
+    if (this->owner != getpid())
+      {
+        this->pending.clear();
+        this->dropped = 0;
+        this->owner = getpid();
+      }
+
+    if (this->pending.size() + data.size() > max_pending)
+      {
+        ++this->dropped;
+        return;
+      }
+
+    this->pending += data;
+    flush(false);
+  }
+
+  void
+  log_writer::flush (bool wait)
+  {
+    if (this->owner != getpid())
+      return;
+
+    while (!this->pending.empty() || this->dropped)
+      {
+        if (this->pending.empty())
+          {
+            this->pending = (format(_("%1% log messages discarded\n"))
+                             % this->dropped).str();
+            this->dropped = 0;
+          }
+
+        struct pollfd pfd;
+        pfd.fd = this->fd;
+        pfd.events = POLLOUT;
+        pfd.revents = 0;
+        int status = poll(&pfd, 1, wait ? flush_timeout : 0);
+        if (status < 0 && errno == EINTR)
+          continue;
+        if (status <= 0)
+          break;
+        if (pfd.revents & (POLLERR|POLLHUP|POLLNVAL))
+          {
+            this->pending.clear();
+            this->dropped = 0;
+            break;
+          }
+
+        // Writing at most PIPE_BUF bytes will not block on a pipe
+        // which poll reports as writable.
+        std::string::size_type count = std::min<std::string::size_type>
+          (this->pending.size(), PIPE_BUF);
+        ssize_t written = ::write(this->fd, this->pending.data(), count);
+        if (written < 0)
+          {
+            if (errno == EINTR || errno == EAGAIN)
+              continue;
+            this->pending.clear();
+            this->dropped = 0;
+            break;
+          }
+        this->pending.erase(0, written);
+      }
+  }
+
+  log_text_sink::log_text_sink (int fd):
+    log_sink(),
+    writer(fd)
+  {
+  }
+
+  log_text_sink::~log_text_sink ()
+  {
+  }
+
+  void
+  log_text_sink::write (const log_record& record)
+  {
+    std::string line;
+    switch (record.level)
+      {
+      case LOG_LEVEL_DEBUG:
+        // TRANSLATORS: %1% = integer debug level
+        // TRANSLATORS: "D" is an abbreviation of "Debug"
+        line = (format(_("D(%1%): ")) % record.debug).str();
+        break;
+      case LOG_LEVEL_INFO:
+        // TRANSLATORS: "I" is an abbreviation of "Information"
+        line = _("I: ");
+        break;
+      case LOG_LEVEL_WARNING:
+        // TRANSLATORS: "W" is an abbreviation of "Warning"
+        line = _("W: ");
+        break;
+      case LOG_LEVEL_ERROR:
+      default:
+        // TRANSLATORS: "E" is an abbreviation of "Error"
+        line = _("E: ");
+        break;
+      }
+
+    const log_field *script = find_field(record, "script");
+    if (script)
+      line += script->second + ": ";
+
+    line += record.message;
+    line += '\n';
+    this->writer.write(line);
+  }
+
+  void
+  log_text_sink::flush ()
+  {
+    this->writer.flush(true);
+  }
+
+  log_json_sink::log_json_sink (int fd):
+    log_sink(),
+    writer(fd)
+  {
+    fcntl(fd, F_SETFD, FD_CLOEXEC);
+  }
+
+  log_json_sink::~log_json_sink ()
+  {
+  }
+
+  void
+  log_json_sink::write (const log_record& record)
+  {
+    struct tm utc;
+    gmtime_r(&record.time.tv_sec, &utc);
+    char timestamp[64];
+    if (strftime(timestamp, sizeof(timestamp), "%Y-%m-%dT%H:%M:%S", &utc) == 0)
+      timestamp[0] = '\0';
+    char fraction[16];
+    snprintf(fraction, sizeof(fraction), ".%06dZ",
+             static_cast<int>(record.time.tv_nsec / 1000 % 1000000));
+
+    std::string line("{\"time\":\"");
+    line += timestamp;
+    line += fraction;
+    line += "\",\"level\":\"";
+    line += level_name(record.level);
+    line += "\",\"pid\":";
+    line += std::to_string(record.pid);
+    if (record.level == LOG_LEVEL_DEBUG)
+      {
+        line += ",\"debug\":";
+        line += std::to_string(record.debug);
+      }
+    line += ",\"message\":";
+    line += json_string(record.message);
+    for (const auto& field : record.fields)
+      {
+        line += ',';
+        line += json_string(field.first);
+        line += ':';
+        line += json_string(field.second);
+      }
+    line += "}\n";
+    this->writer.write(line);
+  }
+
+  void
+  log_json_sink::flush ()
+  {
+    this->writer.flush(true);
+  }
+
+  log_journal_sink::log_journal_sink (const std::string& socket_path):
+    log_sink(),
+    fd(socket(AF_UNIX, SOCK_DGRAM|SOCK_CLOEXEC, 0))
+  {
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strncpy(address.sun_path, socket_path.c_str(), sizeof(address.sun_path) - 1);
+
+    if (this->fd >= 0 &&
+        connect(this->fd, reinterpret_cast<struct sockaddr *>(&address),
+                sizeof(address)) < 0)
+      {
+        close(this->fd);
+        this->fd = -1;
+      }
+  }
+
+  log_journal_sink::~log_journal_sink ()
+  {
+    if (this->fd >= 0)
+      close(this->fd);
+  }
+
+  void
+  log_journal_sink::write (const log_record& record)
+  {
+    if (this->fd < 0)
+      return;
+
+    std::string message;
+    journal_field(message, "MESSAGE", record.message);
+    journal_field(message, "PRIORITY",
+                  std::to_string(level_priority(record.level)));
+    journal_field(message, "SYSLOG_IDENTIFIER", program_invocation_short_name);
+    for (const auto& field : record.fields)
+      {
+        std::string name("SCHROOT_");
+        for (const auto& chr : field.first)
+          name += (chr >= 'a' && chr <= 'z') ? chr - 'a' + 'A' :
+            (((chr >= 'A' && chr <= 'Z') || (chr >= '0' && chr <= '9')) ?
+             chr : '_');
+        journal_field(message, name, field.second);
+      }
+
+    // Messages which can't be sent immediately are discarded.
+    send(this->fd, message.data(), message.size(), MSG_DONTWAIT|MSG_NOSIGNAL);
+  }
+
+  std::string
+  json_string (const std::string& str)
+  {
+    std::string ret("\"");
+    for (const auto& chr : str)
+      {
+        switch (chr)
+          {
+          case '"':
+            ret += "\\\"";
+            break;
+          case '\\':
+            ret += "\\\\";
+            break;
+          case '\n':
+            ret += "\\n";
+            break;
+          case '\r':
+            ret += "\\r";
+            break;
+          case '\t':
+            ret += "\\t";
+            break;
+          default:
+            if (static_cast<unsigned char>(chr) < 0x20)
+              {
+                char escape[8];
+                snprintf(escape, sizeof(escape), "\\u%04x",
+                         static_cast<unsigned int>(chr));
+                ret += escape;
+              }
+            else
+              ret += chr;
+          }
+      }
+    ret += '"';
+    return ret;
+  }
+
+}
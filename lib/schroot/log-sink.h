@@ -0,0 +1,179 @@
+/* Copyright © 2005-2013  Roger Leigh <rleigh@codelibre.net>
+ *
+ * schroot is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * schroot is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ *********************************************************************/
+
+#ifndef SCHROOT_LOG_SINK_H
+#define SCHROOT_LOG_SINK_H
+
+#include <schroot/log.h>
+
+#include <cstddef>
+#include <string>
+
+namespace schroot
+{
+
+  /**
+   * Buffered writer for a file descriptor.  Data is written only
+   * when the file descriptor is ready, and is otherwise kept in a
+   * bounded buffer, so that a slow terminal or reader does not stall
+   * the caller.  If the buffer fills, further data is discarded, and
+   * the number of discarded writes is reported once space is
+   * available.  Data buffered by a parent process is not written by
+   * a forked child.
+   */
+  class log_writer
+  {
+  public:
+    /**
+     * The constructor.
+     *
+     * @param fd the file descriptor to write to.
+     */
+    log_writer (int fd);
+
+    /// The destructor.  Buffered data is flushed.
+    ~log_writer ();
+
+    /**
+     * Write data.
+     *
+     * @param data the data to write.
+     */
+    void
+    write (const std::string& data);
+
+    /**
+     * Write buffered data.
+     *
+     * @param wait true to wait for the file descriptor to become
+     * ready, or false to write only what may be written immediately.
+     */
+    void
+    flush (bool wait);
+
+  private:
+    /// The file descriptor to write to.
+    int         fd;
+    /// The process which buffered the pending data.
+    pid_t       owner;
+    /// Data not yet written.
+    std::string pending;
+    /// The number of writes discarded.
+    std::size_t dropped;
+  };
+
+  /**
+   * Log messages as text, for example "E: 10mount: message".
+   */
+  class log_text_sink : public log_sink
+  {
+  public:
+    /**
+     * The constructor.
+     *
+     * @param fd the file descriptor to write to.
+     */
+    log_text_sink (int fd);
+
+    /// The destructor.
+    virtual ~log_text_sink ();
+
+    virtual void
+    write (const log_record& record);
+
+    virtual void
+    flush ();
+
+  private:
+    /// The writer.
+    log_writer writer;
+  };
+
+  /**
+   * Log messages as JSON objects, one per line.  Each object
+   * contains "time", "level", "pid" and "message" members, plus a
+   * member for each structured field.
+   */
+  class log_json_sink : public log_sink
+  {
+  public:
+    /**
+     * The constructor.
+     *
+     * @param fd the file descriptor to write to.
+     */
+    log_json_sink (int fd);
+
+    /// The destructor.
+    virtual ~log_json_sink ();
+
+    virtual void
+    write (const log_record& record);
+
+    virtual void
+    flush ();
+
+  private:
+    /// The writer.
+    log_writer writer;
+  };
+
+  /**
+   * Log messages to the systemd journal, using the native protocol.
+   * Structured fields are sent as SCHROOT_NAME fields.  Messages are
+   * discarded if the journal is not running or cannot keep up.
+   */
+  class log_journal_sink : public log_sink
+  {
+  public:
+    /**
+     * The constructor.
+     *
+     * @param socket_path the journal socket.
+     */
+    log_journal_sink (const std::string& socket_path = "/run/systemd/journal/socket");
+
+    /// The destructor.
+    virtual ~log_journal_sink ();
+
+    virtual void
+    write (const log_record& record);
+
+  private:
+    /// The socket.
+    int fd;
+  };
+
+  /**
+   * Escape a string for use as a JSON string.
+   *
+   * @param str the string to escape.
+   * @returns the escaped string, including the enclosing quotes.
+   */
+  std::string
+  json_string (const std::string& str);
+
+}
+
+#endif /* SCHROOT_LOG_SINK_H */
+
+/*
+ * Local Variables:
+ * mode:C++
+ * End:
+ */
@@ -22,14 +22,14 @@
 #include <schroot/error.h>
 #include <schroot/i18n.h>
 #include <schroot/log.h>
+#include <schroot/log-sink.h>
 #include <schroot/nostream.h>
 #include <schroot/util.h>
 
 #include <iostream>
+#include <streambuf>
 
-#include <boost/format.hpp>
-
-using boost::format;
+#include <unistd.h>
 
 namespace schroot
 {
@@ -37,6 +37,119 @@ namespace schroot
   namespace
   {
 
+    /// The sinks messages are written to.
+    std::vector<log_sink::ptr>&
+    sinks ()
+    {
+      static std::vector<log_sink::ptr> log_sinks
+        {std::make_shared<log_text_sink>(STDERR_FILENO)};
+      return log_sinks;
+    }
+
+    /// Structured fields set with log_context.
+    std::vector<log_field>&
+    context ()
+    {
+      static std::vector<log_field> log_context_fields;
+      return log_context_fields;
+    }
+
+    /**
+     * Stream buffer for a logging stream.  Text is accumulated, and
+     * each complete line is written to the sinks as a separate
+     * message.
+     */
+    class log_streambuf : public std::streambuf
+    {
+    public:
+      /**
+       * The constructor.
+       *
+       * @param level the message severity.
+       * @param debug the debug level, for debugging messages.
+       */
+      log_streambuf (log_level   level,
+                     debug_level debug = DEBUG_NONE):
+        std::streambuf(),
+        level(level),
+        debug(debug),
+        line()
+      {
+      }
+
+    protected:
+      virtual int_type
+      overflow (int_type c)
+      {
+        if (traits_type::eq_int_type(c, traits_type::eof()))
+          return traits_type::not_eof(c);
+
+        if (traits_type::to_char_type(c) == '\n')
+          emit();
+        else
+          this->line += traits_type::to_char_type(c);
+        return c;
+      }
+
+      virtual std::streamsize
+      xsputn (const char_type *s,
+              std::streamsize  n)
+      {
+        for (std::streamsize i = 0; i < n; ++i)
+          overflow(traits_type::to_int_type(s[i]));
+        return n;
+      }
+
+    private:
+      /// Write the current line to the sinks.
+      void
+      emit ()
+      {
+        log_record record;
+        record.level = this->level;
+        record.debug = this->debug;
+        clock_gettime(CLOCK_REALTIME, &record.time);
+        record.pid = getpid();
+        record.message.swap(this->line);
+        record.fields = context();
+
+        for (const auto& sink : sinks())
+          sink->write(record);
+      }
+
+      /// The message severity.
+      log_level   level;
+      /// The debug level.
+      debug_level debug;
+      /// The incomplete line.
+      std::string line;
+    };
+
+    /**
+     * A logging stream.
+     */
+    class log_stream : public std::ostream
+    {
+    public:
+      /**
+       * The constructor.
+       *
+       * @param level the message severity.
+       * @param debug the debug level, for debugging messages.
+       */
+      log_stream (log_level   level,
+                  debug_level debug = DEBUG_NONE):
+        std::ostream(nullptr),
+        buffer(level, debug)
+      {
+        rdbuf(&this->buffer);
+      }
+
+    private:
+      /// The stream buffer.
+      log_streambuf buffer;
+    };
+
     /**
      * Log an exception reason.  Log the reason an exception was thrown,
      * if the exception contains reason information.
@@ -88,32 +201,39 @@ namespace schroot
   std::ostream&
   log_info ()
   {
-    // TRANSLATORS: "I" is an abbreviation of "Information"
-    return std::cerr << _("I: ");
+    static log_stream info(LOG_LEVEL_INFO);
+    return info;
   }
 
   std::ostream&
   log_warning ()
   {
-    // TRANSLATORS: "W" is an abbreviation of "Warning"
-    return std::cerr << _("W: ");
+    static log_stream warning(LOG_LEVEL_WARNING);
+    return warning;
   }
 
   std::ostream&
   log_error ()
   {
-    // TRANSLATORS: "E" is an abbreviation of "Error"
-    return std::cerr << _("E: ");
+    static log_stream error(LOG_LEVEL_ERROR);
+    return error;
   }
 
   std::ostream&
   log_debug (debug_level level)
   {
+    static log_stream debug[] =
+      {
+        {LOG_LEVEL_DEBUG, DEBUG_NOTICE},
+        {LOG_LEVEL_DEBUG, DEBUG_INFO},
+        {LOG_LEVEL_DEBUG, DEBUG_WARNING},
+        {LOG_LEVEL_DEBUG, DEBUG_CRITICAL}
+      };
+
     if (debug_log_level > 0 &&
-        level >= debug_log_level)
-      // TRANSLATORS: %1% = integer debug level
-      // TRANSLATORS: "D" is an abbreviation of "Debug"
-      return std::cerr << format(_("D(%1%): ")) % level;
+        level >= debug_log_level &&
+        level >= DEBUG_NOTICE && level <= DEBUG_CRITICAL)
+      return debug[level - DEBUG_NOTICE];
     else
       return cnull;
   }
@@ -173,6 +293,67 @@ namespace schroot
     log_error() << _("An unknown exception occurred") << std::endl;
   }
 
+  log_sink::~log_sink ()
+  {
+  }
+
+  void
+  log_sink::flush ()
+  {
+  }
+
+  log_context::log_context (const std::string& name,
+                            const std::string& value):
+    name(name),
+    previous(),
+    was_set(false)
+  {
+    for (auto& field : context())
+      if (field.first == name)
+        {
+          this->previous = field.second;
+          this->was_set = true;
+          field.second = value;
+          return;
+        }
+    context().push_back(log_field(name, value));
+  }
+
+  log_context::~log_context ()
+  {
+    std::vector<log_field>& fields(context());
+    for (auto pos = fields.begin(); pos != fields.end(); ++pos)
+      if (pos->first == this->name)
+        {
+          if (this->was_set)
+            pos->second = this->previous;
+          else
+            fields.erase(pos);
+          break;
+        }
+  }
+
+  void
+  log_add_sink (log_sink::ptr sink)
+  {
+    sinks().push_back(sink);
+  }
+
+  void
+  log_set_sink (log_sink::ptr sink)
+  {
+    log_flush();
+    sinks().clear();
+    sinks().push_back(sink);
+  }
+
+  void
+  log_flush ()
+  {
+    for (const auto& sink : sinks())
+      sink->flush();
+  }
+
   debug_level debug_log_level = DEBUG_NONE;
 
 }
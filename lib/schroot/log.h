@@ -19,7 +19,14 @@
 #ifndef SCHROOT_LOG_H
 #define SCHROOT_LOG_H
 
+#include <ctime>
+#include <memory>
 #include <ostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <sys/types.h>
 
 namespace schroot
 {
@@ -34,6 +41,102 @@ namespace schroot
       DEBUG_CRITICAL = 4 ///< Critical messages.
     };
 
+  /// Message severity.
+  enum log_level
+    {
+      LOG_LEVEL_DEBUG,   ///< Debugging message.
+      LOG_LEVEL_INFO,    ///< Informational message.
+      LOG_LEVEL_WARNING, ///< Warning message.
+      LOG_LEVEL_ERROR    ///< Error message.
+    };
+
+  /// A structured field name and value.
+  typedef std::pair<std::string, std::string> log_field;
+
+  /**
+   * A single logged message.  Each line written to one of the
+   * logging streams is a separate message.
+   */
+  struct log_record
+  {
+    /// The message severity.
+    log_level              level;
+    /// The debug level, for debugging messages.
+    debug_level            debug;
+    /// The time the message was logged.
+    struct timespec        time;
+    /// The ID of the process logging the message.
+    pid_t                  pid;
+    /// The message text, without a trailing newline.
+    std::string            message;
+    /// Structured fields set with log_context.
+    std::vector<log_field> fields;
+  };
+
+  /**
+   * A destination for log messages.
+   */
+  class log_sink
+  {
+  public:
+    /// A shared_ptr to a log_sink object.
+    typedef std::shared_ptr<log_sink> ptr;
+
+    /// The destructor.
+    virtual ~log_sink ();
+
+    /**
+     * Write a message.  This must not block.
+     *
+     * @param record the message to write.
+     */
+    virtual void
+    write (const log_record& record) = 0;
+
+    /**
+     * Write any buffered messages, waiting if required.
+     */
+    virtual void
+    flush ();
+  };
+
+  /**
+   * Set a structured field on all messages logged during the
+   * lifetime of this object.  Any previous value of the field is
+   * restored on destruction.
+   */
+  class log_context
+  {
+  public:
+    /**
+     * The constructor.
+     *
+     * @param name the field name.  This should be lowercase, with
+     * words separated by underscores, for example "chroot".
+     * @param value the field value.
+     */
+    log_context (const std::string& name,
+                 const std::string& value);
+
+    /// The destructor.
+    ~log_context ();
+
+    /// Not copyable.
+    log_context (const log_context& rhs) = delete;
+
+    /// Not copyable.
+    log_context&
+    operator = (const log_context& rhs) = delete;
+
+  private:
+    /// The field name.
+    std::string name;
+    /// The previous field value.
+    std::string previous;
+    /// Was the field previously set?
+    bool        was_set;
+  };
+
   /**
    * Log an informational message.
    *
@@ -131,6 +234,31 @@ namespace schroot
   void
   log_unknown_exception_error ();
 
+  /**
+   * Add a log sink.  Messages are written to standard error as text
+   * by default; added sinks receive messages in addition.
+   *
+   * @param sink the sink to add.
+   */
+  void
+  log_add_sink (log_sink::ptr sink);
+
+  /**
+   * Replace all log sinks, including the default standard error
+   * sink, with a single sink.
+   *
+   * @param sink the sink to use.
+   */
+  void
+  log_set_sink (log_sink::ptr sink);
+
+  /**
+   * Write any buffered messages in all sinks.  This must be called
+   * before replacing the process image with exec.
+   */
+  void
+  log_flush ();
+
   /// The debugging level in use.
   extern debug_level debug_log_level;
 
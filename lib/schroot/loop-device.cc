@@ -0,0 +1,382 @@
+/* Copyright © 2005-2013  Roger Leigh <rleigh@codelibre.net>
+ *
+ * schroot is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * schroot is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ *********************************************************************/
+
+#include <config.h>
+
+#include <schroot/loop-device.h>
+#include <schroot/util.h>
+
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <linux/loop.h>
+
+namespace schroot
+{
+
+  template<>
+  error<loop_device::error_code>::map_type
+  error<loop_device::error_code>::error_strings =
+    {
+      {loop_device::CONTROL_OPEN,  N_("Failed to open loop control device")},
+      {loop_device::DEVICE_FREE,   N_("Failed to find a free loop device")},
+      {loop_device::DEVICE_OPEN,   N_("Failed to open loop device")},
+      {loop_device::DEVICE_ATTACH, N_("Failed to attach loop device")},
+      {loop_device::DEVICE_DETACH, N_("Failed to detach loop device")},
+      // TRANSLATORS: %1% = loop device name
+      {loop_device::DEVICE_RW,     N_("Loop device ‘%1%’ is attached read-only, and may not be shared for writing")},
+      {loop_device::FILE_OPEN,     N_("Failed to open loop device backing file")}
+    };
+
+  namespace
+  {
+
+    /// The number of attempts to claim a free loop device.
+    const int attach_attempts = 8;
+
+    /**
+     * Get the status of a loop device, and check it is attached to
+     * the specified file.
+     *
+     * @param fd the open loop device.
+     * @param dev the backing file device.
+     * @param ino the backing file inode.
+     * @param info the loop device status (returned).
+     * @returns true if the device is attached to the whole of the
+     * file, otherwise false.
+     */
+    bool
+    attached_to (int                 fd,
+                 dev_t               dev,
+                 ino_t               ino,
+                 struct loop_info64& info)
+    {
+      std::memset(&info, 0, sizeof(info));
+      return (ioctl(fd, LOOP_GET_STATUS64, &info) == 0 &&
+              info.lo_device == dev &&
+              info.lo_inode == ino &&
+              info.lo_offset == 0 &&
+              info.lo_sizelimit == 0);
+    }
+
+    /**
+     * Convert loop device flags to kernel loop flags.
+     *
+     * @param flags the loop device flags.
+     * @returns the kernel flags.
+     */
+    unsigned int
+    to_lo_flags (int flags)
+    {
+      unsigned int lo_flags = 0;
+      if (flags & loop_device::FLAG_READ_ONLY)
+        lo_flags |= LO_FLAGS_READ_ONLY;
+      if (flags & loop_device::FLAG_DIRECT_IO)
+        lo_flags |= LO_FLAGS_DIRECT_IO;
+      if (flags & loop_device::FLAG_PARTSCAN)
+        lo_flags |= LO_FLAGS_PARTSCAN;
+      if (flags & loop_device::FLAG_AUTOCLEAR)
+        lo_flags |= LO_FLAGS_AUTOCLEAR;
+      return lo_flags;
+    }
+
+    /**
+     * Convert kernel loop flags to loop device flags.
+     *
+     * @param lo_flags the kernel flags.
+     * @returns the loop device flags.
+     */
+    int
+    from_lo_flags (unsigned int lo_flags)
+    {
+      int flags = loop_device::FLAG_NONE;
+      if (lo_flags & LO_FLAGS_READ_ONLY)
+        flags |= loop_device::FLAG_READ_ONLY;
+      if (lo_flags & LO_FLAGS_DIRECT_IO)
+        flags |= loop_device::FLAG_DIRECT_IO;
+      if (lo_flags & LO_FLAGS_PARTSCAN)
+        flags |= loop_device::FLAG_PARTSCAN;
+      if (lo_flags & LO_FLAGS_AUTOCLEAR)
+        flags |= loop_device::FLAG_AUTOCLEAR;
+      return flags;
+    }
+
+    /**
+     * List the loop device nodes.
+     *
+     * @returns the loop device names.
+     */
+    string_list
+    loop_devices ()
+    {
+      string_list devices;
+
+      DIR *dir = opendir("/dev");
+      if (dir == nullptr)
+        return devices;
+
+      struct dirent *entry;
+      while ((entry = readdir(dir)) != nullptr)
+        {
+          std::string name(entry->d_name);
+          if (name.size() > 4 && name.compare(0, 4, "loop") == 0 &&
+              name.find_first_not_of("0123456789", 4) == std::string::npos)
+            devices.push_back("/dev/" + name);
+        }
+
+      closedir(dir);
+      return devices;
+    }
+
+  }
+
+  loop_device::loop_device (const std::string& file,
+                            int                flags):
+    device(),
+    fd(-1),
+    shared(false),
+    flags(flags)
+  {
+    bool read_only = flags & FLAG_READ_ONLY;
+    int mode = (read_only ? O_RDONLY : O_RDWR) | O_CLOEXEC;
+
+    int filefd = open(file.c_str(), mode);
+    if (filefd < 0)
+      throw error(file, FILE_OPEN, strerror(errno));
+
+    struct ::stat file_status;
+    if (fstat(filefd, &file_status) < 0)
+      {
+        int saved_errno = errno;
+        close(filefd);
+        throw error(file, FILE_OPEN, strerror(saved_errno));
+      }
+
+    int ctlfd = open("/dev/loop-control", O_RDWR|O_CLOEXEC);
+    if (ctlfd < 0)
+      {
+        int saved_errno = errno;
+        close(filefd);
+        throw error("/dev/loop-control", CONTROL_OPEN, strerror(saved_errno));
+      }
+
+    try
+      {
+        // Serialise looking up and attaching devices, so that
+        // concurrent sessions do not attach the same file twice.
+        if (flock(ctlfd, LOCK_EX) < 0)
+          throw error("/dev/loop-control", CONTROL_OPEN, strerror(errno));
+
+        for (const auto& candidate : loop_devices())
+          {
+            if (open_attached(candidate, file_status.st_dev,
+                              file_status.st_ino))
+              {
+                if (!read_only && (this->flags & FLAG_READ_ONLY))
+                  throw error(candidate, DEVICE_RW);
+                break;
+              }
+          }
+
+        unsigned int lo_flags = to_lo_flags(flags);
+        for (int attempt = 0;
+             this->fd < 0 && attempt < attach_attempts;
+             ++attempt)
+          {
+            int number = ioctl(ctlfd, LOOP_CTL_GET_FREE);
+            if (number < 0)
+              throw error(DEVICE_FREE, strerror(errno));
+
+            std::string candidate("/dev/loop" + std::to_string(number));
+            int devfd = open(candidate.c_str(), mode);
+            if (devfd < 0)
+              throw error(candidate, DEVICE_OPEN, strerror(errno));
+
+            struct loop_config config;
+            std::memset(&config, 0, sizeof(config));
+            config.fd = filefd;
+            config.info.lo_flags = lo_flags;
+            std::strncpy(reinterpret_cast<char *>(config.info.lo_file_name),
+                         file.c_str(), LO_NAME_SIZE - 1);
+
+            int status = ioctl(devfd, LOOP_CONFIGURE, &config);
+            if (status < 0 && errno == EINVAL &&
+                (lo_flags & LO_FLAGS_DIRECT_IO))
+              {
+                // The backing filesystem does not support direct I/O.
+                lo_flags &= ~LO_FLAGS_DIRECT_IO;
+                config.info.lo_flags = lo_flags;
+                status = ioctl(devfd, LOOP_CONFIGURE, &config);
+              }
+
+            if (status == 0)
+              {
+                struct loop_info64 info;
+                std::memset(&info, 0, sizeof(info));
+                if (ioctl(devfd, LOOP_GET_STATUS64, &info) == 0)
+                  lo_flags = info.lo_flags;
+                this->device = candidate;
+                this->fd = devfd;
+                this->flags = from_lo_flags(lo_flags);
+              }
+            else
+              {
+                int saved_errno = errno;
+                close(devfd);
+                // Claimed by another process since it was found free.
+                if (saved_errno != EBUSY)
+                  throw error(candidate, DEVICE_ATTACH, strerror(saved_errno));
+              }
+          }
+
+        if (this->fd < 0)
+          throw error(file, DEVICE_ATTACH, strerror(EBUSY));
+      }
+    catch (const error&)
+      {
+        if (this->fd >= 0)
+          close(this->fd);
+        close(ctlfd);
+        close(filefd);
+        throw;
+      }
+
+    close(ctlfd);
+    close(filefd);
+  }
+
+  loop_device::~loop_device ()
+  {
+    if (this->fd >= 0)
+      close(this->fd);
+  }
+
+  std::string const&
+  loop_device::get_device () const
+  {
+    return this->device;
+  }
+
+  bool
+  loop_device::get_shared () const
+  {
+    return this->shared;
+  }
+
+  int
+  loop_device::get_flags () const
+  {
+    return this->flags;
+  }
+
+  bool
+  loop_device::open_attached (const std::string& device,
+                              dev_t              dev,
+                              ino_t              ino)
+  {
+    int devfd = open(device.c_str(), O_RDONLY|O_CLOEXEC);
+    if (devfd < 0)
+      return false;
+
+    // Holding the device open prevents it being cleared
+    // automatically while it is checked and used.
+    struct loop_info64 info;
+    if (!attached_to(devfd, dev, ino, info))
+      {
+        close(devfd);
+        return false;
+      }
+
+    this->device = device;
+    this->fd = devfd;
+    this->shared = true;
+    this->flags = from_lo_flags(info.lo_flags);
+    return true;
+  }
+
+  std::string
+  loop_device::find (const std::string& file)
+  {
+    struct ::stat file_status;
+    if (::stat(file.c_str(), &file_status) < 0)
+      return std::string();
+
+    for (const auto& candidate : loop_devices())
+      {
+        int devfd = open(candidate.c_str(), O_RDONLY|O_CLOEXEC);
+        if (devfd < 0)
+          continue;
+
+        struct loop_info64 info;
+        bool found = attached_to(devfd, file_status.st_dev,
+                                 file_status.st_ino, info);
+        close(devfd);
+        if (found)
+          return candidate;
+      }
+
+    return std::string();
+  }
+
+  bool
+  loop_device::detach (const std::string& device,
+                       const std::string& file)
+  {
+    struct ::stat file_status;
+    if (::stat(file.c_str(), &file_status) < 0)
+      return false;
+
+    int devfd = open(device.c_str(), O_RDONLY|O_CLOEXEC);
+    if (devfd < 0)
+      {
+        if (errno == ENOENT || errno == ENXIO)
+          return false;
+        throw error(device, DEVICE_OPEN, strerror(errno));
+      }
+
+    // Check the device has not been reused for another file.
+    struct loop_info64 info;
+    if (!attached_to(devfd, file_status.st_dev, file_status.st_ino, info))
+      {
+        close(devfd);
+        return false;
+      }
+
+    int status = ioctl(devfd, LOOP_CLR_FD, 0);
+    int saved_errno = errno;
+    close(devfd);
+
+    if (status < 0)
+      {
+        if (saved_errno == ENXIO)
+          return false;
+        throw error(device, DEVICE_DETACH, strerror(saved_errno));
+      }
+
+    return true;
+  }
+
+}
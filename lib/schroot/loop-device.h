@@ -0,0 +1,176 @@
+/* Copyright © 2005-2013  Roger Leigh <rleigh@codelibre.net>
+ *
+ * schroot is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * schroot is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ *********************************************************************/
+
+#ifndef SCHROOT_LOOP_DEVICE_H
+#define SCHROOT_LOOP_DEVICE_H
+
+#include <schroot/custom-error.h>
+
+#include <string>
+
+#include <sys/types.h>
+
+namespace schroot
+{
+
+  /**
+   * Loop device attachment.  Loop devices are allocated using
+   * /dev/loop-control and configured atomically with LOOP_CONFIGURE,
+   * rather than running losetup(8).  A file which is already attached
+   * is reused rather than attached a second time, so that concurrent
+   * sessions share a single loop device (and page cache) for each
+   * image.  This is a Linux only feature.
+   *
+   * The loop device is held open for the lifetime of the object.  An
+   * automatically cleared device is detached by the kernel when it is
+   * last closed or unmounted, so it must be mounted before this
+   * object is destroyed.
+   */
+  class loop_device
+  {
+  public:
+    /// Loop device flags.
+    enum flags
+      {
+        FLAG_NONE      = 0,      ///< No flags.
+        FLAG_READ_ONLY = 1 << 0, ///< Attach read-only.
+        FLAG_DIRECT_IO = 1 << 1, ///< Use direct I/O on the backing file.
+        FLAG_PARTSCAN  = 1 << 2, ///< Scan for partitions.
+        FLAG_AUTOCLEAR = 1 << 3  ///< Detach when last closed.
+      };
+
+    /// Error codes.
+    enum error_code
+      {
+        CONTROL_OPEN,   ///< Failed to open loop control device.
+        DEVICE_FREE,    ///< Failed to find a free loop device.
+        DEVICE_OPEN,    ///< Failed to open loop device.
+        DEVICE_ATTACH,  ///< Failed to attach loop device.
+        DEVICE_DETACH,  ///< Failed to detach loop device.
+        DEVICE_RW,      ///< Loop device is attached read-only.
+        FILE_OPEN       ///< Failed to open backing file.
+      };
+
+    /// Exception type.
+    typedef custom_error<error_code> error;
+
+    /**
+     * The constructor.  Attach a file to a loop device, or reuse the
+     * loop device it is already attached to.  When reusing a device,
+     * its flags are left unchanged; a writable attachment may be
+     * shared with read-only users, but not the reverse.
+     *
+     * @param file the file to attach.
+     * @param flags the loop device flags.
+     */
+    loop_device (const std::string& file,
+                 int                flags);
+
+    /// The destructor.  The loop device is closed but not detached.
+    ~loop_device ();
+
+    /**
+     * Get the loop device name.
+     *
+     * @returns the device name, for example /dev/loop0.
+     */
+    std::string const&
+    get_device () const;
+
+    /**
+     * Was an existing loop device reused?
+     *
+     * @returns true if the file was already attached, or false if it
+     * was attached by this object.
+     */
+    bool
+    get_shared () const;
+
+    /**
+     * Get the loop device flags in effect.  These may differ from
+     * the requested flags if the device was shared, or if direct I/O
+     * is not supported by the backing filesystem.
+     *
+     * @returns the loop device flags.
+     */
+    int
+    get_flags () const;
+
+    /**
+     * Find the loop device a file is attached to.
+     *
+     * @param file the backing file.
+     * @returns the device name, or an empty string if the file is not
+     * attached.
+     */
+    static std::string
+    find (const std::string& file);
+
+    /**
+     * Detach a loop device, if it is still attached to the specified
+     * file.  If the device is still in use, for example by the mounts
+     * of other sessions, the kernel will instead detach it when it is
+     * last closed.
+     *
+     * @param device the loop device name.
+     * @param file the backing file.
+     * @returns true if the device was detached, or false if it was
+     * not attached to the file.
+     */
+    static bool
+    detach (const std::string& device,
+            const std::string& file);
+
+  private:
+    loop_device (const loop_device&) = delete;
+    loop_device& operator = (const loop_device&) = delete;
+
+    /**
+     * Open the loop device and check it is attached to the backing
+     * file.
+     *
+     * @param device the loop device name.
+     * @param dev the backing file device.
+     * @param ino the backing file inode.
+     * @returns true if the device was opened, or false if it is not
+     * attached to the file.
+     */
+    bool
+    open_attached (const std::string& device,
+                   dev_t              dev,
+                   ino_t              ino);
+
+    /// The loop device name.
+    std::string device;
+    /// The open loop device.
+    int fd;
+    /// Was an existing loop device reused?
+    bool shared;
+    /// The loop device flags.
+    int flags;
+  };
+
+}
+
+#endif /* SCHROOT_LOOP_DEVICE_H */
+
+/*
+ * Local Variables:
+ * mode:C++
+ * End:
+ */
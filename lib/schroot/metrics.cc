@@ -0,0 +1,739 @@
+/* Copyright © 2005-2013  Roger Leigh <rleigh@codelibre.net>
+ *
+ * schroot is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * schroot is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ *********************************************************************/
+
+#include <config.h>
+
+#include <schroot/keyfile.h>
+#include <schroot/keyfile-reader.h>
+#include <schroot/log.h>
+#include <schroot/metrics.h>
+#include <schroot/util.h>
+
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <locale>
+#include <map>
+#include <mutex>
+#include <sstream>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <boost/format.hpp>
+
+using boost::format;
+
+namespace schroot
+{
+
+  template<>
+  error<metrics::error_code>::map_type
+  error<metrics::error_code>::error_strings =
+    {
+      // TRANSLATORS: %1% = file
+      {metrics::LOCK,  N_("Failed to lock metrics file ‘%1%’")},
+      // TRANSLATORS: %1% = file
+      {metrics::READ,  N_("Failed to read metrics file ‘%1%’")},
+      // TRANSLATORS: %1% = file
+      {metrics::WRITE, N_("Failed to write metrics file ‘%1%’")}
+    };
+
+  namespace
+  {
+
+    /// Histogram bucket upper bounds, in seconds.
+    const double buckets[] =
+      {0.005, 0.01, 0.025, 0.05, 0.1, 0.25, 0.5, 1, 2.5, 5, 10, 30, 60, 300};
+
+    /// The number of buckets, excluding +Inf.
+    const std::size_t bucket_count = sizeof(buckets) / sizeof(buckets[0]);
+
+    /// Metric help text.
+    const std::map<std::string, std::string> help =
+      {
+        {"schroot_operation_total",
+         "Session operations, by chroot, operation and result."},
+        {"schroot_operation_duration_seconds",
+         "Session operation duration, by chroot and operation."},
+        {"schroot_setup_total",
+         "Setup script runs, by chroot, stage and result."},
+        {"schroot_setup_duration_seconds",
+         "Setup script run duration, by chroot and stage."},
+        {"schroot_setup_script_total",
+         "Individual setup script runs, by script and result."},
+        {"schroot_setup_script_duration_seconds",
+         "Individual setup script duration, by script."},
+        {"schroot_lock_wait_seconds",
+         "Time spent waiting for file locks, by lock type."},
+        {"schroot_lock_contended_total",
+         "File lock acquisitions which had to wait, by lock type and holder."},
+        {"schroot_lock_timeouts_total",
+         "File lock waits which timed out, by lock type."},
+        {"schroot_lease_wait_seconds",
+         "Time spent waiting for source chroot leases, by lease mode."},
+        {"schroot_lease_timeouts_total",
+         "Source chroot lease waits which timed out, by lease mode."},
+        {"schroot_reclaim_total",
+         "Deferred storage reclaims, by storage type and result."},
+        {"schroot_reclaim_duration_seconds",
+         "Deferred storage reclaim duration, by storage type."},
+        {"schroot_sessions_active",
+         "Active sessions, by chroot."}
+      };
+
+    /// A single time series.
+    struct series
+    {
+      /// Is this a histogram, or a counter?
+      bool                  histogram;
+      /// The counter value, or the sum of histogram observations.
+      double                sum;
+      /// The number of histogram observations.
+      uint64_t              count;
+      /// Histogram observations per bucket, including +Inf.
+      std::vector<uint64_t> bucket;
+    };
+
+    /// Time series by metric name and rendered labels.
+    typedef std::map<std::pair<std::string, std::string>, series> series_map;
+
+    /**
+     * Chroot names by session identifier.  When recording changes, an
+     * empty chroot name records the end of a session.
+     */
+    typedef std::map<std::string, std::string> session_map;
+
+    /// Metrics state for the process.
+    struct metrics_state
+    {
+      /// The process which recorded the pending metrics.
+      pid_t       owner;
+      /// Metrics not yet merged into the totals.
+      series_map  pending;
+      /// Sessions begun or ended, not yet merged into the totals.
+      session_map sessions;
+      /// Check the recorded sessions against the session directory?
+      bool        update_sessions;
+      /// The metrics directory.
+      std::string directory;
+      /// The session directory.
+      std::string session_directory;
+      /// Does the metrics directory exist (-1 if not yet known)?
+      int         enabled;
+    };
+
+    metrics_state&
+    state ()
+    {
+      static metrics_state metrics_data{0, series_map(), session_map(), false,
+          SCHROOT_METRICS_DIR, SCHROOT_SESSION_DIR, -1};
+      return metrics_data;
+    }
+
+    /// Serialises access to the metrics state between threads.
+    std::mutex state_lock;
+
+    /// Get the metrics state, discarding anything recorded by a parent.
+    metrics_state&
+    owned_state ()
+    {
+      metrics_state& metrics_data(state());
+      if (metrics_data.owner != getpid())
+        {
+          metrics_data.pending.clear();
+          metrics_data.sessions.clear();
+          metrics_data.update_sessions = false;
+          metrics_data.owner = getpid();
+        }
+      return metrics_data;
+    }
+
+    /// Get the pending metrics, discarding any recorded by a parent.
+    series_map&
+    pending ()
+    {
+      return owned_state().pending;
+    }
+
+    std::string
+    escape_label (const std::string& value)
+    {
+      std::string ret;
+      for (const auto& chr : value)
+        {
+          if (chr == '\\')
+            ret += "\\\\";
+          else if (chr == '"')
+            ret += "\\\"";
+          else if (chr == '\n')
+            ret += "\\n";
+          else if (chr == '\t')
+            ret += ' ';
+          else
+            ret += chr;
+        }
+      return ret;
+    }
+
+    std::string
+    render_labels (const metrics::label_list& labels)
+    {
+      std::string ret;
+      for (const auto& label : labels)
+        {
+          if (!ret.empty())
+            ret += ',';
+          ret += label.first + "=\"" + escape_label(label.second) + '"';
+        }
+      return ret;
+    }
+
+    double
+    parse_number (const std::string& value)
+    {
+      std::istringstream input(value);
+      input.imbue(std::locale::classic());
+      double ret = 0;
+      input >> ret;
+      return ret;
+    }
+
+    std::string
+    number (double value)
+    {
+      // Use the shortest representation which reads back exactly,
+      // independent of the locale.
+      std::ostringstream output;
+      output.imbue(std::locale::classic());
+      output.precision(15);
+      output << value;
+      if (parse_number(output.str()) != value)
+        {
+          output.str("");
+          output.precision(17);
+          output << value;
+        }
+      return output.str();
+    }
+
+    void
+    merge (series_map&       totals,
+           const series_map& add)
+    {
+      for (const auto& item : add)
+        {
+          auto pos = totals.find(item.first);
+          if (pos == totals.end())
+            {
+              totals.insert(item);
+              continue;
+            }
+          if (pos->second.histogram != item.second.histogram)
+            continue;
+          pos->second.sum += item.second.sum;
+          pos->second.count += item.second.count;
+          for (std::size_t i = 0;
+               i < pos->second.bucket.size() && i < item.second.bucket.size();
+               ++i)
+            pos->second.bucket[i] += item.second.bucket[i];
+        }
+    }
+
+    /**
+     * Read metrics.  Each line is tab-separated, containing the type,
+     * name, labels and values, or the session identifier and chroot
+     * name of a session.  Malformed lines are ignored.
+     */
+    void
+    read_series (const std::string& file,
+                 series_map&        totals,
+                 session_map&       sessions)
+    {
+      std::ifstream input(file.c_str());
+      if (!input)
+        {
+          if (errno == ENOENT)
+            return;
+          throw metrics::error(file, metrics::READ, strerror(errno));
+        }
+      input.imbue(std::locale::classic());
+
+      series_map data;
+      std::string line;
+      while (std::getline(input, line))
+        {
+          string_list fields;
+          std::string::size_type start = 0, end;
+          while ((end = line.find('\t', start)) != std::string::npos)
+            {
+              fields.push_back(line.substr(start, end - start));
+              start = end + 1;
+            }
+          fields.push_back(line.substr(start));
+          if (fields[0] == "session" && fields.size() == 3)
+            {
+              sessions[fields[1]] = fields[2];
+              continue;
+            }
+          if (fields.size() < 4)
+            continue;
+
+          series item{false, 0, 0, std::vector<uint64_t>()};
+          if (fields[0] == "counter" && fields.size() == 4)
+            item.sum = parse_number(fields[3]);
+          else if (fields[0] == "histogram" &&
+                   fields.size() == 5 + bucket_count + 1)
+            {
+              item.histogram = true;
+              item.sum = parse_number(fields[3]);
+              item.count = strtoull(fields[4].c_str(), 0, 10);
+              for (std::size_t i = 0; i <= bucket_count; ++i)
+                item.bucket.push_back(strtoull(fields[5 + i].c_str(), 0, 10));
+            }
+          else
+            continue;
+
+          series_map::key_type key(fields[1], fields[2]);
+          data.insert(std::make_pair(key, item));
+        }
+
+      merge(totals, data);
+    }
+
+    /// Write a file atomically, by renaming a temporary file.
+    void
+    write_file (const std::string& file,
+                const std::string& contents)
+    {
+      std::string::size_type slash = file.rfind('/');
+      std::string temporary = file.substr(0, slash + 1) + '.' +
+        file.substr(slash + 1) + '.' + std::to_string(getpid());
+
+      int fd = open(temporary.c_str(),
+                    O_WRONLY|O_CREAT|O_TRUNC|O_NOFOLLOW|O_CLOEXEC, 0644);
+      if (fd < 0)
+        throw metrics::error(temporary, metrics::WRITE, strerror(errno));
+
+      const char *data = contents.data();
+      std::string::size_type remaining = contents.size();
+      while (remaining)
+        {
+          ssize_t written = write(fd, data, remaining);
+          if (written < 0)
+            {
+              if (errno == EINTR)
+                continue;
+              int write_errno = errno;
+              close(fd);
+              unlink(temporary.c_str());
+              throw metrics::error(temporary, metrics::WRITE,
+                                   strerror(write_errno));
+            }
+          data += written;
+          remaining -= written;
+        }
+
+      if (close(fd) < 0 || rename(temporary.c_str(), file.c_str()) < 0)
+        {
+          int write_errno = errno;
+          unlink(temporary.c_str());
+          throw metrics::error(file, metrics::WRITE, strerror(write_errno));
+        }
+    }
+
+    std::string
+    serialise (const series_map&  data,
+               const session_map& sessions)
+    {
+      std::string ret;
+      for (const auto& item : data)
+        {
+          ret += item.second.histogram ? "histogram\t" : "counter\t";
+          ret += item.first.first + '\t' + item.first.second + '\t';
+          ret += number(item.second.sum);
+          if (item.second.histogram)
+            {
+              ret += '\t' + std::to_string(item.second.count);
+              for (const auto& count : item.second.bucket)
+                ret += '\t' + std::to_string(count);
+            }
+          ret += '\n';
+        }
+      for (const auto& session : sessions)
+        ret += "session\t" + session.first + '\t' + session.second + '\n';
+      return ret;
+    }
+
+    /**
+     * Check the recorded sessions against the session directory.
+     * Sessions whose files no longer exist are forgotten.  The chroot
+     * of a session which was not recorded is read from its session
+     * file, so each session file is read at most once.
+     */
+    void
+    check_sessions (const std::string& session_directory,
+                    session_map&       active)
+    {
+      session_map found;
+
+      DIR *dir = opendir(session_directory.c_str());
+      if (dir == nullptr)
+        {
+          active.clear();
+          return;
+        }
+
+      struct dirent *entry;
+      while ((entry = readdir(dir)) != nullptr)
+        {
+          std::string name(entry->d_name);
+          if (!is_valid_sessionname(name))
+            continue;
+
+          auto pos = active.find(name);
+          if (pos != active.end())
+            {
+              found.insert(*pos);
+              continue;
+            }
+
+          std::string chroot(name);
+          try
+            {
+              std::ifstream input((session_directory + '/' + name).c_str());
+              if (!input)
+                continue;
+              keyfile kconfig;
+              keyfile_reader(kconfig, input);
+              kconfig.get_value(name, "original-name", chroot);
+            }
+          catch (const std::runtime_error& e)
+            {
+            }
+          found.insert(std::make_pair(name, chroot));
+        }
+      closedir(dir);
+
+      active.swap(found);
+    }
+
+    void
+    write_help (std::string&       output,
+                const std::string& name,
+                const char        *type)
+    {
+      auto pos = help.find(name);
+      output += "# HELP " + name + ' ' +
+        (pos != help.end() ? pos->second : std::string("schroot metric.")) +
+        '\n';
+      output += "# TYPE " + name + ' ' + type + '\n';
+    }
+
+    /// Render metrics in the Prometheus text exposition format.
+    std::string
+    render (const series_map&  data,
+            const session_map& active)
+    {
+      std::string ret;
+      std::string current;
+
+      for (const auto& item : data)
+        {
+          const std::string& name(item.first.first);
+          const std::string& labels(item.first.second);
+          const series& value(item.second);
+
+          if (name != current)
+            {
+              write_help(ret, name, value.histogram ? "histogram" : "counter");
+              current = name;
+            }
+
+          if (!value.histogram)
+            {
+              ret += name;
+              if (!labels.empty())
+                ret += '{' + labels + '}';
+              ret += ' ' + number(value.sum) + '\n';
+              continue;
+            }
+
+          std::string prefix(labels.empty() ? labels : labels + ',');
+          uint64_t cumulative = 0;
+          for (std::size_t i = 0; i <= bucket_count; ++i)
+            {
+              cumulative += value.bucket[i];
+              ret += name + "_bucket{" + prefix + "le=\"" +
+                (i < bucket_count ? number(buckets[i]) : std::string("+Inf")) +
+                "\"} " + std::to_string(cumulative) + '\n';
+            }
+          std::string suffix(labels.empty() ? labels : '{' + labels + '}');
+          ret += name + "_sum" + suffix + ' ' + number(value.sum) + '\n';
+          ret += name + "_count" + suffix + ' ' +
+            std::to_string(value.count) + '\n';
+        }
+
+      std::map<std::string, unsigned int> chroots;
+      for (const auto& session : active)
+        ++chroots[session.second];
+
+      write_help(ret, "schroot_sessions_active", "gauge");
+      for (const auto& chroot : chroots)
+        ret += "schroot_sessions_active{chroot=\"" +
+          escape_label(chroot.first) + "\"} " +
+          std::to_string(chroot.second) + '\n';
+
+      return ret;
+    }
+
+  }
+
+  void
+  metrics::increment (const std::string& name,
+                      const label_list&  labels,
+                      double             value)
+  {
+    std::lock_guard<std::mutex> guard(state_lock);
+    if (!enabled())
+      return;
+
+    series_map::key_type key(name, render_labels(labels));
+    series& item(pending()[key]);
+    item.histogram = false;
+    item.sum += value;
+  }
+
+  void
+  metrics::observe (const std::string& name,
+                    const label_list&  labels,
+                    double             value)
+  {
+    std::lock_guard<std::mutex> guard(state_lock);
+    if (!enabled())
+      return;
+
+    series_map::key_type key(name, render_labels(labels));
+    series& item(pending()[key]);
+    if (!item.histogram)
+      {
+        item.histogram = true;
+        item.bucket.assign(bucket_count + 1, 0);
+      }
+    item.sum += value;
+    ++item.count;
+
+    std::size_t i = 0;
+    while (i < bucket_count && value > buckets[i])
+      ++i;
+    ++item.bucket[i];
+  }
+
+  void
+  metrics::session_begin (const std::string& session_id,
+                          const std::string& chroot)
+  {
+    std::lock_guard<std::mutex> guard(state_lock);
+    if (!enabled())
+      return;
+
+    owned_state().sessions[session_id] = chroot;
+  }
+
+  void
+  metrics::session_end (const std::string& session_id)
+  {
+    std::lock_guard<std::mutex> guard(state_lock);
+    if (!enabled())
+      return;
+
+    owned_state().sessions[session_id] = std::string();
+  }
+
+  void
+  metrics::update_sessions ()
+  {
+    std::lock_guard<std::mutex> guard(state_lock);
+    if (!enabled())
+      return;
+
+    owned_state().update_sessions = true;
+  }
+
+  void
+  metrics::flush ()
+  {
+    std::lock_guard<std::mutex> guard(state_lock);
+    metrics_state& metrics_data(owned_state());
+    series_map& data(metrics_data.pending);
+    session_map& sessions(metrics_data.sessions);
+    if ((data.empty() && sessions.empty() && !metrics_data.update_sessions) ||
+        !enabled())
+      return;
+
+    const std::string& dir(metrics_data.directory);
+    std::string lockfile(dir + "/lock");
+    int fd = -1;
+
+    try
+      {
+        fd = open(lockfile.c_str(), O_RDWR|O_CREAT|O_NOFOLLOW|O_CLOEXEC, 0644);
+        if (fd < 0)
+          throw error(lockfile, LOCK, strerror(errno));
+
+        if (flock(fd, LOCK_EX|LOCK_NB) < 0)
+          {
+            if (errno != EWOULDBLOCK)
+              throw error(lockfile, LOCK, strerror(errno));
+
+            // Another process is merging; leave a shard for it.
+            struct timespec ts;
+            clock_gettime(CLOCK_REALTIME, &ts);
+            write_file((format("%1%/shard.%2%.%3%.%4%")
+                        % dir % getpid() % ts.tv_sec % ts.tv_nsec).str(),
+                       serialise(data, sessions));
+          }
+        else
+          {
+            series_map totals;
+            session_map active;
+            read_series(dir + "/state", totals, active);
+
+            // Shards are only removed once the totals including them
+            // have been written, so a shard can't be lost.
+            string_list shards;
+            DIR *dirp = opendir(dir.c_str());
+            if (dirp == nullptr)
+              throw error(dir, READ, strerror(errno));
+            struct dirent *entry;
+            while ((entry = readdir(dirp)) != nullptr)
+              if (strncmp(entry->d_name, "shard.", 6) == 0)
+                shards.push_back(dir + '/' + entry->d_name);
+            closedir(dirp);
+
+            session_map changes;
+            for (const auto& shard : shards)
+              read_series(shard, totals, changes);
+            merge(totals, data);
+
+            // The session directory is only read when sessions have
+            // begun or ended, so that running commands in existing
+            // sessions doesn't cost a scan of every session.
+            for (const auto& session : sessions)
+              changes[session.first] = session.second;
+            if (!changes.empty() || metrics_data.update_sessions)
+              {
+                for (const auto& change : changes)
+                  {
+                    if (change.second.empty())
+                      active.erase(change.first);
+                    else
+                      active[change.first] = change.second;
+                  }
+                check_sessions(metrics_data.session_directory, active);
+              }
+
+            write_file(dir + "/state", serialise(totals, active));
+            for (const auto& shard : shards)
+              unlink(shard.c_str());
+            write_file(dir + "/schroot.prom", render(totals, active));
+          }
+
+        data.clear();
+        sessions.clear();
+        metrics_data.update_sessions = false;
+      }
+    catch (const std::runtime_error& e)
+      {
+        log_exception_warning(e);
+      }
+
+    if (fd >= 0)
+      close(fd);
+  }
+
+  bool
+  metrics::enabled ()
+  {
+    metrics_state& metrics_data(state());
+    if (metrics_data.enabled < 0)
+      {
+        struct ::stat status;
+        metrics_data.enabled =
+          (::stat(metrics_data.directory.c_str(), &status) == 0 &&
+           S_ISDIR(status.st_mode)) ? 1 : 0;
+      }
+    return metrics_data.enabled == 1;
+  }
+
+  void
+  metrics::set_directory (const std::string& dir)
+  {
+    metrics_state& metrics_data(state());
+    metrics_data.directory = dir;
+    metrics_data.enabled = -1;
+  }
+
+  void
+  metrics::set_session_directory (const std::string& dir)
+  {
+    state().session_directory = dir;
+  }
+
+  double
+  metrics::now ()
+  {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+  }
+
+  metrics::outcome::outcome (const std::string& name,
+                             const label_list&  labels):
+    name(name),
+    labels(labels),
+    success(false),
+    start(now())
+  {
+  }
+
+  metrics::outcome::~outcome ()
+  {
+    double duration = now() - this->start;
+    observe(this->name + "_duration_seconds", this->labels, duration);
+
+    label_list result(this->labels);
+    result.push_back(std::make_pair(std::string("result"),
+                                    std::string(this->success ?
+                                                "success" : "failure")));
+    increment(this->name + "_total", result);
+  }
+
+  void
+  metrics::outcome::set_success (bool success)
+  {
+    this->success = success;
+  }
+
+}
@@ -0,0 +1,225 @@
+/* Copyright © 2005-2013  Roger Leigh <rleigh@codelibre.net>
+ *
+ * schroot is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * schroot is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ *********************************************************************/
+
+#ifndef SCHROOT_METRICS_H
+#define SCHROOT_METRICS_H
+
+#include <schroot/custom-error.h>
+
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace schroot
+{
+
+  /**
+   * Prometheus metrics.
+   *
+   * Counters and histograms are accumulated in memory by each
+   * process, and merged by flush() into the totals kept in the
+   * metrics directory, from which a node-exporter textfile collector
+   * file, schroot.prom, is written.  Metrics are only recorded if
+   * the metrics directory exists.
+   *
+   * The chroot of each active session is recorded when it begins
+   * and ends, so that the active sessions gauge may be written
+   * without reading every session file.  The recorded sessions are
+   * only checked against the session directory when sessions have
+   * begun or ended.
+   *
+   * Concurrent processes merge their totals under an exclusive lock.
+   * A process which can't take the lock immediately writes its
+   * totals to a separate shard file instead, which is merged by the
+   * next process to take the lock, so that no process waits for
+   * another to write its metrics.
+   */
+  class metrics
+  {
+  public:
+    /// Error codes.
+    enum error_code
+      {
+        LOCK,  ///< Failed to lock metrics.
+        READ,  ///< Failed to read metrics.
+        WRITE  ///< Failed to write metrics.
+      };
+
+    /// Exception type.
+    typedef custom_error<error_code> error;
+
+    /// Metric labels, as name and value pairs.
+    typedef std::vector<std::pair<std::string, std::string>> label_list;
+
+    /**
+     * Add to a counter.
+     *
+     * @param name the metric name.
+     * @param labels the metric labels.
+     * @param value the amount to add.
+     */
+    static void
+    increment (const std::string& name,
+               const label_list&  labels,
+               double             value = 1);
+
+    /**
+     * Add an observation to a histogram.
+     *
+     * @param name the metric name.
+     * @param labels the metric labels.
+     * @param value the observed value, in seconds.
+     */
+    static void
+    observe (const std::string& name,
+             const label_list&  labels,
+             double             value);
+
+    /**
+     * Record the beginning of a session, for the active sessions
+     * gauge.
+     *
+     * @param session_id the session identifier.
+     * @param chroot the name of the chroot the session was created
+     * from.
+     */
+    static void
+    session_begin (const std::string& session_id,
+                   const std::string& chroot);
+
+    /**
+     * Record the end of a session, for the active sessions gauge.
+     *
+     * @param session_id the session identifier.
+     */
+    static void
+    session_end (const std::string& session_id);
+
+    /**
+     * Check the recorded sessions against the session directory at
+     * the next flush, for example after ending stale sessions.
+     * Sessions whose files no longer exist are forgotten, and
+     * sessions which were not recorded are read once to find their
+     * chroot.
+     */
+    static void
+    update_sessions ();
+
+    /**
+     * Merge the metrics recorded by this process into the totals,
+     * and write the textfile collector file.  Errors are logged as
+     * warnings, since failing to record metrics must not cause an
+     * operation to fail.
+     */
+    static void
+    flush ();
+
+    /**
+     * Are metrics being recorded?
+     *
+     * @returns true if the metrics directory exists, otherwise false.
+     */
+    static bool
+    enabled ();
+
+    /**
+     * Set the metrics directory.  This is intended for testing.
+     *
+     * @param dir the metrics directory.
+     */
+    static void
+    set_directory (const std::string& dir);
+
+    /**
+     * Set the session directory, used to check active sessions.
+     * This is intended for testing.
+     *
+     * @param dir the session directory.
+     */
+    static void
+    set_session_directory (const std::string& dir);
+
+    /**
+     * The outcome of a timed operation.  On destruction, the
+     * "<name>_total" counter is incremented, with an additional
+     * "result" label of "success" or "failure", and the duration is
+     * added to the "<name>_duration_seconds" histogram.  The result
+     * is a failure unless set otherwise, so that an operation
+     * abandoned by throwing an exception is recorded as a failure.
+     */
+    class outcome
+    {
+    public:
+      /**
+       * The constructor.  The operation starts when it is
+       * constructed.
+       *
+       * @param name the metric name prefix.
+       * @param labels the metric labels.
+       */
+      outcome (const std::string& name,
+               const label_list&  labels);
+
+      /// The destructor.
+      ~outcome ();
+
+      /// Not copyable.
+      outcome (const outcome& rhs) = delete;
+
+      /// Not copyable.
+      outcome&
+      operator = (const outcome& rhs) = delete;
+
+      /**
+       * Set the result of the operation.
+       *
+       * @param success true if the operation succeeded, otherwise
+       * false.
+       */
+      void
+      set_success (bool success);
+
+    private:
+      /// The metric name prefix.
+      std::string name;
+      /// The metric labels.
+      label_list  labels;
+      /// Did the operation succeed?
+      bool        success;
+      /// The start time, in seconds.
+      double      start;
+    };
+
+    /**
+     * Get the current time, for timing operations.
+     *
+     * @returns the monotonic time in seconds.
+     */
+    static double
+    now ();
+  };
+
+}
+
+#endif /* SCHROOT_METRICS_H */
+
+/*
+ * Local Variables:
+ * mode:C++
+ * End:
+ */
@@ -0,0 +1,559 @@
+/* Copyright © 2005-2013  Roger Leigh <rleigh@codelibre.net>
+ *
+ * schroot is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * schroot is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ *********************************************************************/
+
+#include <config.h>
+
+#include <schroot/environment.h>
+#include <schroot/lock.h>
+#include <schroot/log.h>
+#include <schroot/nss-snapshot.h>
+#include <schroot/util.h>
+#ifdef SCHROOT_FEATURE_REFLINK
+#include <schroot/reflink.h>
+#endif
+
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <vector>
+
+#include <fcntl.h>
+#include <grp.h>
+#include <pwd.h>
+#include <shadow.h>
+#include <sys/mount.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <boost/format.hpp>
+
+using std::endl;
+using boost::format;
+
+namespace schroot
+{
+
+  template<>
+  error<nss_snapshot::error_code>::map_type
+  error<nss_snapshot::error_code>::error_strings =
+    {
+      {nss_snapshot::DATABASE_INVALID, N_("Invalid database name")},
+      {nss_snapshot::ENUMERATE,        N_("Failed to enumerate database")},
+      {nss_snapshot::CACHE_DIR,        N_("Failed to create snapshot cache directory")},
+      {nss_snapshot::CACHE_LOCK,       N_("Failed to lock snapshot")},
+      {nss_snapshot::CACHE_WRITE,      N_("Failed to write snapshot")},
+      {nss_snapshot::INSTALL,          N_("Failed to install snapshot")},
+      {nss_snapshot::LIST_OPEN,        N_("Failed to open database list")}
+    };
+
+  namespace
+  {
+
+    /// Default snapshot time to live.
+    const time_t default_ttl = 600;
+
+    /// Time to wait for another process generating a snapshot.
+    const unsigned int lock_timeout = 120;
+
+    bool
+    is_valid_database (const std::string& database)
+    {
+      if (database.empty())
+        return false;
+      for (const auto& chr : database)
+        if (!((chr >= 'a' && chr <= 'z') || (chr >= '0' && chr <= '9')))
+          return false;
+      return true;
+    }
+
+    /// Databases which may contain password hashes.
+    bool
+    is_private_database (const std::string& database)
+    {
+      return database == "shadow" || database == "gshadow";
+    }
+
+    void
+    write_string (int                fd,
+                  const std::string& str)
+    {
+      const char *data = str.c_str();
+      std::string::size_type remaining = str.size();
+      while (remaining)
+        {
+          ssize_t count = write(fd, data, remaining);
+          if (count < 0)
+            {
+              if (errno == EINTR)
+                continue;
+              throw nss_snapshot::error(nss_snapshot::CACHE_WRITE, strerror(errno));
+            }
+          data += count;
+          remaining -= count;
+        }
+    }
+
+    inline const char *
+    field (const char *value)
+    {
+      return value ? value : "";
+    }
+
+    /// Format a shadow numeric field, as for putspent(3).
+    std::string
+    shadow_field (long value)
+    {
+      return value == -1 ? std::string() : std::to_string(value);
+    }
+
+    void
+    enumerate_passwd (int fd)
+    {
+      setpwent();
+      struct ::passwd *entry;
+      while ((entry = getpwent()) != nullptr)
+        write_string(fd,
+                     (format("%1%:%2%:%3%:%4%:%5%:%6%:%7%\n")
+                      % field(entry->pw_name) % field(entry->pw_passwd)
+                      % entry->pw_uid % entry->pw_gid
+                      % field(entry->pw_gecos) % field(entry->pw_dir)
+                      % field(entry->pw_shell)).str());
+      endpwent();
+    }
+
+    void
+    enumerate_group (int fd)
+    {
+      setgrent();
+      struct ::group *entry;
+      while ((entry = getgrent()) != nullptr)
+        {
+          std::string members;
+          for (char **member = entry->gr_mem; member && *member; ++member)
+            {
+              if (!members.empty())
+                members += ',';
+              members += *member;
+            }
+          write_string(fd,
+                       (format("%1%:%2%:%3%:%4%\n")
+                        % field(entry->gr_name) % field(entry->gr_passwd)
+                        % entry->gr_gid % members).str());
+        }
+      endgrent();
+    }
+
+    void
+    enumerate_shadow (int fd)
+    {
+      setspent();
+      struct ::spwd *entry;
+      while ((entry = getspent()) != nullptr)
+        write_string(fd,
+                     (format("%1%:%2%:%3%:%4%:%5%:%6%:%7%:%8%:%9%\n")
+                      % field(entry->sp_namp) % field(entry->sp_pwdp)
+                      % shadow_field(entry->sp_lstchg)
+                      % shadow_field(entry->sp_min)
+                      % shadow_field(entry->sp_max)
+                      % shadow_field(entry->sp_warn)
+                      % shadow_field(entry->sp_inact)
+                      % shadow_field(entry->sp_expire)
+                      % (entry->sp_flag == ~0UL ?
+                         std::string() : std::to_string(entry->sp_flag))).str());
+      endspent();
+    }
+
+    void
+    enumerate_getent (const std::string& database,
+                      int                fd)
+    {
+      std::string file = find_program_in_path("getent", "/usr/bin:/bin", "");
+      if (file.empty())
+        throw nss_snapshot::error(database, nss_snapshot::ENUMERATE,
+                                  _("getent not found"));
+
+      string_list command;
+      command.push_back("getent");
+      command.push_back(database);
+
+      pid_t pid = fork();
+      if (pid < 0)
+        throw nss_snapshot::error(database, nss_snapshot::ENUMERATE,
+                                  strerror(errno));
+      if (pid == 0)
+        {
+          if (dup2(fd, STDOUT_FILENO) < 0)
+            _exit(EXIT_FAILURE);
+          exec(file, command, environment());
+          _exit(EXIT_FAILURE);
+        }
+
+      int status;
+      while (waitpid(pid, &status, 0) < 0)
+        if (errno != EINTR)
+          throw nss_snapshot::error(database, nss_snapshot::ENUMERATE,
+                                    strerror(errno));
+
+      // getent exits 2 if the database is empty.
+      if (!WIFEXITED(status) ||
+          (WEXITSTATUS(status) != 0 && WEXITSTATUS(status) != 2))
+        throw nss_snapshot::error(database, nss_snapshot::ENUMERATE);
+    }
+
+  }
+
+  nss_snapshot::nss_snapshot ():
+    cache_dir(SCHROOT_NSS_DIR),
+    ttl(default_ttl),
+    verbose(false)
+  {
+  }
+
+  nss_snapshot::nss_snapshot (const std::string& cache_dir):
+    cache_dir(cache_dir),
+    ttl(default_ttl),
+    verbose(false)
+  {
+  }
+
+  nss_snapshot::~nss_snapshot ()
+  {
+  }
+
+  time_t
+  nss_snapshot::get_ttl () const
+  {
+    return this->ttl;
+  }
+
+  void
+  nss_snapshot::set_ttl (time_t ttl)
+  {
+    this->ttl = ttl;
+  }
+
+  bool
+  nss_snapshot::get_verbose () const
+  {
+    return this->verbose;
+  }
+
+  void
+  nss_snapshot::set_verbose (bool verbose)
+  {
+    this->verbose = verbose;
+  }
+
+  void
+  nss_snapshot::enumerate (const std::string& database,
+                           int                fd)
+  {
+    if (database == "passwd")
+      enumerate_passwd(fd);
+    else if (database == "group")
+      enumerate_group(fd);
+    else if (database == "shadow")
+      enumerate_shadow(fd);
+    else
+      enumerate_getent(database, fd);
+  }
+
+  bool
+  nss_snapshot::is_current (const std::string& database,
+                            const std::string& file) const
+  {
+    struct ::stat snapshot_status;
+    if (::stat(file.c_str(), &snapshot_status) < 0)
+      return false;
+
+    // The snapshot mtime is the time enumeration started.
+    const struct timespec& generated(snapshot_status.st_mtim);
+    if (time(nullptr) >= generated.tv_sec + this->ttl)
+      return false;
+
+    const char *sources[] = { "/etc/nsswitch.conf", nullptr };
+    std::string source("/etc/" + database);
+    sources[1] = source.c_str();
+    for (const char *path : sources)
+      {
+        struct ::stat source_status;
+        if (::stat(path, &source_status) == 0 &&
+            (source_status.st_mtim.tv_sec > generated.tv_sec ||
+             (source_status.st_mtim.tv_sec == generated.tv_sec &&
+              source_status.st_mtim.tv_nsec >= generated.tv_nsec)))
+          return false;
+      }
+
+    return true;
+  }
+
+  void
+  nss_snapshot::generate (const std::string& database,
+                          const std::string& file)
+  {
+    if (this->verbose)
+      log_info() << format(_("Enumerating %1% database")) % database << endl;
+
+    struct timespec started;
+    clock_gettime(CLOCK_REALTIME, &started);
+
+    std::vector<char> temp(file.begin(), file.end());
+    const char *suffix = ".XXXXXX";
+    temp.insert(temp.end(), suffix, suffix + strlen(suffix) + 1);
+    int fd = mkostemp(&temp[0], O_CLOEXEC);
+    if (fd < 0)
+      throw error(file, CACHE_WRITE, strerror(errno));
+
+    try
+      {
+        mode_t mode = 0644;
+        gid_t gid = 0;
+        if (is_private_database(database))
+          {
+            struct ::group *shadow_group = getgrnam("shadow");
+            if (shadow_group)
+              {
+                mode = 0640;
+                gid = shadow_group->gr_gid;
+              }
+            else
+              mode = 0600;
+          }
+
+        enumerate(database, fd);
+
+        if (geteuid() == 0 && fchown(fd, 0, gid) < 0)
+          throw error(file, CACHE_WRITE, strerror(errno));
+        if (fchmod(fd, mode) < 0)
+          throw error(file, CACHE_WRITE, strerror(errno));
+        if (fdatasync(fd) < 0)
+          throw error(file, CACHE_WRITE, strerror(errno));
+
+        /* Record when enumeration started, so that changes to the
+           source files made during enumeration invalidate it. */
+        struct timespec times[2] = { started, started };
+        if (futimens(fd, times) < 0)
+          throw error(file, CACHE_WRITE, strerror(errno));
+
+        if (close(fd) < 0)
+          {
+            fd = -1;
+            throw error(file, CACHE_WRITE, strerror(errno));
+          }
+        fd = -1;
+
+        if (rename(&temp[0], file.c_str()) < 0)
+          throw error(file, CACHE_WRITE, strerror(errno));
+      }
+    catch (...)
+      {
+        if (fd >= 0)
+          close(fd);
+        unlink(&temp[0]);
+        throw;
+      }
+  }
+
+  std::string
+  nss_snapshot::snapshot (const std::string& database)
+  {
+    if (!is_valid_database(database))
+      throw error(database, DATABASE_INVALID);
+
+    std::string file(this->cache_dir + '/' + database);
+
+    // Fast path: no locking is needed to use a current snapshot.
+    if (is_current(database, file))
+      return file;
+
+    if (mkdir(this->cache_dir.c_str(), 0755) < 0 && errno != EEXIST)
+      throw error(this->cache_dir, CACHE_DIR, strerror(errno));
+
+    std::string lock_file(file + ".lock");
+    int fd = open(lock_file.c_str(), O_RDWR|O_CREAT|O_CLOEXEC, 0600);
+    if (fd < 0)
+      throw error(lock_file, CACHE_LOCK, strerror(errno));
+
+    try
+      {
+        ofd_lock lock(fd);
+        lock.set_lock(lock::LOCK_EXCLUSIVE, lock_timeout);
+
+        // Another process may have generated the snapshot while we
+        // were waiting for the lock.
+        if (!is_current(database, file))
+          generate(database, file);
+
+        lock.unset_lock();
+      }
+    catch (const lock::error& e)
+      {
+        close(fd);
+        throw error(lock_file, CACHE_LOCK, e.what());
+      }
+    catch (...)
+      {
+        close(fd);
+        throw;
+      }
+    close(fd);
+
+    return file;
+  }
+
+  void
+  nss_snapshot::install (const std::string& database,
+                         const std::string& destination,
+                         bool               bind)
+  {
+    std::string file = snapshot(database);
+
+    /* A bind mount keeps the host owner of the snapshot, and the
+       host "shadow" group may be an unrelated group in the chroot,
+       so databases containing password hashes are always copied. */
+    if (bind && is_private_database(database))
+      bind = false;
+
+    if (this->verbose)
+      log_info() << format(_("Copying %1% database to %2%"))
+        % database % destination << endl;
+
+    struct ::stat status;
+    bool exists = lstat(destination.c_str(), &status) == 0;
+
+    if (bind)
+      {
+        if (!exists)
+          {
+            int fd = open(destination.c_str(),
+                          O_WRONLY|O_CREAT|O_EXCL|O_NOFOLLOW|O_CLOEXEC, 0644);
+            if (fd < 0)
+              throw error(destination, INSTALL, strerror(errno));
+            close(fd);
+          }
+        else if (!S_ISREG(status.st_mode))
+          throw error(destination, INSTALL, strerror(EINVAL));
+
+        if (mount(file.c_str(), destination.c_str(), nullptr,
+                  MS_BIND, nullptr) < 0)
+          throw error(destination, INSTALL, strerror(errno));
+        if (mount(nullptr, destination.c_str(), nullptr,
+                  MS_REMOUNT|MS_BIND|MS_RDONLY|MS_NOSUID|MS_NODEV,
+                  nullptr) < 0)
+          {
+            int saved_errno = errno;
+            umount2(destination.c_str(), MNT_DETACH);
+            throw error(destination, INSTALL, strerror(saved_errno));
+          }
+        return;
+      }
+
+#ifdef SCHROOT_FEATURE_REFLINK
+    try
+      {
+        reflink::copy_file(file, destination);
+      }
+    catch (const reflink::error& e)
+      {
+        throw error(destination, INSTALL, e.what());
+      }
+#else
+    {
+      std::ifstream input(file.c_str(), std::ios::binary);
+      std::string temp(destination + ".schroot-new");
+      {
+        std::ofstream output(temp.c_str(), std::ios::binary|std::ios::trunc);
+        output << input.rdbuf();
+        if (!input || !output)
+          {
+            unlink(temp.c_str());
+            throw error(destination, INSTALL);
+          }
+      }
+      struct ::stat snapshot_status;
+      if (::stat(file.c_str(), &snapshot_status) < 0 ||
+          chown(temp.c_str(), snapshot_status.st_uid, snapshot_status.st_gid) < 0 ||
+          chmod(temp.c_str(), snapshot_status.st_mode & 07777) < 0 ||
+          rename(temp.c_str(), destination.c_str()) < 0)
+        {
+          int saved_errno = errno;
+          unlink(temp.c_str());
+          throw error(destination, INSTALL, strerror(saved_errno));
+        }
+    }
+#endif
+
+    /* The owner and permissions of the chroot's own file are kept;
+       group IDs such as "shadow" differ between systems. */
+    if (exists && S_ISREG(status.st_mode))
+      {
+        if (lchown(destination.c_str(), status.st_uid, status.st_gid) < 0 ||
+            chmod(destination.c_str(), status.st_mode & 07777) < 0)
+          throw error(destination, INSTALL, strerror(errno));
+      }
+    // Otherwise, only root may read a new private database.
+    else if (is_private_database(database) &&
+             ((geteuid() == 0 && lchown(destination.c_str(), 0, 0) < 0) ||
+              chmod(destination.c_str(), 0600) < 0))
+      throw error(destination, INSTALL, strerror(errno));
+  }
+
+  unsigned int
+  nss_snapshot::install_list (const std::string& list,
+                              const std::string& root,
+                              bool               bind)
+  {
+    std::ifstream input(list.c_str());
+    if (!input)
+      throw error(list, LIST_OPEN, strerror(errno));
+
+    unsigned int count = 0;
+    std::string database;
+    while (std::getline(input, database))
+      {
+        if (database.empty() || database[0] == '#')
+          continue;
+
+        std::string host_file("/etc/" + database);
+        std::string chroot_file(root + "/etc/" + database);
+
+        // If the database inside and outside the chroot is the same,
+        // installing would truncate it, so skip it.
+        struct ::stat host_status, chroot_status;
+        if (::stat(host_file.c_str(), &host_status) == 0 &&
+            ::stat(chroot_file.c_str(), &chroot_status) == 0 &&
+            host_status.st_dev == chroot_status.st_dev &&
+            host_status.st_ino == chroot_status.st_ino)
+          {
+            log_warning() << format(_("%1% files ‘%2%’ and ‘%3%’ are the same file; skipping"))
+              % database % host_file % chroot_file << endl;
+            continue;
+          }
+
+        install(database, chroot_file, bind);
+        ++count;
+      }
+
+    return count;
+  }
+
+}
@@ -0,0 +1,203 @@
+/* Copyright © 2005-2013  Roger Leigh <rleigh@codelibre.net>
+ *
+ * schroot is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * schroot is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ *********************************************************************/
+
+#ifndef SCHROOT_NSS_SNAPSHOT_H
+#define SCHROOT_NSS_SNAPSHOT_H
+
+#include <schroot/custom-error.h>
+
+#include <ctime>
+#include <string>
+
+namespace schroot
+{
+
+  /**
+   * Snapshots of host NSS databases, shared between sessions.
+   *
+   * Each database is enumerated once into a host-side cache, which
+   * is reused until its time to live expires or the corresponding
+   * file in /etc (or /etc/nsswitch.conf) is modified.  Generation
+   * is serialised with a lock, so that many sessions starting
+   * concurrently result in a single enumeration.  Snapshots are
+   * installed into a chroot either by copying or by a read-only bind
+   * mount.
+   */
+  class nss_snapshot
+  {
+  public:
+    /// Error codes.
+    enum error_code
+      {
+        DATABASE_INVALID, ///< Invalid database name.
+        ENUMERATE,        ///< Failed to enumerate database.
+        CACHE_DIR,        ///< Failed to create cache directory.
+        CACHE_LOCK,       ///< Failed to lock cache.
+        CACHE_WRITE,      ///< Failed to write snapshot.
+        INSTALL,          ///< Failed to install snapshot.
+        LIST_OPEN         ///< Failed to open database list.
+      };
+
+    /// Exception type.
+    typedef custom_error<error_code> error;
+
+    /**
+     * The constructor.  The default cache directory will be used.
+     */
+    nss_snapshot ();
+
+    /**
+     * The constructor.
+     *
+     * @param cache_dir the directory to store snapshots in.
+     */
+    nss_snapshot (const std::string& cache_dir);
+
+    /// The destructor.
+    virtual ~nss_snapshot ();
+
+    /**
+     * Get the time to live of snapshots.
+     *
+     * @returns the time in seconds.
+     */
+    time_t
+    get_ttl () const;
+
+    /**
+     * Set the time to live of snapshots.  A snapshot older than this
+     * is regenerated when next used.  If zero, snapshots are
+     * regenerated every time.
+     *
+     * @param ttl the time in seconds.
+     */
+    void
+    set_ttl (time_t ttl);
+
+    /**
+     * Get the verbosity level.
+     *
+     * @returns true if verbose, otherwise false.
+     */
+    bool
+    get_verbose () const;
+
+    /**
+     * Set the verbosity level.
+     *
+     * @param verbose true to log each database installed, otherwise
+     * false.
+     */
+    void
+    set_verbose (bool verbose);
+
+    /**
+     * Get a current snapshot of a database, generating it if the
+     * cached snapshot is missing or stale.
+     *
+     * @param database the database name, for example "passwd".
+     * @returns the path of the snapshot.
+     */
+    std::string
+    snapshot (const std::string& database);
+
+    /**
+     * Install a snapshot of a database.  When copying, the owner and
+     * permissions of an existing destination file are preserved.
+     * The shadow and gshadow databases are always copied, since the
+     * owner of a bind mounted snapshot would be that of the host.
+     *
+     * @param database the database name.
+     * @param destination the file to install the snapshot as.
+     * @param bind true to bind mount the snapshot read-only, or false
+     * to copy it.
+     */
+    void
+    install (const std::string& database,
+             const std::string& destination,
+             bool               bind);
+
+    /**
+     * Install the databases listed in a file into a chroot.  The
+     * list contains one database name per line.  Blank lines and
+     * lines beginning with ‘#’ are ignored.  Each database is
+     * installed as /etc/database inside the chroot.
+     *
+     * @param list the file containing the list of databases.
+     * @param root the root directory of the chroot.
+     * @param bind true to bind mount snapshots read-only, or false to
+     * copy them.
+     * @returns the number of databases installed.
+     */
+    unsigned int
+    install_list (const std::string& list,
+                  const std::string& root,
+                  bool               bind);
+
+    /**
+     * Enumerate a database.  The passwd, group and shadow databases
+     * are enumerated directly; other databases are enumerated using
+     * getent(1).
+     *
+     * @param database the database name.
+     * @param fd the file descriptor to write the entries to.
+     */
+    static void
+    enumerate (const std::string& database,
+               int                fd);
+
+  private:
+    /**
+     * Check if a snapshot is current.
+     *
+     * @param database the database name.
+     * @param file the snapshot file.
+     * @returns true if the snapshot exists and is current, otherwise
+     * false.
+     */
+    bool
+    is_current (const std::string& database,
+                const std::string& file) const;
+
+    /**
+     * Generate a snapshot.
+     *
+     * @param database the database name.
+     * @param file the snapshot file.
+     */
+    void
+    generate (const std::string& database,
+              const std::string& file);
+
+    /// The snapshot cache directory.
+    std::string cache_dir;
+    /// The snapshot time to live.
+    time_t      ttl;
+    /// Log each database installed.
+    bool        verbose;
+  };
+
+}
+
+#endif /* SCHROOT_NSS_SNAPSHOT_H */
+
+/*
+ * Local Variables:
+ * mode:C++
+ * End:
+ */
@@ -0,0 +1,328 @@
+/* Copyright © 2005-2013  Roger Leigh <rleigh@codelibre.net>
+ *
+ * schroot is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * schroot is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ *********************************************************************/
+
+#include <config.h>
+
+#include <schroot/reaper.h>
+#include <schroot/log.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <climits>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <boost/format.hpp>
+
+using std::endl;
+using boost::format;
+
+namespace schroot
+{
+
+  template<>
+  error<reaper::error_code>::map_type
+  error<reaper::error_code>::error_strings =
+    {
+      {reaper::ROOT_INVALID, N_("Invalid chroot root directory")},
+      {reaper::PROC_OPEN,    N_("Failed to open process table")}
+    };
+
+  namespace
+  {
+
+    /// Time to wait for processes to exit after SIGKILL (milliseconds).
+    const int kill_wait = 1000;
+
+    /**
+     * Read a symbolic link.
+     *
+     * @param dirfd the directory the path is relative to.
+     * @param path the link to read.
+     * @returns the link target, or an empty string on failure.
+     */
+    std::string
+    read_link (int                dirfd,
+               const std::string& path)
+    {
+      char buf[PATH_MAX];
+      ssize_t len = readlinkat(dirfd, path.c_str(), buf, sizeof(buf));
+      if (len < 0 || len == sizeof(buf))
+        return std::string();
+      return std::string(buf, len);
+    }
+
+  }
+
+  /// A process being reaped.
+  struct reaper::process
+  {
+    /// The process ID.
+    pid_t pid;
+    /// A pidfd referring to the process, or -1 if unsupported.
+    int   pidfd;
+
+    /**
+     * Send a signal to the process.
+     *
+     * @param sig the signal to send.
+     */
+    void
+    signal (int sig) const
+    {
+#ifdef SYS_pidfd_send_signal
+      if (pidfd >= 0)
+        {
+          syscall(SYS_pidfd_send_signal, pidfd, sig, nullptr, 0);
+          return;
+        }
+#endif
+      ::kill(pid, sig);
+    }
+
+    /// Stop tracking the process.
+    void
+    release ()
+    {
+      if (pidfd >= 0)
+        close(pidfd);
+      pidfd = -1;
+    }
+  };
+
+  reaper::reaper (const std::string& root):
+    root(),
+    verbose(false)
+  {
+    // NOTE: This is a non-standard GNU extension.
+    char *rpath = realpath(root.c_str(), nullptr);
+    if (rpath == nullptr)
+      throw error(root, ROOT_INVALID, strerror(errno));
+    this->root = rpath;
+    free(rpath);
+
+    // Every process would match.
+    if (this->root == "/")
+      throw error(root, ROOT_INVALID);
+  }
+
+  reaper::~reaper ()
+  {
+  }
+
+  std::string const&
+  reaper::get_root () const
+  {
+    return this->root;
+  }
+
+  bool
+  reaper::get_verbose () const
+  {
+    return this->verbose;
+  }
+
+  void
+  reaper::set_verbose (bool verbose)
+  {
+    this->verbose = verbose;
+  }
+
+  std::vector<pid_t>
+  reaper::find () const
+  {
+    std::vector<pid_t> pids;
+
+    DIR *dir = opendir("/proc");
+    if (dir == nullptr)
+      throw error("/proc", PROC_OPEN, strerror(errno));
+
+    pid_t self = getpid();
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != nullptr)
+      {
+        std::string name(entry->d_name);
+        if (name.empty() ||
+            name.find_first_not_of("0123456789") != std::string::npos)
+          continue;
+
+        if (read_link(dirfd(dir), name + "/root") != this->root)
+          continue;
+
+        pid_t pid = static_cast<pid_t>(atol(name.c_str()));
+        if (pid != self)
+          pids.push_back(pid);
+      }
+
+    closedir(dir);
+
+    return pids;
+  }
+
+  bool
+  reaper::track (pid_t    pid,
+                 process& proc) const
+  {
+    proc.pid = pid;
+    proc.pidfd = -1;
+
+#ifdef SYS_pidfd_open
+    proc.pidfd = static_cast<int>(syscall(SYS_pidfd_open, pid, 0));
+    if (proc.pidfd < 0 && errno == ESRCH)
+      return false;
+#endif
+
+    /* Check again once the pidfd is held, in case the process has
+       exited and its PID been reused since it was found. */
+    std::string proc_dir((format("/proc/%1%") % pid).str());
+    if (read_link(AT_FDCWD, proc_dir + "/root") != this->root)
+      {
+        proc.release();
+        return false;
+      }
+
+    if (this->verbose)
+      {
+        std::string exe(read_link(AT_FDCWD, proc_dir + "/exe"));
+        if (exe.compare(0, this->root.size(), this->root) == 0)
+          exe.erase(0, this->root.size());
+        log_info() << format(_("Killing left-over pid %1% (%2%)"))
+          % pid % exe << endl;
+      }
+
+    return true;
+  }
+
+  void
+  reaper::wait (std::vector<process>& procs,
+                int                   timeout) const
+  {
+    auto deadline = std::chrono::steady_clock::now() +
+      std::chrono::milliseconds(timeout);
+
+    while (!procs.empty())
+      {
+        // Without a pidfd, poll for the process to exit.
+        bool pidfds = true;
+        for (auto proc = procs.begin(); proc != procs.end();)
+          {
+            if (proc->pidfd < 0)
+              {
+                pidfds = false;
+                if (::kill(proc->pid, 0) < 0 && errno == ESRCH)
+                  {
+                    proc = procs.erase(proc);
+                    continue;
+                  }
+              }
+            ++proc;
+          }
+        if (procs.empty())
+          break;
+
+        int remaining = static_cast<int>
+          (std::chrono::duration_cast<std::chrono::milliseconds>
+           (deadline - std::chrono::steady_clock::now()).count());
+        if (remaining <= 0)
+          break;
+
+        std::vector<struct pollfd> fds;
+        for (const auto& proc : procs)
+          if (proc.pidfd >= 0)
+            fds.push_back({proc.pidfd, POLLIN, 0});
+
+        if (poll(fds.data(), fds.size(),
+                 pidfds ? remaining : std::min(remaining, 100)) < 0 &&
+            errno != EINTR)
+          break;
+
+        // A pidfd is readable once its process has exited.
+        for (const auto& fd : fds)
+          {
+            if (fd.revents == 0)
+              continue;
+            for (auto proc = procs.begin(); proc != procs.end(); ++proc)
+              {
+                if (proc->pidfd == fd.fd)
+                  {
+                    proc->release();
+                    procs.erase(proc);
+                    break;
+                  }
+              }
+          }
+      }
+  }
+
+  unsigned int
+  reaper::kill (int grace) const
+  {
+    std::vector<process> procs;
+    for (pid_t pid : find())
+      {
+        process proc;
+        if (track(pid, proc))
+          procs.push_back(proc);
+      }
+
+    unsigned int count = procs.size();
+
+    for (const auto& proc : procs)
+      proc.signal(SIGTERM);
+    wait(procs, grace);
+
+    // Include any processes started during the grace period.
+    for (pid_t pid : find())
+      {
+        if (std::find_if(procs.begin(), procs.end(),
+                         [pid](const process& proc)
+                         { return proc.pid == pid; }) != procs.end())
+          continue;
+
+        process proc;
+        if (track(pid, proc))
+          {
+            procs.push_back(proc);
+            ++count;
+          }
+      }
+
+    for (const auto& proc : procs)
+      {
+        if (this->verbose)
+          log_info() << format(_("Sending SIGKILL to pid %1%"))
+            % proc.pid << endl;
+        proc.signal(SIGKILL);
+      }
+    wait(procs, kill_wait);
+
+    for (auto& proc : procs)
+      proc.release();
+
+    return count;
+  }
+
+}
@@ -0,0 +1,155 @@
+/* Copyright © 2005-2013  Roger Leigh <rleigh@codelibre.net>
+ *
+ * schroot is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * schroot is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ *********************************************************************/
+
+#ifndef SCHROOT_REAPER_H
+#define SCHROOT_REAPER_H
+
+#include <schroot/custom-error.h>
+
+#include <string>
+#include <vector>
+
+#include <sys/types.h>
+
+namespace schroot
+{
+
+  /**
+   * Kill stray processes running inside a chroot.
+   *
+   * Processes are found by a single scan of /proc, comparing the root
+   * directory of each process with the chroot.  All of the processes
+   * found are sent SIGTERM at once, and are then given a single grace
+   * period in which to exit, rather than a grace period each.  Where
+   * supported, each process is tracked using a pidfd, so that its
+   * exit may be waited for without polling, and so that a PID reused
+   * by an unrelated process is never signalled.  Processes remaining
+   * at the end of the grace period, and any which were started during
+   * it, are sent SIGKILL.
+   */
+  class reaper
+  {
+  public:
+    /// Error codes.
+    enum error_code
+      {
+        ROOT_INVALID, ///< Invalid chroot root directory.
+        PROC_OPEN     ///< Failed to open /proc.
+      };
+
+    /// Exception type.
+    typedef custom_error<error_code> error;
+
+    /**
+     * The constructor.
+     *
+     * @param root the root directory of the chroot.  This may not be
+     * the root directory of the host.
+     */
+    reaper (const std::string& root);
+
+    /// The destructor.
+    virtual ~reaper ();
+
+    /**
+     * Get the root directory of the chroot.
+     *
+     * @returns the canonical path of the root directory.
+     */
+    std::string const&
+    get_root () const;
+
+    /**
+     * Get the verbosity level.
+     *
+     * @returns true if verbose, otherwise false.
+     */
+    bool
+    get_verbose () const;
+
+    /**
+     * Set the verbosity level.
+     *
+     * @param verbose true to be verbose, otherwise false.
+     */
+    void
+    set_verbose (bool verbose);
+
+    /**
+     * Find the processes running inside the chroot.  The calling
+     * process is never included.
+     *
+     * @returns a list of process IDs.
+     */
+    std::vector<pid_t>
+    find () const;
+
+    /**
+     * Kill all processes running inside the chroot, and wait for
+     * them to exit.
+     *
+     * @param grace the time in milliseconds to wait for processes to
+     * exit after SIGTERM, before sending SIGKILL.
+     * @returns the number of processes signalled.
+     */
+    unsigned int
+    kill (int grace) const;
+
+  private:
+    /// A process being reaped.
+    struct process;
+
+    /**
+     * Start tracking a process found inside the chroot, checking
+     * that its root directory has not changed.
+     *
+     * @param pid the process to track.
+     * @param proc the tracked process.
+     * @returns true if the process is inside the chroot, or false if
+     * it has exited or left the chroot.
+     */
+    bool
+    track (pid_t    pid,
+           process& proc) const;
+
+    /**
+     * Wait for processes to exit.
+     *
+     * @param procs the processes to wait for.  Processes which have
+     * exited are removed.
+     * @param timeout the time in milliseconds to wait.
+     */
+    void
+    wait (std::vector<process>& procs,
+          int                   timeout) const;
+
+    /// The root directory of the chroot.
+    std::string root;
+    /// Log each process killed.
+    bool        verbose;
+  };
+
+}
+
+#endif /* SCHROOT_REAPER_H */
+
+/*
+ * Local Variables:
+ * mode:C++
+ * End:
+ */
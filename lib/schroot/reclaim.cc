@@ -0,0 +1,629 @@
+/* Copyright © 2005-2013  Roger Leigh <rleigh@codelibre.net>
+ *
+ * schroot is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * schroot is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ *********************************************************************/
+
+#include <config.h>
+
+#include <schroot/reclaim.h>
+#include <schroot/fdstream.h>
+#include <schroot/keyfile.h>
+#include <schroot/keyfile-reader.h>
+#include <schroot/keyfile-writer.h>
+#include <schroot/lock.h>
+#include <schroot/log.h>
+#include <schroot/metrics.h>
+#include <schroot/util.h>
+
+#ifdef SCHROOT_FEATURE_BTRFSSNAP
+#include <schroot/btrfs.h>
+#endif
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <boost/format.hpp>
+
+using std::endl;
+using boost::format;
+
+namespace schroot
+{
+
+  template<>
+  error<reclaim::error_code>::map_type
+  error<reclaim::error_code>::error_strings =
+    {
+      {reclaim::QUEUE_OPEN,   N_("Failed to open reclaim queue")},
+      {reclaim::ITEM_WRITE,   N_("Failed to write reclaim queue item")},
+      {reclaim::ITEM_READ,    N_("Failed to read reclaim queue item")},
+      {reclaim::ITEM_INVALID, N_("Invalid reclaim queue item")},
+      // TRANSLATORS: %1% = reclaim item type
+      {reclaim::ITEM_TYPE,    N_("Unsupported reclaim item type ‘%1%’")},
+      {reclaim::ITEM_UNLINK,  N_("Failed to remove reclaim queue item")},
+      {reclaim::DETACH,       N_("Failed to detach storage for reclaim")},
+      {reclaim::RUNNER_LOCK,  N_("Failed to lock reclaim queue runner")},
+      {reclaim::FORK,         N_("Failed to fork background reclaim process")},
+      {reclaim::REMOVE,       N_("Failed to remove file")},
+      {reclaim::REMOVE_MOUNT, N_("Refusing to remove a mounted filesystem")}
+    };
+
+  namespace
+  {
+
+    /// The keyfile group used for queue items.
+    const std::string item_group("reclaim");
+
+    /// The lock file held by the background queue runner.
+    const std::string runner_lock(".runner");
+
+    /**
+     * The queue runner lock, with its lock file open for the lifetime
+     * of the object.
+     */
+    class runner_lock_file
+    {
+    public:
+      /**
+       * The constructor.  The lock file is created if needed, but is
+       * not locked.
+       *
+       * @param queue_directory the queue directory.
+       */
+      runner_lock_file (const std::string& queue_directory):
+        file(queue_directory + "/" + runner_lock),
+        fd(open(file.c_str(), O_CREAT|O_RDWR|O_CLOEXEC, 0600)),
+        lck()
+      {
+        if (this->fd < 0)
+          throw reclaim::error(this->file, reclaim::RUNNER_LOCK,
+                               strerror(errno));
+        this->lck.reset(new ofd_lock(this->fd));
+      }
+
+      /// The destructor.  The lock is released if held.
+      ~runner_lock_file ()
+      {
+        this->lck.reset();
+        close(this->fd);
+      }
+
+      /**
+       * Take the lock if it is not held by another runner, without
+       * waiting.
+       *
+       * @returns true if locked, or false if held by another runner.
+       */
+      bool
+      try_lock ()
+      {
+        try
+          {
+            this->lck->set_lock(lock::LOCK_EXCLUSIVE, 0);
+          }
+        catch (const lock::error& e)
+          {
+            return false;
+          }
+        return true;
+      }
+
+      /// Release the lock.
+      void
+      unlock ()
+      {
+        try
+          {
+            this->lck->unset_lock();
+          }
+        catch (const lock::error& e)
+          {
+            throw reclaim::error(this->file, reclaim::RUNNER_LOCK, e);
+          }
+      }
+
+    private:
+      /// The lock file.
+      std::string               file;
+      /// The lock file descriptor.
+      int                       fd;
+      /// The lock.
+      std::unique_ptr<ofd_lock> lck;
+    };
+
+    /**
+     * Lower the priority of the calling process to the minimum, for
+     * both CPU and I/O scheduling.  Failure is not an error.
+     */
+    void
+    lower_priority ()
+    {
+      if (setpriority(PRIO_PROCESS, 0, 19) != 0)
+        log_debug(DEBUG_WARNING) << "Failed to set reclaim CPU priority: "
+                                 << strerror(errno) << endl;
+
+#ifdef SYS_ioprio_set
+      // There is no libc wrapper for ioprio_set(2).
+      const int ioprio_who_process = 1;
+      const int ioprio_class_idle = 3;
+      const int ioprio_class_shift = 13;
+      if (syscall(SYS_ioprio_set, ioprio_who_process, 0,
+                  ioprio_class_idle << ioprio_class_shift) != 0)
+        log_debug(DEBUG_WARNING) << "Failed to set reclaim I/O priority: "
+                                 << strerror(errno) << endl;
+#endif
+    }
+
+    /**
+     * Remove the contents of a directory.  All access is relative to
+     * the directory file descriptor, and symbolic links are never
+     * followed, so that the tree may not be redirected outside
+     * itself by replacing a directory with a symbolic link while it
+     * is being removed.
+     *
+     * @param fd the directory file descriptor, which is closed.
+     * @param path the directory path (only used for error reporting).
+     * @param device the device of the tree; directories on other
+     * devices (mount points) are not removed.
+     */
+    void
+    remove_directory (int                fd,
+                      const std::string& path,
+                      dev_t              device)
+    {
+      struct ::stat st;
+      if (fstat(fd, &st) != 0)
+        {
+          int saved_errno = errno;
+          close(fd);
+          throw reclaim::error(path, reclaim::REMOVE, strerror(saved_errno));
+        }
+      if (st.st_dev != device)
+        {
+          close(fd);
+          throw reclaim::error(path, reclaim::REMOVE_MOUNT);
+        }
+
+      DIR *dir = fdopendir(fd);
+      if (dir == 0)
+        {
+          int saved_errno = errno;
+          close(fd);
+          throw reclaim::error(path, reclaim::REMOVE, strerror(saved_errno));
+        }
+
+      try
+        {
+          string_list subdirectories;
+
+          struct dirent *de;
+          while ((de = readdir(dir)) != 0)
+            {
+              std::string name(de->d_name);
+              if (name == "." || name == "..")
+                continue;
+
+              std::string file(path + '/' + name);
+              if (fstatat(dirfd(dir), name.c_str(), &st,
+                          AT_SYMLINK_NOFOLLOW) != 0)
+                throw reclaim::error(file, reclaim::REMOVE, strerror(errno));
+
+              if (S_ISDIR(st.st_mode))
+                subdirectories.push_back(name);
+              else if (unlinkat(dirfd(dir), name.c_str(), 0) != 0)
+                throw reclaim::error(file, reclaim::REMOVE, strerror(errno));
+            }
+
+          for (const auto& name : subdirectories)
+            {
+              std::string file(path + '/' + name);
+              int subfd = openat(dirfd(dir), name.c_str(),
+                                 O_RDONLY|O_DIRECTORY|O_NOFOLLOW|O_CLOEXEC);
+              if (subfd < 0)
+                throw reclaim::error(file, reclaim::REMOVE,
+                                     strerror(errno));
+
+              remove_directory(subfd, file, device);
+              if (unlinkat(dirfd(dir), name.c_str(), AT_REMOVEDIR) != 0)
+                throw reclaim::error(file, reclaim::REMOVE, strerror(errno));
+            }
+        }
+      catch (const reclaim::error& e)
+        {
+          closedir(dir);
+          throw;
+        }
+      closedir(dir);
+    }
+
+  }
+
+  reclaim::reclaim ():
+    queue_directory(SCHROOT_RECLAIM_DIR)
+  {
+  }
+
+  reclaim::reclaim (const std::string& queue_directory):
+    queue_directory(queue_directory)
+  {
+  }
+
+  reclaim::~reclaim ()
+  {
+  }
+
+  std::string const&
+  reclaim::get_queue_directory () const
+  {
+    return this->queue_directory;
+  }
+
+  void
+  reclaim::enqueue (item_type          type,
+                    const std::string& path)
+  {
+    std::string id(unique_identifier());
+    std::string tmpfile(this->queue_directory + "/." + id);
+    std::string file(this->queue_directory + "/" + id);
+
+    log_debug(DEBUG_NOTICE) << format("Queueing %1% ‘%2%’ for reclaim as %3%")
+      % get_type_name(type) % path % file << endl;
+
+    int fd = open(tmpfile.c_str(), O_CREAT|O_EXCL|O_WRONLY|O_CLOEXEC, 0600);
+    if (fd < 0)
+      throw error(tmpfile, ITEM_WRITE, strerror(errno));
+
+    {
+      // Create a stream from the file descriptor.  The fd will be
+      // closed when the stream is destroyed.
+#ifdef BOOST_IOSTREAMS_CLOSE_HANDLE_OLD
+      fdostream output(fd, true);
+#else
+      fdostream output(fd, boost::iostreams::close_handle);
+#endif
+      output.imbue(std::locale::classic());
+
+      keyfile details;
+      details.set_value(item_group, "type", get_type_name(type));
+      details.set_value(item_group, "path", path);
+      output << keyfile_writer(details);
+      output.flush();
+      if (!output)
+        {
+          unlink(tmpfile.c_str());
+          throw error(tmpfile, ITEM_WRITE);
+        }
+    }
+
+    if (rename(tmpfile.c_str(), file.c_str()) != 0)
+      {
+        int saved_errno = errno;
+        unlink(tmpfile.c_str());
+        throw error(file, ITEM_WRITE, strerror(saved_errno));
+      }
+  }
+
+  bool
+  reclaim::defer (item_type          type,
+                  const std::string& path)
+  {
+    std::string detached(dirname(path) + "/." + basename(path) + '-' +
+                         unique_identifier());
+
+    log_debug(DEBUG_INFO) << format("Detaching %1% ‘%2%’ for reclaim as %3%")
+      % get_type_name(type) % path % detached << endl;
+
+    if (rename(path.c_str(), detached.c_str()) != 0)
+      {
+        if (errno == ENOENT)
+          return false;
+        throw error(path, DETACH, strerror(errno));
+      }
+
+    enqueue(type, detached);
+
+    return true;
+  }
+
+  string_list
+  reclaim::get_items () const
+  {
+    string_list items;
+
+    DIR *dir = opendir(this->queue_directory.c_str());
+    if (dir == 0)
+      throw error(this->queue_directory, QUEUE_OPEN, strerror(errno));
+
+    struct dirent *de;
+    while ((de = readdir(dir)) != 0)
+      {
+        // Hidden files are incomplete items, or "." and "..".
+        if (de->d_name[0] != '.')
+          items.push_back(de->d_name);
+      }
+    closedir(dir);
+
+    std::sort(items.begin(), items.end());
+
+    return items;
+  }
+
+  void
+  reclaim::run ()
+  {
+    for (const auto& item : get_items())
+      {
+        try
+          {
+            run_item(item);
+          }
+        catch (const std::exception& e)
+          {
+            log_exception_warning(e);
+          }
+      }
+  }
+
+  bool
+  reclaim::run_item (const std::string& item)
+  {
+    std::string file(this->queue_directory + "/" + item);
+
+    // An exclusive lock requires the file to be open for writing.
+    int fd = open(file.c_str(), O_RDWR|O_CLOEXEC);
+    if (fd < 0)
+      {
+        // Already reclaimed by another process.
+        if (errno == ENOENT)
+          return false;
+        throw error(file, ITEM_READ, strerror(errno));
+      }
+
+#ifdef BOOST_IOSTREAMS_CLOSE_HANDLE_OLD
+    fdistream input(fd, true);
+#else
+    fdistream input(fd, boost::iostreams::close_handle);
+#endif
+    input.imbue(std::locale::classic());
+
+    ofd_lock lock(fd);
+    try
+      {
+        lock.set_lock(lock::LOCK_EXCLUSIVE, 0);
+      }
+    catch (const lock::error& e)
+      {
+        // Being reclaimed by another process.
+        return false;
+      }
+
+    // The item may have been completed and removed after we opened
+    // it, but before we took the lock.
+    if (stat(file, fd).links() == 0)
+      return false;
+
+    keyfile details;
+    keyfile_reader(details, input);
+
+    std::string type;
+    std::string path;
+    if (!details.get_value(item_group, "type", type) ||
+        !details.get_value(item_group, "path", path) ||
+        !is_absname(path))
+      throw error(file, ITEM_INVALID);
+
+    metrics::outcome item_outcome("schroot_reclaim", {{"type", type}});
+
+    reclaim_item(get_type(type), path);
+
+    if (unlink(file.c_str()) != 0)
+      throw error(file, ITEM_UNLINK, strerror(errno));
+
+    item_outcome.set_success(true);
+
+    return true;
+  }
+
+  bool
+  reclaim::run_exclusive ()
+  {
+    runner_lock_file lock(this->queue_directory);
+    bool ran = false;
+
+    // The other runner will also reclaim any items queued while it
+    // runs.
+    while (lock.try_lock())
+      {
+        ran = true;
+
+        // Keep running while items are being added, but stop once a
+        // pass reclaims nothing, leaving any failed items for a later
+        // run.
+        string_list items(get_items());
+        while (!items.empty())
+          {
+            run();
+            string_list remaining(get_items());
+            if (remaining == items)
+              break;
+            items = remaining;
+          }
+
+        lock.unlock();
+
+        // An item queued after the last pass, but before the lock was
+        // released, did not start a new runner, so must be picked up
+        // here.
+        if (get_items() == items)
+          break;
+      }
+
+    return ran;
+  }
+
+  void
+  reclaim::run_background ()
+  {
+    // Don't start a runner if one is already running.  It will
+    // reclaim the items queued while it runs.
+    if (!runner_lock_file(this->queue_directory).try_lock())
+      {
+        log_debug(DEBUG_INFO) << "Reclaim queue runner already running"
+                              << endl;
+        return;
+      }
+
+    pid_t pid = fork();
+    if (pid == -1)
+      throw error(FORK, strerror(errno));
+    else if (pid == 0)
+      {
+        // Detach from the session and controlling terminal, and fork
+        // again so that the queue runner is reparented to init and
+        // never becomes a zombie of the caller.
+        setsid();
+        pid_t runner = fork();
+        if (runner != 0)
+          _exit(runner == -1 ? EXIT_FAILURE : EXIT_SUCCESS);
+
+        if (chdir("/"))
+          _exit(EXIT_FAILURE);
+
+        int null = open("/dev/null", O_RDWR);
+        if (null >= 0)
+          {
+            dup2(null, STDIN_FILENO);
+            dup2(null, STDOUT_FILENO);
+            dup2(null, STDERR_FILENO);
+            if (null > STDERR_FILENO)
+              close(null);
+          }
+
+        lower_priority();
+
+        int status = EXIT_SUCCESS;
+        try
+          {
+            run_exclusive();
+          }
+        catch (const std::exception& e)
+          {
+            log_exception_error(e);
+            status = EXIT_FAILURE;
+          }
+        metrics::flush();
+        _exit(status);
+      }
+    else
+      {
+        int status;
+        while (waitpid(pid, &status, 0) == -1 && errno == EINTR)
+          ;
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+          throw error(FORK);
+      }
+  }
+
+  void
+  reclaim::reclaim_item (item_type          type,
+                         const std::string& path)
+  {
+    log_debug(DEBUG_NOTICE) << format("Reclaiming %1% ‘%2%’")
+      % get_type_name(type) % path << endl;
+
+    if (type == BTRFS_SUBVOLUME)
+      {
+#ifdef SCHROOT_FEATURE_BTRFSSNAP
+        if (!btrfs::destroy_subvolume(path))
+          log_debug(DEBUG_NOTICE) << format("‘%1%’ no longer exists") % path
+                                  << endl;
+#else
+        throw error(get_type_name(type), ITEM_TYPE);
+#endif
+      }
+    else if (type == DIRECTORY_TREE)
+      {
+        if (!remove_tree(path))
+          log_debug(DEBUG_NOTICE) << format("‘%1%’ no longer exists") % path
+                                  << endl;
+      }
+  }
+
+  bool
+  reclaim::remove_tree (const std::string& path)
+  {
+    struct ::stat st;
+    if (lstat(path.c_str(), &st) != 0)
+      {
+        if (errno == ENOENT)
+          return false;
+        throw error(path, REMOVE, strerror(errno));
+      }
+
+    if (S_ISDIR(st.st_mode))
+      {
+        int fd = open(path.c_str(),
+                      O_RDONLY|O_DIRECTORY|O_NOFOLLOW|O_CLOEXEC);
+        if (fd < 0)
+          throw error(path, REMOVE, strerror(errno));
+
+        remove_directory(fd, path, st.st_dev);
+        if (rmdir(path.c_str()) != 0)
+          throw error(path, REMOVE, strerror(errno));
+      }
+    else if (unlink(path.c_str()) != 0)
+      throw error(path, REMOVE, strerror(errno));
+
+    return true;
+  }
+
+  std::string
+  reclaim::get_type_name (item_type type)
+  {
+    std::string name;
+
+    if (type == BTRFS_SUBVOLUME)
+      name = "btrfs-subvolume";
+    else if (type == DIRECTORY_TREE)
+      name = "directory-tree";
+
+    return name;
+  }
+
+  reclaim::item_type
+  reclaim::get_type (const std::string& name)
+  {
+    if (name == "btrfs-subvolume")
+      return BTRFS_SUBVOLUME;
+    else if (name == "directory-tree")
+      return DIRECTORY_TREE;
+
+    throw error(name, ITEM_TYPE);
+  }
+
+}
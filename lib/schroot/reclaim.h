@@ -0,0 +1,226 @@
+/* Copyright © 2005-2013  Roger Leigh <rleigh@codelibre.net>
+ *
+ * schroot is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * schroot is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ *********************************************************************/
+
+#ifndef SCHROOT_RECLAIM_H
+#define SCHROOT_RECLAIM_H
+
+#include <schroot/custom-error.h>
+#include <schroot/types.h>
+
+#include <string>
+
+namespace schroot
+{
+
+  /**
+   * Deferred reclamation of session storage.
+   *
+   * Removing the storage used by a session (for example, deleting a
+   * Btrfs snapshot) may take a long time.  Rather than making the
+   * user wait for this when ending a session, the storage is detached
+   * and an item is added to a queue.  The queue is processed by a
+   * background process.  Each item is a small file in the queue
+   * directory, which is only removed once the item has been
+   * reclaimed, so that work interrupted by a crash or reboot is
+   * resumed by the next process to run the queue.
+   */
+  class reclaim
+  {
+  public:
+    /// Reclaim item type.
+    enum item_type
+      {
+        BTRFS_SUBVOLUME, ///< A Btrfs subvolume.
+        DIRECTORY_TREE   ///< A directory tree.
+      };
+
+    /// Error codes.
+    enum error_code
+      {
+        QUEUE_OPEN,   ///< Failed to open reclaim queue.
+        ITEM_WRITE,   ///< Failed to write reclaim queue item.
+        ITEM_READ,    ///< Failed to read reclaim queue item.
+        ITEM_INVALID, ///< Invalid reclaim queue item.
+        ITEM_TYPE,    ///< Unsupported reclaim item type.
+        ITEM_UNLINK,  ///< Failed to remove reclaim queue item.
+        DETACH,       ///< Failed to detach storage for reclaim.
+        RUNNER_LOCK,  ///< Failed to lock reclaim queue runner.
+        FORK,         ///< Failed to fork background process.
+        REMOVE,       ///< Failed to remove file.
+        REMOVE_MOUNT  ///< Refusing to remove mounted filesystem.
+      };
+
+    /// Exception type.
+    typedef custom_error<error_code> error;
+
+    /**
+     * The constructor.  The default queue directory will be used.
+     */
+    reclaim ();
+
+    /**
+     * The constructor.
+     *
+     * @param queue_directory the directory containing the queue.
+     */
+    reclaim (const std::string& queue_directory);
+
+    /// The destructor.
+    virtual ~reclaim ();
+
+    /**
+     * Get the queue directory.
+     *
+     * @returns the queue directory.
+     */
+    std::string const&
+    get_queue_directory () const;
+
+    /**
+     * Add an item to the queue.  The item is written atomically; it
+     * will never be seen partially written by a queue runner.
+     *
+     * @param type the type of storage to reclaim.
+     * @param path the absolute path to the storage to reclaim.
+     */
+    void
+    enqueue (item_type          type,
+             const std::string& path);
+
+    /**
+     * Detach storage and add it to the queue.  The storage is
+     * renamed to a hidden, unique name in the same directory, so
+     * that its original path may be reused at once, and the renamed
+     * storage is queued for reclaim.
+     *
+     * @param type the type of storage to reclaim.
+     * @param path the absolute path to the storage to reclaim.
+     * @returns true if the storage was queued, or false if it does
+     * not exist.
+     */
+    bool
+    defer (item_type          type,
+           const std::string& path);
+
+    /**
+     * Get the queued items.
+     *
+     * @returns a list of item filenames, relative to the queue
+     * directory.
+     */
+    string_list
+    get_items () const;
+
+    /**
+     * Run the queue.  Each item is locked while it is reclaimed, so
+     * that multiple queue runners may safely run concurrently.  Items
+     * locked by another runner are skipped.  Failure to reclaim an
+     * item is logged, and the item is left in the queue to be
+     * retried by a later run.
+     */
+    void
+    run ();
+
+    /**
+     * Run the queue as the only queue runner.  The queue is run
+     * repeatedly while items are being added, and stops once a pass
+     * reclaims nothing.  If another runner is running the queue, it
+     * is left to reclaim any items queued while it runs.
+     *
+     * @returns true if the queue was run, or false if another runner
+     * is running it.
+     */
+    bool
+    run_exclusive ();
+
+    /**
+     * Run the queue in a background process.  The process is
+     * detached from the caller's session and terminal, so that the
+     * caller may exit while reclamation continues.  It runs at the
+     * lowest CPU and I/O priority, so that reclamation does not
+     * compete with active sessions.  Only one background process
+     * runs the queue at once (see run_exclusive()); no process is
+     * started if one is already running.
+     */
+    void
+    run_background ();
+
+    /**
+     * Reclaim storage immediately, without queueing.
+     *
+     * @param type the type of storage to reclaim.
+     * @param path the absolute path to the storage to reclaim.
+     */
+    static void
+    reclaim_item (item_type          type,
+                  const std::string& path);
+
+    /**
+     * Remove a directory tree.  For safety, removal will fail if a
+     * filesystem is still mounted within the tree, and symbolic
+     * links within the tree are removed but never followed.
+     *
+     * @param path the absolute path of the tree to remove.
+     * @returns true if the tree was removed, or false if it did not
+     * exist.
+     */
+    static bool
+    remove_tree (const std::string& path);
+
+    /**
+     * Get the name of an item type.
+     *
+     * @param type the item type.
+     * @returns the item type name.
+     */
+    static std::string
+    get_type_name (item_type type);
+
+    /**
+     * Get an item type from its name.
+     *
+     * @param name the item type name.
+     * @returns the item type.
+     */
+    static item_type
+    get_type (const std::string& name);
+
+  private:
+    /**
+     * Reclaim a single queued item.
+     *
+     * @param item the item filename, relative to the queue directory.
+     * @returns true if the item was reclaimed, or false if it was
+     * skipped because it is being reclaimed by another process.
+     */
+    bool
+    run_item (const std::string& item);
+
+    /// The queue directory.
+    std::string queue_directory;
+  };
+
+}
+
+#endif /* SCHROOT_RECLAIM_H */
+
+/*
+ * Local Variables:
+ * mode:C++
+ * End:
+ */
@@ -0,0 +1,653 @@
+/* Copyright © 2005-2013  Roger Leigh <rleigh@codelibre.net>
+ *
+ * schroot is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * schroot is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ *********************************************************************/
+
+
+#include <config.h>
+
+#include <schroot/reflink.h>
+#include <schroot/log.h>
+#include <schroot/reclaim.h>
+#include <schroot/types.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/xattr.h>
+#include <unistd.h>
+
+#include <boost/format.hpp>
+
+using std::endl;
+using boost::format;
+
+namespace schroot
+{
+
+  template<>
+  error<reflink::error_code>::map_type
+  error<reflink::error_code>::error_strings =
+    {
+      {reflink::DIRECTORY_OPEN,   N_("Failed to open directory")},
+      {reflink::DIRECTORY_CREATE, N_("Failed to create directory")},
+      {reflink::FILE_STAT,        N_("Failed to stat file")},
+      {reflink::FILE_OPEN,        N_("Failed to open file")},
+      {reflink::FILE_CREATE,      N_("Failed to create file")},
+      {reflink::FILE_CLONE,       N_("Failed to clone file")},
+      {reflink::LINK_CREATE,      N_("Failed to create link")},
+      {reflink::ATTRIBUTE_SET,    N_("Failed to set file attributes")},
+      {reflink::XATTR_COPY,       N_("Failed to copy extended attributes")}
+    };
+
+  namespace
+  {
+
+    /// A file in the tree being cloned.
+    struct node
+    {
+      /// Source path.
+      std::string source;
+      /// Destination path.
+      std::string destination;
+      /// Source file status.
+      struct stat status;
+    };
+
+    /**
+     * The state of a tree clone.  Directories are scanned and file
+     * data is cloned by a pool of threads.  Scanning a directory
+     * queues its subdirectories for scanning and its regular files
+     * for data cloning.
+     */
+    struct clone_state
+    {
+      clone_state ():
+        device(),
+        lock(),
+        changed(),
+        pending(),
+        scanning(0),
+        files(),
+        directories(),
+        links(),
+        failure()
+      {}
+
+      /// The device of the source tree.
+      dev_t device;
+      /// Lock protecting the members below.
+      std::mutex lock;
+      /// Signalled when work is queued or a directory is scanned.
+      std::condition_variable changed;
+      /// Directories waiting to be scanned.
+      std::deque<node> pending;
+      /// The number of directories being scanned.
+      unsigned int scanning;
+      /// Regular files waiting for data cloning.
+      std::deque<node> files;
+      /// All directories, for setting attributes once cloned.
+      std::vector<node> directories;
+      /// The first destination path of each multiply-linked inode.
+      std::map<std::pair<dev_t, ino_t>, std::string> links;
+      /// The first error, which stops all threads.
+      std::exception_ptr failure;
+    };
+
+    /// Close a file descriptor on scope exit.
+    class scoped_fd
+    {
+    public:
+      explicit scoped_fd (int fd):
+        fd(fd)
+      {}
+
+      ~scoped_fd ()
+      {
+        if (fd >= 0)
+          close(fd);
+      }
+
+      int
+      get () const
+      {
+        return fd;
+      }
+
+    private:
+      scoped_fd (const scoped_fd&);
+      scoped_fd& operator= (const scoped_fd&);
+
+      int fd;
+    };
+
+    void
+    copy_xattrs (const node& file)
+    {
+      ssize_t size = llistxattr(file.source.c_str(), 0, 0);
+      if (size < 0)
+        {
+          if (errno == ENOTSUP)
+            return;
+          throw reflink::error(file.source, reflink::XATTR_COPY, strerror(errno));
+        }
+      if (size == 0)
+        return;
+
+      std::vector<char> names(size);
+      size = llistxattr(file.source.c_str(), &names[0], names.size());
+      if (size < 0)
+        throw reflink::error(file.source, reflink::XATTR_COPY, strerror(errno));
+
+      std::vector<char> value;
+      for (const char *name = &names[0];
+           name < &names[0] + size;
+           name += strlen(name) + 1)
+        {
+          ssize_t vsize = lgetxattr(file.source.c_str(), name, 0, 0);
+          if (vsize < 0)
+            {
+              if (errno == ENODATA) // Removed since listing.
+                continue;
+              throw reflink::error(file.source, reflink::XATTR_COPY, strerror(errno));
+            }
+
+          value.resize(vsize + 1);
+          vsize = lgetxattr(file.source.c_str(), name, &value[0], value.size());
+          if (vsize < 0)
+            throw reflink::error(file.source, reflink::XATTR_COPY, strerror(errno));
+
+          if (lsetxattr(file.destination.c_str(), name, &value[0], vsize, 0) != 0)
+            throw reflink::error(file.destination, reflink::XATTR_COPY, strerror(errno));
+        }
+    }
+
+    /**
+     * Copy ownership, permissions, extended attributes and
+     * timestamps.  Ownership is set first, since changing ownership
+     * clears setuid bits and file capabilities.
+     */
+    void
+    copy_attributes (const node& file)
+    {
+      const struct stat& st(file.status);
+
+      if (lchown(file.destination.c_str(), st.st_uid, st.st_gid) != 0)
+        throw reflink::error(file.destination, reflink::ATTRIBUTE_SET, strerror(errno));
+
+      if (!S_ISLNK(st.st_mode) &&
+          chmod(file.destination.c_str(), st.st_mode & 07777) != 0)
+        throw reflink::error(file.destination, reflink::ATTRIBUTE_SET, strerror(errno));
+
+      copy_xattrs(file);
+
+      struct timespec times[2] = { st.st_atim, st.st_mtim };
+      if (utimensat(AT_FDCWD, file.destination.c_str(), times,
+                    AT_SYMLINK_NOFOLLOW) != 0)
+        throw reflink::error(file.destination, reflink::ATTRIBUTE_SET, strerror(errno));
+    }
+
+    /**
+     * Clone file data.  If the filesystem does not support reflinks,
+     * or the destination is on a different filesystem, the data is
+     * copied instead.
+     */
+    void
+    clone_data (const node& file)
+    {
+      scoped_fd in(open(file.source.c_str(), O_RDONLY|O_NOFOLLOW|O_CLOEXEC));
+      if (in.get() < 0)
+        throw reflink::error(file.source, reflink::FILE_OPEN, strerror(errno));
+
+      scoped_fd out(open(file.destination.c_str(), O_WRONLY|O_NOFOLLOW|O_CLOEXEC));
+      if (out.get() < 0)
+        throw reflink::error(file.destination, reflink::FILE_OPEN, strerror(errno));
+
+      if (ioctl(out.get(), FICLONE, in.get()) == 0)
+        return;
+
+      if (errno != EOPNOTSUPP && errno != ENOTTY &&
+          errno != EXDEV && errno != EINVAL)
+        throw reflink::error(file.destination, reflink::FILE_CLONE, strerror(errno));
+
+      bool started = false;
+      while (true)
+        {
+          ssize_t copied = copy_file_range(in.get(), 0, out.get(), 0,
+                                           1 << 30, 0);
+          if (copied < 0)
+            {
+              if (errno == EINTR)
+                continue;
+              // Not supported between these filesystems.
+              if (!started &&
+                  (errno == EXDEV || errno == EINVAL ||
+                   errno == EOPNOTSUPP || errno == ENOSYS))
+                break;
+              throw reflink::error(file.destination, reflink::FILE_CLONE, strerror(errno));
+            }
+          if (copied == 0)
+            return;
+          started = true;
+        }
+
+      std::vector<char> buffer(1 << 16);
+      while (true)
+        {
+          ssize_t len = read(in.get(), &buffer[0], buffer.size());
+          if (len < 0)
+            {
+              if (errno == EINTR)
+                continue;
+              throw reflink::error(file.source, reflink::FILE_CLONE, strerror(errno));
+            }
+          if (len == 0)
+            break;
+
+          for (ssize_t done = 0; done < len;)
+            {
+              ssize_t written = write(out.get(), &buffer[done], len - done);
+              if (written < 0)
+                {
+                  if (errno == EINTR)
+                    continue;
+                  throw reflink::error(file.destination, reflink::FILE_CLONE, strerror(errno));
+                }
+              done += written;
+            }
+        }
+    }
+
+    /**
+     * Recreate a file which is not a directory.  Regular files are
+     * created empty, and added to files for data cloning.
+     */
+    void
+    create_file (const node&        file,
+                 std::vector<node>& files)
+    {
+      const struct stat& st(file.status);
+
+      if (S_ISREG(st.st_mode))
+        {
+          int fd = open(file.destination.c_str(),
+                        O_WRONLY|O_CREAT|O_EXCL|O_CLOEXEC, 0600);
+          if (fd < 0)
+            throw reflink::error(file.destination, reflink::FILE_CREATE, strerror(errno));
+          close(fd);
+          files.push_back(file);
+        }
+      else if (S_ISLNK(st.st_mode))
+        {
+          std::vector<char> target(st.st_size + 1);
+          ssize_t len = readlink(file.source.c_str(), &target[0], target.size());
+          if (len < 0)
+            throw reflink::error(file.source, reflink::FILE_STAT, strerror(errno));
+          std::string linktarget(&target[0], len);
+          if (symlink(linktarget.c_str(), file.destination.c_str()) != 0)
+            throw reflink::error(file.destination, reflink::LINK_CREATE, strerror(errno));
+          copy_attributes(file);
+        }
+      else
+        {
+          if (mknod(file.destination.c_str(), st.st_mode, st.st_rdev) != 0)
+            throw reflink::error(file.destination, reflink::FILE_CREATE, strerror(errno));
+          copy_attributes(file);
+        }
+    }
+
+    /**
+     * Recreate the contents of a directory.  Subdirectories are
+     * queued for scanning, and regular files are created empty and
+     * queued for data cloning.
+     */
+    void
+    scan_directory (clone_state& state,
+                    const node&  directory)
+    {
+      DIR *dir = opendir(directory.source.c_str());
+      if (dir == 0)
+        throw reflink::error(directory.source, reflink::DIRECTORY_OPEN, strerror(errno));
+
+      std::vector<node> subdirectories;
+      std::vector<node> files;
+
+      try
+        {
+          struct dirent *de;
+          while ((de = readdir(dir)) != 0)
+            {
+              std::string name(de->d_name);
+              if (name == "." || name == "..")
+                continue;
+
+              node file;
+              file.source = directory.source + '/' + name;
+              file.destination = directory.destination + '/' + name;
+              if (lstat(file.source.c_str(), &file.status) != 0)
+                throw reflink::error(file.source, reflink::FILE_STAT, strerror(errno));
+
+              const struct stat& st(file.status);
+
+              if (S_ISDIR(st.st_mode))
+                {
+                  if (mkdir(file.destination.c_str(), 0700) != 0)
+                    throw reflink::error(file.destination, reflink::DIRECTORY_CREATE, strerror(errno));
+                  subdirectories.push_back(file);
+                }
+              else if (st.st_nlink > 1)
+                {
+                  // The first link found is created while holding
+                  // the lock, so that other links to it found by
+                  // other threads can't be made before it exists.
+                  std::lock_guard<std::mutex> guard(state.lock);
+                  std::pair<dev_t, ino_t> id(st.st_dev, st.st_ino);
+                  auto pos = state.links.find(id);
+                  if (pos != state.links.end())
+                    {
+                      if (link(pos->second.c_str(), file.destination.c_str()) != 0)
+                        throw reflink::error(file.destination, reflink::LINK_CREATE, strerror(errno));
+                    }
+                  else
+                    {
+                      create_file(file, files);
+                      state.links.insert(std::make_pair(id, file.destination));
+                    }
+                }
+              else
+                create_file(file, files);
+            }
+        }
+      catch (const reflink::error& e)
+        {
+          closedir(dir);
+          throw;
+        }
+      closedir(dir);
+
+      std::lock_guard<std::mutex> guard(state.lock);
+      for (const auto& subdir : subdirectories)
+        {
+          state.directories.push_back(subdir);
+          // Don't descend into mount points.
+          if (subdir.status.st_dev == state.device)
+            state.pending.push_back(subdir);
+        }
+      state.files.insert(state.files.end(), files.begin(), files.end());
+      state.changed.notify_all();
+    }
+
+    /**
+     * Scan directories and clone file data until the tree is
+     * complete or an error occurs.  Scanning is preferred, so that
+     * work for other threads is found as early as possible.
+     */
+    void
+    clone_worker (clone_state& state)
+    {
+      std::unique_lock<std::mutex> guard(state.lock);
+      while (!state.failure)
+        {
+          std::exception_ptr failure;
+
+          if (!state.pending.empty())
+            {
+              node dir(state.pending.front());
+              state.pending.pop_front();
+              ++state.scanning;
+              guard.unlock();
+              try
+                {
+                  scan_directory(state, dir);
+                }
+              catch (const std::exception& e)
+                {
+                  failure = std::current_exception();
+                }
+              guard.lock();
+              --state.scanning;
+              state.changed.notify_all();
+            }
+          else if (!state.files.empty())
+            {
+              node file(state.files.front());
+              state.files.pop_front();
+              guard.unlock();
+              try
+                {
+                  clone_data(file);
+                  copy_attributes(file);
+                }
+              catch (const std::exception& e)
+                {
+                  failure = std::current_exception();
+                }
+              guard.lock();
+            }
+          else if (state.scanning == 0)
+            break; // Nothing left to find.
+          else
+            state.changed.wait(guard);
+
+          if (failure && !state.failure)
+            state.failure = failure;
+        }
+      state.changed.notify_all();
+    }
+
+    /// The depth of a path.
+    std::string::size_type
+    depth (const node& file)
+    {
+      return std::count(file.destination.begin(), file.destination.end(), '/');
+    }
+
+    /**
+     * Clone the contents of a directory tree, once the destination
+     * directory has been created.
+     */
+    void
+    clone_contents (const node&  root,
+                    unsigned int jobs)
+    {
+      clone_state state;
+
+      state.device = root.status.st_dev;
+      state.directories.push_back(root);
+      state.pending.push_back(root);
+
+      if (jobs == 0)
+        jobs = std::thread::hardware_concurrency();
+      if (jobs == 0)
+        jobs = 1;
+
+      log_debug(DEBUG_INFO)
+        << format("Cloning %1% to %2% using %3% threads")
+        % root.source % root.destination % jobs << endl;
+
+      std::vector<std::thread> threads;
+      for (unsigned int i = 1; i < jobs; ++i)
+        threads.push_back(std::thread(clone_worker, std::ref(state)));
+      clone_worker(state);
+      for (auto& thread : threads)
+        thread.join();
+
+      if (state.failure)
+        std::rethrow_exception(state.failure);
+
+      // Set directory attributes last, deepest first, so that
+      // timestamps are not altered by creating their contents.
+      std::stable_sort(state.directories.begin(), state.directories.end(),
+                       [] (const node& a, const node& b)
+                       { return depth(a) > depth(b); });
+      for (const auto& dir : state.directories)
+        copy_attributes(dir);
+    }
+
+  }
+
+  void
+  reflink::clone_tree (const std::string& source,
+                       const std::string& destination,
+                       unsigned int       jobs)
+  {
+    node root;
+    root.source = source;
+    root.destination = destination;
+    if (stat(source.c_str(), &root.status) != 0)
+      throw error(source, FILE_STAT, strerror(errno));
+    if (!S_ISDIR(root.status.st_mode))
+      throw error(source, DIRECTORY_OPEN, strerror(ENOTDIR));
+    if (mkdir(destination.c_str(), 0700) != 0)
+      throw error(destination, DIRECTORY_CREATE, strerror(errno));
+
+    try
+      {
+        clone_contents(root, jobs);
+      }
+    catch (...)
+      {
+        // Remove the partial clone.  Only the directory created
+        // above is removed, never an existing destination.
+        try
+          {
+            reclaim::remove_tree(destination);
+          }
+        catch (const reclaim::error& discard)
+          {
+          }
+        throw;
+      }
+  }
+
+  void
+  reflink::copy_file (const std::string& source,
+                      const std::string& destination)
+  {
+    node file;
+    file.source = source;
+    if (lstat(source.c_str(), &file.status) != 0)
+      throw error(source, FILE_STAT, strerror(errno));
+    if (!S_ISREG(file.status.st_mode))
+      throw error(source, FILE_OPEN, strerror(EINVAL));
+
+    std::vector<char> temp(destination.begin(), destination.end());
+    const char *suffix = ".XXXXXX";
+    temp.insert(temp.end(), suffix, suffix + strlen(suffix) + 1);
+    int fd = mkostemp(&temp[0], O_CLOEXEC);
+    if (fd < 0)
+      throw error(destination, FILE_CREATE, strerror(errno));
+    close(fd);
+    file.destination = &temp[0];
+
+    try
+      {
+        clone_data(file);
+        copy_attributes(file);
+        if (rename(file.destination.c_str(), destination.c_str()) != 0)
+          throw error(destination, FILE_CREATE, strerror(errno));
+      }
+    catch (const error&)
+      {
+        unlink(file.destination.c_str());
+        throw;
+      }
+  }
+
+  void
+  reflink::copy_special (const std::string& source,
+                         const std::string& destination)
+  {
+    std::vector<char> temp(destination.begin(), destination.end());
+    const char *suffix = ".XXXXXX";
+    temp.insert(temp.end(), suffix, suffix + strlen(suffix) + 1);
+    if (mkdtemp(&temp[0]) == nullptr)
+      throw error(destination, DIRECTORY_CREATE, strerror(errno));
+    std::string tempdir(&temp[0]);
+
+    try
+      {
+        node file;
+        file.source = source;
+        file.destination = tempdir + "/copy";
+        if (lstat(source.c_str(), &file.status) != 0)
+          throw error(source, FILE_STAT, strerror(errno));
+
+        if (S_ISDIR(file.status.st_mode))
+          clone_tree(source, file.destination);
+        else
+          {
+            std::vector<node> files;
+            create_file(file, files);
+            for (const auto& regular : files)
+              {
+                clone_data(regular);
+                copy_attributes(regular);
+              }
+          }
+
+        // Exchange, so that the destination is replaced whatever its
+        // type.  The old destination is left in the temporary
+        // directory.
+        if (renameat2(AT_FDCWD, file.destination.c_str(),
+                      AT_FDCWD, destination.c_str(), RENAME_EXCHANGE) != 0)
+          {
+            // Nothing to exchange with, or not supported by the
+            // filesystem.
+            if ((errno != ENOENT && errno != EINVAL) ||
+                rename(file.destination.c_str(), destination.c_str()) != 0)
+              throw error(destination, FILE_CREATE, strerror(errno));
+          }
+      }
+    catch (...)
+      {
+        try
+          {
+            reclaim::remove_tree(tempdir);
+          }
+        catch (const reclaim::error& discard)
+          {
+          }
+        throw;
+      }
+
+    try
+      {
+        reclaim::remove_tree(tempdir);
+      }
+    catch (const reclaim::error& e)
+      {
+        log_exception_warning(e);
+      }
+  }
+
+}
@@ -0,0 +1,122 @@
+/* Copyright © 2005-2013  Roger Leigh <rleigh@codelibre.net>
+ *
+ * schroot is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * schroot is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ *********************************************************************/
+
+#ifndef SCHROOT_REFLINK_H
+#define SCHROOT_REFLINK_H
+
+#include <schroot/custom-error.h>
+
+#include <string>
+
+namespace schroot
+{
+
+  /**
+   * Directory tree cloning using reflinks.  File data is cloned with
+   * the FICLONE ioctl, so that the clone shares its extents with the
+   * source until either is modified.  This requires a filesystem
+   * with reflink support, such as XFS or Btrfs.  On filesystems
+   * without reflink support, data is copied with copy_file_range(2),
+   * or read and written where that is not supported.
+   * This is a Linux only feature.
+   */
+  class reflink
+  {
+  public:
+    /// Error codes.
+    enum error_code
+      {
+        DIRECTORY_OPEN,   ///< Failed to open directory.
+        DIRECTORY_CREATE, ///< Failed to create directory.
+        FILE_STAT,        ///< Failed to stat file.
+        FILE_OPEN,        ///< Failed to open file.
+        FILE_CREATE,      ///< Failed to create file.
+        FILE_CLONE,       ///< Failed to clone file.
+        LINK_CREATE,      ///< Failed to create link.
+        ATTRIBUTE_SET,    ///< Failed to set file attributes.
+        XATTR_COPY        ///< Failed to copy extended attributes.
+      };
+
+    /// Exception type.
+    typedef custom_error<error_code> error;
+
+    /**
+     * Clone a directory tree.  A number of threads walk the tree in
+     * parallel, recreating directories, symbolic links, device nodes
+     * and hard links, and cloning file data as files are found.
+     * Ownership, permissions, extended attributes (including ACLs
+     * and file capabilities) and timestamps are preserved.  Mount
+     * points inside the source tree are not descended into.
+     *
+     * @param source the absolute path of the directory to clone.
+     * @param destination the absolute path of the clone.  This must
+     * not exist, and its parent directory must exist.  If cloning
+     * fails, the partial clone is removed.
+     * @param jobs the number of threads to clone the tree with, or 0
+     * to use one per CPU.
+     */
+    static void
+    clone_tree (const std::string& source,
+                const std::string& destination,
+                unsigned int       jobs = 0);
+
+    /**
+     * Copy a single regular file.  File data is cloned as for
+     * clone_tree, and ownership, permissions, extended attributes
+     * and timestamps are preserved.  The copy is made in a temporary
+     * file beside the destination, which then replaces the
+     * destination atomically; if the destination is a symbolic link,
+     * the link itself is replaced rather than followed.
+     *
+     * @param source the path of the file to copy.  This must not be a
+     * symbolic link.
+     * @param destination the path of the copy.  Its parent directory
+     * must exist.
+     */
+    static void
+    copy_file (const std::string& source,
+               const std::string& destination);
+
+    /**
+     * Copy a file of any type, as cp -a would.  Directories are
+     * cloned as for clone_tree, and symbolic links, device nodes,
+     * FIFOs and sockets are recreated, preserving ownership,
+     * permissions, extended attributes and timestamps.  The copy is
+     * made in a private temporary directory beside the destination,
+     * and then atomically exchanged with the destination, whatever
+     * its type.
+     *
+     * @param source the path of the file to copy.  If this is a
+     * symbolic link, the link itself is copied.
+     * @param destination the path of the copy.  Its parent directory
+     * must exist.
+     */
+    static void
+    copy_special (const std::string& source,
+                  const std::string& destination);
+  };
+
+}
+
+#endif /* SCHROOT_REFLINK_H */
+
+/*
+ * Local Variables:
+ * mode:C++
+ * End:
+ */
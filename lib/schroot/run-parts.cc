@@ -18,7 +18,9 @@
 
 #include <config.h>
 
+#include <schroot/metrics.h>
 #include <schroot/run-parts.h>
+#include <schroot/trace.h>
 #include <schroot/util.h>
 
 #include <cerrno>
@@ -163,6 +165,9 @@ namespace schroot
     int stderr_pipe[2];
     int exit_status = 0;
     pid_t pid;
+    trace::span span("run_parts", file);
+    metrics::outcome script_outcome("schroot_setup_script",
+                                    {{"script", file}});
 
     try
       {
@@ -203,7 +208,11 @@ namespace schroot
                 close(stderr_pipe[0]);
                 close(stderr_pipe[1]);
 
-                exec(this->directory + '/' + file, command, env);
+                // Helpers run by the script continue this span.
+                environment script_env(env);
+                trace::setup_env(script_env);
+
+                exec(this->directory + '/' + file, command, script_env);
                 error e(file, EXEC, strerror(errno));
                 log_exception_error(e);
               }
@@ -216,6 +225,7 @@ namespace schroot
                 log_error()
                   << _("An unknown exception occurred") << std::endl;
               }
+            log_flush();
             _exit(EXIT_FAILURE);
           }
 
@@ -223,6 +233,8 @@ namespace schroot
         close(stdout_pipe[1]);
         close(stderr_pipe[1]);
 
+        log_context script("script", file);
+
         struct pollfd pollfds[2];
         pollfds[0].fd = stdout_pipe[0];
         pollfds[0].events = POLLIN;
@@ -277,7 +289,7 @@ namespace schroot
                      ++pos)
                   {
                     if (pos + 1 != lines.end() || flush)
-                      log_error() << file << ": " << *pos << '\n';
+                      log_error() << *pos << '\n';
                     else // Save possibly incompete line
                       stderr_buf = *pos;
                   }
@@ -298,7 +310,7 @@ namespace schroot
                      ++pos)
                   {
                     if (pos + 1 != lines.end() || flush)
-                      log_info() << file << ": " << *pos << '\n';
+                      log_info() << *pos << '\n';
                     else // Save possibly incompete line
                       stdout_buf = *pos;
                   }
@@ -311,9 +323,9 @@ namespace schroot
               {
                 // Flush any remaining lines
                 if (!stderr_buf.empty())
-                  log_error() << file << ": " << stderr_buf << '\n';
+                  log_error() << stderr_buf << '\n';
                 if (!stdout_buf.empty())
-                  log_info() << file << ": " << stdout_buf << '\n';
+                  log_info() << stdout_buf << '\n';
                 break;
               }
           }
@@ -321,6 +333,7 @@ namespace schroot
         close(stdout_pipe[0]);
         close(stderr_pipe[0]);
         wait_for_child(pid, exit_status);
+        script_outcome.set_success(exit_status == 0);
       }
     catch (const error& e)
       {
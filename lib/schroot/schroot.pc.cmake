@@ -5,6 +5,6 @@ includedir=@CMAKE_INSTALL_FULL_INCLUDEDIR@
 
 Name: schroot
 Description: chroot maintenance and session manager
-Version: ${GIT_RELEASE_VERSION}
+Version: @GIT_RELEASE_VERSION@
 Libs: -L${libdir} -lschroot
 Cflags: -I${includedir}
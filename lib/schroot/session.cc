@@ -19,11 +19,17 @@
 #include <config.h>
 
 #include <schroot/chroot/chroot.h>
+#include <schroot/chroot/pool.h>
+#ifdef SCHROOT_FEATURE_CGROUP
+#include <schroot/chroot/facet/cgroup.h>
+#endif // SCHROOT_FEATURE_CGROUP
 #ifdef SCHROOT_FEATURE_PERSONALITY
 #include <schroot/chroot/facet/personality.h>
 #endif // SCHROOT_FEATURE_PERSONALITY
 #include <schroot/chroot/facet/session.h>
 #include <schroot/chroot/facet/session-clonable.h>
+#include <schroot/chroot/facet/source.h>
+#include <schroot/chroot/facet/source-clonable.h>
 #ifdef SCHROOT_FEATURE_UNSHARE
 #include <schroot/chroot/facet/unshare.h>
 #endif // SCHROOT_FEATURE_UNSHARE
@@ -37,20 +43,28 @@
 #endif // SCHROOT_FEATURE_PAM
 #include <schroot/ctty.h>
 #include <schroot/feature.h>
+#include <schroot/identity.h>
+#include <schroot/lease.h>
+#include <schroot/metrics.h>
 #include <schroot/run-parts.h>
 #include <schroot/session.h>
+#include <schroot/trace.h>
 #include <schroot/util.h>
 
 #include <cassert>
 #include <cerrno>
+#include <csignal>
 #include <cstdlib>
 #include <cstring>
 #include <iostream>
 #include <memory>
+#include <vector>
 
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/wait.h>
 #include <fcntl.h>
+#include <grp.h>
 #include <termios.h>
 #include <unistd.h>
 
@@ -120,10 +134,158 @@ namespace schroot
       sigterm_called = true;
     }
 
+#ifdef SCHROOT_FEATURE_UNSHARE
+    /// The command run by an init process.
+    volatile sig_atomic_t init_child = 0;
+
+    /**
+     * Forward a signal received by an init process to its command.
+     *
+     * @param signal the signal number.
+     */
+    void
+    init_signal_handler (int signal)
+    {
+      if (init_child > 0)
+        kill(init_child, signal);
+    }
+#endif // SCHROOT_FEATURE_UNSHARE
+
 #ifdef SCHROOT_DEBUG
     volatile bool child_wait = true;
 #endif
 
+    /**
+     * Get the name of the chroot a session was created from.
+     *
+     * @param chroot the chroot or session chroot.
+     * @returns the original chroot name, or the chroot name if it is
+     * not a session chroot.
+     */
+    std::string
+    original_chroot_name (const chroot::chroot::ptr& chroot)
+    {
+      chroot::facet::session::const_ptr psess =
+        chroot->get_facet<chroot::facet::session>();
+      if (psess && psess->get_original_name().length())
+        return psess->get_original_name();
+      return chroot->get_name();
+    }
+
+    /**
+     * Get the name of a session operation.
+     *
+     * @param operation the session operation.
+     * @returns the name.
+     */
+    const char *
+    operation_name (session::operation operation)
+    {
+      switch (operation)
+        {
+        case session::OPERATION_BEGIN:
+          return "begin";
+        case session::OPERATION_RECOVER:
+          return "recover";
+        case session::OPERATION_END:
+          return "end";
+        case session::OPERATION_RUN:
+          return "run";
+        case session::OPERATION_AUTOMATIC:
+        default:
+          return "automatic";
+        }
+    }
+
+    /**
+     * Check if the process already has the groups which initgroups(3)
+     * would set.  setgroups(2) is always denied in an unprivileged
+     * user namespace, where changing the groups is then unnecessary.
+     *
+     * @param user the user to get the group list for.
+     * @param gid the primary group of the user.
+     * @returns true if the groups are unchanged, otherwise false.
+     */
+    bool
+    groups_unchanged (const std::string& user,
+                      gid_t              gid)
+    {
+      int ngroups = 0;
+      getgrouplist(user.c_str(), gid, 0, &ngroups);
+      std::vector<gid_t> groups(ngroups > 0 ? ngroups : 1);
+      if (getgrouplist(user.c_str(), gid, &groups[0], &ngroups) < 0)
+        return false;
+
+      identity::gid_set required(groups.begin(), groups.begin() + ngroups);
+      required.insert(gid);
+
+      // The groups of the process now, which may differ from those
+      // resolved by identity::current().
+      int ncurrent = getgroups(0, 0);
+      if (ncurrent < 0)
+        return false;
+      std::vector<gid_t> current_groups(ncurrent > 0 ? ncurrent : 1);
+      ncurrent = getgroups(ncurrent, &current_groups[0]);
+      if (ncurrent < 0)
+        return false;
+
+      identity::gid_set current(current_groups.begin(),
+                                current_groups.begin() + ncurrent);
+      current.insert(gid);
+      return required == current;
+    }
+
+    /**
+     * A lease ticket held for the lifetime of the object.
+     */
+    class scoped_lease
+    {
+    public:
+      /// The constructor.
+      scoped_lease ():
+        held(),
+        number(0)
+      {
+      }
+
+      /// The destructor.
+      ~scoped_lease ()
+      {
+        if (this->held)
+          {
+            try
+              {
+                this->held->release(this->number);
+              }
+            catch (const std::exception& e)
+              {
+                log_exception_warning(e);
+              }
+          }
+      }
+
+      /**
+       * Acquire a shared lease.
+       *
+       * @param name the name of the lease.
+       * @param timeout the time to wait for the lease, in seconds.
+       */
+      void
+      acquire_shared (const std::string& name,
+                      unsigned int       timeout)
+      {
+        std::unique_ptr<lease> l(new lease(name));
+        this->number = l->acquire(lease::LEASE_SHARED, "", timeout);
+        this->held = std::move(l);
+      }
+
+    private:
+      /// The lease, if held.
+      std::unique_ptr<lease> held;
+      /// The ticket number.
+      unsigned long          number;
+    };
+
   }
 
   template<>
@@ -153,14 +315,6 @@ namespace schroot
       {session::COMMAND_ABS,    N_("Command “%1%” must have an absolute path")},
       // TRANSLATORS: %1% = command
       {session::EXEC,           N_("Failed to execute “%1%”")},
-      // TRANSLATORS: A supplementary group is the list of additional
-      // system groups a user belongs to, in addition to their default
-      // group.
-      {session::GROUP_GET_SUP,  N_("Failed to get supplementary groups")},
-      // TRANSLATORS: A supplementary group is the list of additional
-      // system groups a user belongs to, in addition to their default
-      // group.
-      {session::GROUP_GET_SUPC, N_("Failed to get supplementary group count")},
       // TRANSLATORS: %1% = integer group ID
       {session::GROUP_SET,      N_("Failed to set group ‘%1%’")},
       {session::GROUP_SET_SUP,  N_("Failed to set supplementary groups")},
@@ -211,8 +365,10 @@ namespace schroot
     termios_ok(false),
     verbosity(),
     preserve_environment(false),
+    async_end(false),
     shell(),
     user_options(),
+    setup_environment(),
     cwd(schroot::getcwd())
   {
   }
@@ -293,6 +449,18 @@ namespace schroot
     this->preserve_environment = preserve_environment;
   }
 
+  bool
+  session::get_async_end () const
+  {
+    return this->async_end;
+  }
+
+  void
+  session::set_async_end (bool async_end)
+  {
+    this->async_end = async_end;
+  }
+
   std::string const&
   session::get_shell_override () const
   {
@@ -384,49 +552,7 @@ namespace schroot
   bool
   session::is_group_member (const std::string& groupname) const
   {
-    errno = 0;
-    schroot::group grp(groupname);
-    if (!grp)
-      {
-        if (errno == 0)
-          log_debug(DEBUG_INFO) << "Group " << groupname << "not found" << endl;
-        else
-          log_debug(DEBUG_INFO) << "Group " << groupname
-                                << "not found: " << strerror(errno) << endl;
-        return false;
-      }
-
-    bool group_member = false;
-    if (grp.gr_gid == getgid())
-      {
-        group_member = true;
-      }
-    else
-      {
-        int supp_group_count = getgroups(0, 0);
-        if (supp_group_count < 0)
-          throw session::error(session::GROUP_GET_SUPC, strerror(errno));
-        if (supp_group_count > 0)
-          {
-            gid_t *supp_groups = new gid_t[supp_group_count];
-            assert (supp_groups);
-            if (getgroups(supp_group_count, supp_groups) < 1)
-              {
-                // Free supp_groups before throwing to avoid leak.
-                delete[] supp_groups;
-                throw session::error(session::GROUP_GET_SUP, strerror(errno));
-              }
-
-            for (int i = 0; i < supp_group_count; ++i)
-              {
-                if (grp.gr_gid == supp_groups[i])
-                  group_member = true;
-              }
-            delete[] supp_groups;
-          }
-      }
-
-    return group_member;
+    return identity::current().is_group_member(groupname);
   }
 
   void
@@ -456,19 +582,21 @@ namespace schroot
     if (rupos != root_users.end())
       in_root_users = true;
 
-    if (!groups.empty())
-      {
-        for (const auto& gp : groups)
-          if (is_group_member(gp))
-            in_groups = true;
-      }
+    identity& caller(identity::current());
 
-    if (!root_groups.empty())
-      {
-        for (const auto& rgp : root_groups)
-          if (is_group_member(rgp))
-            in_root_groups = true;
-      }
+    for (const auto& gp : groups)
+      if (caller.is_group_member(gp))
+        {
+          in_groups = true;
+          break;
+        }
+
+    for (const auto& rgp : root_groups)
+      if (caller.is_group_member(rgp))
+        {
+          in_root_groups = true;
+          break;
+        }
 
     log_debug(DEBUG_INFO)
       << "In users: " << in_users << endl
@@ -538,9 +666,6 @@ namespace schroot
 
     auth::auth::status status = auth::auth::STATUS_NONE;
 
-    /** @todo Use set difference rather than iteration and
-     * is_group_member.
-     */
     for (const auto& chrootent : this->chroots)
       status = auth::auth::change_auth(status,
                                        get_chroot_auth_status(status, chrootent.chroot));
@@ -624,6 +749,10 @@ namespace schroot
               << endl;
 
             const chroot::chroot::ptr ch = chrootent.chroot;
+            metrics::outcome operation_outcome
+              ("schroot_operation",
+               {{"chroot", original_chroot_name(ch)},
+                {"operation", operation_name(this->session_operation)}});
 
             // TODO: Make chroot/session selection automatically fail
             // if no session exists earlier on when selecting chroots.
@@ -636,6 +765,7 @@ namespace schroot
             // later, we will replace it.
             chroot::chroot::ptr chroot(ch->clone());
             assert(chroot);
+            bool pool_claimed = false;
 
             /* Create a session using randomly-generated session ID. */
             if (ch->get_session_flags() & chroot::facet::facet::SESSION_CREATE)
@@ -665,10 +795,38 @@ namespace schroot
                                       in_users, in_root_users,
                                       in_groups, in_root_groups);
 
-                chroot = ch->clone_session(new_session_id,
-                                           chrootent.alias,
-                                           this->authstat->get_ruser(),
-                                           (in_root_users || in_root_groups));
+                // Claim a pre-provisioned session from the pool if
+                // possible, so that setup-start has already been run.
+                // User options must be seen by setup-start, so the
+                // pool can't be used if any were given.
+                chroot::chroot::ptr claimed;
+                if (ch->get_facet_strict<chroot::facet::session_clonable>()->get_session_pool_size() > 0 &&
+                    this->user_options.empty())
+                  {
+                    try
+                      {
+                        chroot::pool pool(ch);
+                        claimed = pool.claim(new_session_id,
+                                             chrootent.alias,
+                                             this->authstat->get_ruser(),
+                                             (in_root_users || in_root_groups));
+                      }
+                    catch (const std::exception& e)
+                      {
+                        log_exception_warning(e);
+                      }
+                  }
+
+                if (claimed)
+                  {
+                    chroot = claimed;
+                    pool_claimed = true;
+                  }
+                else
+                  chroot = ch->clone_session(new_session_id,
+                                             chrootent.alias,
+                                             this->authstat->get_ruser(),
+                                             (in_root_users || in_root_groups));
                 assert(chroot->get_facet<chroot::facet::session>());
               }
             assert(chroot);
@@ -693,6 +851,33 @@ namespace schroot
                   userdata->set_user_data(this->user_options);
               }
 
+            // Record the process beginning a session, and the use of
+            // an existing session, so that stale sessions may be found.
+            chroot::facet::session::ptr psess
+              (chroot->get_facet<chroot::facet::session>());
+            if (psess)
+              {
+                if (this->session_operation == OPERATION_BEGIN)
+                  psess->set_driver(getppid());
+                else if (this->session_operation == OPERATION_RUN ||
+                         this->session_operation == OPERATION_RECOVER)
+                  psess->touch_session_info();
+              }
+
+            // A claimed session has already saved its session
+            // information, so save it again with the driver.
+            if (pool_claimed && this->session_operation == OPERATION_BEGIN)
+              {
+                try
+                  {
+                    psess->update_session_info();
+                  }
+                catch (const chroot::chroot::error& e)
+                  {
+                    throw error(chroot->get_name(), CHROOT_LOCK, e);
+                  }
+              }
+
             // Following authentication success, default child status to
             // success so that operations such as beginning, ending and
             // recovering sessions will return success unless an
@@ -701,13 +886,32 @@ namespace schroot
 
             try
               {
-                /* Run setup-start chroot setup scripts. */
-                setup_chroot(chroot, chroot::chroot::SETUP_START);
+                /* Run setup-start chroot setup scripts, unless the
+                   session was claimed from the pool, in which case
+                   they have already been run. */
+                if (pool_claimed)
+                  this->chroot_status = true;
+                else
+                  setup_chroot(chroot, chroot::chroot::SETUP_START);
                 if (this->session_operation == OPERATION_BEGIN)
                   {
                     cout << chroot->get_name() << endl;
                   }
 
+                /* Replenish the session pool in the background. */
+                if (ch->get_session_flags() & chroot::facet::facet::SESSION_CREATE &&
+                    ch->get_facet_strict<chroot::facet::session_clonable>()->get_session_pool_size() > 0)
+                  {
+                    try
+                      {
+                        fill_pool(ch);
+                      }
+                    catch (const std::exception& e)
+                      {
+                        log_exception_warning(e);
+                      }
+                  }
+
                 /* Run recover scripts. */
                 setup_chroot(chroot, chroot::chroot::SETUP_RECOVER);
 
@@ -776,6 +980,8 @@ namespace schroot
             /* Run setup-stop chroot setup scripts whether or not there
                was an error. */
             setup_chroot(chroot, chroot::chroot::SETUP_STOP);
+
+            operation_outcome.set_success(this->child_status == EXIT_SUCCESS);
           }
       }
     catch (const error& e)
@@ -1108,6 +1314,63 @@ namespace schroot
     if (setup_type == chroot::chroot::SETUP_START)
       this->chroot_status = true;
 
+    // Sessions cloned from a source chroot hold a shared lease on the
+    // source while they are set up.  Sessions of the source chroot
+    // hold an exclusive lease from setup-start until setup-stop, so
+    // that the source is never modified while it is being cloned.
+    const std::string source_name(original_chroot_name(session_chroot));
+    scoped_lease clone_lease;
+    if (setup_type == chroot::chroot::SETUP_START)
+      {
+        chroot::facet::source::const_ptr psrc
+          (session_chroot->get_facet<chroot::facet::source>());
+        chroot::facet::session::const_ptr psess
+          (session_chroot->get_facet<chroot::facet::session>());
+        chroot::facet::source_clonable::const_ptr pclone;
+        if (psess && psess->get_parent_chroot())
+          pclone = psess->get_parent_chroot()->
+            get_facet<chroot::facet::source_clonable>();
+
+        try
+          {
+            if (psrc)
+              lease(source_name).acquire(lease::LEASE_EXCLUSIVE,
+                                         session_chroot->get_name(),
+                                         psrc->get_lease_timeout());
+            else if (pclone && pclone->get_source_clone())
+              clone_lease.acquire_shared(source_name,
+                                         pclone->get_source_lease_timeout());
+          }
+        catch (const lease::error& e)
+          {
+            this->chroot_status = false;
+            this->lock_status = false;
+            throw error(session_chroot->get_name(), CHROOT_LOCK, e);
+          }
+      }
+
+    // Mark the session as ending before it is torn down, so that the
+    // storage facets defer its reclaim, and so that an interrupted
+    // end may be detected and completed by garbage collection.
+    if (setup_type == chroot::chroot::SETUP_STOP && this->async_end)
+      {
+        chroot::facet::session::ptr psess
+          (session_chroot->get_facet<chroot::facet::session>());
+        if (psess && !psess->get_ending())
+          {
+            psess->set_ending(true);
+            psess->set_driver(getpid());
+            try
+              {
+                psess->update_session_info();
+              }
+            catch (const chroot::chroot::error& e)
+              {
+                log_exception_warning(e);
+              }
+          }
+      }
+
     try
       {
         session_chroot->lock(setup_type);
@@ -1139,6 +1402,16 @@ namespace schroot
     else if (setup_type == chroot::chroot::EXEC_STOP)
       setup_type_string = "exec-stop";
 
+    // Identify all messages logged while running the setup scripts.
+    const std::string chroot_name(original_chroot_name(session_chroot));
+    log_context log_session("session_id", session_chroot->get_name());
+    log_context log_chroot("chroot", chroot_name);
+    log_context log_stage("stage", setup_type_string);
+    trace::span span("setup_chroot", setup_type_string);
+    metrics::outcome setup_outcome
+      ("schroot_setup",
+       {{"chroot", chroot_name}, {"stage", setup_type_string}});
+
     std::string chroot_status_string;
     if (this->chroot_status)
       chroot_status_string = "ok";
@@ -1154,40 +1427,10 @@ namespace schroot
        chroot type. */
     environment env;
     session_chroot->setup_env(env);
-    env.add("AUTH_USER", this->authstat->get_user());
-    env.add("AUTH_RUSER", this->authstat->get_ruser());
-    env.add("AUTH_RGROUP", this->authstat->get_rgroup());
-    env.add("AUTH_UID", this->authstat->get_uid());
-    env.add("AUTH_GID", this->authstat->get_gid());
-    env.add("AUTH_RUID", this->authstat->get_ruid());
-    env.add("AUTH_RGID", this->authstat->get_rgid());
-    env.add("AUTH_HOME", this->authstat->get_home());
-    env.add("AUTH_SHELL", this->authstat->get_shell());
-
     env.add("VERBOSE", session_chroot->get_verbosity_string());
-    env.add("MOUNT_DIR", SCHROOT_MOUNT_DIR);
-    env.add("LIBEXEC_DIR", SCHROOT_LIBEXEC_DIR);
-    env.add("SYSCONF_DIR", SCHROOT_SYSCONF_DIR);
-    env.add("DATA_DIR", SCHROOT_DATA_DIR);
-    env.add("SETUP_DATA_DIR", SCHROOT_SETUP_DATA_DIR);
+    // Not cached, since the session may be used by a forked process.
     env.add("PID", getpid());
-#ifdef SCHROOT_HOST
-    env.add("HOST", SCHROOT_HOST);
-#endif // SCHROOT_HOST
-#ifdef SCHROOT_HOST_OS
-    env.add("HOST_OS", SCHROOT_HOST_OS);
-#endif // SCHROOT_HOST_OS
-#ifdef SCHROOT_HOST_VENDOR
-    env.add("HOST_VENDOR", SCHROOT_HOST_VENDOR);
-#endif // SCHROOT_HOST_VENDOR
-#ifdef SCHROOT_HOST_CPU
-    env.add("HOST_CPU", SCHROOT_HOST_CPU);
-#endif // SCHROOT_HOST_CPU
-#ifdef SCHROOT_PLATFORM
-    env.add("PLATFORM", SCHROOT_PLATFORM);
-#endif // SCHROOT_PLATFORM
-
-    env.add("PATH", "/usr/local/sbin:/usr/local/bin:/usr/sbin:/usr/bin:/sbin:/bin");
+    env.add(get_setup_environment());
 
     run_parts rp(SCHROOT_CONF_SETUP_D,
                  true, true, 022);
@@ -1223,6 +1466,8 @@ namespace schroot
 
             int status = rp.run(arg_list, env);
 
+            metrics::flush();
+            log_flush();
             _exit (status);
           }
         catch (const std::exception& e)
@@ -1234,6 +1479,7 @@ namespace schroot
             log_error()
               << _("An unknown exception occurred") << std::endl;
           }
+        log_flush();
         _exit(EXIT_FAILURE);
       }
     else
@@ -1252,6 +1498,35 @@ namespace schroot
         throw error(session_chroot->get_name(), CHROOT_UNLOCK, e);
       }
 
+    // The session no longer uses the source chroot, whether or not
+    // it was cleanly stopped.  Sessions pooled from the chroot before
+    // the source was modified are out of date.
+    if (setup_type == chroot::chroot::SETUP_STOP)
+      {
+        try
+          {
+            lease(source_name).release(session_chroot->get_name());
+          }
+        catch (const lease::error& e)
+          {
+            log_exception_warning(e);
+          }
+
+        if (session_chroot->get_facet<chroot::facet::source>())
+          {
+            try
+              {
+                chroot::pool::invalidate(source_name);
+              }
+            catch (const chroot::pool::error& e)
+              {
+                log_exception_warning(e);
+              }
+          }
+      }
+
+    setup_outcome.set_success(exit_status == 0);
+
     if (exit_status != 0)
       {
         this->chroot_status = false;
@@ -1262,6 +1537,155 @@ namespace schroot
       }
   }
 
+  const environment&
+  session::get_setup_environment ()
+  {
+    if (!this->setup_environment.empty())
+      return this->setup_environment;
+
+    environment& env(this->setup_environment);
+    env.add("AUTH_USER", this->authstat->get_user());
+    env.add("AUTH_RUSER", this->authstat->get_ruser());
+    env.add("AUTH_RGROUP", this->authstat->get_rgroup());
+    env.add("AUTH_UID", this->authstat->get_uid());
+    env.add("AUTH_GID", this->authstat->get_gid());
+    env.add("AUTH_RUID", this->authstat->get_ruid());
+    env.add("AUTH_RGID", this->authstat->get_rgid());
+    env.add("AUTH_HOME", this->authstat->get_home());
+    env.add("AUTH_SHELL", this->authstat->get_shell());
+
+    env.add("MOUNT_DIR", SCHROOT_MOUNT_DIR);
+    env.add("LIBEXEC_DIR", SCHROOT_LIBEXEC_DIR);
+    env.add("SYSCONF_DIR", SCHROOT_SYSCONF_DIR);
+    env.add("DATA_DIR", SCHROOT_DATA_DIR);
+    env.add("SETUP_DATA_DIR", SCHROOT_SETUP_DATA_DIR);
+#ifdef SCHROOT_HOST
+    env.add("HOST", SCHROOT_HOST);
+#endif // SCHROOT_HOST
+#ifdef SCHROOT_HOST_OS
+    env.add("HOST_OS", SCHROOT_HOST_OS);
+#endif // SCHROOT_HOST_OS
+#ifdef SCHROOT_HOST_VENDOR
+    env.add("HOST_VENDOR", SCHROOT_HOST_VENDOR);
+#endif // SCHROOT_HOST_VENDOR
+#ifdef SCHROOT_HOST_CPU
+    env.add("HOST_CPU", SCHROOT_HOST_CPU);
+#endif // SCHROOT_HOST_CPU
+#ifdef SCHROOT_PLATFORM
+    env.add("PLATFORM", SCHROOT_PLATFORM);
+#endif // SCHROOT_PLATFORM
+
+    env.add("PATH", "/usr/local/sbin:/usr/local/bin:/usr/sbin:/usr/bin:/sbin:/bin");
+
+    return env;
+  }
+
+  void
+  session::fill_pool (const chroot::chroot::ptr& source)
+  {
+    pid_t pid;
+
+    if ((pid = fork()) == -1)
+      {
+        throw error(source->get_name(), CHILD_FORK, strerror(errno));
+      }
+    else if (pid == 0)
+      {
+        // Detach from the session and controlling terminal, and fork
+        // again so that the pool is refilled by a process reparented
+        // to init.  Standard output must not be held open, or else
+        // callers reading the session name would block.
+        setsid();
+        pid_t filler = fork();
+        if (filler != 0)
+          _exit(filler == -1 ? EXIT_FAILURE : EXIT_SUCCESS);
+
+        if (chdir("/"))
+          _exit(EXIT_FAILURE);
+
+        int null = open("/dev/null", O_RDWR);
+        if (null >= 0)
+          {
+            dup2(null, STDIN_FILENO);
+            dup2(null, STDOUT_FILENO);
+            dup2(null, STDERR_FILENO);
+            if (null > STDERR_FILENO)
+              close(null);
+          }
+
+        try
+          {
+            chroot::pool pool(source);
+
+            // Another process is already refilling the pool.
+            if (!pool.lock())
+              _exit(EXIT_SUCCESS);
+
+            // Discard members of an older generation, and trim
+            // excess members if the pool size was reduced.
+            for (const auto& surplus : pool.get_surplus_members())
+              {
+                chroot::chroot::ptr member
+                  (pool.claim_member(surplus, surplus, source->get_name(),
+                                     this->authstat->get_ruser(), false));
+                if (!member)
+                  continue;
+
+                this->session_operation = OPERATION_END;
+                this->chroot_status = true;
+                this->lock_status = true;
+                setup_chroot(member, chroot::chroot::SETUP_STOP);
+              }
+
+            for (std::string::size_type members = pool.get_members().size();
+                 members < pool.get_size();
+                 ++members)
+              {
+                chroot::chroot::ptr member
+                  (source->clone_session(pool.create_member_name(),
+                                         source->get_name(),
+                                         this->authstat->get_ruser(),
+                                         false));
+
+                this->session_operation = OPERATION_BEGIN;
+                this->chroot_status = true;
+                this->lock_status = true;
+                try
+                  {
+                    setup_chroot(member, chroot::chroot::SETUP_START);
+                  }
+                catch (const error& e)
+                  {
+                    this->session_operation = OPERATION_END;
+                    try
+                      {
+                        setup_chroot(member, chroot::chroot::SETUP_STOP);
+                      }
+                    catch (const error& discard)
+                      {
+                      }
+                    throw;
+                  }
+
+                pool.add(member);
+              }
+          }
+        catch (const std::exception& e)
+          {
+            log_exception_error(e);
+            _exit(EXIT_FAILURE);
+          }
+        _exit(EXIT_SUCCESS);
+      }
+    else
+      {
+        int status;
+        wait_for_child(pid, status);
+        if (status != EXIT_SUCCESS)
+          throw error(source->get_name(), CHILD_FORK);
+      }
+  }
+
   void
   session::run_child (chroot::chroot::ptr& session_chroot)
   {
@@ -1291,7 +1715,13 @@ namespace schroot
       throw error(this->authstat->get_gid(), GROUP_SET, strerror(errno));
     log_debug(DEBUG_NOTICE) << "Set GID=" << this->authstat->get_gid() << std::endl;
     if (initgroups (this->authstat->get_user().c_str(), this->authstat->get_gid()))
-      throw error(GROUP_SET_SUP, strerror(errno));
+      {
+        int initgroups_errno = errno;
+        if (initgroups_errno != EPERM ||
+            !groups_unchanged(this->authstat->get_user(),
+                              this->authstat->get_gid()))
+          throw error(GROUP_SET_SUP, strerror(initgroups_errno));
+      }
     log_debug(DEBUG_NOTICE) << "Set supplementary groups" << std::endl;
 
 
@@ -1423,6 +1853,109 @@ namespace schroot
     _exit(EXIT_FAILURE);
   }
 
+  void
+  session::run_init (chroot::chroot::ptr& session_chroot)
+  {
+#ifdef SCHROOT_FEATURE_UNSHARE
+    chroot::facet::unshare::const_ptr pu =
+      session_chroot->get_facet_strict<chroot::facet::unshare>();
+
+    pu->do_unshare_child(session_chroot->get_path());
+
+    /* Without a PID or user namespace, no init process is needed. */
+    if (!pu->get_unshare_pid() && !pu->get_unshare_user())
+      run_child(session_chroot);
+
+    /* The command unshares its user namespace, and then waits for
+       its ID maps to be written from outside it. */
+    int ready[2];
+    int mapped[2];
+    if (pipe(ready) < 0)
+      throw error(CHILD_FORK, strerror(errno));
+    if (pipe(mapped) < 0)
+      throw error(CHILD_FORK, strerror(errno));
+
+    pid_t pid = fork();
+    if (pid == -1)
+      {
+        throw error(CHILD_FORK, strerror(errno));
+      }
+    else if (pid == 0)
+      {
+        close(ready[0]);
+        close(mapped[1]);
+
+        pu->do_unshare_user();
+
+        char sync = 0;
+        if (write(ready[1], &sync, 1) != 1 ||
+            read(mapped[0], &sync, 1) != 1)
+          throw error(CHILD_WAIT, strerror(errno));
+        close(ready[1]);
+        close(mapped[0]);
+
+        run_child(session_chroot);
+      }
+
+    close(ready[1]);
+    close(mapped[0]);
+
+    char sync = 0;
+    if (read(ready[0], &sync, 1) != 1)
+      throw error(CHILD_WAIT, strerror(errno));
+    if (pu->get_unshare_user())
+      pu->map_user_namespace(pid);
+    if (write(mapped[1], &sync, 1) != 1)
+      throw error(CHILD_WAIT, strerror(errno));
+    close(ready[0]);
+    close(mapped[1]);
+
+    /* Forward termination signals to the command.  Interrupts from
+       the terminal are received by the command directly. */
+    init_child = pid;
+    struct sigaction forward;
+    std::memset(&forward, 0, sizeof(forward));
+    forward.sa_handler = init_signal_handler;
+    sigemptyset(&forward.sa_mask);
+    const int forwarded[] = { SIGHUP, SIGTERM, SIGUSR1, SIGUSR2 };
+    for (int signum : forwarded)
+      sigaction(signum, &forward, nullptr);
+    std::signal(SIGINT, SIG_IGN);
+    std::signal(SIGQUIT, SIG_IGN);
+
+    /* Reap every process until the command exits.  Orphaned
+       processes are reparented to us if we are the init process of
+       the PID namespace. */
+    int status = 0;
+    while (1)
+      {
+        pid_t child = waitpid(-1, &status, 0);
+        if (child == -1)
+          {
+            if (errno == EINTR)
+              continue;
+            throw error(CHILD_WAIT, strerror(errno));
+          }
+        else if (child == pid)
+          break;
+      }
+
+    if (WIFSIGNALED(status))
+      {
+        /* Terminate with the same signal, if permitted (the init
+           process of a PID namespace may only be killed from
+           outside it). */
+        std::signal(WTERMSIG(status), SIG_DFL);
+        kill(getpid(), WTERMSIG(status));
+        _exit(128 + WTERMSIG(status));
+      }
+
+    _exit(WIFEXITED(status) ? WEXITSTATUS(status) : EXIT_FAILURE);
+#else
+    run_child(session_chroot);
+#endif // SCHROOT_FEATURE_UNSHARE
+  }
+
   void
   session::wait_for_child (pid_t pid,
                            int&  child_status)
@@ -1504,8 +2037,32 @@ namespace schroot
   {
     assert(!session_chroot->get_name().empty());
 
-    pid_t pid;
-    if ((pid = fork()) == -1)
+    trace::span span("run_child", session_chroot->get_name());
+
+#ifdef SCHROOT_FEATURE_UNSHARE
+    /* The child is the init process of a new PID namespace. */
+    chroot::facet::unshare::const_ptr pu =
+      session_chroot->get_facet<chroot::facet::unshare>();
+    int pidns = pu ? pu->begin_pid_namespace() : -1;
+#endif // SCHROOT_FEATURE_UNSHARE
+
+    pid_t pid = fork();
+
+#ifdef SCHROOT_FEATURE_UNSHARE
+    if (pid != 0 && pu)
+      {
+        try
+          {
+            pu->end_pid_namespace(pidns);
+          }
+        catch (const std::runtime_error& e)
+          {
+            log_exception_error(e);
+          }
+      }
+#endif // SCHROOT_FEATURE_UNSHARE
+
+    if (pid == -1)
       {
         throw error(CHILD_FORK, strerror(errno));
       }
@@ -1517,7 +2074,21 @@ namespace schroot
 #endif
         try
           {
-            run_child(session_chroot);
+#ifdef SCHROOT_FEATURE_CGROUP
+            /* The cgroup is created by setup-start, and is killed
+               as a whole by setup-stop. */
+            chroot::facet::cgroup::const_ptr pcg =
+              session_chroot->get_facet<chroot::facet::cgroup>();
+            if (pcg && session_chroot->get_run_setup_scripts())
+              pcg->attach();
+#endif // SCHROOT_FEATURE_CGROUP
+
+#ifdef SCHROOT_FEATURE_UNSHARE
+            if (pu && pu->get_unshare_child())
+              run_init(session_chroot);
+            else
+#endif // SCHROOT_FEATURE_UNSHARE
+              run_child(session_chroot);
           }
         catch (const std::runtime_error& e)
           {
@@ -1528,6 +2099,7 @@ namespace schroot
             log_error()
               << _("An unknown exception occurred") << std::endl;
           }
+        log_flush();
         _exit (EXIT_FAILURE);
       }
     else
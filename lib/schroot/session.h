@@ -85,8 +85,6 @@ namespace schroot
         CHROOT_UNLOCK,  ///< Failed to unlock chroot.
         COMMAND_ABS,    ///< Command must have an absolute path.
         EXEC,           ///< Failed to execute.
-        GROUP_GET_SUP,  ///< Failed to get supplementary groups.
-        GROUP_GET_SUPC, ///< Failed to get supplementary group count
         GROUP_SET,      ///< Failed to set group.
         GROUP_SET_SUP,  ///< Failed to set supplementary groups.
         GROUP_UNKNOWN,  ///< Group not found.
@@ -220,6 +218,27 @@ namespace schroot
     void
     set_preserve_environment (bool preserve_environment);
 
+    /**
+     * Check if sessions should be ended asynchronously.
+     *
+     * @returns true if ending asynchronously, otherwise false.
+     */
+    bool
+    get_async_end () const;
+
+    /**
+     * Set if sessions should be ended asynchronously.  An ending
+     * session is marked as ending in its session information, and
+     * its processes are killed and its filesystems unmounted as
+     * usual, but deleting its storage is deferred to a background
+     * reclaim process, so that the session ends quickly and its name
+     * may be reused at once.
+     *
+     * @param async_end true to end asynchronously, otherwise false.
+     */
+    void
+    set_async_end (bool async_end);
+
     /**
      * Get user-specified login shell.
      *
@@ -452,6 +471,29 @@ namespace schroot
     setup_chroot (chroot::chroot::ptr&       session_chroot,
                   chroot::chroot::setup_type setup_type);
 
+    /**
+     * Get the setup script environment variables which do not depend
+     * upon the chroot, setup type or process.  These are computed
+     * once, and reused for every chroot and setup stage.
+     *
+     * @returns the environment.
+     */
+    const environment&
+    get_setup_environment ();
+
+    /**
+     * Replenish the session pool of a clonable chroot.  The pool is
+     * filled (or trimmed) to its configured size by a detached
+     * background process, so that this method returns immediately.
+     * Only one process will refill a given pool at once.
+     *
+     * An error will be thrown on failure.
+     *
+     * @param source the clonable chroot providing the pool.
+     */
+    void
+    fill_pool (const chroot::chroot::ptr& source);
+
     /**
      * Run command or login shell in the specified chroot.
      *
@@ -472,6 +514,23 @@ namespace schroot
     void
     run_child (chroot::chroot::ptr& session_chroot);
 
+    /**
+     * Run a command or login shell as a child process in the
+     * specified chroot, after unsharing the namespaces which are
+     * private to the command.  If a PID or user namespace is
+     * unshared, the command is run in a further child process, and
+     * this process acts as its init process: it forwards signals to
+     * the command, reaps orphaned processes, and exits with the exit
+     * status of the command.  When the init process of a PID
+     * namespace exits, all the remaining processes in it are killed.
+     * This method is only ever to be run in a child process, and
+     * will never return.
+     *
+     * @param session_chroot the chroot to setup.
+     */
+    void
+    run_init (chroot::chroot::ptr& session_chroot);
+
     /**
      * Wait for a child process to complete, and check its exit status.
      *
@@ -580,10 +639,14 @@ namespace schroot
     std::string verbosity;
     /// Preserve environment?
     bool        preserve_environment;
+    /// End sessions asynchronously?
+    bool        async_end;
     /// Login shell.
     std::string shell;
     /// User-defined options.
     string_map  user_options;
+    /// Setup script environment common to all chroots and stages.
+    environment setup_environment;
 
   protected:
     /// Current working directory.
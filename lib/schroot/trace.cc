@@ -0,0 +1,343 @@
+/* Copyright © 2005-2013  Roger Leigh <rleigh@codelibre.net>
+ *
+ * schroot is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * schroot is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ *********************************************************************/
+
+#include <config.h>
+
+#include <schroot/log-sink.h>
+#include <schroot/trace.h>
+
+#include <atomic>
+#include <cerrno>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace schroot
+{
+
+  template<>
+  error<trace::error_code>::map_type
+  error<trace::error_code>::error_strings =
+    {
+      // TRANSLATORS: %1% = file
+      {trace::OPEN,         N_("Failed to open trace file ‘%1%’")},
+      // TRANSLATORS: %1% = file
+      {trace::FILE_CHANGED, N_("Trace file ‘%1%’ has been replaced")}
+    };
+
+  namespace
+  {
+
+    /// Tracing state for the process.
+    struct trace_state
+    {
+      /// The trace file descriptor, or -1 if not tracing.
+      int                   fd;
+      /// The trace file.
+      std::string           file;
+      /// The trace file device.
+      dev_t                 device;
+      /// The trace file inode.
+      ino_t                 inode;
+      /// The parent span of this process, from SCHROOT_TRACE_CONTEXT.
+      uint64_t              remote_parent;
+      /// The process which last wrote process metadata.
+      pid_t                 named;
+    };
+
+    /// The number of spans created.
+    std::atomic<uint32_t> span_count(0);
+
+    /// The IDs of the spans in progress on this thread.
+    thread_local std::vector<uint64_t> span_stack;
+
+    trace_state&
+    state ()
+    {
+      static trace_state trace_data{-1, std::string(), 0, 0, 0, 0};
+      return trace_data;
+    }
+
+    int64_t
+    now ()
+    {
+      struct timespec ts;
+      clock_gettime(CLOCK_MONOTONIC, &ts);
+      return static_cast<int64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+    }
+
+    /// Format a time in nanoseconds as microseconds.
+    std::string
+    microseconds (int64_t ns)
+    {
+      char buf[32];
+      snprintf(buf, sizeof(buf), "%" PRId64 ".%03" PRId64,
+               ns / 1000, ns % 1000);
+      return buf;
+    }
+
+    std::string
+    span_id (uint64_t id)
+    {
+      char buf[24];
+      snprintf(buf, sizeof(buf), "%" PRIx64, id);
+      return buf;
+    }
+
+    /**
+     * Write data in a single write.  Tracing is best effort, so a
+     * failed write is not an error.
+     */
+    void
+    write_data (int                fd,
+                const std::string& data)
+    {
+      while (write(fd, data.data(), data.size()) < 0 && errno == EINTR);
+    }
+
+    /**
+     * Write an event.  Each event is written with a single write to
+     * a file opened for appending, so that events from concurrent
+     * processes are not interleaved.
+     */
+    void
+    write_event (const std::string& event)
+    {
+      trace_state& trace_data(state());
+      pid_t pid = getpid();
+
+      std::string data;
+      if (trace_data.named != pid)
+        {
+          data += "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":";
+          data += std::to_string(pid);
+          data += ",\"tid\":";
+          data += std::to_string(pid);
+          data += ",\"args\":{\"name\":";
+          data += json_string(program_invocation_short_name);
+          data += "}},\n";
+          trace_data.named = pid;
+        }
+      data += event;
+
+      write_data(trace_data.fd, data);
+    }
+
+    void
+    opened (int                fd,
+            const std::string& file)
+    {
+      struct ::stat status;
+      if (fstat(fd, &status) < 0)
+        {
+          close(fd);
+          throw trace::error(file, trace::OPEN, strerror(errno));
+        }
+
+      trace_state& trace_data(state());
+      if (trace_data.fd >= 0)
+        close(trace_data.fd);
+      trace_data.fd = fd;
+      trace_data.file = file;
+      trace_data.device = status.st_dev;
+      trace_data.inode = status.st_ino;
+      trace_data.named = 0;
+
+      if (status.st_size == 0)
+        write_data(fd, "[\n");
+    }
+
+  }
+
+  trace::span::span (const std::string& name,
+                     const std::string& detail):
+    active(state().fd >= 0),
+    name(),
+    detail(),
+    id(0),
+    parent(0),
+    start(0)
+  {
+    if (!this->active)
+      return;
+
+    trace_state& trace_data(state());
+    this->name = name;
+    this->detail = detail;
+    this->id = (static_cast<uint64_t>(getpid()) << 32) | ++span_count;
+    this->parent = span_stack.empty() ?
+      trace_data.remote_parent : span_stack.back();
+    span_stack.push_back(this->id);
+    this->start = now();
+  }
+
+  trace::span::~span ()
+  {
+    if (!this->active)
+      return;
+
+    int64_t end = now();
+    trace_state& trace_data(state());
+    if (!span_stack.empty() && span_stack.back() == this->id)
+      span_stack.pop_back();
+    if (trace_data.fd < 0)
+      return;
+
+    pid_t pid = getpid();
+    std::string event("{\"name\":");
+    event += json_string(this->name);
+    event += ",\"cat\":\"schroot\",\"ph\":\"X\",\"ts\":";
+    event += microseconds(this->start);
+    event += ",\"dur\":";
+    event += microseconds(end - this->start);
+    event += ",\"pid\":";
+    event += std::to_string(pid);
+    event += ",\"tid\":";
+    event += std::to_string(pid);
+    event += ",\"args\":{\"id\":\"";
+    event += span_id(this->id);
+    event += '"';
+    if (this->parent)
+      {
+        event += ",\"parent\":\"";
+        event += span_id(this->parent);
+        event += '"';
+      }
+    if (!this->detail.empty())
+      {
+        event += ",\"detail\":";
+        event += json_string(this->detail);
+      }
+    event += "}},\n";
+
+    write_event(event);
+  }
+
+  void
+  trace::open (const std::string& file)
+  {
+    // Don't create or append to files as root on behalf of the user.
+    uid_t euid = geteuid();
+    gid_t egid = getegid();
+    bool setuid = getuid() != euid || getgid() != egid;
+    if (setuid)
+      {
+        if (setegid(getgid()) < 0 || seteuid(getuid()) < 0)
+          throw error(file, OPEN, strerror(errno));
+      }
+
+    int fd = ::open(file.c_str(),
+                    O_WRONLY|O_APPEND|O_CREAT|O_NOFOLLOW|O_NOCTTY|O_CLOEXEC,
+                    0644);
+    int open_errno = errno;
+
+    if (setuid)
+      {
+        if (seteuid(euid) < 0 || setegid(egid) < 0)
+          {
+            if (fd >= 0)
+              close(fd);
+            throw error(file, OPEN, strerror(errno));
+          }
+      }
+
+    if (fd < 0)
+      throw error(file, OPEN, strerror(open_errno));
+
+    opened(fd, file);
+  }
+
+  void
+  trace::open_environment ()
+  {
+    const char *file = getenv("SCHROOT_TRACE");
+    if (file == nullptr || *file == '\0')
+      return;
+
+    // The context can't be trusted from the user running a setuid
+    // program: the device and inode of any file are easily found,
+    // and the file is opened with the privileges of this process.
+    bool setuid = getuid() != geteuid() || getgid() != getegid();
+
+    const char *context = getenv("SCHROOT_TRACE_CONTEXT");
+    uintmax_t device, inode;
+    uint64_t parent;
+    if (setuid || context == nullptr ||
+        sscanf(context, "%" SCNuMAX ":%" SCNuMAX ":%" SCNx64,
+               &device, &inode, &parent) != 3)
+      {
+        open(file);
+        return;
+      }
+
+    // Continue the parent's trace.  The file must already exist, and
+    // must be the file the parent opened, since the parent may have
+    // opened it with fewer privileges than this process has.
+    int fd = ::open(file,
+                    O_WRONLY|O_APPEND|O_NOFOLLOW|O_NOCTTY|O_NONBLOCK|O_CLOEXEC);
+    if (fd < 0)
+      throw error(file, OPEN, strerror(errno));
+
+    struct ::stat status;
+    if (fstat(fd, &status) < 0 ||
+        !S_ISREG(status.st_mode) ||
+        status.st_dev != static_cast<dev_t>(device) ||
+        status.st_ino != static_cast<ino_t>(inode))
+      {
+        close(fd);
+        throw error(file, FILE_CHANGED);
+      }
+
+    opened(fd, file);
+    state().remote_parent = parent;
+  }
+
+  bool
+  trace::enabled ()
+  {
+    return state().fd >= 0;
+  }
+
+  void
+  trace::setup_env (environment& env)
+  {
+    const trace_state& trace_data(state());
+    if (trace_data.fd < 0)
+      return;
+
+    uint64_t parent = span_stack.empty() ?
+      trace_data.remote_parent : span_stack.back();
+
+    char context[64];
+    snprintf(context, sizeof(context), "%ju:%ju:%" PRIx64,
+             static_cast<uintmax_t>(trace_data.device),
+             static_cast<uintmax_t>(trace_data.inode),
+             parent);
+
+    env.add("SCHROOT_TRACE", trace_data.file);
+    env.add("SCHROOT_TRACE_CONTEXT", std::string(context));
+  }
+
+}
@@ -0,0 +1,148 @@
+/* Copyright © 2005-2013  Roger Leigh <rleigh@codelibre.net>
+ *
+ * schroot is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * schroot is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ *********************************************************************/
+
+#ifndef SCHROOT_TRACE_H
+#define SCHROOT_TRACE_H
+
+#include <schroot/custom-error.h>
+#include <schroot/environment.h>
+
+#include <cstdint>
+#include <string>
+
+namespace schroot
+{
+
+  /**
+   * Span tracing.
+   *
+   * When enabled, each span records the start time and duration of
+   * an operation, and is written as a Chrome trace event (a
+   * "complete" event) to the trace file, which may be loaded into
+   * chrome://tracing or Perfetto.  Spans nest within each thread,
+   * and helper programs run by the setup scripts append to the same
+   * file, recording the span which ran them as their parent, so that
+   * the whole of a session's setup may be seen on a single
+   * timeline.  When disabled, spans cost a single test.
+   */
+  class trace
+  {
+  public:
+    /// Error codes.
+    enum error_code
+      {
+        OPEN,        ///< Failed to open trace file.
+        FILE_CHANGED ///< Trace file has been replaced.
+      };
+
+    /// Exception type.
+    typedef custom_error<error_code> error;
+
+    /**
+     * A traced operation.  The span starts on construction and ends
+     * on destruction.
+     */
+    class span
+    {
+    public:
+      /**
+       * The constructor.
+       *
+       * @param name the name of the operation.
+       * @param detail the object of the operation, for example a
+       * file name.
+       */
+      span (const std::string& name,
+            const std::string& detail = std::string());
+
+      /// The destructor.
+      ~span ();
+
+      /// Not copyable.
+      span (const span& rhs) = delete;
+
+      /// Not copyable.
+      span&
+      operator = (const span& rhs) = delete;
+
+    private:
+      /// Is the span being recorded?
+      bool        active;
+      /// The name of the operation.
+      std::string name;
+      /// The object of the operation.
+      std::string detail;
+      /// The span ID.
+      uint64_t    id;
+      /// The parent span ID, or 0 if none.
+      uint64_t    parent;
+      /// The start time, in nanoseconds.
+      int64_t     start;
+    };
+
+    /**
+     * Enable tracing.  If the process is running setuid, the file
+     * is opened using the privileges of the real user.  If the file
+     * is empty, the opening bracket of the trace event array is
+     * written; the closing bracket is optional and is never written.
+     *
+     * @param file the trace file to append to.
+     */
+    static void
+    open (const std::string& file);
+
+    /**
+     * Enable tracing if SCHROOT_TRACE is set in the environment.  If
+     * SCHROOT_TRACE_CONTEXT is also set, the trace file must be the
+     * one the parent process opened, and the parent span is recorded
+     * as the parent of the spans in this process.  The context is
+     * only trusted if the process is not running setuid, as is the
+     * case for the setup scripts run by schroot; otherwise it is
+     * ignored, and the file is opened as by open().
+     */
+    static void
+    open_environment ();
+
+    /**
+     * Is tracing enabled?
+     *
+     * @returns true if enabled, otherwise false.
+     */
+    static bool
+    enabled ();
+
+    /**
+     * Add the trace file and context to an environment, so that
+     * child processes may continue the trace with the current span
+     * as their parent.  Nothing is added if tracing is not enabled.
+     *
+     * @param env the environment to add to.
+     */
+    static void
+    setup_env (environment& env);
+  };
+
+}
+
+#endif /* SCHROOT_TRACE_H */
+
+/*
+ * Local Variables:
+ * mode:C++
+ * End:
+ */
@@ -19,10 +19,13 @@
 #include <config.h>
 
 #include <schroot/error.h>
+#include <schroot/log.h>
 #include <schroot/util.h>
 
 #include <cerrno>
 #include <cstring>
+#include <fstream>
+#include <sstream>
 
 #include <sys/types.h>
 #include <sys/time.h>
@@ -234,6 +237,38 @@ namespace schroot
     return id.str();
   }
 
+  unsigned long long
+  process_start_time (pid_t pid)
+  {
+    std::ostringstream path;
+    path.imbue(std::locale::classic());
+    path << "/proc/" << pid << "/stat";
+
+    std::ifstream stat(path.str().c_str());
+    std::string line;
+    if (pid <= 0 || !std::getline(stat, line))
+      return 0;
+
+    // The command name may contain spaces and parentheses, so the
+    // fields are counted from the last parenthesis.  The start time
+    // is the 22nd field; the state following the command name is the
+    // 3rd.
+    std::string::size_type pos = line.rfind(')');
+    if (pos == std::string::npos)
+      return 0;
+
+    std::istringstream fields(line.substr(pos + 1));
+    fields.imbue(std::locale::classic());
+    std::string field;
+    for (int i = 3; i < 22 && fields >> field; ++i)
+      ;
+
+    unsigned long long start = 0;
+    if (!(fields >> start))
+      return 0;
+    return start;
+  }
+
   std::string
   string_list_to_string (const string_list& list,
                          const std::string& separator)
@@ -472,14 +507,13 @@ namespace schroot
         const environment& env)
   {
     char **argv = string_list_to_strv(command);
-    char **envp = env.get_strv();
+    environment::envp envp(env.get_envp());
     int status;
 
-    if ((status = execve(file.c_str(), argv, envp)) != 0)
-      {
-        strv_delete(argv);
-        strv_delete(envp);
-      }
+    log_flush();
+
+    if ((status = execve(file.c_str(), argv, envp.get())) != 0)
+      strv_delete(argv);
 
     return status;
   }
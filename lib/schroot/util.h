@@ -124,6 +124,18 @@ namespace schroot
   std::string
   unique_identifier ();
 
+  /**
+   * Get the start time of a process.  Together with the process ID,
+   * this uniquely identifies a process, even if its process ID is
+   * later reused.
+   *
+   * @param pid the process ID.
+   * @returns the start time in clock ticks after system boot, or 0
+   * if the process does not exist.
+   */
+  unsigned long long
+  process_start_time (pid_t pid);
+
   /**
    * Convert a string_list into a string.  The strings are
    * concatenated using separator as a delimiter.
@@ -0,0 +1,81 @@
+/* Copyright © 2005-2013  Roger Leigh <rleigh@codelibre.net>
+ *
+ * schroot is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * schroot is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ *********************************************************************/
+
+#ifndef LIBEXEC_COPYFILES_MAIN_H
+#define LIBEXEC_COPYFILES_MAIN_H
+
+#include <bin-common/main.h>
+
+#include <libexec/copyfiles/options.h>
+
+namespace bin
+{
+  /**
+   * schroot-copyfiles program components
+   */
+  namespace schroot_copyfiles
+  {
+
+    /**
+     * Frontend for schroot-copyfiles.  This class is used to "run"
+     * schroot-copyfiles.
+     */
+    class main : public bin::common::main
+    {
+    public:
+      /**
+       * The constructor.
+       *
+       * @param options the command-line options to use.
+       */
+      main (options::ptr& options);
+
+      /// The destructor.
+      virtual ~main ();
+
+    private:
+      /**
+       * Copy files.
+       */
+      virtual void
+      action_copyfiles ();
+
+    protected:
+      /**
+       * Run the program.
+       *
+       * @returns 0 on success, 1 on failure.
+       */
+      virtual int
+      run_impl ();
+
+    private:
+      /// The program options.
+      options::ptr opts;
+    };
+
+  }
+}
+
+#endif /* LIBEXEC_COPYFILES_MAIN_H */
+
+/*
+ * Local Variables:
+ * mode:C++
+ * End:
+ */
@@ -0,0 +1,78 @@
+/* Copyright © 2005-2013  Roger Leigh <rleigh@codelibre.net>
+ *
+ * schroot is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * schroot is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ *********************************************************************/
+
+#ifndef LIBEXEC_COPYFILES_OPTIONS_H
+#define LIBEXEC_COPYFILES_OPTIONS_H
+
+#include <bin-common/options.h>
+
+#include <string>
+
+namespace bin
+{
+  namespace schroot_copyfiles
+  {
+
+    /**
+     * schroot-copyfiles command-line options.
+     */
+    class options : public bin::common::options
+    {
+    public:
+      /// A shared_ptr to an options object.
+      typedef std::shared_ptr<options> ptr;
+
+      /// Copy files.
+      static const action_type ACTION_COPYFILES;
+
+      /// The constructor.
+      options ();
+
+      /// The destructor.
+      virtual ~options ();
+
+      /// The chroot root directory.
+      std::string root;
+
+      /// The file listing the files to copy.
+      std::string file;
+
+    protected:
+      virtual void
+      add_options ();
+
+      virtual void
+      add_option_groups ();
+
+      virtual void
+      check_options ();
+
+      /// File options group.
+      boost::program_options::options_description files;
+    };
+
+  }
+}
+
+#endif /* LIBEXEC_COPYFILES_OPTIONS_H */
+
+/*
+ * Local Variables:
+ * mode:C++
+ * End:
+ */
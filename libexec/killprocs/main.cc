@@ -0,0 +1,85 @@
+/* Copyright © 2005-2013  Roger Leigh <rleigh@codelibre.net>
+ *
+ * schroot is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * schroot is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ *********************************************************************/
+
+#include <config.h>
+
+#include <schroot/log.h>
+#include <schroot/reaper.h>
+
+#include <libexec/killprocs/main.h>
+
+#include <cassert>
+#include <cstdlib>
+#include <iostream>
+
+#include <boost/format.hpp>
+
+using std::endl;
+using boost::format;
+using schroot::_;
+
+namespace bin
+{
+  namespace schroot_killprocs
+  {
+
+    main::main (options::ptr& options):
+      bin::common::main("schroot-killprocs",
+                        // TRANSLATORS: '...' is an ellipsis e.g. U+2026,
+                        // and '-' is an em-dash.
+                        _("[OPTION…] — kill processes running in a chroot"),
+                        options,
+                        false),
+      opts(options)
+    {
+    }
+
+    main::~main ()
+    {
+    }
+
+    void
+    main::action_killprocs ()
+    {
+      schroot::reaper reaper(this->opts->root);
+      reaper.set_verbose(this->opts->verbose);
+
+      unsigned int count = reaper.kill(this->opts->timeout * 1000);
+
+      if (this->opts->verbose)
+        schroot::log_info()
+          << format(_("Killed %1% left-over processes")) % count << endl;
+    }
+
+    int
+    main::run_impl ()
+    {
+      if (this->opts->action == options::ACTION_HELP)
+        action_help(std::cerr);
+      else if (this->opts->action == options::ACTION_VERSION)
+        action_version(std::cerr);
+      else if (this->opts->action == options::ACTION_KILLPROCS)
+        action_killprocs();
+      else
+        assert(0); // Invalid action.
+
+      return EXIT_SUCCESS;
+    }
+
+  }
+}
@@ -0,0 +1,100 @@
+/* Copyright © 2005-2013  Roger Leigh <rleigh@codelibre.net>
+ *
+ * schroot is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * schroot is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ *********************************************************************/
+
+#include <config.h>
+
+#include <schroot/i18n.h>
+
+#include <libexec/killprocs/options.h>
+
+#include <cstdlib>
+#include <iostream>
+
+#include <boost/format.hpp>
+#include <boost/program_options.hpp>
+
+using std::endl;
+using boost::format;
+using schroot::_;
+namespace opt = boost::program_options;
+
+namespace bin
+{
+  namespace schroot_killprocs
+  {
+
+    const options::action_type options::ACTION_KILLPROCS ("killprocs");
+
+    options::options ():
+      bin::common::options(),
+      root(),
+      timeout(5),
+      process(_("Process"))
+    {
+    }
+
+    options::~options ()
+    {
+    }
+
+    void
+    options::add_options ()
+    {
+      // Chain up to add basic options.
+      bin::common::options::add_options();
+
+      action.add(ACTION_KILLPROCS);
+      action.set_default(ACTION_KILLPROCS);
+
+      process.add_options()
+        ("root,r", opt::value<std::string>(&this->root),
+         _("Chroot root directory (full path)"))
+        ("timeout,t", opt::value<unsigned int>(&this->timeout),
+         _("Seconds to wait for processes to exit before killing them"));
+    }
+
+    void
+    options::add_option_groups ()
+    {
+      // Chain up to add basic option groups.
+      bin::common::options::add_option_groups();
+
+#ifndef BOOST_PROGRAM_OPTIONS_DESCRIPTION_OLD
+      if (!process.options().empty())
+#else
+        if (!process.primary_keys().empty())
+#endif
+          {
+            visible.add(process);
+            global.add(process);
+          }
+    }
+
+    void
+    options::check_options ()
+    {
+      // Chain up to check basic options.
+      bin::common::options::check_options();
+
+      if (this->action == ACTION_KILLPROCS &&
+          this->root.empty())
+        throw error(_("No chroot root directory specified"));
+    }
+
+  }
+}
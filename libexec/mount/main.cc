@@ -19,6 +19,7 @@
 #include <config.h>
 
 #include <schroot/mntstream.h>
+#include <schroot/trace.h>
 #include <schroot/util.h>
 
 #include <libexec/mount/main.h>
@@ -154,6 +155,7 @@ namespace bin
       while (mounts >> entry)
         {
           std::string directory = resolve_path(entry.directory);
+          schroot::trace::span span("mount", directory);
 
           if (!boost::filesystem::exists(directory))
             {
@@ -0,0 +1,79 @@
+/* Copyright © 2005-2013  Roger Leigh <rleigh@codelibre.net>
+ *
+ * schroot is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * schroot is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ *********************************************************************/
+
+#include <config.h>
+
+#include <schroot/nss-snapshot.h>
+
+#include <libexec/nssdatabases/main.h>
+
+#include <cassert>
+#include <cstdlib>
+#include <iostream>
+
+
+using schroot::_;
+
+namespace bin
+{
+  namespace schroot_nssdatabases
+  {
+
+    main::main (options::ptr& options):
+      bin::common::main("schroot-nssdatabases",
+                        // TRANSLATORS: '...' is an ellipsis e.g. U+2026,
+                        // and '-' is an em-dash.
+                        _("[OPTION…] — copy NSS databases into a chroot"),
+                        options,
+                        false),
+      opts(options)
+    {
+    }
+
+    main::~main ()
+    {
+    }
+
+    void
+    main::action_nssdatabases ()
+    {
+      schroot::nss_snapshot snapshot;
+      snapshot.set_ttl(this->opts->ttl);
+      snapshot.set_verbose(this->opts->verbose);
+
+      snapshot.install_list(this->opts->file, this->opts->root,
+                            this->opts->bind);
+    }
+
+    int
+    main::run_impl ()
+    {
+      if (this->opts->action == options::ACTION_HELP)
+        action_help(std::cerr);
+      else if (this->opts->action == options::ACTION_VERSION)
+        action_version(std::cerr);
+      else if (this->opts->action == options::ACTION_NSSDATABASES)
+        action_nssdatabases();
+      else
+        assert(0); // Invalid action.
+
+      return EXIT_SUCCESS;
+    }
+
+  }
+}
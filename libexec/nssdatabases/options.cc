@@ -0,0 +1,113 @@
+/* Copyright © 2005-2013  Roger Leigh <rleigh@codelibre.net>
+ *
+ * schroot is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * schroot is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ *********************************************************************/
+
+#include <config.h>
+
+#include <schroot/i18n.h>
+
+#include <libexec/nssdatabases/options.h>
+
+#include <cstdlib>
+#include <iostream>
+
+#include <boost/format.hpp>
+#include <boost/program_options.hpp>
+
+using std::endl;
+using boost::format;
+using schroot::_;
+namespace opt = boost::program_options;
+
+namespace bin
+{
+  namespace schroot_nssdatabases
+  {
+
+    const options::action_type options::ACTION_NSSDATABASES ("nssdatabases");
+
+    options::options ():
+      bin::common::options(),
+      root(),
+      file(),
+      ttl(600),
+      bind(false),
+      database(_("Database"))
+    {
+    }
+
+    options::~options ()
+    {
+    }
+
+    void
+    options::add_options ()
+    {
+      // Chain up to add basic options.
+      bin::common::options::add_options();
+
+      action.add(ACTION_NSSDATABASES);
+      action.set_default(ACTION_NSSDATABASES);
+
+      database.add_options()
+        ("root,r", opt::value<std::string>(&this->root),
+         _("Chroot root directory (full path)"))
+        ("file,f", opt::value<std::string>(&this->file),
+         _("File listing the databases to install"))
+        ("ttl,t", opt::value<unsigned int>(&this->ttl),
+         _("Seconds to reuse a database snapshot for"))
+        ("bind,b",
+         _("Bind mount snapshots read-only rather than copying them"));
+    }
+
+    void
+    options::add_option_groups ()
+    {
+      // Chain up to add basic option groups.
+      bin::common::options::add_option_groups();
+
+#ifndef BOOST_PROGRAM_OPTIONS_DESCRIPTION_OLD
+      if (!database.options().empty())
+#else
+        if (!database.primary_keys().empty())
+#endif
+          {
+            visible.add(database);
+            global.add(database);
+          }
+    }
+
+    void
+    options::check_options ()
+    {
+      // Chain up to check basic options.
+      bin::common::options::check_options();
+
+      if (vm.count("bind"))
+        this->bind = true;
+
+      if (this->action == ACTION_NSSDATABASES &&
+          this->root.empty())
+        throw error(_("No chroot root directory specified"));
+
+      if (this->action == ACTION_NSSDATABASES &&
+          this->file.empty())
+        throw error(_("No file list specified"));
+    }
+
+  }
+}
@@ -0,0 +1,84 @@
+/* Copyright © 2005-2013  Roger Leigh <rleigh@codelibre.net>
+ *
+ * schroot is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * schroot is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ *********************************************************************/
+
+#ifndef LIBEXEC_NSSDATABASES_OPTIONS_H
+#define LIBEXEC_NSSDATABASES_OPTIONS_H
+
+#include <bin-common/options.h>
+
+#include <string>
+
+namespace bin
+{
+  namespace schroot_nssdatabases
+  {
+
+    /**
+     * schroot-nssdatabases command-line options.
+     */
+    class options : public bin::common::options
+    {
+    public:
+      /// A shared_ptr to an options object.
+      typedef std::shared_ptr<options> ptr;
+
+      /// Install NSS databases.
+      static const action_type ACTION_NSSDATABASES;
+
+      /// The constructor.
+      options ();
+
+      /// The destructor.
+      virtual ~options ();
+
+      /// The chroot root directory.
+      std::string root;
+
+      /// The file listing the databases to install.
+      std::string file;
+
+      /// The snapshot time to live, in seconds.
+      unsigned int ttl;
+
+      /// Bind mount snapshots rather than copying them.
+      bool bind;
+
+    protected:
+      virtual void
+      add_options ();
+
+      virtual void
+      add_option_groups ();
+
+      virtual void
+      check_options ();
+
+      /// Database options group.
+      boost::program_options::options_description database;
+    };
+
+  }
+}
+
+#endif /* LIBEXEC_NSSDATABASES_OPTIONS_H */
+
+/*
+ * Local Variables:
+ * mode:C++
+ * End:
+ */
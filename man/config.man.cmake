@@ -6,6 +6,12 @@
 .ds SCHROOT_FILE_UNPACK_DIR ${SCHROOT_FILE_UNPACK_DIR}
 .ds SCHROOT_OVERLAY_DIR ${SCHROOT_OVERLAY_DIR}
 .ds SCHROOT_UNDERLAY_DIR ${SCHROOT_UNDERLAY_DIR}
+.ds SCHROOT_RECLAIM_DIR ${SCHROOT_RECLAIM_DIR}
+.ds SCHROOT_POOL_DIR ${SCHROOT_POOL_DIR}
+.ds SCHROOT_LEASE_DIR ${SCHROOT_LEASE_DIR}
+.ds SCHROOT_COPYFILES_DIR ${SCHROOT_COPYFILES_DIR}
+.ds SCHROOT_NSS_DIR ${SCHROOT_NSS_DIR}
+.ds SCHROOT_METRICS_DIR ${SCHROOT_METRICS_DIR}
 .ds SCHROOT_SYSCONF_DIR ${SCHROOT_SYSCONF_DIR}
 .ds SCHROOT_CONF ${SCHROOT_CONF}
 .ds SCHROOT_CONF_CHROOT_D ${SCHROOT_CONF_CHROOT_D}
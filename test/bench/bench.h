@@ -0,0 +1,85 @@
+/* Copyright © 2006-2013  Roger Leigh <rleigh@codelibre.net>
+ *
+ * schroot is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * schroot is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ *********************************************************************/
+
+
+#ifndef TEST_BENCH_BENCH_H
+#define TEST_BENCH_BENCH_H
+
+#include <cstdlib>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+
+#include <sys/stat.h>
+
+#include <boost/filesystem/operations.hpp>
+
+/**
+ * A temporary directory for synthetic benchmark data, which is
+ * removed along with its contents on destruction.
+ */
+class bench_directory
+{
+public:
+  bench_directory ():
+    path()
+  {
+    char name[] = "/tmp/schroot-bench-XXXXXX";
+    if (mkdtemp(name) == 0)
+      throw std::runtime_error("Failed to create benchmark directory");
+    path = name;
+  }
+
+  ~bench_directory ()
+  {
+    boost::filesystem::remove_all(path);
+  }
+
+  /**
+   * Write a file in the directory.
+   *
+   * @param name the name of the file.
+   * @param contents the contents of the file.
+   * @param mode the permissions of the file.
+   * @returns the path of the file.
+   */
+  std::string
+  write (const std::string& name,
+         const std::string& contents,
+         mode_t             mode = 0644)
+  {
+    std::string file(path + '/' + name);
+    std::ofstream output(file.c_str());
+    output << contents;
+    output.close();
+    if (!output || chmod(file.c_str(), mode) != 0)
+      throw std::runtime_error("Failed to write " + file);
+    return file;
+  }
+
+  /// The directory path.
+  std::string path;
+};
+
+#endif /* TEST_BENCH_BENCH_H */
+
+/*
+ * Local Variables:
+ * mode:C++
+ * End:
+ */
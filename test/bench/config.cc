@@ -0,0 +1,128 @@
+/* Copyright © 2006-2013  Roger Leigh <rleigh@codelibre.net>
+ *
+ * schroot is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * schroot is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ *********************************************************************/
+
+
+#include <benchmark/benchmark.h>
+
+#include <schroot/chroot/config.h>
+
+#include <sstream>
+
+#include "bench.h"
+
+namespace
+{
+
+  /**
+   * Create a synthetic chroot configuration.
+   *
+   * @param chroots the number of chroots.
+   * @returns the configuration file contents.
+   */
+  std::string
+  synthetic_config (int chroots)
+  {
+    std::ostringstream data;
+    for (int i = 0; i < chroots; ++i)
+      {
+        data << "[chroot" << i << "]\n"
+             << "description=Synthetic chroot " << i << '\n'
+             << "type=directory\n"
+             << "directory=/srv/chroot/chroot" << i << '\n'
+             << "users=root\n"
+             << "aliases=alias" << i << '\n'
+             << "profile=default\n\n";
+      }
+    return data.str();
+  }
+
+  /**
+   * Get a list of chroot names and aliases spread across a
+   * configuration.
+   *
+   * @param chroots the number of chroots in the configuration.
+   * @param count the number of names.
+   * @returns the names.
+   */
+  schroot::string_list
+  synthetic_names (int chroots,
+                   int count)
+  {
+    schroot::string_list names;
+    for (int i = 0; i < count; ++i)
+      {
+        std::ostringstream name;
+        int n = (i * 7919) % chroots;
+        if (i % 2)
+          name << "alias" << n;
+        else
+          name << "chroot:chroot" << n;
+        names.push_back(name.str());
+      }
+    return names;
+  }
+
+}
+
+static void
+BM_ConfigLoad (benchmark::State& state)
+{
+  bench_directory dir;
+  std::string file(dir.write("schroot.conf", synthetic_config(state.range(0))));
+
+  for (auto _ : state)
+    {
+      schroot::chroot::config config("chroot", file);
+      benchmark::DoNotOptimize(config);
+    }
+
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_ConfigLoad)->Arg(10)->Arg(1000)->Arg(10000)
+  ->Unit(benchmark::kMillisecond);
+
+static void
+BM_ConfigValidateChroots (benchmark::State& state)
+{
+  bench_directory dir;
+  std::string file(dir.write("schroot.conf", synthetic_config(state.range(0))));
+  schroot::chroot::config config("chroot", file);
+  schroot::string_list names(synthetic_names(state.range(0), 100));
+
+  for (auto _ : state)
+    benchmark::DoNotOptimize(config.validate_chroots("chroot", names));
+
+  state.SetItemsProcessed(state.iterations() * names.size());
+}
+BENCHMARK(BM_ConfigValidateChroots)->Arg(10)->Arg(1000)->Arg(10000);
+
+static void
+BM_ConfigFindAlias (benchmark::State& state)
+{
+  bench_directory dir;
+  std::string file(dir.write("schroot.conf", synthetic_config(state.range(0))));
+  schroot::chroot::config config("chroot", file);
+  schroot::string_list names(synthetic_names(state.range(0), 100));
+
+  for (auto _ : state)
+    for (const auto& name : names)
+      benchmark::DoNotOptimize(config.find_alias("chroot", name));
+
+  state.SetItemsProcessed(state.iterations() * names.size());
+}
+BENCHMARK(BM_ConfigFindAlias)->Arg(10)->Arg(1000)->Arg(10000);
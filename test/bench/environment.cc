@@ -0,0 +1,129 @@
+/* Copyright © 2006-2013  Roger Leigh <rleigh@codelibre.net>
+ *
+ * schroot is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * schroot is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ *********************************************************************/
+
+
+#include <benchmark/benchmark.h>
+
+#include <schroot/config.h>
+#include <schroot/environment.h>
+#include <schroot/regex.h>
+#include <schroot/util.h>
+
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace
+{
+
+  /**
+   * A synthetic process environment.
+   */
+  class synthetic_environ
+  {
+  public:
+    /**
+     * The constructor.
+     *
+     * @param count the number of variables.
+     */
+    synthetic_environ (int count):
+      strings(),
+      strv()
+    {
+      for (int i = 0; i < count; ++i)
+        {
+          std::ostringstream var;
+          // Include some variables removed by the default filter.
+          if (i % 10 == 0)
+            var << "LD_VAR" << i << "=/usr/lib/var" << i;
+          else
+            var << "VARIABLE" << i << "=value of variable " << i;
+          strings.push_back(var.str());
+        }
+      for (auto& str : strings)
+        strv.push_back(&str[0]);
+      strv.push_back(nullptr);
+    }
+
+    /// Get the environment as a string vector.
+    char **
+    get ()
+    {
+      return &strv[0];
+    }
+
+  private:
+    /// The "name=value" strings.
+    std::vector<std::string> strings;
+    /// Pointers to the strings.
+    std::vector<char *>      strv;
+  };
+
+}
+
+static void
+BM_EnvironmentBuild (benchmark::State& state)
+{
+  synthetic_environ env(state.range(0));
+  schroot::regex filter(SCHROOT_DEFAULT_ENVIRONMENT_FILTER);
+
+  for (auto _ : state)
+    {
+      schroot::environment e;
+      e.set_filter(filter);
+      e.add(env.get());
+      benchmark::DoNotOptimize(e);
+    }
+
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_EnvironmentBuild)->Arg(10)->Arg(100)->Arg(1000);
+
+static void
+BM_EnvironmentGetStrv (benchmark::State& state)
+{
+  synthetic_environ env(state.range(0));
+  schroot::environment e(env.get());
+
+  for (auto _ : state)
+    {
+      char **strv = e.get_strv();
+      benchmark::DoNotOptimize(strv);
+      schroot::strv_delete(strv);
+    }
+
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_EnvironmentGetStrv)->Arg(10)->Arg(100)->Arg(1000);
+
+static void
+BM_EnvironmentGetEnvp (benchmark::State& state)
+{
+  synthetic_environ env(state.range(0));
+  schroot::environment e(env.get());
+
+  for (auto _ : state)
+    {
+      schroot::environment::envp envp(e.get_envp());
+      benchmark::DoNotOptimize(envp.get());
+    }
+
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_EnvironmentGetEnvp)->Arg(10)->Arg(100)->Arg(1000);
@@ -0,0 +1,80 @@
+/* Copyright © 2006-2013  Roger Leigh <rleigh@codelibre.net>
+ *
+ * schroot is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * schroot is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ *********************************************************************/
+
+
+#include <benchmark/benchmark.h>
+
+#include <schroot/keyfile.h>
+#include <schroot/keyfile-reader.h>
+
+#include <sstream>
+
+#include "bench.h"
+
+namespace
+{
+
+  /**
+   * Create a synthetic keyfile, similar to a large schroot.conf.
+   *
+   * @param groups the number of groups.
+   * @returns the keyfile contents.
+   */
+  std::string
+  synthetic_keyfile (int groups)
+  {
+    std::ostringstream data;
+    data << "# Synthetic keyfile\n\n";
+    for (int i = 0; i < groups; ++i)
+      {
+        data << "# Group " << i << '\n'
+             << "[group" << i << "]\n"
+             << "description=Synthetic group " << i << '\n'
+             << "description[fr]=Groupe synthétique " << i << '\n'
+             << "type=directory\n"
+             << "directory=/srv/chroot/group" << i << '\n'
+             << "users=user1,user2,user3\n"
+             << "groups=sbuild\n"
+             << "root-groups=root,sbuild\n"
+             << "aliases=alias" << i << ",other" << i << '\n'
+             << "profile=sbuild\n"
+             << "personality=linux\n"
+             << "preserve-environment=false\n\n";
+      }
+    return data.str();
+  }
+
+}
+
+static void
+BM_KeyfileReader (benchmark::State& state)
+{
+  bench_directory dir;
+  std::string file(dir.write("keyfile", synthetic_keyfile(state.range(0))));
+
+  for (auto _ : state)
+    {
+      schroot::keyfile kf;
+      schroot::keyfile_reader(kf, file);
+      benchmark::DoNotOptimize(kf);
+    }
+
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_KeyfileReader)->Arg(10)->Arg(1000)->Arg(10000)
+  ->Unit(benchmark::kMillisecond);
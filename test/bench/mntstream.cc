@@ -0,0 +1,104 @@
+/* Copyright © 2006-2013  Roger Leigh <rleigh@codelibre.net>
+ *
+ * schroot is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * schroot is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ *********************************************************************/
+
+
+#include <benchmark/benchmark.h>
+
+#include <schroot/mntstream.h>
+
+#include <sstream>
+
+#include "bench.h"
+
+namespace
+{
+
+  /**
+   * Create a synthetic mount table, similar to that of a host with
+   * many active sessions.
+   *
+   * @param mounts the number of mounts.
+   * @returns the mount table contents.
+   */
+  std::string
+  synthetic_mounts (int mounts)
+  {
+    std::ostringstream data;
+    data << "/dev/sda1 / ext4 rw,relatime,errors=remount-ro 0 0\n";
+    for (int i = 1; i < mounts; ++i)
+      {
+        int session = i / 8;
+        std::string base("/var/lib/schroot/mount/session" +
+                         std::to_string(session));
+        switch (i % 8)
+          {
+          case 0:
+            data << "overlay " << base
+                 << " overlay rw,relatime,lowerdir=/srv/chroot/sid,"
+                 << "upperdir=/var/lib/schroot/union/overlay/session" << session
+                 << "/upper,workdir=/var/lib/schroot/union/overlay/session"
+                 << session << "/work 0 0\n";
+            break;
+          case 1:
+            data << "proc " << base << "/proc proc rw,nosuid,nodev,noexec,relatime 0 0\n";
+            break;
+          case 2:
+            data << "sysfs " << base << "/sys sysfs rw,nosuid,nodev,noexec,relatime 0 0\n";
+            break;
+          case 3:
+            data << "udev " << base << "/dev devtmpfs rw,nosuid,relatime,size=8192k,mode=755 0 0\n";
+            break;
+          case 4:
+            data << "devpts " << base << "/dev/pts devpts rw,nosuid,noexec,relatime,gid=5,mode=620 0 0\n";
+            break;
+          case 5:
+            data << "/dev/sda1 " << base << "/home ext4 rw,relatime,errors=remount-ro 0 0\n";
+            break;
+          case 6:
+            data << "tmpfs " << base << "/dev/shm tmpfs rw,nosuid,nodev 0 0\n";
+            break;
+          default:
+            data << "/dev/sda1 " << base << "/build\\040dir ext4 rw,relatime 0 0\n";
+            break;
+          }
+      }
+    return data.str();
+  }
+
+}
+
+static void
+BM_MntstreamParse (benchmark::State& state)
+{
+  bench_directory dir;
+  std::string file(dir.write("mounts", synthetic_mounts(state.range(0))));
+
+  for (auto _ : state)
+    {
+      schroot::mntstream mounts(file);
+      schroot::mntstream::mntentry entry;
+      int count = 0;
+      while (mounts >> entry)
+        ++count;
+      benchmark::DoNotOptimize(count);
+    }
+
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_MntstreamParse)->Arg(100)->Arg(10000)
+  ->Unit(benchmark::kMicrosecond);
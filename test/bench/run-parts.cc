@@ -0,0 +1,57 @@
+/* Copyright © 2006-2013  Roger Leigh <rleigh@codelibre.net>
+ *
+ * schroot is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * schroot is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ *********************************************************************/
+
+
+#include <benchmark/benchmark.h>
+
+#include <schroot/environment.h>
+#include <schroot/run-parts.h>
+
+#include <cstdlib>
+#include <cstdio>
+
+#include "bench.h"
+
+extern char **environ;
+
+static void
+BM_RunPartsSpawn (benchmark::State& state)
+{
+  bench_directory dir;
+  for (int i = 0; i < state.range(0); ++i)
+    {
+      char name[16];
+      snprintf(name, sizeof(name), "%02dnoop", i);
+      dir.write(name, "#!/bin/sh\nexit 0\n", 0755);
+    }
+
+  schroot::run_parts rp(dir.path);
+  schroot::string_list command;
+  command.push_back("setup-start");
+  schroot::environment env(environ);
+
+  for (auto _ : state)
+    {
+      if (rp.run(command, env) != EXIT_SUCCESS)
+        state.SkipWithError("Script failed");
+    }
+
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_RunPartsSpawn)->Arg(1)->Arg(10)
+  ->Unit(benchmark::kMillisecond);
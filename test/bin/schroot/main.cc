@@ -0,0 +1,240 @@
+/* Copyright © 2006-2013  Roger Leigh <rleigh@codelibre.net>
+ *
+ * schroot is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * schroot is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ *********************************************************************/
+
+#include <gtest/gtest.h>
+
+#include <boost/filesystem.hpp>
+
+#include <bin/schroot/main.h>
+#include <bin/schroot/options.h>
+
+#include <fstream>
+#include <string>
+#include <vector>
+
+using bin::schroot::options;
+
+namespace
+{
+
+  /// Expose the configuration loading of the schroot frontend.
+  class test_main : public bin::schroot::main
+  {
+  public:
+    test_main (options::ptr& options):
+      bin::schroot::main(options)
+    {
+      this->config =
+        ::schroot::chroot::config::ptr(new ::schroot::chroot::config);
+    }
+
+    using bin::schroot::main::load_config;
+    using bin::schroot::main::load_session_config;
+    using bin::schroot::main::config;
+  };
+
+}
+
+class SchrootMain : public ::testing::Test
+{
+public:
+  std::string sessions;
+
+  void SetUp()
+  {
+    sessions = (boost::filesystem::temp_directory_path() /
+                boost::filesystem::unique_path("schroot-main-%%%%-%%%%")).string();
+    ASSERT_TRUE(boost::filesystem::create_directory(sessions));
+
+    add_session("sid-1234");
+    add_session("sid-5678");
+  }
+
+  void TearDown()
+  {
+    boost::filesystem::remove_all(sessions);
+  }
+
+  void
+  add_session (const std::string& name)
+  {
+    std::ofstream(sessions + '/' + name)
+      << '[' << name << "]\n"
+      << "type=directory\n"
+      << "directory=/srv/chroot/sid\n"
+      << "mount-location=/run/schroot/mount/" << name << '\n'
+      << "original-name=sid\n"
+      << "selected-name=sid\n";
+  }
+
+  // Parse a command line, as for schroot.
+  options::ptr
+  parse (std::vector<std::string> args)
+  {
+    args.insert(args.begin(), "schroot");
+    std::vector<char *> argv;
+    for (auto& arg : args)
+      argv.push_back(&arg[0]);
+
+    options::ptr opts(new options);
+    opts->parse(argv.size(), &argv[0]);
+    return opts;
+  }
+
+  // Load the configuration for a single session, if possible.
+  bool
+  load_session (const options::ptr& opts,
+                ::schroot::string_list& loaded)
+  {
+    options::ptr o(opts);
+    test_main frontend(o);
+    frontend.set_session_directory(sessions);
+    bool ret = frontend.load_session_config();
+    loaded = frontend.config->get_chroot_list("session");
+    return ret;
+  }
+};
+
+TEST_F(SchrootMain, LoadSession)
+{
+  ::schroot::string_list loaded;
+  ASSERT_TRUE(load_session(parse({"--run-session", "-c", "sid-1234"}),
+                           loaded));
+  ASSERT_EQ(loaded, ::schroot::string_list({"session:sid-1234"}));
+}
+
+TEST_F(SchrootMain, LoadSessionNamespace)
+{
+  ::schroot::string_list loaded;
+  ASSERT_TRUE(load_session(parse({"--end-session", "-c", "session:sid-5678"}),
+                           loaded));
+  ASSERT_EQ(loaded, ::schroot::string_list({"session:sid-5678"}));
+}
+
+TEST_F(SchrootMain, LoadSessionRecover)
+{
+  ::schroot::string_list loaded;
+  ASSERT_TRUE(load_session(parse({"--recover-session", "-c", "sid-1234"}),
+                           loaded));
+  ASSERT_EQ(loaded.size(), 1U);
+}
+
+TEST_F(SchrootMain, LoadConfigSession)
+{
+  options::ptr opts(parse({"--run-session", "-c", "sid-1234"}));
+  test_main frontend(opts);
+  frontend.set_session_directory(sessions);
+  frontend.load_config();
+
+  // Chroot definitions are not loaded.
+  ASSERT_FALSE(opts->load_chroots);
+  ASSERT_TRUE(frontend.config->get_chroot_list("chroot").empty());
+  ASSERT_EQ(frontend.config->get_chroot_list("session"),
+            ::schroot::string_list({"session:sid-1234"}));
+}
+
+TEST_F(SchrootMain, FallbackNoSessionFile)
+{
+  // An alias or plain chroot has no session file.
+  ::schroot::string_list loaded;
+  ASSERT_FALSE(load_session(parse({"--run-session", "-c", "unstable"}),
+                            loaded));
+  ASSERT_TRUE(loaded.empty());
+  ASSERT_FALSE(load_session(parse({"--run-session", "-c", "session:sid"}),
+                            loaded));
+  ASSERT_TRUE(loaded.empty());
+}
+
+TEST_F(SchrootMain, FallbackDirectory)
+{
+  // Only regular files are session files.
+  ASSERT_TRUE(boost::filesystem::create_directory(sessions + "/sid-dir"));
+
+  ::schroot::string_list loaded;
+  ASSERT_FALSE(load_session(parse({"--run-session", "-c", "sid-dir"}),
+                            loaded));
+  ASSERT_TRUE(loaded.empty());
+}
+
+TEST_F(SchrootMain, FallbackNamespace)
+{
+  // Names in other namespaces use the full configuration, even if a
+  // session of the same name exists.
+  ::schroot::string_list loaded;
+  ASSERT_FALSE(load_session(parse({"--run-session", "-c", "chroot:sid-1234"}),
+                            loaded));
+  ASSERT_TRUE(loaded.empty());
+  ASSERT_FALSE(load_session(parse({"--run-session", "-c", "source:sid-1234"}),
+                            loaded));
+  ASSERT_TRUE(loaded.empty());
+}
+
+TEST_F(SchrootMain, FallbackInvalidName)
+{
+  // Names which could not be a session file are never looked up.
+  add_session(".hidden");
+  add_session("sid-1234.dpkg-old");
+
+  ::schroot::string_list loaded;
+  ASSERT_FALSE(load_session(parse({"--run-session", "-c", ".hidden"}),
+                            loaded));
+  ASSERT_TRUE(loaded.empty());
+  ASSERT_FALSE(load_session(parse({"--run-session", "-c", "sid-1234.dpkg-old"}),
+                            loaded));
+  ASSERT_TRUE(loaded.empty());
+  ASSERT_FALSE(load_session(parse({"--run-session", "-c", "../sid-1234"}),
+                            loaded));
+  ASSERT_TRUE(loaded.empty());
+}
+
+TEST_F(SchrootMain, FallbackAllSessions)
+{
+  ::schroot::string_list loaded;
+  ASSERT_FALSE(load_session(parse({"--end-session", "--all-sessions"}),
+                            loaded));
+  ASSERT_TRUE(loaded.empty());
+
+  // --all-sessions with a single session uses the full configuration.
+  options::ptr opts(parse({"--end-session", "-c", "sid-1234"}));
+  opts->all_sessions = true;
+  ASSERT_FALSE(load_session(opts, loaded));
+  ASSERT_TRUE(loaded.empty());
+}
+
+TEST_F(SchrootMain, FallbackMultipleSessions)
+{
+  ::schroot::string_list loaded;
+  ASSERT_FALSE(load_session(parse({"--end-session",
+                                   "-c", "sid-1234", "-c", "sid-5678"}),
+                            loaded));
+  ASSERT_TRUE(loaded.empty());
+}
+
+TEST_F(SchrootMain, FallbackOtherActions)
+{
+  // Only operations on existing sessions use a single session file.
+  ::schroot::string_list loaded;
+  ASSERT_FALSE(load_session(parse({"--begin-session", "-c", "sid-1234"}),
+                            loaded));
+  ASSERT_TRUE(loaded.empty());
+  ASSERT_FALSE(load_session(parse({"--info", "-c", "sid-1234"}),
+                            loaded));
+  ASSERT_TRUE(loaded.empty());
+  ASSERT_FALSE(load_session(parse({"-c", "sid-1234"}), loaded));
+  ASSERT_TRUE(loaded.empty());
+}
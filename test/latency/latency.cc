@@ -0,0 +1,546 @@
+/* Copyright © 2006-2013  Roger Leigh <rleigh@codelibre.net>
+ *
+ * schroot is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * schroot is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ *********************************************************************/
+
+/*
+ * Rootless session latency harness.
+ *
+ * A throwaway directory chroot is created, and configured in the
+ * sysconfdir of a schroot installed in a private prefix.  Full
+ * begin/run/end session cycles are then run, using the real setup.d
+ * scripts, inside an unprivileged user and mount namespace, and the
+ * latency percentiles of each operation are reported.
+ */
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sched.h>
+#include <sys/mount.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <boost/filesystem.hpp>
+#include <boost/program_options.hpp>
+
+namespace fs = boost::filesystem;
+namespace opt = boost::program_options;
+
+namespace
+{
+
+  /// Timed session operations.
+  enum operation
+    {
+      BEGIN,          ///< Begin a session.
+      RUN,            ///< Run a command in a session.
+      END,            ///< End a session.
+      OPERATION_COUNT ///< Number of operations.
+    };
+
+  /// Operation names.
+  const char *operation_names[OPERATION_COUNT] =
+    { "begin", "run", "end" };
+
+  /// The chroot and profile name used by the harness.
+  const char *chroot_name = "latency";
+
+  /**
+   * Host directories made available inside the chroot.  Symbolic
+   * links (as on merged-/usr systems) are copied, and directories
+   * are bind mounted by the setup scripts.
+   */
+  const char *host_directories[] =
+    { "bin", "lib", "lib32", "lib64", "libx32", "sbin", "usr" };
+
+  /// Harness settings.
+  struct settings
+  {
+    /// The schroot installation prefix.
+    fs::path                 prefix;
+    /// The schroot executable.
+    fs::path                 schroot;
+    /// Session cycles run by each concurrent session.
+    unsigned int             iterations;
+    /// Number of concurrent sessions.
+    unsigned int             sessions;
+    /// The command to run in each session.
+    std::vector<std::string> command;
+  };
+
+  /// Operation timings, in milliseconds.
+  struct results
+  {
+    /// Timings of each operation.
+    std::vector<double> times[OPERATION_COUNT];
+    /// Failures of each operation.
+    unsigned int        failures[OPERATION_COUNT] = { 0, 0, 0 };
+  };
+
+  /**
+   * Write a string to a file.
+   *
+   * @param file the file to write.
+   * @param contents the contents to write.
+   * @returns true on success, or false on failure, with errno set.
+   */
+  bool
+  write_file (const std::string& file,
+              const std::string& contents)
+  {
+    int fd = open(file.c_str(), O_WRONLY|O_CLOEXEC);
+    if (fd < 0)
+      return false;
+    bool ok = write(fd, contents.c_str(), contents.size()) ==
+      static_cast<ssize_t>(contents.size());
+    int saved_errno = errno;
+    close(fd);
+    errno = saved_errno;
+    return ok;
+  }
+
+  /**
+   * Create the chroot directory.  It contains only empty directories
+   * and symbolic links, and the host directories are bind mounted
+   * over it by the setup scripts, so it may be removed safely from
+   * outside the mount namespace.
+   *
+   * @param root the chroot directory.
+   * @param fstab the fstab to add bind mounts to.
+   */
+  void
+  create_chroot (const fs::path& root,
+                 std::ostream&   fstab)
+  {
+    fs::create_directory(root);
+    for (const char *dir : { "dev", "etc", "proc", "tmp" })
+      fs::create_directory(root / dir);
+
+    for (const char *dir : host_directories)
+      {
+        fs::path host(fs::path("/") / dir);
+        fs::file_status status(fs::symlink_status(host));
+        if (fs::is_symlink(status))
+          fs::create_symlink(fs::read_symlink(host), root / dir);
+        else if (fs::is_directory(status))
+          {
+            fs::create_directory(root / dir);
+            fstab << host.string() << '\t' << host.string()
+                  << "\tnone\trw,bind\t0\t0\n";
+          }
+      }
+  }
+
+  /**
+   * Configure the chroot and its profile in the schroot sysconfdir.
+   *
+   * @param sysconf_dir the schroot sysconfdir.
+   * @param root the chroot directory.
+   * @param fstab the fstab bind mounts.
+   */
+  void
+  configure_chroot (const fs::path&    sysconf_dir,
+                    const fs::path&    root,
+                    const std::string& fstab)
+  {
+    fs::path profile(sysconf_dir / chroot_name);
+    fs::create_directories(profile);
+
+    fs::ofstream(profile / "fstab") << fstab;
+    // Host files are owned by IDs which are unmapped in the user
+    // namespace, so their ownership can't be copied.
+    fs::ofstream(profile / "copyfiles");
+    fs::ofstream(profile / "nssdatabases") << "passwd\ngroup\n";
+
+    fs::ofstream(sysconf_dir / "chroot.d" / chroot_name)
+      << '[' << chroot_name << "]\n"
+      << "description=Session latency harness\n"
+      << "type=directory\n"
+      << "directory=" << root.string() << '\n'
+      << "users=root\n"
+      << "root-users=root\n"
+      << "profile=" << chroot_name << '\n';
+  }
+
+  /**
+   * Remove the chroot configuration from the schroot sysconfdir.
+   *
+   * @param sysconf_dir the schroot sysconfdir.
+   */
+  void
+  unconfigure_chroot (const fs::path& sysconf_dir)
+  {
+    boost::system::error_code ec;
+    fs::remove(sysconf_dir / "chroot.d" / chroot_name, ec);
+    fs::remove_all(sysconf_dir / chroot_name, ec);
+  }
+
+  /**
+   * Enter a new user and mount namespace, mapping the caller to
+   * root.  The lock directory used by the setup scripts is replaced
+   * with a private tmpfs, so that it is not shared with the host.
+   *
+   * @returns true on success, or false on failure.
+   */
+  bool
+  enter_namespace ()
+  {
+    uid_t uid = getuid();
+    gid_t gid = getgid();
+
+    if (unshare(CLONE_NEWUSER|CLONE_NEWNS) < 0)
+      {
+        std::cerr << "E: Failed to create user and mount namespace: "
+                  << strerror(errno) << std::endl;
+        return false;
+      }
+
+    // Unprivileged processes must deny setgroups before setting the
+    // group mapping; this file is absent before Linux 3.19.
+    if (!write_file("/proc/self/setgroups", "deny") && errno != ENOENT)
+      {
+        std::cerr << "E: Failed to deny setgroups: "
+                  << strerror(errno) << std::endl;
+        return false;
+      }
+
+    std::ostringstream uid_map;
+    uid_map << "0 " << uid << " 1";
+    std::ostringstream gid_map;
+    gid_map << "0 " << gid << " 1";
+    if (!write_file("/proc/self/uid_map", uid_map.str()) ||
+        !write_file("/proc/self/gid_map", gid_map.str()))
+      {
+        std::cerr << "E: Failed to map user to root: "
+                  << strerror(errno) << std::endl;
+        return false;
+      }
+
+    if (mount("none", "/", 0, MS_REC|MS_PRIVATE, 0) < 0 ||
+        mount("tmpfs", "/var/lock", "tmpfs", 0, "mode=0755") < 0)
+      {
+        std::cerr << "E: Failed to set up mount namespace: "
+                  << strerror(errno) << std::endl;
+        return false;
+      }
+
+    return true;
+  }
+
+  /**
+   * Run schroot and wait for it to exit.
+   *
+   * @param schroot the schroot executable.
+   * @param args the schroot arguments.
+   * @returns true if schroot exited successfully, otherwise false.
+   */
+  bool
+  run_schroot (const fs::path&                 schroot,
+               const std::vector<std::string>& args)
+  {
+    std::vector<char *> argv;
+    argv.push_back(const_cast<char *>(schroot.c_str()));
+    for (const auto& arg : args)
+      argv.push_back(const_cast<char *>(arg.c_str()));
+    argv.push_back(0);
+
+    pid_t pid = fork();
+    if (pid < 0)
+      {
+        std::cerr << "E: Failed to fork: " << strerror(errno) << std::endl;
+        return false;
+      }
+    else if (pid == 0)
+      {
+        int null = open("/dev/null", O_RDWR);
+        if (null >= 0)
+          {
+            dup2(null, STDIN_FILENO);
+            dup2(null, STDOUT_FILENO);
+          }
+        execv(argv[0], &argv[0]);
+        _exit(127);
+      }
+
+    int status;
+    while (waitpid(pid, &status, 0) < 0)
+      {
+        if (errno != EINTR)
+          return false;
+      }
+    return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+  }
+
+  /**
+   * Run session cycles, timing each operation.
+   *
+   * @param config the harness settings.
+   * @param worker the worker number, used to name the sessions.
+   * @param timings the timings to record.
+   */
+  void
+  run_sessions (const settings& config,
+                unsigned int    worker,
+                results&        timings)
+  {
+    for (unsigned int i = 0; i < config.iterations; ++i)
+      {
+        std::ostringstream name;
+        name << chroot_name << '-' << getpid() << '-' << worker << '-' << i;
+
+        std::vector<std::string> args[OPERATION_COUNT];
+        args[BEGIN] = { "--begin-session", "--chroot", chroot_name,
+                        "--session-name", name.str() };
+        args[RUN] = { "--run-session", "--chroot", name.str(),
+                      "--directory", "/", "--" };
+        args[RUN].insert(args[RUN].end(),
+                         config.command.begin(), config.command.end());
+        args[END] = { "--end-session", "--chroot", name.str() };
+
+        for (int op = BEGIN; op < OPERATION_COUNT; ++op)
+          {
+            auto start = std::chrono::steady_clock::now();
+            bool ok = run_schroot(config.schroot, args[op]);
+            std::chrono::duration<double, std::milli> elapsed =
+              std::chrono::steady_clock::now() - start;
+
+            if (ok)
+              timings.times[op].push_back(elapsed.count());
+            else
+              {
+                ++timings.failures[op];
+                // Without a session, there is nothing to run or end.
+                if (op == BEGIN)
+                  break;
+              }
+          }
+      }
+  }
+
+  /**
+   * Get a percentile, using the nearest-rank method.
+   *
+   * @param sorted the sorted timings.
+   * @param percent the percentile.
+   * @returns the percentile.
+   */
+  double
+  percentile (const std::vector<double>& sorted,
+              double                     percent)
+  {
+    if (sorted.empty())
+      return 0.0;
+    std::size_t rank =
+      static_cast<std::size_t>(std::ceil(percent / 100.0 * sorted.size()));
+    return sorted[std::max<std::size_t>(rank, 1) - 1];
+  }
+
+  /**
+   * Run the concurrent sessions and report the operation latencies.
+   *
+   * @param config the harness settings.
+   * @returns true if all operations succeeded, otherwise false.
+   */
+  bool
+  measure (const settings& config)
+  {
+    std::vector<results> worker_results(config.sessions);
+    std::vector<std::thread> workers;
+
+    auto start = std::chrono::steady_clock::now();
+    for (unsigned int w = 0; w < config.sessions; ++w)
+      workers.emplace_back(run_sessions, std::cref(config), w,
+                           std::ref(worker_results[w]));
+    for (auto& worker : workers)
+      worker.join();
+    std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+
+    results total;
+    for (const auto& r : worker_results)
+      for (int op = BEGIN; op < OPERATION_COUNT; ++op)
+        {
+          total.times[op].insert(total.times[op].end(),
+                                 r.times[op].begin(), r.times[op].end());
+          total.failures[op] += r.failures[op];
+        }
+
+    std::cout << std::left << std::setw(10) << "Operation" << std::right
+              << std::setw(8) << "Count"
+              << std::setw(8) << "Failed"
+              << std::setw(12) << "p50 (ms)"
+              << std::setw(12) << "p95 (ms)"
+              << std::setw(12) << "p99 (ms)" << '\n'
+              << std::fixed << std::setprecision(3);
+
+    bool ok = true;
+    for (int op = BEGIN; op < OPERATION_COUNT; ++op)
+      {
+        std::vector<double>& times(total.times[op]);
+        std::sort(times.begin(), times.end());
+        std::cout << std::left << std::setw(10) << operation_names[op]
+                  << std::right
+                  << std::setw(8) << times.size()
+                  << std::setw(8) << total.failures[op]
+                  << std::setw(12) << percentile(times, 50)
+                  << std::setw(12) << percentile(times, 95)
+                  << std::setw(12) << percentile(times, 99) << '\n';
+        if (total.failures[op])
+          ok = false;
+      }
+
+    std::size_t cycles = total.times[END].size();
+    std::cout << '\n' << config.sessions << " concurrent sessions, "
+              << config.iterations << " iterations each: "
+              << cycles << " cycles in " << std::setprecision(2)
+              << elapsed.count() << " s ("
+              << (elapsed.count() > 0 ? cycles / elapsed.count() : 0.0)
+              << " cycles/s)" << std::endl;
+
+    return ok;
+  }
+
+}
+
+int
+main (int   argc,
+      char *argv[])
+{
+  settings config;
+
+  opt::options_description visible("Options");
+  visible.add_options()
+    ("help,h", "Show help options")
+    ("prefix,p", opt::value<std::string>(),
+     "schroot installation prefix")
+    ("iterations,i", opt::value<unsigned int>(&config.iterations)->default_value(20),
+     "Session cycles run by each concurrent session")
+    ("sessions,s", opt::value<unsigned int>(&config.sessions)->default_value(1),
+     "Number of concurrent sessions");
+  opt::options_description hidden;
+  hidden.add_options()
+    ("command", opt::value<std::vector<std::string>>(&config.command));
+  opt::options_description all;
+  all.add(visible).add(hidden);
+  opt::positional_options_description positional;
+  positional.add("command", -1);
+
+  opt::variables_map vm;
+  try
+    {
+      opt::store(opt::command_line_parser(argc, argv)
+                 .options(all).positional(positional).run(), vm);
+      opt::notify(vm);
+    }
+  catch (const std::exception& e)
+    {
+      std::cerr << "E: " << e.what() << std::endl;
+      return EXIT_FAILURE;
+    }
+
+  if (vm.count("help"))
+    {
+      std::cout << "Usage: " << argv[0]
+                << " --prefix PREFIX [OPTION...] [-- COMMAND [ARG...]]\n"
+                << "Measure schroot session latency without root privileges.\n\n"
+                << visible << std::endl;
+      return EXIT_SUCCESS;
+    }
+
+  if (!vm.count("prefix"))
+    {
+      std::cerr << "E: --prefix is required" << std::endl;
+      return EXIT_FAILURE;
+    }
+  if (config.iterations < 1 || config.sessions < 1)
+    {
+      std::cerr << "E: --iterations and --sessions must be at least 1" << std::endl;
+      return EXIT_FAILURE;
+    }
+  if (config.command.empty())
+    config.command.push_back("/bin/true");
+
+  config.prefix = fs::absolute(vm["prefix"].as<std::string>());
+  config.schroot = config.prefix / "bin" / "schroot";
+  fs::path sysconf_dir(config.prefix / "etc" / "schroot");
+  if (!fs::exists(config.schroot) || !fs::is_directory(sysconf_dir / "chroot.d"))
+    {
+      std::cerr << "E: " << config.prefix.string()
+                << ": No schroot installation found" << std::endl;
+      return EXIT_FAILURE;
+    }
+
+  std::string tmpl((fs::temp_directory_path() / "schroot-latency.XXXXXX").string());
+  if (!mkdtemp(&tmpl[0]))
+    {
+      std::cerr << "E: Failed to create temporary directory: "
+                << strerror(errno) << std::endl;
+      return EXIT_FAILURE;
+    }
+  fs::path tmpdir(tmpl);
+
+  int status = EXIT_FAILURE;
+  try
+    {
+      std::ostringstream fstab;
+      create_chroot(tmpdir / "chroot", fstab);
+      configure_chroot(sysconf_dir, tmpdir / "chroot", fstab.str());
+
+      // The namespace is entered by a child, so that its mounts are
+      // gone by the time the chroot is removed.
+      std::cout.flush();
+      pid_t pid = fork();
+      if (pid < 0)
+        std::cerr << "E: Failed to fork: " << strerror(errno) << std::endl;
+      else if (pid == 0)
+        _exit(enter_namespace() && measure(config) ? EXIT_SUCCESS : EXIT_FAILURE);
+      else
+        {
+          int child_status;
+          pid_t waited;
+          while ((waited = waitpid(pid, &child_status, 0)) < 0 &&
+                 errno == EINTR)
+            ;
+          if (waited == pid && WIFEXITED(child_status))
+            status = WEXITSTATUS(child_status);
+        }
+    }
+  catch (const std::exception& e)
+    {
+      std::cerr << "E: " << e.what() << std::endl;
+    }
+
+  unconfigure_chroot(sysconf_dir);
+  boost::system::error_code ec;
+  fs::remove_all(tmpdir, ec);
+
+  return status;
+}
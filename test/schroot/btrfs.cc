@@ -0,0 +1,177 @@
+/* Copyright © 2006-2013  Roger Leigh <rleigh@codelibre.net>
+ *
+ * schroot is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * schroot is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ *********************************************************************/
+
+#include <gtest/gtest.h>
+
+#include <boost/filesystem.hpp>
+
+#include <schroot/btrfs.h>
+#include <schroot/loop-device.h>
+#include <schroot/reclaim.h>
+
+#include <test/schroot/tmpdir.h>
+
+#include <cerrno>
+#include <fstream>
+#include <memory>
+#include <string>
+
+#include <fcntl.h>
+#include <sys/mount.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+class Btrfs : public TmpdirTest
+{
+public:
+  std::string queuedir;
+  std::string mountpoint;
+  bool mounted;
+
+  Btrfs():
+    TmpdirTest("btrfs"),
+    mounted(false)
+  {}
+
+  void SetUp()
+  {
+    // Attaching loop devices and mounting require privileges.
+    if (geteuid() != 0 || access("/dev/loop-control", R_OK|W_OK) != 0)
+      GTEST_SKIP();
+
+    ASSERT_NO_FATAL_FAILURE(TmpdirTest::SetUp());
+    queuedir = tmpdir + "/queue";
+    mountpoint = tmpdir + "/mnt";
+    ASSERT_EQ(mkdir(queuedir.c_str(), 0700), 0);
+    ASSERT_EQ(mkdir(mountpoint.c_str(), 0755), 0);
+
+    // A sparse image, large enough for mkfs.btrfs.
+    std::string image(tmpdir + "/image");
+    int fd = open(image.c_str(), O_CREAT|O_WRONLY|O_CLOEXEC, 0600);
+    ASSERT_GE(fd, 0);
+    ASSERT_EQ(ftruncate(fd, 256 * 1024 * 1024), 0);
+    close(fd);
+
+    std::string command("mkfs.btrfs -q " + image + " >/dev/null 2>&1");
+    if (system(command.c_str()) != 0)
+      GTEST_SKIP();
+
+    // The device is detached by the kernel once it is unmounted.
+    std::unique_ptr<schroot::loop_device> loop;
+    try
+      {
+        loop.reset(new schroot::loop_device
+                   (image, schroot::loop_device::FLAG_AUTOCLEAR));
+      }
+    catch (const schroot::loop_device::error&)
+      {
+        GTEST_SKIP();
+      }
+
+    if (mount(loop->get_device().c_str(), mountpoint.c_str(),
+              "btrfs", 0, 0) != 0)
+      GTEST_SKIP();
+    mounted = true;
+  }
+
+  void TearDown()
+  {
+    if (mounted)
+      umount2(mountpoint.c_str(), MNT_DETACH);
+    TmpdirTest::TearDown();
+  }
+
+  // The number of entries in the top-level subvolume.
+  unsigned int
+  count_entries ()
+  {
+    unsigned int count = 0;
+    for (boost::filesystem::directory_iterator pos(mountpoint), end;
+         pos != end;
+         ++pos)
+      ++count;
+    return count;
+  }
+};
+
+TEST_F(Btrfs, SnapshotDestroy)
+{
+  std::ofstream(mountpoint + "/file") << "file contents\n";
+
+  std::string snapshot(mountpoint + "/snapshot");
+  schroot::btrfs::create_snapshot(mountpoint, snapshot);
+  ASSERT_TRUE(boost::filesystem::exists(snapshot + "/file"));
+
+  // The snapshot is writable, and independent of its source.
+  std::ofstream(snapshot + "/snapshot-file") << "snapshot contents\n";
+  ASSERT_FALSE(boost::filesystem::exists(mountpoint + "/snapshot-file"));
+
+  std::string readonly(mountpoint + "/readonly");
+  schroot::btrfs::create_snapshot(snapshot, readonly, true);
+  ASSERT_TRUE(boost::filesystem::exists(readonly + "/snapshot-file"));
+  ASSERT_LT(open((readonly + "/new").c_str(),
+                 O_CREAT|O_WRONLY|O_CLOEXEC, 0644), 0);
+  ASSERT_EQ(errno, EROFS);
+
+  ASSERT_TRUE(schroot::btrfs::destroy_subvolume(readonly));
+  ASSERT_FALSE(boost::filesystem::exists(readonly));
+  ASSERT_FALSE(schroot::btrfs::destroy_subvolume(readonly));
+
+  ASSERT_TRUE(schroot::btrfs::destroy_subvolume(snapshot));
+  ASSERT_FALSE(boost::filesystem::exists(snapshot));
+}
+
+TEST_F(Btrfs, SnapshotExists)
+{
+  std::string snapshot(mountpoint + "/snapshot");
+  schroot::btrfs::create_snapshot(mountpoint, snapshot);
+  ASSERT_THROW(schroot::btrfs::create_snapshot(mountpoint, snapshot),
+               schroot::btrfs::error);
+  ASSERT_TRUE(schroot::btrfs::destroy_subvolume(snapshot));
+}
+
+TEST_F(Btrfs, DestroyNotSubvolume)
+{
+  // Only subvolumes may be destroyed.
+  std::string directory(mountpoint + "/directory");
+  ASSERT_EQ(mkdir(directory.c_str(), 0755), 0);
+  ASSERT_THROW(schroot::btrfs::destroy_subvolume(directory),
+               schroot::btrfs::error);
+  ASSERT_TRUE(boost::filesystem::exists(directory));
+}
+
+TEST_F(Btrfs, DeferReclaim)
+{
+  std::string snapshot(mountpoint + "/snapshot");
+  schroot::btrfs::create_snapshot(mountpoint, snapshot);
+  std::ofstream(snapshot + "/file") << "file contents\n";
+  ASSERT_EQ(count_entries(), 1U);
+
+  // The subvolume is detached at once, and destroyed when the queue
+  // is run.
+  schroot::reclaim queue(queuedir);
+  ASSERT_TRUE(queue.defer(schroot::reclaim::BTRFS_SUBVOLUME, snapshot));
+  ASSERT_FALSE(boost::filesystem::exists(snapshot));
+  ASSERT_EQ(count_entries(), 1U);
+  ASSERT_EQ(queue.get_items().size(), 1U);
+
+  queue.run();
+  ASSERT_TRUE(queue.get_items().empty());
+  ASSERT_EQ(count_entries(), 0U);
+}
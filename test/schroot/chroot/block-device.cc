@@ -131,6 +131,7 @@ TEST_F(ChrootBlockDevice, SetupEnvSession)
   setup_env_gen(expected);
   expected.add("SESSION_ID",            "test-session-name");
   expected.add("CHROOT_ALIAS",          "test-session-name");
+  expected.add("CHROOT_SESSION_RECLAIM", "immediate");
   expected.add("CHROOT_DESCRIPTION",     chroot->get_description() + ' ' + _("(session chroot)"));
   expected.add("CHROOT_SESSION_CLONE",  "false");
   expected.add("CHROOT_SESSION_CREATE", "false");
@@ -156,6 +157,8 @@ TEST_F(ChrootBlockDevice, SetupEnvUnion)
   expected.add("CHROOT_UNION_MOUNT_OPTIONS",      "union-mount-options");
   expected.add("CHROOT_UNION_OVERLAY_DIRECTORY",  "/overlay");
   expected.add("CHROOT_UNION_UNDERLAY_DIRECTORY", "/underlay");
+  expected.add("CHROOT_UNION_OVERLAY_TMPFS", "false");
+  expected.add("CHROOT_UNION_OVERLAY_VOLATILE", "false");
 
   ChrootBase::test_setup_env(chroot_union, expected);
 }
@@ -166,6 +169,7 @@ TEST_F(ChrootBlockDevice, SetupEnvSessionUnion)
   setup_env_gen(expected);
   expected.add("SESSION_ID",            "test-union-session-name");
   expected.add("CHROOT_ALIAS",          "test-union-session-name");
+  expected.add("CHROOT_SESSION_RECLAIM", "immediate");
   expected.add("CHROOT_DESCRIPTION",     chroot->get_description() + ' ' + _("(session chroot)"));
   expected.add("CHROOT_SESSION_CLONE",  "false");
   expected.add("CHROOT_SESSION_CREATE", "false");
@@ -176,6 +180,8 @@ TEST_F(ChrootBlockDevice, SetupEnvSessionUnion)
   expected.add("CHROOT_UNION_MOUNT_OPTIONS",      "union-mount-options");
   expected.add("CHROOT_UNION_OVERLAY_DIRECTORY",  "/overlay/test-union-session-name");
   expected.add("CHROOT_UNION_UNDERLAY_DIRECTORY", "/underlay/test-union-session-name");
+  expected.add("CHROOT_UNION_OVERLAY_TMPFS", "false");
+  expected.add("CHROOT_UNION_OVERLAY_VOLATILE", "false");
   ChrootBase::test_setup_env(session_union, expected);
 }
 
@@ -201,6 +207,7 @@ TEST_F(ChrootBlockDevice, SetupEnvSessionSourceUnion)
 
   expected.add("SESSION_ID",            "test-session-name");
   expected.add("CHROOT_ALIAS",          "test-session-name");
+  expected.add("CHROOT_SESSION_RECLAIM", "immediate");
   expected.add("CHROOT_DESCRIPTION",     chroot->get_description() + ' ' + _("(source chroot) (session chroot)"));
   expected.add("CHROOT_SESSION_CLONE",  "false");
   expected.add("CHROOT_SESSION_CREATE", "false");
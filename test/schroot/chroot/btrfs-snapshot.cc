@@ -88,6 +88,14 @@ TEST_F(BtrfsSnapshot, SnapshotName)
   ASSERT_EQ(bfac->get_snapshot_directory(), "/srv/chroot/snapshot2/test-session-id");
 }
 
+TEST_F(BtrfsSnapshot, AsyncReclaim)
+{
+  schroot::chroot::facet::btrfs_snapshot::ptr bfac = chroot->get_facet_strict<schroot::chroot::facet::btrfs_snapshot>();
+  ASSERT_FALSE(bfac->get_async_reclaim());
+  bfac->set_async_reclaim(true);
+  ASSERT_TRUE(bfac->get_async_reclaim());
+}
+
 TEST_F(BtrfsSnapshot, SourceSubvolumeFail)
 {
   schroot::chroot::facet::btrfs_snapshot::ptr bfac = chroot->get_facet_strict<schroot::chroot::facet::btrfs_snapshot>();
@@ -134,6 +142,7 @@ TEST_F(BtrfsSnapshot, SetupEnvSession)
   expected.add("CHROOT_TYPE",           "btrfs-snapshot");
   expected.add("SESSION_ID",            "test-session-name");
   expected.add("CHROOT_ALIAS",          "test-session-name");
+  expected.add("CHROOT_SESSION_RECLAIM", "immediate");
   expected.add("CHROOT_DESCRIPTION",     chroot->get_description() + ' ' + _("(session chroot)"));
   expected.add("CHROOT_BTRFS_SOURCE_SUBVOLUME",       "/srv/chroot/sid");
   expected.add("CHROOT_BTRFS_SNAPSHOT_DIRECTORY", "/srv/chroot/snapshot");
@@ -170,6 +179,7 @@ TEST_F(BtrfsSnapshot, SetupEnvSessionSource)
   expected.add("SESSION_ID",            "test-session-name");
   expected.add("CHROOT_NAME",           "test-name");
   expected.add("CHROOT_ALIAS",          "test-session-name");
+  expected.add("CHROOT_SESSION_RECLAIM", "immediate");
   expected.add("CHROOT_DESCRIPTION",     chroot->get_description() + ' ' + _("(source chroot)") + ' ' + _("(session chroot)"));
   expected.add("CHROOT_DIRECTORY",       "/srv/chroot/sid");
   expected.add("CHROOT_SESSION_CLONE",  "false");
@@ -190,6 +200,7 @@ TEST_F(BtrfsSnapshot, SetupKeyfile)
   expected.set_value(group, "type", "btrfs-snapshot");
   expected.set_value(group, "btrfs-source-subvolume", "/srv/chroot/sid");
   expected.set_value(group, "btrfs-snapshot-directory", "/srv/chroot/snapshot");
+  expected.set_value(group, "btrfs-async-reclaim", "false");
 
   ChrootBase::test_setup_keyfile
     (chroot,expected, chroot->get_name());
@@ -207,6 +218,7 @@ TEST_F(BtrfsSnapshot, SetupKeyfileSession)
   expected.set_value(group, "description", chroot->get_description() + ' ' + _("(session chroot)"));
   expected.set_value(group, "aliases", "");
   expected.set_value(group, "btrfs-snapshot-name", "/srv/chroot/snapshot/test-session-name");
+  expected.set_value(group, "btrfs-async-reclaim", "false");
   expected.set_value(group, "mount-location", "/mnt/mount-location");
 
   ChrootBase::test_setup_keyfile
@@ -33,6 +33,9 @@
 #ifdef SCHROOT_FEATURE_UNION
 #include <schroot/chroot/facet/fsunion.h>
 #endif // SCHROOT_FEATURE_UNION
+#ifdef SCHROOT_FEATURE_CGROUP
+#include <schroot/chroot/facet/cgroup.h>
+#endif // SCHROOT_FEATURE_CGROUP
 #ifdef SCHROOT_FEATURE_UNSHARE
 #include <schroot/chroot/facet/unshare.h>
 #endif // SCHROOT_FEATURE_UNSHARE
@@ -270,6 +273,10 @@ public:
     env.add("UNSHARE_SYSVIPC", "false");
     env.add("UNSHARE_SYSVSEM", "false");
     env.add("UNSHARE_UTS", "false");
+    env.add("UNSHARE_PID", "false");
+    env.add("UNSHARE_MOUNT", "false");
+    env.add("UNSHARE_CGROUP", "false");
+    env.add("UNSHARE_USER", "false");
 #endif // SCHROOT_FEATURE_UNSHARE
   }
 
@@ -296,11 +303,25 @@ public:
     keyfile.set_value(group, "setup.fstab", "default/fstab");
     keyfile.set_value(group, "setup.nssdatabases", "default/nssdatabases");
     keyfile.set_value(group, "custom.test1", "testval");
+#ifdef SCHROOT_FEATURE_CGROUP
+    keyfile.set_value(group, "cgroup.enable", "false");
+    keyfile.set_value(group, "cgroup.parent", "schroot");
+    keyfile.set_value(group, "cgroup.cpu.max", "");
+    keyfile.set_value(group, "cgroup.cpu.weight", "");
+    keyfile.set_value(group, "cgroup.memory.max", "");
+    keyfile.set_value(group, "cgroup.memory.high", "");
+    keyfile.set_value(group, "cgroup.io.max", "");
+    keyfile.set_value(group, "cgroup.pids.max", "");
+#endif // SCHROOT_FEATURE_CGROUP
 #ifdef SCHROOT_FEATURE_UNSHARE
     keyfile.set_value(group, "unshare.net", "false");
     keyfile.set_value(group, "unshare.sysvipc", "false");
     keyfile.set_value(group, "unshare.sysvsem", "false");
     keyfile.set_value(group, "unshare.uts", "false");
+    keyfile.set_value(group, "unshare.pid", "false");
+    keyfile.set_value(group, "unshare.mount", "false");
+    keyfile.set_value(group, "unshare.cgroup", "false");
+    keyfile.set_value(group, "unshare.user", "false");
 #endif // SCHROOT_FEATURE_UNSHARE
   }
 
@@ -329,6 +350,10 @@ public:
     keyfile.set_value(group, "union-mount-options", "union-mount-options");
     keyfile.set_value(group, "union-overlay-directory", "/overlay");
     keyfile.set_value(group, "union-underlay-directory", "/underlay");
+    keyfile.set_value(group, "union-overlay-tmpfs", "false");
+    keyfile.set_value(group, "union-overlay-tmpfs-size", "");
+    keyfile.set_value(group, "union-overlay-volatile", "false");
+    keyfile.set_value(group, "union-underlay-layers", "");
   }
 
   void setup_keyfile_union_session (schroot::keyfile&  keyfile,
@@ -338,6 +363,10 @@ public:
     keyfile.set_value(group, "union-mount-options", "union-mount-options");
     keyfile.set_value(group, "union-overlay-directory", "/overlay/test-union-session-name");
     keyfile.set_value(group, "union-underlay-directory", "/underlay/test-union-session-name");
+    keyfile.set_value(group, "union-overlay-tmpfs", "false");
+    keyfile.set_value(group, "union-overlay-tmpfs-size", "");
+    keyfile.set_value(group, "union-overlay-volatile", "false");
+    keyfile.set_value(group, "union-underlay-layers", "");
   }
 #endif // SCHROOT_FEATURE_UNION
 
@@ -356,6 +385,7 @@ public:
     keyfile.set_value(group, "source-root-users", "suser3,suser4");
     keyfile.set_value(group, "source-groups", "sgroup1,sgroup2");
     keyfile.set_value(group, "source-root-groups", "sgroup3,sgroup4");
+    keyfile.set_value(group, "source-lease-timeout", "600");
   }
 
   void setup_keyfile_source_clone (schroot::keyfile&  keyfile,
@@ -19,6 +19,10 @@
 #include <config.h>
 
 #include <schroot/chroot/facet/directory.h>
+#ifdef SCHROOT_FEATURE_UNION
+#include <schroot/chroot/facet/fsunion.h>
+#endif // SCHROOT_FEATURE_UNION
+#include <schroot/chroot/facet/session-clonable.h>
 #include <schroot/i18n.h>
 #include <schroot/keyfile-writer.h>
 
@@ -110,6 +114,7 @@ TEST_F(ChrootDirectory, SetupEnvSession)
 
   expected.add("SESSION_ID",            "test-session-name");
   expected.add("CHROOT_ALIAS",          "test-session-name");
+  expected.add("CHROOT_SESSION_RECLAIM", "immediate");
   expected.add("CHROOT_DESCRIPTION",     chroot->get_description() + ' ' + _("(session chroot)"));
   expected.add("CHROOT_SESSION_CLONE",  "false");
   expected.add("CHROOT_SESSION_CREATE", "false");
@@ -130,6 +135,7 @@ TEST_F(ChrootDirectory, SetupEnvUnion)
 
   expected.add("SESSION_ID",            "test-union-session-name");
   expected.add("CHROOT_ALIAS",          "test-union-session-name");
+  expected.add("CHROOT_SESSION_RECLAIM", "immediate");
   expected.add("CHROOT_DESCRIPTION",     chroot->get_description() + ' ' + _("(session chroot)"));
   expected.add("CHROOT_SESSION_CLONE",  "false");
   expected.add("CHROOT_SESSION_CREATE", "false");
@@ -139,6 +145,8 @@ TEST_F(ChrootDirectory, SetupEnvUnion)
   expected.add("CHROOT_UNION_MOUNT_OPTIONS",      "union-mount-options");
   expected.add("CHROOT_UNION_OVERLAY_DIRECTORY",  "/overlay/test-union-session-name");
   expected.add("CHROOT_UNION_UNDERLAY_DIRECTORY", "/underlay/test-union-session-name");
+  expected.add("CHROOT_UNION_OVERLAY_TMPFS", "false");
+  expected.add("CHROOT_UNION_OVERLAY_VOLATILE", "false");
 
   ChrootBase::test_setup_env(session_union, expected);
 }
@@ -164,6 +172,7 @@ TEST_F(ChrootDirectory, SetupEnvSessionSourceUnion)
 
   expected.add("SESSION_ID",            "test-session-name");
   expected.add("CHROOT_ALIAS",          "test-session-name");
+  expected.add("CHROOT_SESSION_RECLAIM", "immediate");
   expected.add("CHROOT_DESCRIPTION",     chroot->get_description() + ' ' + _("(source chroot) (session chroot)"));
   expected.add("CHROOT_SESSION_CLONE",  "false");
   expected.add("CHROOT_SESSION_CREATE", "false");
@@ -304,6 +313,72 @@ TEST_F(ChrootDirectory, SetupKeyfileSessionSourceUnion)
 }
 #endif // SCHROOT_FEATURE_UNION
 
+#ifdef SCHROOT_FEATURE_UNION
+TEST_F(ChrootDirectory, UnionOverlayTmpfs)
+{
+  schroot::chroot::facet::fsunion::ptr un
+    (chroot_union->get_facet_strict<schroot::chroot::facet::fsunion>());
+  ASSERT_FALSE(un->get_union_overlay_tmpfs());
+  un->set_union_overlay_tmpfs(true);
+  ASSERT_TRUE(un->get_union_overlay_tmpfs());
+
+  un->set_union_overlay_tmpfs_size("4G");
+  ASSERT_EQ(un->get_union_overlay_tmpfs_size(), "4G");
+  un->set_union_overlay_tmpfs_size("50%");
+  un->set_union_overlay_tmpfs_size("1048576");
+  un->set_union_overlay_tmpfs_size("");
+  ASSERT_THROW(un->set_union_overlay_tmpfs_size("G"), schroot::chroot::facet::fsunion::error);
+  ASSERT_THROW(un->set_union_overlay_tmpfs_size("4GB"), schroot::chroot::facet::fsunion::error);
+  ASSERT_THROW(un->set_union_overlay_tmpfs_size("-1"), schroot::chroot::facet::fsunion::error);
+}
+
+TEST_F(ChrootDirectory, UnionUnderlayLayers)
+{
+  schroot::chroot::facet::fsunion::ptr un
+    (chroot_union->get_facet_strict<schroot::chroot::facet::fsunion>());
+  ASSERT_TRUE(un->get_union_underlay_layers().empty());
+
+  schroot::string_list layers;
+  layers.push_back("/usr");
+  layers.push_back("/etc");
+  un->set_union_underlay_layers(layers);
+  ASSERT_EQ(un->get_union_underlay_layers(), layers);
+
+  schroot::environment env;
+  chroot_union->setup_env(env);
+  std::string value;
+  ASSERT_TRUE(env.get("CHROOT_UNION_UNDERLAY_LAYERS", value));
+  ASSERT_EQ(value, "/usr:/etc");
+
+  // Only sessions lease their layers.
+  un->setup_lock(schroot::chroot::chroot::SETUP_START, true, 0);
+  un->setup_lock(schroot::chroot::chroot::SETUP_STOP, false, 0);
+
+  schroot::string_list bad;
+  bad.push_back("usr");
+  ASSERT_THROW(un->set_union_underlay_layers(bad), schroot::chroot::facet::fsunion::error);
+  bad[0] = "/usr:/etc";
+  ASSERT_THROW(un->set_union_underlay_layers(bad), schroot::chroot::facet::fsunion::error);
+  bad[0] = "/usr";
+  bad.push_back("/usr");
+  ASSERT_THROW(un->set_union_underlay_layers(bad), schroot::chroot::facet::fsunion::error);
+  ASSERT_EQ(un->get_union_underlay_layers(), layers);
+}
+
+TEST_F(ChrootDirectory, UnionLayerLeaseName)
+{
+  typedef schroot::chroot::facet::fsunion fsunion;
+
+  ASSERT_EQ(fsunion::get_layer_lease_name("/nonexistent/layer"),
+            "layer:%2Fnonexistent%2Flayer");
+  ASSERT_EQ(fsunion::get_layer_lease_name("/nonexistent/50%"),
+            "layer:%2Fnonexistent%2F50%25");
+  // Every path to a directory names the same lease.
+  ASSERT_EQ(fsunion::get_layer_lease_name("/"), "layer:%2F");
+  ASSERT_EQ(fsunion::get_layer_lease_name("//."), "layer:%2F");
+}
+#endif // SCHROOT_FEATURE_UNION
+
 TEST_F(ChrootDirectory, SessionFlags)
 {
   ASSERT_EQ(chroot->get_session_flags(),
@@ -325,6 +400,109 @@ TEST_F(ChrootDirectory, SessionFlags)
 #endif // SCHROOT_FEATURE_UNION
 }
 
+#ifdef SCHROOT_FEATURE_UNSHARE
+TEST_F(ChrootDirectory, UnshareChildNamespaces)
+{
+  schroot::chroot::facet::unshare::ptr pu
+    (chroot->get_facet_strict<schroot::chroot::facet::unshare>());
+  ASSERT_FALSE(pu->get_unshare_child());
+  ASSERT_EQ(pu->begin_pid_namespace(), -1);
+
+  pu->set_unshare_pid(true);
+  ASSERT_TRUE(pu->get_unshare_pid());
+  ASSERT_TRUE(pu->get_unshare_child());
+  pu->set_unshare_pid(false);
+
+  pu->set_unshare_mount(true);
+  ASSERT_TRUE(pu->get_unshare_mount());
+  ASSERT_TRUE(pu->get_unshare_child());
+  pu->set_unshare_mount(false);
+
+  pu->set_unshare_cgroup(true);
+  ASSERT_TRUE(pu->get_unshare_cgroup());
+  pu->set_unshare_user(true);
+  ASSERT_TRUE(pu->get_unshare_user());
+
+  schroot::keyfile config;
+  config << chroot;
+  bool value = false;
+  ASSERT_TRUE(config.get_value(chroot->get_name(), "unshare.user", value));
+  ASSERT_TRUE(value);
+}
+#endif // SCHROOT_FEATURE_UNSHARE
+
+#ifdef SCHROOT_FEATURE_CGROUP
+TEST_F(ChrootDirectory, Cgroup)
+{
+  schroot::chroot::facet::cgroup::ptr pcg
+    (chroot->get_facet_strict<schroot::chroot::facet::cgroup>());
+  ASSERT_FALSE(pcg->get_cgroup_enable());
+  ASSERT_EQ(pcg->get_cgroup_parent(), "schroot");
+
+  pcg->set_cgroup_enable(true);
+  pcg->set_cgroup_parent("/machine.slice/schroot/");
+  ASSERT_EQ(pcg->get_cgroup_parent(), "machine.slice/schroot");
+  ASSERT_THROW(pcg->set_cgroup_parent("/"),
+               schroot::chroot::facet::cgroup::error);
+  ASSERT_THROW(pcg->set_cgroup_parent("schroot/../.."),
+               schroot::chroot::facet::cgroup::error);
+  pcg->set_cgroup_memory_max("1G");
+  pcg->set_cgroup_io_max(schroot::split_string("8:0 wbps=1048576,8:16 riops=100", ","));
+
+  // Only sessions have a cgroup.
+  ASSERT_EQ(pcg->get_cgroup_path(), "");
+
+  schroot::chroot::chroot::ptr cgroup_session
+    (chroot->clone_session("test-cgroup-session", "test-cgroup-session",
+                           "user1", false));
+  schroot::chroot::facet::cgroup::const_ptr psesscg
+    (cgroup_session->get_facet_strict<schroot::chroot::facet::cgroup>());
+  ASSERT_EQ(psesscg->get_cgroup_path(),
+            "/sys/fs/cgroup/machine.slice/schroot/test-cgroup-session");
+  ASSERT_EQ(psesscg->get_cgroup_io_max().size(), 2U);
+
+  schroot::environment env;
+  cgroup_session->setup_env(env);
+  std::string path;
+  ASSERT_TRUE(env.get("CHROOT_CGROUP", path));
+  ASSERT_EQ(path, "/sys/fs/cgroup/machine.slice/schroot/test-cgroup-session");
+
+  schroot::keyfile config;
+  config << cgroup_session;
+  std::string limit;
+  ASSERT_TRUE(config.get_value(cgroup_session->get_name(),
+                               "cgroup.memory.max", limit));
+  ASSERT_EQ(limit, "1G");
+  ASSERT_TRUE(config.get_value(cgroup_session->get_name(),
+                               "cgroup.path", path));
+  ASSERT_EQ(path, "/sys/fs/cgroup/machine.slice/schroot/test-cgroup-session");
+
+  // The cgroup is not moved when a pooled session is claimed.
+  cgroup_session->set_name("test-cgroup-claimed");
+  ASSERT_EQ(psesscg->get_cgroup_path(),
+            "/sys/fs/cgroup/machine.slice/schroot/test-cgroup-session");
+  ASSERT_THROW(pcg->set_cgroup_path("/sys/fs/cgroup/../../etc"),
+               schroot::chroot::facet::cgroup::error);
+  ASSERT_THROW(pcg->set_cgroup_path("/tmp/cgroup"),
+               schroot::chroot::facet::cgroup::error);
+}
+#endif // SCHROOT_FEATURE_CGROUP
+
+TEST_F(ChrootDirectory, SessionPoolSize)
+{
+  schroot::chroot::facet::session_clonable::ptr psess
+    (chroot->get_facet_strict<schroot::chroot::facet::session_clonable>());
+  ASSERT_EQ(psess->get_session_pool_size(), 0U);
+  psess->set_session_pool_size(4);
+  ASSERT_EQ(psess->get_session_pool_size(), 4U);
+
+  schroot::keyfile config;
+  config << chroot;
+  unsigned int size = 0;
+  ASSERT_TRUE(config.get_value(chroot->get_name(), "session-pool-size", size));
+  ASSERT_EQ(size, 4U);
+}
+
 TEST_F(ChrootDirectory, PrintDetails)
 {
   std::ostringstream os;
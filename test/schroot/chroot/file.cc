@@ -148,6 +148,26 @@ TEST_F(ChrootFile, SetupEnvSession)
   setup_env_gen(expected);
   expected.add("SESSION_ID",           "test-session-name");
   expected.add("CHROOT_ALIAS",         "test-session-name");
+  expected.add("CHROOT_SESSION_RECLAIM", "immediate");
+  expected.add("CHROOT_DESCRIPTION",    chroot->get_description() + ' ' + _("(session chroot)"));
+  expected.add("CHROOT_FILE_REPACK",    "false");
+  expected.add("CHROOT_SESSION_CLONE",  "false");
+  expected.add("CHROOT_SESSION_CREATE", "false");
+  expected.add("CHROOT_SESSION_PURGE",  "true");
+  expected.add("CHROOT_SESSION_SOURCE", "false");
+
+  ChrootBase::test_setup_env(session, expected);
+}
+
+TEST_F(ChrootFile, SetupEnvSessionEnding)
+{
+  session->get_facet_strict<schroot::chroot::facet::session>()->set_ending(true);
+
+  schroot::environment expected;
+  setup_env_gen(expected);
+  expected.add("SESSION_ID",           "test-session-name");
+  expected.add("CHROOT_ALIAS",         "test-session-name");
+  expected.add("CHROOT_SESSION_RECLAIM", "deferred");
   expected.add("CHROOT_DESCRIPTION",    chroot->get_description() + ' ' + _("(session chroot)"));
   expected.add("CHROOT_FILE_REPACK",    "false");
   expected.add("CHROOT_SESSION_CLONE",  "false");
@@ -178,6 +198,7 @@ TEST_F(ChrootFile, SetupEnvSessionSource)
   setup_env_gen(expected);
   expected.add("SESSION_ID",           "test-session-name");
   expected.add("CHROOT_ALIAS",         "test-session-name");
+  expected.add("CHROOT_SESSION_RECLAIM", "immediate");
   expected.add("CHROOT_DESCRIPTION",    chroot->get_description() + ' ' + _("(source chroot) (session chroot)"));
   expected.add("CHROOT_FILE_REPACK",    "true");
   expected.add("CHROOT_SESSION_CLONE",  "false");
@@ -216,6 +237,25 @@ TEST_F(ChrootFile, SetupKeyfileSession)
     (session, expected, group);
 }
 
+TEST_F(ChrootFile, SetupKeyfileSessionEnding)
+{
+  session->get_facet_strict<schroot::chroot::facet::session>()->set_ending(true);
+
+  schroot::keyfile expected;
+  const std::string group(session->get_name());
+  setup_keyfile_session(expected, group);
+  setup_keyfile_file(expected, group);
+  expected.set_value(group, "name", "test-session-name");
+  expected.set_value(group, "selected-name", "test-session-name");
+  expected.set_value(group, "file-repack", "false");
+  expected.set_value(group, "mount-location", "/mnt/mount-location");
+  expected.set_value(group, "ending", "true");
+  setup_keyfile_session_clone(expected, group);
+
+  ChrootBase::test_setup_keyfile
+    (session, expected, group);
+}
+
 TEST_F(ChrootFile, SetupKeyfileSource)
 {
   schroot::keyfile expected;
@@ -0,0 +1,182 @@
+/* Copyright © 2006-2013  Roger Leigh <rleigh@codelibre.net>
+ *
+ * schroot is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * schroot is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ *********************************************************************/
+
+#include <config.h>
+
+#include <schroot/chroot/facet/directory.h>
+#include <schroot/chroot/facet/session.h>
+#include <schroot/chroot/gc.h>
+
+#include <test/schroot/chroot/chroot.h>
+
+#include <ctime>
+#include <string>
+
+#include <unistd.h>
+
+class ChrootGC : public ChrootBase
+{
+public:
+  schroot::chroot::facet::session::ptr psess;
+
+  ChrootGC():
+    ChrootBase("directory"),
+    psess()
+  {}
+
+  void SetUp()
+  {
+    ChrootBase::SetUp();
+    ASSERT_NE(session, nullptr);
+    psess = session->get_facet<schroot::chroot::facet::session>();
+    ASSERT_NE(psess, nullptr);
+  }
+
+  virtual void setup_chroot_props (schroot::chroot::chroot::chroot::ptr& chroot)
+  {
+    ChrootBase::setup_chroot_props(chroot);
+
+    schroot::chroot::facet::directory::ptr dirfac = chroot->get_facet<schroot::chroot::facet::directory>();
+    ASSERT_NE(dirfac, nullptr);
+
+    dirfac->set_directory("/srv/chroot/example-chroot");
+  }
+
+  // A driver which has exited, since its start time does not match.
+  void set_dead_driver()
+  {
+    psess->set_driver_pid(getpid());
+    psess->set_driver_start_time(1);
+    ASSERT_FALSE(psess->driver_alive());
+  }
+};
+
+TEST_F(ChrootGC, Ending)
+{
+  schroot::chroot::gc collector;
+  schroot::chroot::gc::candidate stale;
+
+  psess->set_ending(true);
+  set_dead_driver();
+
+  // An interrupted end is stale at once, however recently used.
+  ASSERT_TRUE(collector.check(session, time(nullptr), stale));
+  ASSERT_EQ(stale.why, schroot::chroot::gc::STALE_ENDING);
+  ASSERT_EQ(stale.session, session);
+  ASSERT_EQ(schroot::chroot::gc::describe(stale),
+            _("session end was interrupted"));
+}
+
+TEST_F(ChrootGC, EndingDriverAlive)
+{
+  schroot::chroot::gc collector;
+  schroot::chroot::gc::candidate stale;
+
+  // The session is still being ended.
+  psess->set_ending(true);
+  psess->set_driver(getpid());
+  ASSERT_TRUE(psess->driver_alive());
+  ASSERT_FALSE(collector.check(session, time(nullptr), stale));
+}
+
+TEST_F(ChrootGC, Idle)
+{
+  schroot::chroot::gc collector;
+  schroot::chroot::gc::candidate stale;
+  collector.set_idle_time(60);
+
+  // The driver is alive, but the session has been idle too long.
+  psess->set_driver(getpid());
+  ASSERT_TRUE(collector.check(session, time(nullptr) - 120, stale));
+  ASSERT_EQ(stale.why, schroot::chroot::gc::STALE_IDLE);
+  ASSERT_GE(stale.idle, 120);
+  ASSERT_EQ(schroot::chroot::gc::describe(stale).find(_("idle for")), 0U);
+
+  ASSERT_FALSE(collector.check(session, time(nullptr), stale));
+}
+
+TEST_F(ChrootGC, Orphaned)
+{
+  schroot::chroot::gc collector;
+  schroot::chroot::gc::candidate stale;
+
+  // Orphaned sessions are only stale if requested.
+  set_dead_driver();
+  ASSERT_FALSE(collector.check(session, time(nullptr), stale));
+
+  collector.set_orphans(true);
+  ASSERT_TRUE(collector.check(session, time(nullptr), stale));
+  ASSERT_EQ(stale.why, schroot::chroot::gc::STALE_ORPHANED);
+  ASSERT_NE(schroot::chroot::gc::describe(stale).find(std::to_string(getpid())),
+            std::string::npos);
+}
+
+TEST_F(ChrootGC, OrphanedDriverAlive)
+{
+  schroot::chroot::gc collector;
+  schroot::chroot::gc::candidate stale;
+  collector.set_orphans(true);
+
+  psess->set_driver(getpid());
+  ASSERT_FALSE(collector.check(session, time(nullptr), stale));
+}
+
+TEST_F(ChrootGC, NotSession)
+{
+  schroot::chroot::gc collector;
+  schroot::chroot::gc::candidate stale;
+  collector.set_idle_time(0);
+  collector.set_orphans(true);
+
+  ASSERT_FALSE(collector.check(chroot, time(nullptr), stale));
+}
+
+TEST_F(ChrootGC, DriverKeyfile)
+{
+  psess->set_driver_pid(1234);
+  psess->set_driver_start_time(5678);
+  psess->set_ending(true);
+
+  schroot::keyfile keyfile;
+  psess->get_keyfile(keyfile);
+  const std::string group(session->get_name());
+  pid_t pid = 0;
+  unsigned long long start_time = 0;
+  bool ending = false;
+  ASSERT_TRUE(keyfile.get_value(group, "driver-pid", pid));
+  ASSERT_TRUE(keyfile.get_value(group, "driver-start-time", start_time));
+  ASSERT_TRUE(keyfile.get_value(group, "ending", ending));
+  ASSERT_EQ(pid, 1234);
+  ASSERT_EQ(start_time, 5678U);
+  ASSERT_TRUE(ending);
+
+  schroot::chroot::chroot::ptr copy
+    (chroot->clone_session(session->get_name(), session->get_name(),
+                           "user1", false));
+  ASSERT_NE(copy, nullptr);
+  schroot::chroot::facet::session::ptr pcopy
+    (copy->get_facet<schroot::chroot::facet::session>());
+  ASSERT_NE(pcopy, nullptr);
+  ASSERT_EQ(pcopy->get_driver_pid(), 0);
+  ASSERT_FALSE(pcopy->get_ending());
+
+  pcopy->set_keyfile(keyfile);
+  ASSERT_EQ(pcopy->get_driver_pid(), 1234);
+  ASSERT_EQ(pcopy->get_driver_start_time(), 5678U);
+  ASSERT_TRUE(pcopy->get_ending());
+}
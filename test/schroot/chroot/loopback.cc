@@ -86,6 +86,9 @@ public:
     expected.add("CHROOT_PATH",           "/mnt/mount-location/squeeze");
     expected.add("CHROOT_FILE",           loopback_file);
     expected.add("CHROOT_MOUNT_OPTIONS",  "-t jfs -o quota,rw");
+#ifdef SCHROOT_FEATURE_LOOPDEV
+    expected.add("CHROOT_LOOP_READ_ONLY", "false");
+#endif // SCHROOT_FEATURE_LOOPDEV
   }
 
   void setup_keyfile_loop(schroot::keyfile &expected, std::string group)
@@ -94,6 +97,12 @@ public:
     expected.set_value(group, "file", loopback_file);
     expected.set_value(group, "location", "/squeeze");
     expected.set_value(group, "mount-options", "-t jfs -o quota,rw");
+#ifdef SCHROOT_FEATURE_LOOPDEV
+    expected.set_value(group, "loop-read-only", "false");
+    expected.set_value(group, "loop-direct-io", "true");
+    expected.set_value(group, "loop-partscan", "false");
+    expected.set_value(group, "loop-autoclear", "true");
+#endif // SCHROOT_FEATURE_LOOPDEV
   }
 };
 
@@ -105,6 +114,31 @@ TEST_F(ChrootLoopback, File)
   ASSERT_EQ(loop->get_filename(), "/dev/some/file");
 }
 
+#ifdef SCHROOT_FEATURE_LOOPDEV
+TEST_F(ChrootLoopback, LoopDevice)
+{
+  schroot::chroot::facet::loopback::ptr loop = chroot->get_facet_strict<schroot::chroot::facet::loopback>();
+  ASSERT_NE(loop, nullptr);
+  ASSERT_TRUE(loop->get_loop_device().empty());
+  loop->set_loop_device("/dev/loop7");
+  ASSERT_EQ(loop->get_loop_device(), "/dev/loop7");
+  ASSERT_THROW(loop->set_loop_device("loop7"), schroot::chroot::chroot::error);
+
+  ASSERT_FALSE(loop->get_loop_read_only());
+  loop->set_loop_read_only(true);
+  ASSERT_TRUE(loop->get_loop_read_only());
+  ASSERT_TRUE(loop->get_loop_direct_io());
+  loop->set_loop_direct_io(false);
+  ASSERT_FALSE(loop->get_loop_direct_io());
+  ASSERT_FALSE(loop->get_loop_partscan());
+  loop->set_loop_partscan(true);
+  ASSERT_TRUE(loop->get_loop_partscan());
+  ASSERT_TRUE(loop->get_loop_autoclear());
+  loop->set_loop_autoclear(false);
+  ASSERT_FALSE(loop->get_loop_autoclear());
+}
+#endif // SCHROOT_FEATURE_LOOPDEV
+
 TEST_F(ChrootLoopback, MountOptions)
 {
   schroot::chroot::facet::mountable::ptr pmnt(chroot->get_facet<schroot::chroot::facet::mountable>());
@@ -136,6 +170,7 @@ TEST_F(ChrootLoopback, SetupEnvSession)
 
   expected.add("SESSION_ID",            "test-session-name");
   expected.add("CHROOT_ALIAS",          "test-session-name");
+  expected.add("CHROOT_SESSION_RECLAIM", "immediate");
   expected.add("CHROOT_DESCRIPTION",     chroot->get_description() + ' ' + _("(session chroot)"));
   expected.add("CHROOT_SESSION_CLONE",  "false");
   expected.add("CHROOT_SESSION_CREATE", "false");
@@ -164,6 +199,8 @@ TEST_F(ChrootLoopback, SetupEnvUnion)
   expected.add("CHROOT_UNION_MOUNT_OPTIONS",      "union-mount-options");
   expected.add("CHROOT_UNION_OVERLAY_DIRECTORY",  "/overlay");
   expected.add("CHROOT_UNION_UNDERLAY_DIRECTORY", "/underlay");
+  expected.add("CHROOT_UNION_OVERLAY_TMPFS", "false");
+  expected.add("CHROOT_UNION_OVERLAY_VOLATILE", "false");
 
   ChrootBase::test_setup_env(chroot_union, expected);
 }
@@ -175,6 +212,7 @@ TEST_F(ChrootLoopback, SetupEnvSessionUnion)
 
   expected.add("SESSION_ID",            "test-union-session-name");
   expected.add("CHROOT_ALIAS",          "test-union-session-name");
+  expected.add("CHROOT_SESSION_RECLAIM", "immediate");
   expected.add("CHROOT_DESCRIPTION",     chroot->get_description() + ' ' + _("(session chroot)"));
   expected.add("CHROOT_SESSION_CLONE",  "false");
   expected.add("CHROOT_SESSION_CREATE", "false");
@@ -185,6 +223,8 @@ TEST_F(ChrootLoopback, SetupEnvSessionUnion)
   expected.add("CHROOT_UNION_MOUNT_OPTIONS",      "union-mount-options");
   expected.add("CHROOT_UNION_OVERLAY_DIRECTORY",  "/overlay/test-union-session-name");
   expected.add("CHROOT_UNION_UNDERLAY_DIRECTORY", "/underlay/test-union-session-name");
+  expected.add("CHROOT_UNION_OVERLAY_TMPFS", "false");
+  expected.add("CHROOT_UNION_OVERLAY_VOLATILE", "false");
   ChrootBase::test_setup_env(session_union, expected);
 }
 
@@ -210,6 +250,7 @@ TEST_F(ChrootLoopback, SetupEnvSessionSourceUnion)
 
   expected.add("SESSION_ID",            "test-session-name");
   expected.add("CHROOT_ALIAS",          "test-session-name");
+  expected.add("CHROOT_SESSION_RECLAIM", "immediate");
   expected.add("CHROOT_NAME",           "test-name");
   expected.add("CHROOT_DESCRIPTION",     chroot->get_description() + ' ' + _("(source chroot) (session chroot)"));
   expected.add("CHROOT_MOUNT_DEVICE",   loopback_file);
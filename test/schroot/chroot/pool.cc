@@ -0,0 +1,216 @@
+/* Copyright © 2006-2013  Roger Leigh <rleigh@codelibre.net>
+ *
+ * schroot is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * schroot is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ *********************************************************************/
+
+#include <config.h>
+
+#include <schroot/chroot/facet/directory.h>
+#include <schroot/chroot/facet/session.h>
+#include <schroot/chroot/facet/session-clonable.h>
+#include <schroot/chroot/pool.h>
+#include <schroot/keyfile-writer.h>
+
+#include <test/schroot/chroot/chroot.h>
+
+#include <boost/filesystem.hpp>
+
+#include <fstream>
+#include <string>
+
+#include <unistd.h>
+
+class ChrootPool : public ChrootBase
+{
+public:
+  std::string tmpdir;
+
+  ChrootPool():
+    ChrootBase("directory"),
+    tmpdir()
+  {}
+
+  void SetUp()
+  {
+    ChrootBase::SetUp();
+
+    tmpdir = (boost::filesystem::temp_directory_path() /
+              boost::filesystem::unique_path("schroot-pool-%%%%-%%%%")).string();
+    ASSERT_TRUE(boost::filesystem::create_directory(tmpdir));
+  }
+
+  void TearDown()
+  {
+    boost::filesystem::remove_all(tmpdir);
+  }
+
+  virtual void setup_chroot_props (schroot::chroot::chroot::chroot::ptr& chroot)
+  {
+    ChrootBase::setup_chroot_props(chroot);
+
+    schroot::chroot::facet::directory::ptr dirfac = chroot->get_facet<schroot::chroot::facet::directory>();
+    ASSERT_NE(dirfac, nullptr);
+    dirfac->set_directory("/srv/chroot/example-chroot");
+
+    set_size(chroot, 2);
+  }
+
+  void set_size (schroot::chroot::chroot::ptr& chroot,
+                 unsigned int                  size)
+  {
+    schroot::chroot::facet::session_clonable::ptr psess = chroot->get_facet<schroot::chroot::facet::session_clonable>();
+    ASSERT_NE(psess, nullptr);
+    psess->set_session_pool_size(size);
+  }
+
+  // Add a pooled session, as if set up by a refill.
+  void add_member (const std::string& name)
+  {
+    schroot::chroot::chroot::ptr member
+      (chroot->clone_session(name, chroot->get_name(), "user1", false));
+    ASSERT_NE(member, nullptr);
+
+    schroot::keyfile kf;
+    kf << member;
+    std::ofstream output((tmpdir + '/' + name).c_str());
+    output << schroot::keyfile_writer(kf);
+  }
+};
+
+TEST_F(ChrootPool, Generation)
+{
+  schroot::chroot::pool pool(chroot, tmpdir);
+  const std::string generation(pool.get_generation());
+  ASSERT_EQ(generation.size(), 8U);
+  ASSERT_EQ(schroot::chroot::pool(chroot, tmpdir).get_generation(), generation);
+
+  // The pool size does not change the generation.
+  set_size(chroot, 4);
+  ASSERT_EQ(pool.get_generation(), generation);
+
+  // Changing the chroot does.
+  chroot->set_description("modified-description");
+  const std::string modified(pool.get_generation());
+  ASSERT_NE(modified, generation);
+
+  schroot::chroot::pool::invalidate(chroot->get_name(), tmpdir);
+  ASSERT_NE(pool.get_generation(), modified);
+  ASSERT_NE(pool.get_generation(), generation);
+}
+
+TEST_F(ChrootPool, Members)
+{
+  schroot::chroot::pool pool(chroot, tmpdir);
+  ASSERT_TRUE(pool.get_members().empty());
+  ASSERT_TRUE(pool.get_surplus_members().empty());
+
+  const std::string name(pool.create_member_name());
+  ASSERT_EQ(name.compare(0, std::string("test-name-pool-").size(), "test-name-pool-"), 0);
+  ASSERT_NE(name.find(pool.get_generation()), std::string::npos);
+
+  const std::string prefix("test-name-pool-" + pool.get_generation() + '-');
+  add_member(prefix + "a");
+  add_member(prefix + "b");
+  // Locks, claimed members and other chroots are not members.
+  std::ofstream(tmpdir + "/.test-name.lock");
+  std::ofstream(tmpdir + "/." + prefix + "c.claim");
+  std::ofstream(tmpdir + "/other-pool-" + pool.get_generation() + "-a");
+
+  schroot::string_list members(pool.get_members());
+  ASSERT_EQ(members.size(), 2U);
+  ASSERT_EQ(members[0], prefix + "a");
+  ASSERT_EQ(members[1], prefix + "b");
+  ASSERT_TRUE(pool.get_surplus_members().empty());
+}
+
+TEST_F(ChrootPool, Refill)
+{
+  schroot::chroot::pool pool(chroot, tmpdir);
+  const std::string prefix("test-name-pool-" + pool.get_generation() + '-');
+  add_member(prefix + "a");
+  add_member(prefix + "b");
+  ASSERT_EQ(pool.get_size(), 2U);
+  ASSERT_TRUE(pool.get_surplus_members().empty());
+
+  // Members beyond a reduced pool size are surplus.
+  set_size(chroot, 1);
+  schroot::string_list surplus(pool.get_surplus_members());
+  ASSERT_EQ(surplus.size(), 1U);
+  ASSERT_EQ(surplus[0], prefix + "b");
+
+  // A disabled pool is drained completely.
+  set_size(chroot, 0);
+  ASSERT_EQ(pool.get_surplus_members().size(), 2U);
+
+  // Only one process may refill the pool at once.
+  ASSERT_TRUE(pool.lock());
+  schroot::chroot::pool other(chroot, tmpdir);
+  ASSERT_FALSE(other.lock());
+  pool.unlock();
+  ASSERT_TRUE(other.lock());
+}
+
+TEST_F(ChrootPool, Invalidate)
+{
+  schroot::chroot::pool pool(chroot, tmpdir);
+  const std::string prefix("test-name-pool-" + pool.get_generation() + '-');
+  add_member(prefix + "a");
+  add_member(prefix + "b");
+  ASSERT_EQ(pool.get_members().size(), 2U);
+
+  schroot::chroot::pool::invalidate(chroot->get_name(), tmpdir);
+
+  // Members of an older generation are never claimed, and are all
+  // surplus.
+  ASSERT_TRUE(pool.get_members().empty());
+  ASSERT_EQ(pool.get_surplus_members().size(), 2U);
+  ASSERT_EQ(pool.claim("test-claimed", "test-alias", "user2", false), nullptr);
+  ASSERT_TRUE(boost::filesystem::exists(tmpdir + '/' + prefix + "a"));
+}
+
+TEST_F(ChrootPool, Claim)
+{
+  // Claimed sessions are written to the session directory.
+  if (access(SCHROOT_SESSION_DIR, W_OK) != 0)
+    GTEST_SKIP();
+
+  schroot::chroot::pool pool(chroot, tmpdir);
+  const std::string member(pool.create_member_name());
+  add_member(member);
+  const std::string session_id("test-claimed-" + schroot::unique_identifier());
+
+  schroot::chroot::chroot::ptr claimed
+    (pool.claim(session_id, "test-alias", "user2", false));
+  ASSERT_NE(claimed, nullptr);
+  std::string session_file(std::string(SCHROOT_SESSION_DIR) + '/' + session_id);
+  bool saved = boost::filesystem::exists(session_file);
+  unlink(session_file.c_str());
+
+  ASSERT_TRUE(saved);
+  ASSERT_EQ(claimed->get_name(), session_id);
+  schroot::chroot::facet::session::const_ptr psess
+    (claimed->get_facet<schroot::chroot::facet::session>());
+  ASSERT_NE(psess, nullptr);
+  ASSERT_EQ(psess->get_selected_name(), "test-alias");
+  ASSERT_EQ(claimed->get_users().size(), 1U);
+  ASSERT_EQ(claimed->get_users().front(), "user2");
+
+  // The member is removed from the pool.
+  ASSERT_FALSE(boost::filesystem::exists(tmpdir + '/' + member));
+  ASSERT_FALSE(boost::filesystem::exists(tmpdir + "/." + member + ".claim"));
+  ASSERT_TRUE(pool.get_members().empty());
+  ASSERT_EQ(pool.claim(session_id, "test-alias", "user2", false), nullptr);
+}
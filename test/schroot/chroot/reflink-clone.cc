@@ -0,0 +1,311 @@
+/* Copyright © 2006-2013  Roger Leigh <rleigh@codelibre.net>
+ *
+ * schroot is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * schroot is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ *********************************************************************/
+
+#include <config.h>
+
+#include <schroot/chroot/facet/reflink-clone.h>
+#include <schroot/i18n.h>
+#include <schroot/keyfile-writer.h>
+#include <schroot/util.h>
+
+#include <test/schroot/chroot/chroot.h>
+
+#include <algorithm>
+#include <set>
+
+using schroot::_;
+
+class ReflinkClone : public ChrootBase
+{
+public:
+  ReflinkClone():
+    ChrootBase("reflink-clone")
+  {}
+
+  void SetUp()
+  {
+    ChrootBase::SetUp();
+    ASSERT_NE(chroot, nullptr);
+    ASSERT_NE(session, nullptr);
+    ASSERT_NE(source, nullptr);
+    ASSERT_NE(session_source, nullptr);
+  }
+
+  virtual void setup_chroot_props (schroot::chroot::chroot::ptr& chroot)
+  {
+    ChrootBase::setup_chroot_props(chroot);
+
+    schroot::chroot::facet::reflink_clone::ptr rfac = chroot->get_facet_strict<schroot::chroot::facet::reflink_clone>();
+    rfac->set_source_directory("/srv/chroot/sid");
+    rfac->set_clone_directory("/srv/chroot/clone");
+  }
+
+  void setup_env_gen(schroot::environment &expected)
+  {
+    setup_env_chroot(expected);
+    expected.add("CHROOT_MOUNT_LOCATION", "/mnt/mount-location");
+    expected.add("CHROOT_PATH",           "/mnt/mount-location");
+  }
+
+  void setup_keyfile_reflink(schroot::keyfile &expected, std::string group)
+  {
+  }
+};
+
+TEST_F(ReflinkClone, SourceDirectory)
+{
+  schroot::chroot::facet::reflink_clone::ptr rfac = chroot->get_facet_strict<schroot::chroot::facet::reflink_clone>();
+  rfac->set_source_directory("/srv/chroot/chroot");
+  ASSERT_EQ(rfac->get_source_directory(), "/srv/chroot/chroot");
+}
+
+TEST_F(ReflinkClone, CloneDirectory)
+{
+  schroot::chroot::facet::reflink_clone::ptr rfac = chroot->get_facet_strict<schroot::chroot::facet::reflink_clone>();
+  rfac->set_clone_directory("/srv/chroot/clone2");
+  ASSERT_EQ(rfac->get_clone_directory(), "/srv/chroot/clone2");
+}
+
+TEST_F(ReflinkClone, CloneName)
+{
+  schroot::chroot::facet::reflink_clone::ptr rfac = chroot->get_facet_strict<schroot::chroot::facet::reflink_clone>();
+  rfac->set_clone_name("/srv/chroot/clone2/test-session-id");
+  ASSERT_EQ(rfac->get_clone_name(), "/srv/chroot/clone2/test-session-id");
+}
+
+TEST_F(ReflinkClone, CloneJobs)
+{
+  schroot::chroot::facet::reflink_clone::ptr rfac = chroot->get_facet_strict<schroot::chroot::facet::reflink_clone>();
+  ASSERT_EQ(rfac->get_clone_jobs(), 0U);
+  rfac->set_clone_jobs(8);
+  ASSERT_EQ(rfac->get_clone_jobs(), 8U);
+}
+
+TEST_F(ReflinkClone, AsyncReclaim)
+{
+  schroot::chroot::facet::reflink_clone::ptr rfac = chroot->get_facet_strict<schroot::chroot::facet::reflink_clone>();
+  ASSERT_FALSE(rfac->get_async_reclaim());
+  rfac->set_async_reclaim(true);
+  ASSERT_TRUE(rfac->get_async_reclaim());
+}
+
+TEST_F(ReflinkClone, SourceDirectoryFail)
+{
+  schroot::chroot::facet::reflink_clone::ptr rfac = chroot->get_facet_strict<schroot::chroot::facet::reflink_clone>();
+  ASSERT_THROW(rfac->set_source_directory("chroot/invalid"), schroot::chroot::chroot::error);
+}
+
+TEST_F(ReflinkClone, CloneDirectoryFail)
+{
+  schroot::chroot::facet::reflink_clone::ptr rfac = chroot->get_facet_strict<schroot::chroot::facet::reflink_clone>();
+  ASSERT_THROW(rfac->set_clone_directory("chroot/invalid"), schroot::chroot::chroot::error);
+}
+
+TEST_F(ReflinkClone, CloneNameFail)
+{
+  schroot::chroot::facet::reflink_clone::ptr rfac = chroot->get_facet_strict<schroot::chroot::facet::reflink_clone>();
+  ASSERT_THROW(rfac->set_clone_name("invalid"), schroot::chroot::chroot::error);
+}
+
+TEST_F(ReflinkClone, Type)
+{
+  ASSERT_EQ(chroot->get_chroot_type(), "reflink-clone");
+}
+
+
+TEST_F(ReflinkClone, SetupEnv)
+{
+  schroot::environment expected;
+  setup_env_gen(expected);
+  expected.add("CHROOT_TYPE",           "reflink-clone");
+  expected.add("CHROOT_REFLINK_SOURCE_DIRECTORY",       "/srv/chroot/sid");
+  expected.add("CHROOT_REFLINK_CLONE_DIRECTORY", "/srv/chroot/clone");
+  expected.add("CHROOT_SESSION_CLONE",  "true");
+  expected.add("CHROOT_SESSION_CREATE", "true");
+  expected.add("CHROOT_SESSION_PURGE",  "false");
+  expected.add("CHROOT_SESSION_SOURCE", "false");
+
+  ChrootBase::test_setup_env(chroot, expected);
+}
+
+TEST_F(ReflinkClone, SetupEnvSession)
+{
+  schroot::environment expected;
+  setup_env_gen(expected);
+  expected.add("CHROOT_TYPE",           "reflink-clone");
+  expected.add("SESSION_ID",            "test-session-name");
+  expected.add("CHROOT_ALIAS",          "test-session-name");
+  expected.add("CHROOT_SESSION_RECLAIM", "immediate");
+  expected.add("CHROOT_DESCRIPTION",     chroot->get_description() + ' ' + _("(session chroot)"));
+  expected.add("CHROOT_REFLINK_SOURCE_DIRECTORY",       "/srv/chroot/sid");
+  expected.add("CHROOT_REFLINK_CLONE_DIRECTORY", "/srv/chroot/clone");
+  expected.add("CHROOT_REFLINK_CLONE_NAME", "/srv/chroot/clone/test-session-name");
+  expected.add("CHROOT_SESSION_CLONE",  "false");
+  expected.add("CHROOT_SESSION_CREATE", "false");
+  expected.add("CHROOT_SESSION_PURGE",  "true");
+  expected.add("CHROOT_SESSION_SOURCE", "false");
+
+  ChrootBase::test_setup_env(session, expected);
+}
+
+TEST_F(ReflinkClone, SetupEnvSource)
+{
+  schroot::environment expected;
+  setup_env_gen(expected);
+  expected.add("CHROOT_TYPE",           "directory");
+  expected.add("CHROOT_NAME",           "test-name");
+  expected.add("CHROOT_DESCRIPTION",     chroot->get_description() + ' ' + _("(source chroot)"));
+  expected.add("CHROOT_DIRECTORY",       "/srv/chroot/sid");
+  expected.add("CHROOT_SESSION_CLONE",  "false");
+  expected.add("CHROOT_SESSION_CREATE", "true");
+  expected.add("CHROOT_SESSION_PURGE",  "false");
+  expected.add("CHROOT_SESSION_SOURCE", "false");
+
+  ChrootBase::test_setup_env(source, expected);
+}
+
+TEST_F(ReflinkClone, SetupEnvSessionSource)
+{
+  schroot::environment expected;
+  setup_env_gen(expected);
+  expected.add("CHROOT_TYPE",           "directory");
+  expected.add("SESSION_ID",            "test-session-name");
+  expected.add("CHROOT_NAME",           "test-name");
+  expected.add("CHROOT_ALIAS",          "test-session-name");
+  expected.add("CHROOT_SESSION_RECLAIM", "immediate");
+  expected.add("CHROOT_DESCRIPTION",     chroot->get_description() + ' ' + _("(source chroot)") + ' ' + _("(session chroot)"));
+  expected.add("CHROOT_DIRECTORY",       "/srv/chroot/sid");
+  expected.add("CHROOT_SESSION_CLONE",  "false");
+  expected.add("CHROOT_SESSION_CREATE", "false");
+  expected.add("CHROOT_SESSION_PURGE",  "false");
+  expected.add("CHROOT_SESSION_SOURCE", "true");
+
+  ChrootBase::test_setup_env(session_source, expected);
+}
+
+TEST_F(ReflinkClone, SetupKeyfile)
+{
+  schroot::keyfile expected;
+  std::string group = chroot->get_name();
+  setup_keyfile_chroot(expected, group);
+  setup_keyfile_source(expected, group);
+  setup_keyfile_reflink(expected, group);
+  expected.set_value(group, "type", "reflink-clone");
+  expected.set_value(group, "reflink-source-directory", "/srv/chroot/sid");
+  expected.set_value(group, "reflink-clone-directory", "/srv/chroot/clone");
+  expected.set_value(group, "reflink-clone-jobs", "0");
+  expected.set_value(group, "reflink-async-reclaim", "false");
+
+  ChrootBase::test_setup_keyfile
+    (chroot,expected, chroot->get_name());
+}
+
+TEST_F(ReflinkClone, SetupKeyfileSession)
+{
+  schroot::keyfile expected;
+  const std::string group(session->get_name());
+  setup_keyfile_session(expected, group);
+  setup_keyfile_reflink(expected, group);
+  expected.set_value(group, "type", "reflink-clone");
+  expected.set_value(group, "name", "test-session-name");
+  expected.set_value(group, "selected-name", "test-session-name");
+  expected.set_value(group, "description", chroot->get_description() + ' ' + _("(session chroot)"));
+  expected.set_value(group, "aliases", "");
+  expected.set_value(group, "reflink-clone-name", "/srv/chroot/clone/test-session-name");
+  expected.set_value(group, "reflink-clone-jobs", "0");
+  expected.set_value(group, "reflink-async-reclaim", "false");
+  expected.set_value(group, "mount-location", "/mnt/mount-location");
+
+  ChrootBase::test_setup_keyfile
+    (session, expected, group);
+}
+
+TEST_F(ReflinkClone, SetupKeyfileSource)
+{
+  schroot::keyfile expected;
+  const std::string group(source->get_name());
+  setup_keyfile_chroot(expected, group);
+  setup_keyfile_reflink(expected, group);
+  expected.set_value(group, "type", "directory");
+  expected.set_value(group, "description", chroot->get_description() + ' ' + _("(source chroot)"));
+  expected.set_value(group, "aliases", "test-alias-1-source,test-alias-2-source");
+  expected.set_value(group, "directory", "/srv/chroot/sid");
+  setup_keyfile_source_clone(expected, group);
+
+  ChrootBase::test_setup_keyfile
+    (source, expected, group);
+}
+
+TEST_F(ReflinkClone, SetupKeyfileSessionSource)
+{
+  schroot::keyfile expected;
+  const std::string group(source->get_name());
+  setup_keyfile_chroot(expected, group);
+  setup_keyfile_reflink(expected, group);
+  expected.set_value(group, "type", "directory");
+  expected.set_value(group, "description", chroot->get_description() + ' ' + _("(source chroot)"));
+  expected.set_value(group, "aliases", "test-alias-1-source,test-alias-2-source");
+  expected.set_value(group, "directory", "/srv/chroot/sid");
+  expected.set_value(group, "mount-location", "/mnt/mount-location");
+  setup_keyfile_session_source_clone(expected, group);
+
+  ChrootBase::test_setup_keyfile
+    (session_source, expected, group);
+}
+
+TEST_F(ReflinkClone, SessionFlags)
+{
+  ASSERT_EQ(chroot->get_session_flags(),
+            (schroot::chroot::facet::facet::SESSION_CREATE |
+             schroot::chroot::facet::facet::SESSION_CLONE));
+
+  ASSERT_EQ(session->get_session_flags(),
+            (schroot::chroot::facet::facet::SESSION_PURGE));
+
+  /// @todo: Should return NOFLAGS?  This depends upon if source
+  /// chroots need transforming into sessions as well (which should
+  /// probably happen and be tested for independently).
+  ASSERT_EQ(source->get_session_flags(),
+            (schroot::chroot::facet::facet::SESSION_CREATE));
+
+  ASSERT_EQ(session_source->get_session_flags(),
+            (schroot::chroot::facet::facet::SESSION_SOURCE));
+}
+
+TEST_F(ReflinkClone, PrintDetails)
+{
+  std::ostringstream os;
+  os << chroot;
+  // TODO: Compare output.
+  ASSERT_FALSE(os.str().empty());
+}
+
+TEST_F(ReflinkClone, PrintConfig)
+{
+  std::ostringstream os;
+  schroot::keyfile config;
+  config << chroot;
+  os << schroot::keyfile_writer(config);
+  // TODO: Compare output.
+  ASSERT_FALSE(os.str().empty());
+}
+
+TEST_F(ReflinkClone, RunSetupScripts)
+{
+  ASSERT_TRUE(chroot->get_run_setup_scripts());
+}
@@ -0,0 +1,157 @@
+/* Copyright © 2006-2013  Roger Leigh <rleigh@codelibre.net>
+ *
+ * schroot is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * schroot is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ *********************************************************************/
+
+
+#include <gtest/gtest.h>
+
+#include <schroot/client.h>
+#include <schroot/client-protocol.h>
+
+#include <cstdlib>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+TEST(Client, Request)
+{
+  schroot::client::request req;
+  req.operation = schroot::session::OPERATION_RUN;
+  req.session = "test-session";
+  req.user = "nobody";
+  req.command = {"/bin/sh", "-c", "echo a=b"};
+  req.environment = {"PATH=/usr/bin:/bin", "EMPTY="};
+  req.preserve_environment = true;
+  req.directory = "/tmp";
+  req.options = {{"key", "value=1"}};
+  req.fds = {{0, 5}, {1, 7}};
+
+  schroot::client_protocol::message msg(schroot::client_protocol::encode_request(42, req));
+
+  unsigned long id = 0;
+  schroot::client::request decoded
+    (schroot::client_protocol::decode_request
+     (schroot::client_protocol::deserialise(schroot::client_protocol::serialise(msg)), id));
+
+  EXPECT_EQ(42U, id);
+  EXPECT_EQ(req.operation, decoded.operation);
+  EXPECT_EQ(req.session, decoded.session);
+  EXPECT_TRUE(decoded.chroot.empty());
+  EXPECT_EQ(req.user, decoded.user);
+  EXPECT_EQ(req.command, decoded.command);
+  EXPECT_EQ(req.environment, decoded.environment);
+  EXPECT_TRUE(decoded.preserve_environment);
+  EXPECT_EQ(req.directory, decoded.directory);
+  EXPECT_EQ(req.options, decoded.options);
+
+  // Descriptor numbers are not sent in the message.
+  std::map<int, int> fds{{0, -1}, {1, -1}};
+  EXPECT_EQ(fds, decoded.fds);
+}
+
+TEST(Client, Result)
+{
+  schroot::client::diagnostic diag;
+  diag.level = schroot::LOG_LEVEL_ERROR;
+  diag.message = "test-session: Chroot not found";
+  diag.fields = {{"chroot", "test-session"}};
+
+  schroot::client::result res;
+  res.session = "test-session";
+  res.status = 3;
+  res.diagnostics.push_back(diag);
+
+  unsigned long id = 0;
+  schroot::client::result decoded
+    (schroot::client_protocol::decode_result
+     (schroot::client_protocol::deserialise
+      (schroot::client_protocol::serialise(schroot::client_protocol::encode_result(7, res))), id));
+
+  EXPECT_EQ(7U, id);
+  EXPECT_EQ(res.session, decoded.session);
+  EXPECT_EQ(3, decoded.status);
+  ASSERT_EQ(1U, decoded.diagnostics.size());
+  EXPECT_EQ(schroot::LOG_LEVEL_ERROR, decoded.diagnostics[0].level);
+  EXPECT_EQ(diag.message, decoded.diagnostics[0].message);
+  EXPECT_EQ(diag.fields, decoded.diagnostics[0].fields);
+  EXPECT_EQ(diag.message, decoded.get_error());
+}
+
+TEST(Client, Invalid)
+{
+  unsigned long id;
+
+  // Missing separator.
+  EXPECT_THROW(schroot::client_protocol::deserialise(std::string("id", 3)),
+               schroot::client::error);
+  // Missing terminator.
+  EXPECT_THROW(schroot::client_protocol::deserialise("id=1"),
+               schroot::client::error);
+  // Embedded NUL.
+  schroot::client_protocol::message nul{{"command", std::string("a\0b", 3)}};
+  EXPECT_THROW(schroot::client_protocol::serialise(nul),
+               schroot::client::error);
+
+  schroot::client_protocol::message unknown{{"id", "1"}, {"unknown", "value"}};
+  EXPECT_THROW(schroot::client_protocol::decode_request(unknown, id),
+               schroot::client::error);
+  schroot::client_protocol::message noid{{"operation", "run"}};
+  EXPECT_THROW(schroot::client_protocol::decode_request(noid, id),
+               schroot::client::error);
+  schroot::client_protocol::message badop{{"id", "1"}, {"operation", "stop"}};
+  EXPECT_THROW(schroot::client_protocol::decode_request(badop, id),
+               schroot::client::error);
+  schroot::client_protocol::message badid{{"id", "-1"}, {"status", "0"}};
+  EXPECT_THROW(schroot::client_protocol::decode_result(badid, id),
+               schroot::client::error);
+  schroot::client_protocol::message nostatus{{"id", "1"}};
+  EXPECT_THROW(schroot::client_protocol::decode_result(nostatus, id),
+               schroot::client::error);
+}
+
+TEST(Client, SendReceive)
+{
+  int sv[2];
+  ASSERT_EQ(0, socketpair(AF_UNIX, SOCK_SEQPACKET, 0, sv));
+  int pipefd[2];
+  ASSERT_EQ(0, pipe(pipefd));
+
+  schroot::client_protocol::message msg{{"id", "1"}, {"command", "a=b"}};
+  schroot::client_protocol::send(sv[0], msg, {pipefd[1]});
+  close(pipefd[1]);
+
+  schroot::client_protocol::message received;
+  std::vector<int> fds;
+  ASSERT_TRUE(schroot::client_protocol::receive(sv[1], received, fds));
+  EXPECT_EQ(msg, received);
+  ASSERT_EQ(1U, fds.size());
+
+  // The received descriptor refers to the same pipe.
+  ASSERT_EQ(1, write(fds[0], "x", 1));
+  close(fds[0]);
+  char c = 0;
+  EXPECT_EQ(1, read(pipefd[0], &c, 1));
+  EXPECT_EQ('x', c);
+  close(pipefd[0]);
+
+  close(sv[0]);
+  EXPECT_FALSE(schroot::client_protocol::receive(sv[1], received, fds));
+  close(sv[1]);
+}
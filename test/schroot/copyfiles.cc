@@ -0,0 +1,211 @@
+/* Copyright © 2006-2013  Roger Leigh <rleigh@codelibre.net>
+ *
+ * schroot is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * schroot is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ *********************************************************************/
+
+
+#include <gtest/gtest.h>
+
+#include <boost/filesystem.hpp>
+
+#include <schroot/copyfiles.h>
+
+#include <test/schroot/tmpdir.h>
+
+#include <fstream>
+#include <iterator>
+#include <string>
+
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+namespace
+{
+
+  std::string
+  read_file (const std::string& file)
+  {
+    std::ifstream input(file.c_str());
+    return std::string(std::istreambuf_iterator<char>(input),
+                       std::istreambuf_iterator<char>());
+  }
+
+}
+
+class Copyfiles : public TmpdirTest
+{
+public:
+  std::string cache;
+  std::string source;
+  std::string destination;
+
+  Copyfiles():
+    TmpdirTest("copyfiles")
+  {}
+
+  void SetUp()
+  {
+    ASSERT_NO_FATAL_FAILURE(TmpdirTest::SetUp());
+    cache = tmpdir + "/digests";
+    source = tmpdir + "/source";
+    destination = tmpdir + "/destination";
+
+    std::ofstream(source) << "source contents\n";
+    ASSERT_EQ(chmod(source.c_str(), 0640), 0);
+  }
+};
+
+TEST_F(Copyfiles, Digest)
+{
+  std::string empty(tmpdir + "/empty");
+  std::string abc(tmpdir + "/abc");
+  std::string fox(tmpdir + "/fox");
+  std::ofstream(empty.c_str());
+  std::ofstream(abc) << "abc";
+  std::ofstream(fox) << "The quick brown fox jumps over the lazy dog";
+
+  ASSERT_EQ(schroot::copyfiles::digest(empty), 0xEF46DB3751D8E999ULL);
+  ASSERT_EQ(schroot::copyfiles::digest(abc), 0x44BC2CF5AD770999ULL);
+  ASSERT_EQ(schroot::copyfiles::digest(fox), 0x0B242D361FDA71BCULL);
+}
+
+TEST_F(Copyfiles, Copy)
+{
+  schroot::copyfiles copier(cache);
+
+  ASSERT_TRUE(copier.copy(source, destination));
+  ASSERT_EQ(read_file(destination), "source contents\n");
+
+  struct stat status;
+  ASSERT_EQ(stat(destination.c_str(), &status), 0);
+  ASSERT_EQ(status.st_mode & 07777, 0640U);
+
+  // Unchanged files are not copied again.
+  ASSERT_FALSE(copier.copy(source, destination));
+}
+
+TEST_F(Copyfiles, CopyChanged)
+{
+  schroot::copyfiles copier(cache);
+
+  ASSERT_TRUE(copier.copy(source, destination));
+
+  // Same size, different contents.
+  std::ofstream(destination) << "modified content\n";
+  ASSERT_TRUE(copier.copy(source, destination));
+  ASSERT_EQ(read_file(destination), "source contents\n");
+}
+
+TEST_F(Copyfiles, CopySymlink)
+{
+  std::string target(tmpdir + "/target");
+  std::ofstream(target) << "source contents\n";
+  ASSERT_EQ(symlink(target.c_str(), destination.c_str()), 0);
+
+  schroot::copyfiles copier(cache);
+
+  // The symlink is replaced, not followed.
+  ASSERT_TRUE(copier.copy(source, destination));
+  struct stat status;
+  ASSERT_EQ(lstat(destination.c_str(), &status), 0);
+  ASSERT_TRUE(S_ISREG(status.st_mode));
+  ASSERT_EQ(read_file(target), "source contents\n");
+}
+
+TEST_F(Copyfiles, CopyFifo)
+{
+  std::string fifo(tmpdir + "/fifo");
+  ASSERT_EQ(mkfifo(fifo.c_str(), 0600), 0);
+  ASSERT_EQ(chmod(fifo.c_str(), 0620), 0);
+  std::ofstream(destination) << "destination contents\n";
+
+  schroot::copyfiles copier(cache);
+
+  // Special files are always copied, replacing the destination.
+  ASSERT_TRUE(copier.copy(fifo, destination));
+  struct stat status;
+  ASSERT_EQ(lstat(destination.c_str(), &status), 0);
+  ASSERT_TRUE(S_ISFIFO(status.st_mode));
+  ASSERT_EQ(status.st_mode & 07777, 0620U);
+  ASSERT_TRUE(copier.copy(fifo, destination));
+
+  // No temporary files are left behind.
+  ASSERT_EQ(std::distance(boost::filesystem::directory_iterator(tmpdir),
+                          boost::filesystem::directory_iterator()), 3);
+}
+
+TEST_F(Copyfiles, CopyDirectorySymlink)
+{
+  std::string dir(tmpdir + "/dir");
+  std::string link(tmpdir + "/link");
+  ASSERT_EQ(mkdir(dir.c_str(), 0755), 0);
+  std::ofstream(dir + "/file") << "file contents\n";
+  ASSERT_EQ(symlink("dir", link.c_str()), 0);
+
+  schroot::copyfiles copier(cache);
+
+  // A symlink to a directory is copied as a symlink.
+  ASSERT_TRUE(copier.copy(link, destination));
+  ASSERT_EQ(boost::filesystem::read_symlink(destination).string(), "dir");
+
+  // A directory replaces the destination, whatever its type.
+  ASSERT_TRUE(copier.copy(dir, destination));
+  struct stat status;
+  ASSERT_EQ(lstat(destination.c_str(), &status), 0);
+  ASSERT_TRUE(S_ISDIR(status.st_mode));
+  ASSERT_EQ(read_file(destination + "/file"), "file contents\n");
+}
+
+TEST_F(Copyfiles, CopyMissing)
+{
+  schroot::copyfiles copier(cache);
+
+  ASSERT_THROW(copier.copy(tmpdir + "/missing", destination),
+               schroot::copyfiles::error);
+}
+
+TEST_F(Copyfiles, CopyList)
+{
+  std::string root(tmpdir + "/root");
+  ASSERT_TRUE(boost::filesystem::create_directories(root + tmpdir));
+
+  std::string list(tmpdir + "/list");
+  std::ofstream(list) << "# comment\n\n" << source << "\nrelative\n";
+
+  schroot::copyfiles copier(cache);
+
+  ASSERT_EQ(copier.copy_list(list, root), 1U);
+  ASSERT_EQ(read_file(root + source), "source contents\n");
+  ASSERT_EQ(copier.copy_list(list, root), 0U);
+}
+
+TEST_F(Copyfiles, Cache)
+{
+  {
+    schroot::copyfiles copier(cache);
+    ASSERT_TRUE(copier.copy(source, destination));
+    copier.save();
+  }
+
+  ASSERT_FALSE(read_file(cache).empty());
+
+  // Cached digests are used in place of the file contents.
+  {
+    schroot::copyfiles copier(cache);
+    ASSERT_FALSE(copier.copy(source, destination));
+  }
+}
@@ -212,6 +212,21 @@ TEST_F(Environment, GetStrv)
   schroot::strv_delete(strv);
 }
 
+TEST_F(Environment, GetEnvp)
+{
+  schroot::environment::envp envp(env->get_envp());
+  char **strv = envp.get();
+
+  int size = 0;
+  for (char **ev = strv; ev != 0 && *ev != 0; ++ev, ++size);
+
+  ASSERT_EQ(size, 4);
+  ASSERT_EQ(std::string(strv[0]), "COLUMNS=80");
+  ASSERT_EQ(std::string(strv[1]), "SHELL=/bin/sh");
+  ASSERT_EQ(std::string(strv[2]), "TERM=wy50");
+  ASSERT_EQ(std::string(strv[3]), "USER=root");
+}
+
 TEST_F(Environment, OperatorPlus)
 {
   schroot::environment e;
@@ -311,6 +326,50 @@ TEST_F(Environment, Filter)
   ASSERT_EQ(value, "bah");
 }
 
+TEST_F(Environment, FilterAlternation)
+{
+  // Not a list of names: ^FOO or BAR$.
+  schroot::regex f("^FOO|BAR$");
+
+  schroot::environment e;
+  e.set_filter(f);
+
+  ASSERT_TRUE(e.is_filtered("FOO"));
+  ASSERT_TRUE(e.is_filtered("FOOX"));
+  ASSERT_TRUE(e.is_filtered("XBAR"));
+  ASSERT_FALSE(e.is_filtered("XFOO"));
+}
+
+TEST_F(Environment, FilterNames)
+{
+  schroot::regex f("^(BASH_ENV|IFS|LD_.*|TERMINFO)$");
+
+  schroot::environment e;
+  e.set_filter(f);
+
+  ASSERT_TRUE(e.is_filtered("BASH_ENV"));
+  ASSERT_TRUE(e.is_filtered("IFS"));
+  ASSERT_TRUE(e.is_filtered("LD_"));
+  ASSERT_TRUE(e.is_filtered("LD_PRELOAD"));
+  ASSERT_TRUE(e.is_filtered("TERMINFO"));
+  ASSERT_FALSE(e.is_filtered("TERMINFO_DIRS"));
+  ASSERT_FALSE(e.is_filtered("XIFS"));
+  ASSERT_FALSE(e.is_filtered("IFSX"));
+  ASSERT_FALSE(e.is_filtered("OLD_PWD"));
+
+  e.add("IFS=x");
+  e.add("LD_LIBRARY_PATH=/lib");
+  e.add("TERM=wy50");
+  ASSERT_EQ(e.size(), 1);
+
+  // Replacing with a filtered name removes the existing variable.
+  schroot::environment e2(*env);
+  e2.set_filter(schroot::regex("^(TERM)$"));
+  e2.add("TERM=vt100");
+  std::string value;
+  ASSERT_FALSE(e2.get("TERM", value));
+}
+
 TEST_F(Environment, StreamOutput)
 {
   std::ostringstream os;
@@ -0,0 +1,108 @@
+/* Copyright © 2006-2013  Roger Leigh <rleigh@codelibre.net>
+ *
+ * schroot is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * schroot is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ *********************************************************************/
+
+
+#include <gtest/gtest.h>
+
+#include <schroot/format-detail.h>
+
+#include <limits>
+#include <locale>
+#include <sstream>
+#include <string>
+
+using schroot::format_detail;
+using schroot::N_;
+
+TEST(FormatDetail, Key)
+{
+  ASSERT_EQ(format_detail::get_key("Name"), "name");
+  ASSERT_EQ(format_detail::get_key("Message Verbosity"), "message-verbosity");
+  ASSERT_EQ(format_detail::get_key("Loop Device Direct I/O"),
+            "loop-device-direct-io");
+  ASSERT_EQ(format_detail::get_key("cgroup CPU Weight"), "cgroup-cpu-weight");
+}
+
+TEST(FormatDetail, Text)
+{
+  format_detail detail(N_("Chroot"), std::locale::classic());
+  detail.add(N_("Name"), "test")
+    .add(N_("Users"), schroot::string_list{"root", "user"})
+    .add(N_("Session Managed"), true);
+
+  std::ostringstream os;
+  os.imbue(std::locale::classic());
+  os << detail;
+
+  ASSERT_NE(os.str().find("  Name                  test\n"), std::string::npos);
+  ASSERT_NE(os.str().find("  Users                 root user\n"),
+            std::string::npos);
+}
+
+TEST(FormatDetail, JSON)
+{
+  format_detail detail(N_("Session"), std::locale::classic());
+  detail.add(N_("Name"), "test \"1\"")
+    .add(N_("Users"), schroot::string_list{"root", "user"})
+    .add(N_("Groups"), schroot::string_list())
+    .add(N_("Session Managed"), true)
+    .add(N_("Session Pool Size"), 4U)
+    .add_section(N_("User Data"))
+    .add("  setup.fstab", "default/fstab")
+    .add("  setup.config", "default/config")
+    .add(N_("Directory"), "/")
+    .add(N_("Name"), "duplicate");
+
+  std::ostringstream os;
+  detail.print_json(os);
+
+  ASSERT_EQ(os.str(),
+            "{\"kind\":\"session\",\"name\":\"test \\\"1\\\"\","
+            "\"users\":[\"root\",\"user\"],\"groups\":[],"
+            "\"session-managed\":true,\"session-pool-size\":4,"
+            "\"user-data\":{\"setup.fstab\":\"default/fstab\","
+            "\"setup.config\":\"default/config\"},"
+            "\"directory\":\"/\"}");
+}
+
+TEST(FormatDetail, NonFinite)
+{
+  format_detail detail(N_("Chroot"), std::locale::classic());
+  detail.add(N_("Ratio"), 0.5)
+    .add(N_("Rate"), std::numeric_limits<double>::infinity())
+    .add(N_("Mean"), std::numeric_limits<double>::quiet_NaN());
+
+  std::ostringstream os;
+  detail.print_json(os);
+
+  // JSON has no NaN or infinity.
+  ASSERT_EQ(os.str(),
+            "{\"kind\":\"chroot\",\"ratio\":0.5,\"rate\":null,"
+            "\"mean\":null}");
+}
+
+TEST(FormatDetail, EmptySection)
+{
+  format_detail detail(N_("Chroot"), std::locale::classic());
+  detail.add_section(N_("User Data"));
+
+  std::ostringstream os;
+  detail.print_json(os);
+
+  ASSERT_EQ(os.str(), "{\"kind\":\"chroot\",\"user-data\":{}}");
+}
@@ -0,0 +1,103 @@
+/* Copyright © 2006-2013  Roger Leigh <rleigh@codelibre.net>
+ *
+ * schroot is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * schroot is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ *********************************************************************/
+
+
+#include <gtest/gtest.h>
+
+#include <schroot/identity.h>
+#include <schroot/util.h>
+
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <unistd.h>
+
+TEST(Identity, Current)
+{
+  schroot::identity& caller(schroot::identity::current());
+
+  ASSERT_EQ(caller.get_uid(), getuid());
+  ASSERT_EQ(caller.get_gid(), getgid());
+  ASSERT_TRUE(caller.is_group_member(getgid()));
+  ASSERT_EQ(&caller, &schroot::identity::current());
+}
+
+TEST(Identity, Groups)
+{
+  schroot::identity caller;
+
+  int count = getgroups(0, 0);
+  ASSERT_GE(count, 0);
+  std::vector<gid_t> groups(count);
+  if (count)
+    {
+      ASSERT_EQ(getgroups(count, &groups[0]), count);
+    }
+  for (gid_t gid : groups)
+    ASSERT_TRUE(caller.is_group_member(gid));
+}
+
+TEST(Identity, GroupName)
+{
+  schroot::identity caller;
+
+  schroot::group grp(getgid());
+  ASSERT_FALSE(!grp);
+
+  gid_t gid;
+  ASSERT_TRUE(caller.get_group_gid(grp.gr_name, gid));
+  ASSERT_EQ(gid, getgid());
+  ASSERT_TRUE(caller.is_group_member(std::string(grp.gr_name)));
+
+  // Memoised lookups give the same result.
+  ASSERT_TRUE(caller.is_group_member(std::string(grp.gr_name)));
+}
+
+TEST(Identity, GroupMissing)
+{
+  schroot::identity caller;
+
+  gid_t gid;
+  ASSERT_FALSE(caller.get_group_gid("schroot-nonexistent-group", gid));
+  ASSERT_FALSE(caller.is_group_member(std::string("schroot-nonexistent-group")));
+}
+
+TEST(Identity, GroupNameThreads)
+{
+  schroot::identity caller;
+
+  schroot::group grp(getgid());
+  ASSERT_FALSE(!grp);
+  std::string name(grp.gr_name);
+
+  std::vector<std::thread> threads;
+  std::vector<int> found(8, 0);
+  for (std::vector<int>::size_type i = 0; i < found.size(); ++i)
+    threads.push_back(std::thread([&caller, &name, &found, i] ()
+      {
+        gid_t gid;
+        found[i] = (caller.get_group_gid(name, gid) && gid == getgid() &&
+                    !caller.get_group_gid("schroot-nonexistent-group", gid));
+      }));
+  for (auto& thread : threads)
+    thread.join();
+
+  for (int result : found)
+    ASSERT_EQ(result, 1);
+}
@@ -0,0 +1,200 @@
+/* Copyright © 2006-2013  Roger Leigh <rleigh@codelibre.net>
+ *
+ * schroot is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * schroot is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ *********************************************************************/
+
+
+#include <gtest/gtest.h>
+
+#include <boost/filesystem.hpp>
+
+#include <schroot/lease.h>
+
+#include <test/schroot/tmpdir.h>
+
+#include <cstdlib>
+#include <string>
+
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+class Lease : public TmpdirTest
+{
+public:
+  Lease():
+    TmpdirTest("lease")
+  {}
+
+  // Wait until a number of tickets are queued or held.
+  void wait_for_tickets(schroot::lease& l,
+                        std::size_t     count)
+  {
+    for (int i = 0; i < 500 && l.get_tickets().size() != count; ++i)
+      usleep(10000);
+    ASSERT_EQ(count, l.get_tickets().size());
+  }
+};
+
+TEST_F(Lease, Shared)
+{
+  schroot::lease l("test", tmpdir);
+
+  unsigned long first = l.acquire(schroot::lease::LEASE_SHARED, "", 0);
+  unsigned long second = l.acquire(schroot::lease::LEASE_SHARED, "", 0);
+  EXPECT_NE(first, second);
+
+  schroot::lease::ticket_list tickets(l.get_tickets());
+  ASSERT_EQ(2U, tickets.size());
+  EXPECT_TRUE(tickets[0].granted);
+  EXPECT_TRUE(tickets[1].granted);
+  EXPECT_EQ(getpid(), tickets[0].pid);
+
+  l.release(first);
+  l.release(second);
+  EXPECT_TRUE(l.get_tickets().empty());
+  EXPECT_FALSE(boost::filesystem::exists(tmpdir + "/test"));
+}
+
+TEST_F(Lease, Exclusive)
+{
+  schroot::lease l("test", tmpdir);
+
+  unsigned long shared = l.acquire(schroot::lease::LEASE_SHARED, "", 0);
+  EXPECT_THROW(l.acquire(schroot::lease::LEASE_EXCLUSIVE, "", 0),
+               schroot::lease::error);
+  EXPECT_EQ(1U, l.get_tickets().size());
+  l.release(shared);
+
+  unsigned long exclusive = l.acquire(schroot::lease::LEASE_EXCLUSIVE, "", 0);
+  EXPECT_THROW(l.acquire(schroot::lease::LEASE_SHARED, "", 0),
+               schroot::lease::error);
+  l.release(exclusive);
+  EXPECT_TRUE(l.get_tickets().empty());
+}
+
+TEST_F(Lease, Timeout)
+{
+  schroot::lease l("test", tmpdir);
+
+  l.acquire(schroot::lease::LEASE_EXCLUSIVE, "", 0);
+
+  time_t start = time(0);
+  try
+    {
+      l.acquire(schroot::lease::LEASE_SHARED, "", 1);
+      FAIL() << "Lease acquired while held exclusively";
+    }
+  catch (const schroot::lease::error& e)
+    {
+      std::string pid(std::to_string(getpid()));
+      EXPECT_NE(std::string::npos,
+                std::string(e.what()).find("PID " + pid + " (exclusive)"));
+    }
+  EXPECT_GE(time(0) - start, 1);
+
+  // The timed out ticket is no longer queued.
+  EXPECT_EQ(1U, l.get_tickets().size());
+}
+
+TEST_F(Lease, WriterPreference)
+{
+  schroot::lease l("test", tmpdir);
+
+  unsigned long shared = l.acquire(schroot::lease::LEASE_SHARED, "", 0);
+
+  pid_t pid = fork();
+  ASSERT_GE(pid, 0);
+  if (pid == 0)
+    {
+      try
+        {
+          schroot::lease child("test", tmpdir);
+          unsigned long n = child.acquire(schroot::lease::LEASE_EXCLUSIVE,
+                                          "", 10);
+          child.release(n);
+          _exit(EXIT_SUCCESS);
+        }
+      catch (...)
+        {
+        }
+      _exit(EXIT_FAILURE);
+    }
+
+  wait_for_tickets(l, 2);
+  schroot::lease::ticket_list tickets(l.get_tickets());
+  EXPECT_FALSE(tickets[1].granted);
+  EXPECT_EQ(pid, tickets[1].pid);
+
+  // A later shared lease must not overtake the waiting writer.
+  EXPECT_THROW(l.acquire(schroot::lease::LEASE_SHARED, "", 0),
+               schroot::lease::error);
+
+  l.release(shared);
+
+  int status;
+  ASSERT_EQ(pid, waitpid(pid, &status, 0));
+  ASSERT_TRUE(WIFEXITED(status));
+  EXPECT_EQ(EXIT_SUCCESS, WEXITSTATUS(status));
+  EXPECT_TRUE(l.get_tickets().empty());
+}
+
+TEST_F(Lease, Stale)
+{
+  schroot::lease l("test", tmpdir);
+
+  pid_t pid = fork();
+  ASSERT_GE(pid, 0);
+  if (pid == 0)
+    {
+      try
+        {
+          schroot::lease child("test", tmpdir);
+          child.acquire(schroot::lease::LEASE_EXCLUSIVE, "", 0);
+          _exit(EXIT_SUCCESS);
+        }
+      catch (...)
+        {
+        }
+      _exit(EXIT_FAILURE);
+    }
+
+  int status;
+  ASSERT_EQ(pid, waitpid(pid, &status, 0));
+  ASSERT_TRUE(WIFEXITED(status));
+  ASSERT_EQ(EXIT_SUCCESS, WEXITSTATUS(status));
+
+  // The lease was never released, but its holder no longer exists.
+  EXPECT_TRUE(l.get_tickets().empty());
+  EXPECT_NO_THROW(l.acquire(schroot::lease::LEASE_EXCLUSIVE, "", 0));
+}
+
+TEST_F(Lease, ReleaseSession)
+{
+  schroot::lease l("test", tmpdir);
+
+  l.acquire(schroot::lease::LEASE_EXCLUSIVE, "test-session", 0);
+  schroot::lease::ticket_list tickets(l.get_tickets());
+  ASSERT_EQ(1U, tickets.size());
+  EXPECT_EQ("test-session", tickets[0].session);
+  EXPECT_EQ("session test-session (exclusive)",
+            schroot::lease::describe(tickets[0]));
+
+  l.release("other-session");
+  EXPECT_EQ(1U, l.get_tickets().size());
+  l.release("test-session");
+  EXPECT_TRUE(l.get_tickets().empty());
+}
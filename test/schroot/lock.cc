@@ -20,10 +20,15 @@
 
 #include <schroot/lock.h>
 
+#include <chrono>
+#include <csignal>
 #include <iostream>
+#include <string>
+#include <thread>
 
 #include <sys/types.h>
 #include <sys/wait.h>
+#include <fcntl.h>
 #include <unistd.h>
 
 #include <config.h>
@@ -152,3 +157,203 @@ FileLockParameters params[] =
   };
 
 INSTANTIATE_TEST_CASE_P(LockVariants, FileLock, ::testing::ValuesIn(params));
+
+class OfdLock : public ::testing::TestWithParam<FileLockParameters>
+{
+public:
+  int holder_fd;
+  int fd;
+
+  OfdLock():
+    holder_fd(-1),
+    fd(-1)
+  {
+    // Remove test file if it exists.
+    unlink(TESTDATADIR "/ofdlock.ex1");
+  }
+
+  virtual ~OfdLock()
+  {}
+
+  void SetUp()
+  {
+    // Separate open file descriptions, which contend for the lock
+    // even within a single process.
+    holder_fd = open(TESTDATADIR "/ofdlock.ex1", O_RDWR|O_EXCL|O_CREAT, 0600);
+    ASSERT_GE(holder_fd, 0);
+    fd = open(TESTDATADIR "/ofdlock.ex1", O_RDWR);
+    ASSERT_GE(fd, 0);
+  }
+
+  void TearDown()
+  {
+    ASSERT_EQ(close(fd), 0);
+    ASSERT_EQ(close(holder_fd), 0);
+    ASSERT_EQ(unlink(TESTDATADIR "/ofdlock.ex1"), 0);
+  }
+};
+
+TEST_P(OfdLock, Locking)
+{
+  const FileLockParameters& params = GetParam();
+
+  schroot::ofd_lock held(holder_fd);
+  schroot::ofd_lock lck(fd);
+
+  held.set_lock(params.initial, 0);
+  if (params.willthrow)
+    ASSERT_THROW(lck.set_lock(params.establish, 0), schroot::lock::error);
+  else
+    ASSERT_NO_THROW(lck.set_lock(params.establish, 0));
+}
+
+INSTANTIATE_TEST_CASE_P(LockVariants, OfdLock, ::testing::ValuesIn(params));
+
+TEST_F(OfdLock, Timeout)
+{
+  schroot::ofd_lock held(holder_fd);
+  schroot::ofd_lock lck(fd);
+
+  held.set_lock(schroot::lock::LOCK_SHARED, 0);
+
+  std::string message;
+  auto start = std::chrono::steady_clock::now();
+  try
+    {
+      lck.set_lock(schroot::lock::LOCK_EXCLUSIVE, 1);
+    }
+  catch (const schroot::lock::error& e)
+    {
+      message = e.what();
+    }
+  std::chrono::duration<double> elapsed =
+    std::chrono::steady_clock::now() - start;
+  ASSERT_GE(elapsed.count(), 1.0);
+  ASSERT_LT(elapsed.count(), 3.0);
+
+  // The lock is held by this process, through another open file
+  // description.
+  ASSERT_NE(message.find("lock held by PID " + std::to_string(getpid())),
+            std::string::npos);
+
+  // A shared lock is still compatible.
+  ASSERT_NO_THROW(lck.set_lock(schroot::lock::LOCK_SHARED, 1));
+}
+
+TEST_F(OfdLock, Threads)
+{
+  schroot::ofd_lock held(holder_fd);
+  held.set_lock(schroot::lock::LOCK_EXCLUSIVE, 0);
+
+  // No SIGALRM is used to time out the wait.
+  struct sigaction ignore, saved;
+  sigemptyset(&ignore.sa_mask);
+  ignore.sa_flags = 0;
+  ignore.sa_handler = SIG_IGN;
+  ASSERT_EQ(sigaction(SIGALRM, &ignore, &saved), 0);
+
+  bool acquired = false;
+  std::thread waiter([&]()
+    {
+      schroot::ofd_lock lck(fd);
+      try
+        {
+          lck.set_lock(schroot::lock::LOCK_EXCLUSIVE, 10);
+          acquired = true;
+        }
+      catch (const schroot::lock::error& e)
+        {
+        }
+    });
+
+  std::this_thread::sleep_for(std::chrono::milliseconds(200));
+  held.unset_lock();
+  waiter.join();
+  ASSERT_TRUE(acquired);
+
+  struct sigaction current;
+  ASSERT_EQ(sigaction(SIGALRM, &saved, &current), 0);
+  ASSERT_EQ(current.sa_handler, SIG_IGN);
+}
+
+TEST_F(OfdLock, HolderOfd)
+{
+  int ready[2];
+  ASSERT_EQ(pipe(ready), 0);
+
+  pid_t pid = fork();
+  ASSERT_GE(pid, 0);
+  if (pid == 0)
+    {
+      // An open file description lock held by another process is
+      // found from its open files.
+      close(ready[0]);
+      int child_fd = open(TESTDATADIR "/ofdlock.ex1", O_RDWR);
+      schroot::ofd_lock held(child_fd);
+      held.set_lock(schroot::lock::LOCK_EXCLUSIVE, 0);
+      if (write(ready[1], "", 1) != 1)
+        _exit(EXIT_FAILURE);
+      pause();
+      _exit(EXIT_SUCCESS);
+    }
+
+  close(ready[1]);
+  char byte;
+  ASSERT_EQ(read(ready[0], &byte, 1), 1);
+  close(ready[0]);
+
+  schroot::ofd_lock lck(fd);
+  pid_t holder = lck.get_holder(schroot::lock::LOCK_SHARED);
+
+  kill(pid, SIGTERM);
+  int status;
+  ASSERT_EQ(waitpid(pid, &status, 0), pid);
+
+  ASSERT_EQ(holder, pid);
+}
+
+TEST_F(OfdLock, Holder)
+{
+  int ready[2];
+  ASSERT_EQ(pipe(ready), 0);
+
+  pid_t pid = fork();
+  ASSERT_GE(pid, 0);
+  if (pid == 0)
+    {
+      // A POSIX lock held by another process conflicts.
+      close(ready[0]);
+      schroot::file_lock held(holder_fd);
+      held.set_lock(schroot::lock::LOCK_EXCLUSIVE, 0);
+      if (write(ready[1], "", 1) != 1)
+        _exit(EXIT_FAILURE);
+      pause();
+      _exit(EXIT_SUCCESS);
+    }
+
+  close(ready[1]);
+  char byte;
+  ASSERT_EQ(read(ready[0], &byte, 1), 1);
+  close(ready[0]);
+
+  schroot::ofd_lock lck(fd);
+  ASSERT_EQ(lck.get_holder(schroot::lock::LOCK_SHARED), pid);
+
+  std::string message;
+  try
+    {
+      lck.set_lock(schroot::lock::LOCK_SHARED, 1);
+    }
+  catch (const schroot::lock::error& e)
+    {
+      message = e.what();
+    }
+
+  kill(pid, SIGTERM);
+  int status;
+  ASSERT_EQ(waitpid(pid, &status, 0), pid);
+
+  ASSERT_NE(message.find("lock held by PID " + std::to_string(pid)),
+            std::string::npos);
+  ASSERT_EQ(lck.get_holder(schroot::lock::LOCK_SHARED), 0);
+}
@@ -19,55 +19,85 @@
 #include <gtest/gtest.h>
 
 #include <schroot/log.h>
+#include <schroot/log-sink.h>
 
 #include <iostream>
-#include <ios>
-#include <sstream>
+#include <memory>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
 
 class Log : public ::testing::Test
 {
 public:
-  std::streambuf *saved;
-  std::stringbuf *monitor;
+  int fds[2];
 
   void SetUp()
   {
-    monitor = new std::stringbuf();
-    saved = std::cerr.std::ios::rdbuf(monitor);
+    ASSERT_EQ(pipe(fds), 0);
+    fcntl(fds[0], F_SETFL, O_NONBLOCK);
+    schroot::log_set_sink(std::make_shared<schroot::log_text_sink>(fds[1]));
   }
 
   void TearDown()
   {
-    std::cerr.std::ios::rdbuf(saved);
-    delete monitor;
+    schroot::log_set_sink
+      (std::make_shared<schroot::log_text_sink>(STDERR_FILENO));
+    close(fds[0]);
+    close(fds[1]);
+  }
+
+  std::string
+  output()
+  {
+    schroot::log_flush();
+
+    std::string ret;
+    char buffer[BUFSIZ];
+    ssize_t count;
+    while ((count = read(fds[0], buffer, sizeof(buffer))) > 0)
+      ret.append(buffer, count);
+    return ret;
   }
 
   std::string
   debug(schroot::debug_level level,
         const std::string& msg)
   {
-    monitor->str("");
-    schroot::log_debug(level) << msg;
-    return monitor->str();
+    schroot::log_debug(level) << msg << std::endl;
+    return output();
+  }
+};
+
+class CaptureSink : public schroot::log_sink
+{
+public:
+  std::vector<schroot::log_record> records;
+
+  virtual void
+  write (const schroot::log_record& record)
+  {
+    records.push_back(record);
   }
 };
 
 TEST_F(Log, Info)
 {
-  schroot::log_info() << "Discard me please";
-  ASSERT_EQ(monitor->str(), "I: Discard me please");
+  schroot::log_info() << "Discard me please" << std::endl;
+  ASSERT_EQ(output(), "I: Discard me please\n");
 }
 
 TEST_F(Log, Warning)
 {
-  schroot::log_warning() << "Discard me please";
-  ASSERT_EQ(monitor->str(), "W: Discard me please");
+  schroot::log_warning() << "Discard me please" << std::endl;
+  ASSERT_EQ(output(), "W: Discard me please\n");
 }
 
 TEST_F(Log, Error)
 {
-  schroot::log_error() << "Discard me please";
-  ASSERT_EQ(monitor->str(), "E: Discard me please");
+  schroot::log_error() << "Discard me please" << std::endl;
+  ASSERT_EQ(output(), "E: Discard me please\n");
 }
 
 TEST_F(Log, DebugNone)
@@ -86,13 +116,13 @@ TEST_F(Log, DebugNotice)
   ASSERT_EQ(debug(schroot::DEBUG_NONE,
                        "Discard me"), "");
   ASSERT_EQ(debug(schroot::DEBUG_NOTICE,
-                       "Discard me"), "D(1): Discard me");
+                       "Discard me"), "D(1): Discard me\n");
   ASSERT_EQ(debug(schroot::DEBUG_INFO,
-                       "Discard me"), "D(2): Discard me");
+                       "Discard me"), "D(2): Discard me\n");
   ASSERT_EQ(debug(schroot::DEBUG_WARNING,
-                       "Discard me"), "D(3): Discard me");
+                       "Discard me"), "D(3): Discard me\n");
   ASSERT_EQ(debug(schroot::DEBUG_CRITICAL,
-                       "Discard me"), "D(4): Discard me");
+                       "Discard me"), "D(4): Discard me\n");
 }
 
 TEST_F(Log, DebugInfo)
@@ -103,11 +133,11 @@ TEST_F(Log, DebugInfo)
   ASSERT_EQ(debug(schroot::DEBUG_NOTICE,
                        "Discard me"), "");
   ASSERT_EQ(debug(schroot::DEBUG_INFO,
-                       "Discard me"), "D(2): Discard me");
+                       "Discard me"), "D(2): Discard me\n");
   ASSERT_EQ(debug(schroot::DEBUG_WARNING,
-                       "Discard me"), "D(3): Discard me");
+                       "Discard me"), "D(3): Discard me\n");
   ASSERT_EQ(debug(schroot::DEBUG_CRITICAL,
-                       "Discard me"), "D(4): Discard me");
+                       "Discard me"), "D(4): Discard me\n");
   }
 
 TEST_F(Log, DebugWarning)
@@ -120,9 +150,9 @@ TEST_F(Log, DebugWarning)
   ASSERT_EQ(debug(schroot::DEBUG_INFO,
                        "Discard me"), "");
   ASSERT_EQ(debug(schroot::DEBUG_WARNING,
-                       "Discard me"), "D(3): Discard me");
+                       "Discard me"), "D(3): Discard me\n");
   ASSERT_EQ(debug(schroot::DEBUG_CRITICAL,
-                       "Discard me"), "D(4): Discard me");
+                       "Discard me"), "D(4): Discard me\n");
   }
 
 TEST_F(Log, DebugCritical)
@@ -137,5 +167,83 @@ TEST_F(Log, DebugCritical)
   ASSERT_EQ(debug(schroot::DEBUG_WARNING,
                        "Discard me"), "");
   ASSERT_EQ(debug(schroot::DEBUG_CRITICAL,
-                       "Discard me"), "D(4): Discard me");
+                       "Discard me"), "D(4): Discard me\n");
+}
+
+TEST_F(Log, Lines)
+{
+  schroot::log_info() << "Partial";
+  ASSERT_EQ(output(), "");
+  schroot::log_info() << " line\nSecond line" << std::endl;
+  ASSERT_EQ(output(), "I: Partial line\nI: Second line\n");
+}
+
+TEST_F(Log, Script)
+{
+  {
+    schroot::log_context script("script", "10mount");
+    schroot::log_error() << "Discard me please" << std::endl;
+  }
+  schroot::log_error() << "Discard me please" << std::endl;
+  ASSERT_EQ(output(), "E: 10mount: Discard me please\n"
+            "E: Discard me please\n");
+}
+
+TEST_F(Log, Fields)
+{
+  std::shared_ptr<CaptureSink> sink(std::make_shared<CaptureSink>());
+  schroot::log_add_sink(sink);
+
+  {
+    schroot::log_context chroot("chroot", "sid");
+    schroot::log_context stage("stage", "setup-start");
+    {
+      schroot::log_context stage("stage", "setup-stop");
+      schroot::log_warning() << "first" << std::endl;
+    }
+    schroot::log_warning() << "second" << std::endl;
+  }
+  schroot::log_warning() << "third" << std::endl;
+
+  ASSERT_EQ(sink->records.size(), 3U);
+  ASSERT_EQ(sink->records[0].level, schroot::LOG_LEVEL_WARNING);
+  ASSERT_EQ(sink->records[0].pid, getpid());
+  ASSERT_EQ(sink->records[0].message, "first");
+  ASSERT_EQ(sink->records[0].fields.size(), 2U);
+  ASSERT_EQ(sink->records[0].fields[0].first, "chroot");
+  ASSERT_EQ(sink->records[0].fields[0].second, "sid");
+  ASSERT_EQ(sink->records[0].fields[1].first, "stage");
+  ASSERT_EQ(sink->records[0].fields[1].second, "setup-stop");
+  ASSERT_EQ(sink->records[1].message, "second");
+  ASSERT_EQ(sink->records[1].fields.size(), 2U);
+  ASSERT_EQ(sink->records[1].fields[1].second, "setup-start");
+  ASSERT_EQ(sink->records[2].message, "third");
+  ASSERT_TRUE(sink->records[2].fields.empty());
+}
+
+TEST_F(Log, JSON)
+{
+  schroot::log_set_sink(std::make_shared<schroot::log_json_sink>(fds[1]));
+
+  {
+    schroot::log_context script("script", "10mount");
+    schroot::log_error() << "Quote \" and \\ and \t" << std::endl;
+  }
+
+  std::string line(output());
+  ASSERT_EQ(line.substr(0, 9), "{\"time\":\"");
+  ASSERT_EQ(line[19], 'T');
+  ASSERT_EQ(line[28], '.');
+  ASSERT_EQ(line.substr(35, 2), "Z\"");
+  ASSERT_EQ(line.substr(line.find("\",\"level\"")),
+            std::string("\",\"level\":\"error\",\"pid\":") +
+            std::to_string(getpid()) +
+            ",\"message\":\"Quote \\\" and \\\\ and \\t\","
+            "\"script\":\"10mount\"}\n");
+}
+
+TEST(LogSink, JSONString)
+{
+  ASSERT_EQ(schroot::json_string("plain"), "\"plain\"");
+  ASSERT_EQ(schroot::json_string("a\nb\x01"), "\"a\\nb\\u0001\"");
 }
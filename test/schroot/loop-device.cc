@@ -0,0 +1,90 @@
+/* Copyright © 2005-2013  Roger Leigh <rleigh@codelibre.net>
+ *
+ * schroot is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * schroot is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ *********************************************************************/
+
+#include <gtest/gtest.h>
+
+#include <schroot/loop-device.h>
+
+#include <test/schroot/tmpdir.h>
+
+#include <fstream>
+#include <memory>
+#include <string>
+
+#include <unistd.h>
+
+class LoopDevice : public TmpdirTest
+{
+public:
+  std::string image;
+
+  LoopDevice():
+    TmpdirTest("loop")
+  {}
+
+  void SetUp()
+  {
+    // Attaching loop devices requires privileges.
+    if (geteuid() != 0 || access("/dev/loop-control", R_OK|W_OK) != 0)
+      GTEST_SKIP();
+
+    ASSERT_NO_FATAL_FAILURE(TmpdirTest::SetUp());
+    image = tmpdir + "/image";
+
+    std::ofstream output(image.c_str());
+    output << std::string(1024 * 1024, '\0');
+  }
+};
+
+TEST_F(LoopDevice, AttachShareDetach)
+{
+  std::unique_ptr<schroot::loop_device> first
+    (new schroot::loop_device(image, schroot::loop_device::FLAG_READ_ONLY |
+                              schroot::loop_device::FLAG_DIRECT_IO));
+  ASSERT_FALSE(first->get_device().empty());
+  ASSERT_FALSE(first->get_shared());
+  ASSERT_TRUE(first->get_flags() & schroot::loop_device::FLAG_READ_ONLY);
+  ASSERT_EQ(schroot::loop_device::find(image), first->get_device());
+
+  // A second read-only user shares the same device.
+  schroot::loop_device second(image, schroot::loop_device::FLAG_READ_ONLY);
+  ASSERT_EQ(second.get_device(), first->get_device());
+  ASSERT_TRUE(second.get_shared());
+
+  // A writable user may not share a read-only device.
+  ASSERT_THROW(schroot::loop_device(image, schroot::loop_device::FLAG_NONE),
+               schroot::loop_device::error);
+
+  std::string device(first->get_device());
+  first.reset();
+  ASSERT_TRUE(schroot::loop_device::detach(device, image));
+}
+
+TEST_F(LoopDevice, Autoclear)
+{
+  std::string device;
+  {
+    schroot::loop_device loop(image, schroot::loop_device::FLAG_AUTOCLEAR);
+    device = loop.get_device();
+    ASSERT_EQ(schroot::loop_device::find(image), device);
+  }
+
+  // Detached by the kernel when last closed.
+  ASSERT_TRUE(schroot::loop_device::find(image).empty());
+  ASSERT_FALSE(schroot::loop_device::detach(device, image));
+}
@@ -0,0 +1,223 @@
+/* Copyright © 2006-2013  Roger Leigh <rleigh@codelibre.net>
+ *
+ * schroot is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * schroot is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ *********************************************************************/
+
+
+#include <gtest/gtest.h>
+
+#include <schroot/metrics.h>
+
+#include <test/schroot/tmpdir.h>
+
+#include <fstream>
+#include <sstream>
+#include <string>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <unistd.h>
+
+class Metrics : public TmpdirTest
+{
+public:
+  std::string sessions;
+
+  Metrics():
+    TmpdirTest("metrics")
+  {}
+
+  void SetUp()
+  {
+    ASSERT_NO_FATAL_FAILURE(TmpdirTest::SetUp());
+    sessions = tmpdir + "/sessions";
+    ASSERT_EQ(mkdir(sessions.c_str(), 0755), 0);
+    schroot::metrics::set_directory(tmpdir);
+    schroot::metrics::set_session_directory(sessions);
+  }
+
+  std::string
+  textfile()
+  {
+    std::ifstream input((tmpdir + "/schroot.prom").c_str());
+    std::ostringstream output;
+    output << input.rdbuf();
+    return output.str();
+  }
+
+  bool
+  contains(const std::string& text)
+  {
+    return textfile().find(text) != std::string::npos;
+  }
+};
+
+TEST_F(Metrics, Disabled)
+{
+  schroot::metrics::set_directory(tmpdir + "/nonexistent");
+  ASSERT_FALSE(schroot::metrics::enabled());
+  schroot::metrics::increment("schroot_test_total", {});
+  schroot::metrics::flush();
+  ASSERT_EQ(textfile(), "");
+}
+
+TEST_F(Metrics, Counter)
+{
+  ASSERT_TRUE(schroot::metrics::enabled());
+  schroot::metrics::increment("schroot_operation_total",
+                              {{"chroot", "sid"}, {"operation", "begin"},
+                               {"result", "success"}});
+  schroot::metrics::flush();
+  schroot::metrics::increment("schroot_operation_total",
+                              {{"chroot", "sid"}, {"operation", "begin"},
+                               {"result", "success"}}, 2);
+  schroot::metrics::flush();
+
+  ASSERT_TRUE(contains("# TYPE schroot_operation_total counter\n"));
+  ASSERT_TRUE(contains("schroot_operation_total{chroot=\"sid\","
+                       "operation=\"begin\",result=\"success\"} 3\n"));
+}
+
+TEST_F(Metrics, Histogram)
+{
+  schroot::metrics::observe("schroot_lock_wait_seconds",
+                            {{"type", "shared"}}, 0.2);
+  schroot::metrics::observe("schroot_lock_wait_seconds",
+                            {{"type", "shared"}}, 1000);
+  schroot::metrics::flush();
+
+  ASSERT_TRUE(contains("# TYPE schroot_lock_wait_seconds histogram\n"));
+  ASSERT_TRUE(contains("schroot_lock_wait_seconds_bucket{type=\"shared\",le=\"0.1\"} 0\n"));
+  ASSERT_TRUE(contains("schroot_lock_wait_seconds_bucket{type=\"shared\",le=\"0.25\"} 1\n"));
+  ASSERT_TRUE(contains("schroot_lock_wait_seconds_bucket{type=\"shared\",le=\"300\"} 1\n"));
+  ASSERT_TRUE(contains("schroot_lock_wait_seconds_bucket{type=\"shared\",le=\"+Inf\"} 2\n"));
+  ASSERT_TRUE(contains("schroot_lock_wait_seconds_count{type=\"shared\"} 2\n"));
+}
+
+TEST_F(Metrics, Outcome)
+{
+  {
+    schroot::metrics::outcome failed("schroot_setup",
+                                     {{"chroot", "sid"},
+                                      {"stage", "setup-start"}});
+  }
+  {
+    schroot::metrics::outcome succeeded("schroot_setup",
+                                        {{"chroot", "sid"},
+                                         {"stage", "setup-start"}});
+    succeeded.set_success(true);
+  }
+  schroot::metrics::flush();
+
+  ASSERT_TRUE(contains("schroot_setup_total{chroot=\"sid\",stage=\"setup-start\",result=\"failure\"} 1\n"));
+  ASSERT_TRUE(contains("schroot_setup_total{chroot=\"sid\",stage=\"setup-start\",result=\"success\"} 1\n"));
+  ASSERT_TRUE(contains("schroot_setup_duration_seconds_count{chroot=\"sid\",stage=\"setup-start\"} 2\n"));
+}
+
+TEST_F(Metrics, Shards)
+{
+  // While another process holds the lock, metrics are left in a
+  // shard, which is merged by the next flush.
+  int fd = open((tmpdir + "/lock").c_str(), O_RDWR|O_CREAT, 0644);
+  ASSERT_GE(fd, 0);
+  ASSERT_EQ(flock(fd, LOCK_EX), 0);
+
+  schroot::metrics::increment("schroot_test_total", {}, 5);
+  schroot::metrics::flush();
+  ASSERT_EQ(textfile(), "");
+
+  close(fd);
+
+  schroot::metrics::increment("schroot_test_total", {}, 1);
+  schroot::metrics::flush();
+  ASSERT_TRUE(contains("schroot_test_total 6\n"));
+
+  DIR *dirp = opendir(tmpdir.c_str());
+  ASSERT_NE(dirp, nullptr);
+  struct dirent *entry;
+  while ((entry = readdir(dirp)) != nullptr)
+    ASSERT_NE(std::string(entry->d_name).substr(0, 6), "shard.");
+  closedir(dirp);
+}
+
+TEST_F(Metrics, ActiveSessions)
+{
+  std::ofstream session((sessions + "/sid-1234").c_str());
+  session << "[sid-1234]\ntype=directory\noriginal-name=sid\n";
+  session.close();
+
+  // The chroot of a session which was not recorded is read from its
+  // session file.
+  schroot::metrics::update_sessions();
+  schroot::metrics::flush();
+  ASSERT_TRUE(contains("# TYPE schroot_sessions_active gauge\n"));
+  ASSERT_TRUE(contains("schroot_sessions_active{chroot=\"sid\"} 1\n"));
+}
+
+TEST_F(Metrics, SessionBeginEnd)
+{
+  // The recorded chroot is used, rather than reading the session
+  // file.
+  std::ofstream session((sessions + "/sid-1234").c_str());
+  session << "[sid-1234]\ntype=directory\noriginal-name=other\n";
+  session.close();
+
+  schroot::metrics::session_begin("sid-1234", "sid");
+  schroot::metrics::flush();
+  ASSERT_TRUE(contains("schroot_sessions_active{chroot=\"sid\"} 1\n"));
+  ASSERT_FALSE(contains("chroot=\"other\""));
+
+  ASSERT_EQ(unlink((sessions + "/sid-1234").c_str()), 0);
+  schroot::metrics::session_end("sid-1234");
+  schroot::metrics::flush();
+  ASSERT_TRUE(contains("# TYPE schroot_sessions_active gauge\n"));
+  ASSERT_FALSE(contains("schroot_sessions_active{"));
+}
+
+TEST_F(Metrics, SessionsNotScanned)
+{
+  // The session directory is not read unless sessions have begun or
+  // ended.
+  std::ofstream((sessions + "/sid-1234").c_str())
+    << "[sid-1234]\ntype=directory\noriginal-name=sid\n";
+
+  schroot::metrics::increment("schroot_test_total", {});
+  schroot::metrics::flush();
+  ASSERT_FALSE(contains("schroot_sessions_active{"));
+
+  schroot::metrics::session_begin("sid-5678", "sid");
+  std::ofstream((sessions + "/sid-5678").c_str())
+    << "[sid-5678]\ntype=directory\noriginal-name=sid\n";
+  schroot::metrics::flush();
+  ASSERT_TRUE(contains("schroot_sessions_active{chroot=\"sid\"} 2\n"));
+}
+
+TEST_F(Metrics, SessionsRemoved)
+{
+  // Recorded sessions whose files have gone are forgotten.
+  std::ofstream((sessions + "/sid-1234").c_str())
+    << "[sid-1234]\ntype=directory\noriginal-name=sid\n";
+  schroot::metrics::session_begin("sid-1234", "sid");
+  schroot::metrics::session_begin("sid-5678", "sid");
+  schroot::metrics::flush();
+  ASSERT_TRUE(contains("schroot_sessions_active{chroot=\"sid\"} 1\n"));
+
+  ASSERT_EQ(unlink((sessions + "/sid-1234").c_str()), 0);
+  schroot::metrics::update_sessions();
+  schroot::metrics::flush();
+  ASSERT_FALSE(contains("schroot_sessions_active{"));
+}
@@ -0,0 +1,164 @@
+/* Copyright © 2006-2013  Roger Leigh <rleigh@codelibre.net>
+ *
+ * schroot is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * schroot is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ *********************************************************************/
+
+
+#include <gtest/gtest.h>
+
+#include <boost/filesystem.hpp>
+
+#include <schroot/nss-snapshot.h>
+
+#include <test/schroot/tmpdir.h>
+
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace
+{
+
+  std::string
+  read_file (const std::string& file)
+  {
+    std::ifstream input(file.c_str());
+    return std::string(std::istreambuf_iterator<char>(input),
+                       std::istreambuf_iterator<char>());
+  }
+
+  ino_t
+  inode (const std::string& file)
+  {
+    struct stat status;
+    if (stat(file.c_str(), &status) < 0)
+      return 0;
+    return status.st_ino;
+  }
+
+}
+
+class NssSnapshot : public TmpdirTest
+{
+public:
+  std::string cache;
+
+  NssSnapshot():
+    TmpdirTest("nss")
+  {}
+
+  void SetUp()
+  {
+    ASSERT_NO_FATAL_FAILURE(TmpdirTest::SetUp());
+    cache = tmpdir + "/cache";
+  }
+};
+
+TEST_F(NssSnapshot, Snapshot)
+{
+  schroot::nss_snapshot snapshot(cache);
+
+  std::string file = snapshot.snapshot("passwd");
+  ASSERT_EQ(file, cache + "/passwd");
+  ASSERT_NE(read_file(file).find("root:"), std::string::npos);
+
+  // A current snapshot is reused.
+  ino_t first = inode(file);
+  ASSERT_EQ(snapshot.snapshot("passwd"), file);
+  ASSERT_EQ(inode(file), first);
+
+  // With no time to live, the snapshot is regenerated.
+  snapshot.set_ttl(0);
+  snapshot.snapshot("passwd");
+  ASSERT_NE(inode(file), first);
+}
+
+TEST_F(NssSnapshot, SnapshotConcurrent)
+{
+  std::vector<pid_t> children;
+  int fds[2];
+  ASSERT_EQ(pipe(fds), 0);
+
+  for (int i = 0; i < 8; ++i)
+    {
+      pid_t pid = fork();
+      ASSERT_GE(pid, 0);
+      if (pid == 0)
+        {
+          schroot::nss_snapshot snapshot(cache);
+          ino_t ino = inode(snapshot.snapshot("group"));
+          _exit(write(fds[1], &ino, sizeof(ino)) == sizeof(ino) ?
+                EXIT_SUCCESS : EXIT_FAILURE);
+        }
+      children.push_back(pid);
+    }
+  close(fds[1]);
+
+  for (pid_t child : children)
+    {
+      int status;
+      ASSERT_EQ(waitpid(child, &status, 0), child);
+      ASSERT_TRUE(WIFEXITED(status));
+      ASSERT_EQ(WEXITSTATUS(status), EXIT_SUCCESS);
+    }
+
+  // Every session must use the same, single, enumeration.
+  ino_t ino;
+  std::vector<ino_t> inodes;
+  while (read(fds[0], &ino, sizeof(ino)) == sizeof(ino))
+    inodes.push_back(ino);
+  close(fds[0]);
+
+  ASSERT_EQ(inodes.size(), 8U);
+  for (ino_t i : inodes)
+    ASSERT_EQ(i, inode(cache + "/group"));
+}
+
+TEST_F(NssSnapshot, SnapshotInvalid)
+{
+  schroot::nss_snapshot snapshot(cache);
+
+  ASSERT_THROW(snapshot.snapshot("../passwd"), schroot::nss_snapshot::error);
+  ASSERT_THROW(snapshot.snapshot(""), schroot::nss_snapshot::error);
+}
+
+TEST_F(NssSnapshot, Install)
+{
+  std::string root(tmpdir + "/root");
+  ASSERT_TRUE(boost::filesystem::create_directories(root + "/etc"));
+  std::ofstream(root + "/etc/group") << "old contents\n";
+  ASSERT_EQ(chmod((root + "/etc/group").c_str(), 0600), 0);
+
+  std::string list(tmpdir + "/list");
+  std::ofstream(list) << "# comment\n\npasswd\ngroup\n";
+
+  schroot::nss_snapshot snapshot(cache);
+  ASSERT_EQ(snapshot.install_list(list, root, false), 2U);
+
+  ASSERT_EQ(read_file(root + "/etc/passwd"), read_file(cache + "/passwd"));
+  ASSERT_EQ(read_file(root + "/etc/group"), read_file(cache + "/group"));
+
+  // The permissions of existing files are preserved.
+  struct stat status;
+  ASSERT_EQ(stat((root + "/etc/group").c_str(), &status), 0);
+  ASSERT_EQ(status.st_mode & 07777, 0600U);
+}
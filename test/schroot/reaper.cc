@@ -0,0 +1,169 @@
+/* Copyright © 2005-2013  Roger Leigh <rleigh@codelibre.net>
+ *
+ * schroot is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * schroot is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ *********************************************************************/
+
+#include <gtest/gtest.h>
+
+#include <boost/filesystem.hpp>
+
+#include <schroot/reaper.h>
+
+#include <test/schroot/tmpdir.h>
+
+#include <algorithm>
+#include <chrono>
+#include <csignal>
+#include <string>
+
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+class Reaper : public TmpdirTest
+{
+public:
+  std::vector<pid_t> children;
+
+  Reaper():
+    TmpdirTest("reaper")
+  {}
+
+  void SetUp()
+  {
+    // Entering a chroot requires privileges.
+    if (geteuid() != 0)
+      GTEST_SKIP();
+
+    ASSERT_NO_FATAL_FAILURE(TmpdirTest::SetUp());
+  }
+
+  void TearDown()
+  {
+    for (pid_t child : children)
+      {
+        kill(child, SIGKILL);
+        waitpid(child, nullptr, 0);
+      }
+    TmpdirTest::TearDown();
+  }
+
+  /**
+   * Start a process inside the chroot.
+   *
+   * @param ignore_term true to ignore SIGTERM.
+   * @returns the process ID.
+   */
+  pid_t start (bool ignore_term)
+  {
+    int ready[2];
+    if (pipe(ready) < 0)
+      return -1;
+
+    pid_t pid = fork();
+    if (pid == 0)
+      {
+        if (ignore_term)
+          signal(SIGTERM, SIG_IGN);
+        if (chroot(tmpdir.c_str()) < 0 || chdir("/") < 0)
+          _exit(EXIT_FAILURE);
+        char c = 0;
+        if (write(ready[1], &c, 1) != 1)
+          _exit(EXIT_FAILURE);
+        while (true)
+          pause();
+      }
+
+    close(ready[1]);
+    char c;
+    bool ok = read(ready[0], &c, 1) == 1;
+    close(ready[0]);
+    if (pid > 0)
+      children.push_back(pid);
+    return ok ? pid : -1;
+  }
+
+  /**
+   * Wait for a child process, and get the signal which killed it.
+   *
+   * @param pid the child process.
+   * @returns the signal number, or 0 if not killed by a signal.
+   */
+  int reap (pid_t pid)
+  {
+    int status;
+    if (waitpid(pid, &status, 0) != pid)
+      return 0;
+    children.erase(std::remove(children.begin(), children.end(), pid),
+                   children.end());
+    return WIFSIGNALED(status) ? WTERMSIG(status) : 0;
+  }
+};
+
+TEST_F(Reaper, RootInvalid)
+{
+  ASSERT_THROW(schroot::reaper("/"), schroot::reaper::error);
+  ASSERT_THROW(schroot::reaper(tmpdir + "/nonexistent"),
+               schroot::reaper::error);
+
+  schroot::reaper reaper(tmpdir + "/.");
+  ASSERT_EQ(reaper.get_root(), boost::filesystem::canonical(tmpdir).string());
+  ASSERT_TRUE(reaper.find().empty());
+  ASSERT_EQ(reaper.kill(100), 0U);
+}
+
+TEST_F(Reaper, KillAll)
+{
+  pid_t first = start(false);
+  pid_t second = start(false);
+  ASSERT_GT(first, 0);
+  ASSERT_GT(second, 0);
+
+  schroot::reaper reaper(tmpdir);
+  std::vector<pid_t> found(reaper.find());
+  std::sort(found.begin(), found.end());
+  std::vector<pid_t> expected({first, second});
+  std::sort(expected.begin(), expected.end());
+  ASSERT_EQ(found, expected);
+
+  /* The processes are zombies until reaped here, but have exited,
+     so the whole grace period must not be used. */
+  auto start_time = std::chrono::steady_clock::now();
+  ASSERT_EQ(reaper.kill(5000), 2U);
+  ASSERT_LT(std::chrono::steady_clock::now() - start_time,
+            std::chrono::seconds(4));
+
+  ASSERT_EQ(reap(first), SIGTERM);
+  ASSERT_EQ(reap(second), SIGTERM);
+}
+
+TEST_F(Reaper, KillIgnoringTerm)
+{
+  pid_t stubborn = start(true);
+  pid_t other = start(false);
+  ASSERT_GT(stubborn, 0);
+  ASSERT_GT(other, 0);
+
+  // One grace period is shared by all processes.
+  schroot::reaper reaper(tmpdir);
+  auto start_time = std::chrono::steady_clock::now();
+  ASSERT_EQ(reaper.kill(500), 2U);
+  ASSERT_LT(std::chrono::steady_clock::now() - start_time,
+            std::chrono::seconds(2));
+
+  ASSERT_EQ(reap(stubborn), SIGKILL);
+  ASSERT_EQ(reap(other), SIGTERM);
+}
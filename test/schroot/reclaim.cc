@@ -0,0 +1,281 @@
+/* Copyright © 2006-2013  Roger Leigh <rleigh@codelibre.net>
+ *
+ * schroot is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * schroot is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ *********************************************************************/
+
+
+
+#include <gtest/gtest.h>
+
+#include <boost/filesystem.hpp>
+
+#include <schroot/lock.h>
+#include <schroot/reclaim.h>
+
+#include <test/schroot/tmpdir.h>
+
+#include <fstream>
+#include <iterator>
+#include <string>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+class Reclaim : public TmpdirTest
+{
+public:
+  std::string queuedir;
+  std::string tree;
+
+  Reclaim():
+    TmpdirTest("reclaim")
+  {}
+
+  void SetUp()
+  {
+    ASSERT_NO_FATAL_FAILURE(TmpdirTest::SetUp());
+    queuedir = tmpdir + "/queue";
+    tree = tmpdir + "/tree";
+
+    ASSERT_EQ(mkdir(queuedir.c_str(), 0700), 0);
+    ASSERT_EQ(mkdir(tree.c_str(), 0755), 0);
+    ASSERT_EQ(mkdir((tree + "/dir").c_str(), 0755), 0);
+    std::ofstream(tree + "/dir/file") << "file contents\n";
+  }
+};
+
+TEST_F(Reclaim, Enqueue)
+{
+  schroot::reclaim queue(queuedir);
+  ASSERT_EQ(queue.get_queue_directory(), queuedir);
+  ASSERT_TRUE(queue.get_items().empty());
+
+  queue.enqueue(schroot::reclaim::DIRECTORY_TREE, tree);
+  queue.enqueue(schroot::reclaim::DIRECTORY_TREE, tree + "/dir");
+
+  schroot::string_list items(queue.get_items());
+  ASSERT_EQ(items.size(), 2U);
+  ASSERT_NE(items[0], items[1]);
+  // Nothing is reclaimed until the queue is run.
+  ASSERT_TRUE(boost::filesystem::exists(tree + "/dir/file"));
+}
+
+TEST_F(Reclaim, Defer)
+{
+  schroot::reclaim queue(queuedir);
+  ASSERT_TRUE(queue.defer(schroot::reclaim::DIRECTORY_TREE, tree));
+
+  // The storage is renamed to a hidden name in the same directory,
+  // so the original path may be reused at once.
+  ASSERT_FALSE(boost::filesystem::exists(tree));
+  std::string detached;
+  for (boost::filesystem::directory_iterator pos(tmpdir), end;
+       pos != end;
+       ++pos)
+    {
+      std::string name(pos->path().filename().string());
+      if (name.compare(0, 6, ".tree-") == 0)
+        detached = pos->path().string();
+    }
+  ASSERT_FALSE(detached.empty());
+  ASSERT_TRUE(boost::filesystem::exists(detached + "/dir/file"));
+
+  schroot::string_list items(queue.get_items());
+  ASSERT_EQ(items.size(), 1U);
+  std::ifstream item(queuedir + "/" + items[0]);
+  std::string contents((std::istreambuf_iterator<char>(item)),
+                       std::istreambuf_iterator<char>());
+  ASSERT_NE(contents.find("path=" + detached + "\n"), std::string::npos);
+
+  queue.run();
+  ASSERT_FALSE(boost::filesystem::exists(detached));
+  ASSERT_TRUE(queue.get_items().empty());
+}
+
+TEST_F(Reclaim, DeferMissing)
+{
+  schroot::reclaim queue(queuedir);
+  ASSERT_FALSE(queue.defer(schroot::reclaim::DIRECTORY_TREE,
+                           tmpdir + "/nonexistent"));
+  ASSERT_TRUE(queue.get_items().empty());
+}
+
+TEST_F(Reclaim, GetItemsHidden)
+{
+  // Incomplete items and lock files are hidden.
+  std::ofstream(queuedir + "/.incomplete") << "";
+
+  schroot::reclaim queue(queuedir);
+  ASSERT_TRUE(queue.get_items().empty());
+}
+
+TEST_F(Reclaim, GetItemsMissingQueue)
+{
+  schroot::reclaim queue(tmpdir + "/nonexistent");
+  ASSERT_THROW(queue.get_items(), schroot::reclaim::error);
+}
+
+TEST_F(Reclaim, Run)
+{
+  schroot::reclaim queue(queuedir);
+  queue.enqueue(schroot::reclaim::DIRECTORY_TREE, tree);
+  queue.run();
+
+  ASSERT_FALSE(boost::filesystem::exists(tree));
+  ASSERT_TRUE(queue.get_items().empty());
+}
+
+TEST_F(Reclaim, RunMissing)
+{
+  // Storage which no longer exists is complete.
+  schroot::reclaim queue(queuedir);
+  queue.enqueue(schroot::reclaim::DIRECTORY_TREE, tmpdir + "/nonexistent");
+  queue.run();
+
+  ASSERT_TRUE(queue.get_items().empty());
+}
+
+TEST_F(Reclaim, RunLocked)
+{
+  schroot::reclaim queue(queuedir);
+  queue.enqueue(schroot::reclaim::DIRECTORY_TREE, tree);
+
+  schroot::string_list items(queue.get_items());
+  ASSERT_EQ(items.size(), 1U);
+
+  // An item locked by another runner is skipped.
+  int fd = open((queuedir + "/" + items[0]).c_str(), O_RDWR|O_CLOEXEC);
+  ASSERT_GE(fd, 0);
+  {
+    schroot::ofd_lock lock(fd);
+    lock.set_lock(schroot::lock::LOCK_EXCLUSIVE, 0);
+
+    queue.run();
+    ASSERT_TRUE(boost::filesystem::exists(tree));
+    ASSERT_EQ(queue.get_items(), items);
+
+    lock.unset_lock();
+  }
+  close(fd);
+
+  queue.run();
+  ASSERT_FALSE(boost::filesystem::exists(tree));
+  ASSERT_TRUE(queue.get_items().empty());
+}
+
+TEST_F(Reclaim, RunInvalid)
+{
+  // Invalid items are left in the queue, and don't prevent other
+  // items from being reclaimed.
+  std::ofstream(queuedir + "/invalid") << "[reclaim]\ntype=directory-tree\npath=relative\n";
+
+  schroot::reclaim queue(queuedir);
+  queue.enqueue(schroot::reclaim::DIRECTORY_TREE, tree);
+  queue.run();
+
+  ASSERT_FALSE(boost::filesystem::exists(tree));
+  schroot::string_list items(queue.get_items());
+  ASSERT_EQ(items.size(), 1U);
+  ASSERT_EQ(items[0], "invalid");
+}
+
+TEST_F(Reclaim, RunExclusive)
+{
+  schroot::reclaim queue(queuedir);
+  queue.enqueue(schroot::reclaim::DIRECTORY_TREE, tree + "/dir");
+  queue.enqueue(schroot::reclaim::DIRECTORY_TREE, tree);
+  ASSERT_TRUE(queue.run_exclusive());
+
+  ASSERT_FALSE(boost::filesystem::exists(tree));
+  ASSERT_TRUE(queue.get_items().empty());
+  // The runner lock file is hidden.
+  ASSERT_TRUE(boost::filesystem::exists(queuedir + "/.runner"));
+}
+
+TEST_F(Reclaim, RunExclusiveFailed)
+{
+  // The runner stops once a pass reclaims nothing, leaving failed
+  // items in the queue.
+  std::ofstream(queuedir + "/invalid") << "[reclaim]\ntype=directory-tree\npath=relative\n";
+
+  schroot::reclaim queue(queuedir);
+  queue.enqueue(schroot::reclaim::DIRECTORY_TREE, tree);
+  ASSERT_TRUE(queue.run_exclusive());
+
+  ASSERT_FALSE(boost::filesystem::exists(tree));
+  schroot::string_list items(queue.get_items());
+  ASSERT_EQ(items.size(), 1U);
+  ASSERT_EQ(items[0], "invalid");
+}
+
+TEST_F(Reclaim, RunExclusiveLocked)
+{
+  schroot::reclaim queue(queuedir);
+  queue.enqueue(schroot::reclaim::DIRECTORY_TREE, tree);
+
+  // Another runner is running the queue, so this runner does not
+  // wait for it, and leaves the item for it to reclaim.
+  int fd = open((queuedir + "/.runner").c_str(), O_CREAT|O_RDWR|O_CLOEXEC, 0600);
+  ASSERT_GE(fd, 0);
+  {
+    schroot::ofd_lock lock(fd);
+    lock.set_lock(schroot::lock::LOCK_EXCLUSIVE, 0);
+
+    ASSERT_FALSE(queue.run_exclusive());
+    ASSERT_TRUE(boost::filesystem::exists(tree));
+    ASSERT_EQ(queue.get_items().size(), 1U);
+
+    lock.unset_lock();
+  }
+  close(fd);
+
+  ASSERT_TRUE(queue.run_exclusive());
+  ASSERT_FALSE(boost::filesystem::exists(tree));
+  ASSERT_TRUE(queue.get_items().empty());
+}
+
+TEST_F(Reclaim, RemoveTree)
+{
+  ASSERT_TRUE(schroot::reclaim::remove_tree(tree));
+  ASSERT_FALSE(boost::filesystem::exists(tree));
+  ASSERT_FALSE(schroot::reclaim::remove_tree(tree));
+}
+
+TEST_F(Reclaim, RemoveTreeSymlinkDirectory)
+{
+  // A symbolic link to a directory outside the tree is removed, but
+  // never followed.
+  std::string outside(tmpdir + "/outside");
+  ASSERT_EQ(mkdir(outside.c_str(), 0755), 0);
+  std::ofstream(outside + "/file") << "outside contents\n";
+  ASSERT_EQ(symlink(outside.c_str(), (tree + "/outside").c_str()), 0);
+  ASSERT_TRUE(schroot::reclaim::remove_tree(tree));
+  ASSERT_FALSE(boost::filesystem::exists(tree));
+  ASSERT_TRUE(boost::filesystem::exists(outside + "/file"));
+}
+
+TEST_F(Reclaim, TypeName)
+{
+  ASSERT_EQ(schroot::reclaim::get_type_name(schroot::reclaim::BTRFS_SUBVOLUME),
+            "btrfs-subvolume");
+  ASSERT_EQ(schroot::reclaim::get_type_name(schroot::reclaim::DIRECTORY_TREE),
+            "directory-tree");
+  ASSERT_EQ(schroot::reclaim::get_type("directory-tree"),
+            schroot::reclaim::DIRECTORY_TREE);
+  ASSERT_THROW(schroot::reclaim::get_type("invalid"), schroot::reclaim::error);
+}
@@ -0,0 +1,159 @@
+/* Copyright © 2006-2013  Roger Leigh <rleigh@codelibre.net>
+ *
+ * schroot is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * schroot is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ *********************************************************************/
+
+
+#include <gtest/gtest.h>
+
+#include <boost/filesystem.hpp>
+
+#include <schroot/reflink.h>
+
+#include <test/schroot/tmpdir.h>
+
+#include <fstream>
+#include <iterator>
+#include <string>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+namespace
+{
+
+  std::string
+  read_file (const std::string& file)
+  {
+    std::ifstream input(file.c_str());
+    return std::string(std::istreambuf_iterator<char>(input),
+                       std::istreambuf_iterator<char>());
+  }
+
+}
+
+class Reflink : public TmpdirTest
+{
+public:
+  std::string source;
+  std::string clone;
+
+  Reflink():
+    TmpdirTest("reflink")
+  {}
+
+  void SetUp()
+  {
+    ASSERT_NO_FATAL_FAILURE(TmpdirTest::SetUp());
+    source = tmpdir + "/source";
+    clone = tmpdir + "/clone";
+
+    ASSERT_EQ(mkdir(source.c_str(), 0755), 0);
+    ASSERT_EQ(mkdir((source + "/dir").c_str(), 0750), 0);
+    std::ofstream(source + "/file") << "file contents\n";
+    std::ofstream(source + "/dir/nested") << "nested contents\n";
+    ASSERT_EQ(chmod((source + "/file").c_str(), 0640), 0);
+    ASSERT_EQ(link((source + "/file").c_str(), (source + "/dir/hardlink").c_str()), 0);
+    ASSERT_EQ(symlink("../file", (source + "/dir/symlink").c_str()), 0);
+    ASSERT_EQ(mkfifo((source + "/fifo").c_str(), 0600), 0);
+
+    struct timespec times[2] = { { 1000000000, 0 }, { 1000000000, 0 } };
+    ASSERT_EQ(utimensat(AT_FDCWD, (source + "/dir").c_str(), times, 0), 0);
+  }
+};
+
+TEST_F(Reflink, CloneTree)
+{
+  schroot::reflink::clone_tree(source, clone, 2);
+
+  ASSERT_EQ(read_file(clone + "/file"), "file contents\n");
+  ASSERT_EQ(read_file(clone + "/dir/nested"), "nested contents\n");
+
+  struct stat file, hardlink, dir, fifo;
+  ASSERT_EQ(lstat((clone + "/file").c_str(), &file), 0);
+  ASSERT_EQ(lstat((clone + "/dir/hardlink").c_str(), &hardlink), 0);
+  ASSERT_EQ(file.st_ino, hardlink.st_ino);
+  ASSERT_EQ(file.st_mode & 07777, 0640U);
+
+  ASSERT_EQ(lstat((clone + "/dir").c_str(), &dir), 0);
+  ASSERT_EQ(dir.st_mode & 07777, 0750U);
+  ASSERT_EQ(dir.st_mtime, 1000000000);
+
+  ASSERT_EQ(lstat((clone + "/fifo").c_str(), &fifo), 0);
+  ASSERT_TRUE(S_ISFIFO(fifo.st_mode));
+
+  ASSERT_EQ(boost::filesystem::read_symlink(clone + "/dir/symlink").string(), "../file");
+
+  // The clone must be independent of the source.
+  std::ofstream(clone + "/dir/nested") << "modified\n";
+  ASSERT_EQ(read_file(source + "/dir/nested"), "nested contents\n");
+}
+
+TEST_F(Reflink, CloneTreeParallel)
+{
+  // Many directories, with hard links between them, walked by
+  // several threads.
+  for (int i = 0; i < 20; ++i)
+    {
+      std::string dir(source + "/dir/" + std::to_string(i));
+      ASSERT_EQ(mkdir(dir.c_str(), 0755), 0);
+      ASSERT_EQ(mkdir((dir + "/sub").c_str(), 0755), 0);
+      std::ofstream(dir + "/sub/file") << i << '\n';
+      ASSERT_EQ(link((source + "/file").c_str(), (dir + "/sub/hardlink").c_str()), 0);
+    }
+  struct timespec times[2] = { { 1000000000, 0 }, { 1000000000, 0 } };
+  ASSERT_EQ(utimensat(AT_FDCWD, (source + "/dir").c_str(), times, 0), 0);
+
+  schroot::reflink::clone_tree(source, clone, 8);
+
+  struct stat file;
+  ASSERT_EQ(lstat((clone + "/file").c_str(), &file), 0);
+  ASSERT_EQ(file.st_nlink, 22U);
+  for (int i = 0; i < 20; ++i)
+    {
+      std::string dir(clone + "/dir/" + std::to_string(i));
+      ASSERT_EQ(read_file(dir + "/sub/file"), std::to_string(i) + '\n');
+
+      struct stat hardlink;
+      ASSERT_EQ(lstat((dir + "/sub/hardlink").c_str(), &hardlink), 0);
+      ASSERT_EQ(file.st_ino, hardlink.st_ino);
+    }
+
+  // Directory timestamps are set after their contents are created.
+  struct stat dir;
+  ASSERT_EQ(lstat((clone + "/dir").c_str(), &dir), 0);
+  ASSERT_EQ(dir.st_mtime, 1000000000);
+}
+
+TEST_F(Reflink, CloneTreeExists)
+{
+  // An existing directory at the clone path must survive.
+  ASSERT_EQ(mkdir(clone.c_str(), 0755), 0);
+  std::ofstream(clone + "/existing") << "existing contents\n";
+  ASSERT_THROW(schroot::reflink::clone_tree(source, clone), schroot::reflink::error);
+  ASSERT_EQ(read_file(clone + "/existing"), "existing contents\n");
+}
+
+TEST_F(Reflink, CloneTreeMissingSource)
+{
+  ASSERT_EQ(mkdir(clone.c_str(), 0755), 0);
+  std::ofstream(clone + "/existing") << "existing contents\n";
+  ASSERT_THROW(schroot::reflink::clone_tree(tmpdir + "/missing", clone),
+               schroot::reflink::error);
+  ASSERT_EQ(read_file(clone + "/existing"), "existing contents\n");
+}
@@ -0,0 +1,77 @@
+/* Copyright © 2006-2013  Roger Leigh <rleigh@codelibre.net>
+ *
+ * schroot is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * schroot is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ *********************************************************************/
+
+#ifndef TEST_SCHROOT_TMPDIR_H
+#define TEST_SCHROOT_TMPDIR_H
+
+#include <gtest/gtest.h>
+
+#include <boost/filesystem.hpp>
+
+#include <string>
+
+/**
+ * A test using a private temporary directory.  The directory is
+ * created before each test, and removed with all of its contents
+ * afterwards.  Tests which extend SetUp() and TearDown() must call
+ * these versions; SetUp() may be skipped entirely if the test is
+ * skipped before it is called.
+ */
+class TmpdirTest : public ::testing::Test
+{
+protected:
+  /**
+   * The constructor.
+   *
+   * @param name the name of the test, used in the directory name.
+   */
+  TmpdirTest(const std::string& name):
+    name(name),
+    tmpdir()
+  {}
+
+  void SetUp()
+  {
+    tmpdir = (boost::filesystem::temp_directory_path() /
+              boost::filesystem::unique_path("schroot-" + name +
+                                             "-%%%%-%%%%")).string();
+    ASSERT_TRUE(boost::filesystem::create_directory(tmpdir));
+  }
+
+  void TearDown()
+  {
+    if (!tmpdir.empty())
+      boost::filesystem::remove_all(tmpdir);
+  }
+
+private:
+  /// The name of the test.
+  std::string name;
+
+public:
+  /// The temporary directory.
+  std::string tmpdir;
+};
+
+#endif /* TEST_SCHROOT_TMPDIR_H */
+
+/*
+ * Local Variables:
+ * mode:C++
+ * End:
+ */
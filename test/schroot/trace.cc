@@ -0,0 +1,161 @@
+/* Copyright © 2006-2013  Roger Leigh <rleigh@codelibre.net>
+ *
+ * schroot is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * schroot is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ *********************************************************************/
+
+
+#include <gtest/gtest.h>
+
+#include <schroot/environment.h>
+#include <schroot/trace.h>
+
+#include <test/schroot/tmpdir.h>
+
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <string>
+
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+class Trace : public TmpdirTest
+{
+public:
+  std::string file;
+
+  Trace():
+    TmpdirTest("trace")
+  {}
+
+  void SetUp()
+  {
+    ASSERT_NO_FATAL_FAILURE(TmpdirTest::SetUp());
+    file = tmpdir + "/trace.json";
+    std::ofstream output(file.c_str());
+  }
+
+  std::string
+  contents()
+  {
+    std::ifstream input(file.c_str());
+    std::ostringstream output;
+    output << input.rdbuf();
+    return output.str();
+  }
+};
+
+TEST_F(Trace, Disabled)
+{
+  ASSERT_FALSE(schroot::trace::enabled());
+  {
+    schroot::trace::span span("disabled");
+  }
+
+  schroot::environment env;
+  schroot::trace::setup_env(env);
+  std::string value;
+  ASSERT_FALSE(env.get("SCHROOT_TRACE", value));
+  ASSERT_EQ(contents(), "");
+}
+
+TEST_F(Trace, Spans)
+{
+  schroot::trace::open(file);
+  ASSERT_TRUE(schroot::trace::enabled());
+  {
+    schroot::trace::span outer("outer");
+    schroot::trace::span inner("inner", "detail \"quoted\"");
+  }
+
+  std::string trace(contents());
+  ASSERT_EQ(trace.substr(0, 2), "[\n");
+  ASSERT_NE(trace.find("\"name\":\"process_name\",\"ph\":\"M\""),
+            std::string::npos);
+
+  std::string::size_type inner = trace.find("{\"name\":\"inner\"");
+  std::string::size_type outer = trace.find("{\"name\":\"outer\"");
+  ASSERT_NE(inner, std::string::npos);
+  ASSERT_NE(outer, std::string::npos);
+  // The inner span ends, and is written, first.
+  ASSERT_LT(inner, outer);
+  ASSERT_NE(trace.find("\"ph\":\"X\"", inner), std::string::npos);
+  ASSERT_NE(trace.find("\"parent\":", inner), std::string::npos);
+  ASSERT_NE(trace.find("\"detail\":\"detail \\\"quoted\\\"\"", inner),
+            std::string::npos);
+  ASSERT_EQ(trace.find("\"parent\":", outer), std::string::npos);
+}
+
+TEST_F(Trace, Context)
+{
+  schroot::trace::open(file);
+
+  schroot::environment env;
+  {
+    schroot::trace::span parent("parent");
+    schroot::trace::setup_env(env);
+  }
+
+  std::string path, context;
+  ASSERT_TRUE(env.get("SCHROOT_TRACE", path));
+  ASSERT_TRUE(env.get("SCHROOT_TRACE_CONTEXT", context));
+  ASSERT_EQ(path, file);
+
+  pid_t pid = fork();
+  ASSERT_GE(pid, 0);
+  if (pid == 0)
+    {
+      setenv("SCHROOT_TRACE", path.c_str(), 1);
+      setenv("SCHROOT_TRACE_CONTEXT", context.c_str(), 1);
+      try
+        {
+          schroot::trace::open_environment();
+          schroot::trace::span child("child");
+        }
+      catch (...)
+        {
+          _exit(EXIT_FAILURE);
+        }
+      _exit(EXIT_SUCCESS);
+    }
+  int status;
+  ASSERT_EQ(waitpid(pid, &status, 0), pid);
+  ASSERT_TRUE(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+
+  std::string trace(contents());
+  std::string parent_id(context.substr(context.rfind(':') + 1));
+  std::string::size_type child = trace.find("{\"name\":\"child\"");
+  ASSERT_NE(child, std::string::npos);
+  ASSERT_NE(trace.find("\"parent\":\"" + parent_id + "\"", child),
+            std::string::npos);
+  // The file was not reinitialised by the child.
+  ASSERT_EQ(trace.find("[\n", 1), std::string::npos);
+}
+
+TEST_F(Trace, ContextReplaced)
+{
+  struct ::stat status;
+  ASSERT_EQ(::stat(file.c_str(), &status), 0);
+
+  std::ostringstream context;
+  context << status.st_dev << ':' << status.st_ino + 1 << ":1";
+  setenv("SCHROOT_TRACE", file.c_str(), 1);
+  setenv("SCHROOT_TRACE_CONTEXT", context.str().c_str(), 1);
+  ASSERT_THROW(schroot::trace::open_environment(), schroot::trace::error);
+  unsetenv("SCHROOT_TRACE");
+  unsetenv("SCHROOT_TRACE_CONTEXT");
+}
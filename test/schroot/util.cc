@@ -75,3 +75,13 @@ TEST(Util, FindProgramInPath)
   boost::filesystem::path sed(schroot::find_program_in_path("sed", path, ""));
   ASSERT_EQ(boost::filesystem::path("sed"), sed.filename());
 }
+
+TEST(Util, ProcessStartTime)
+{
+  unsigned long long start = schroot::process_start_time(getpid());
+  ASSERT_NE(start, 0U);
+  ASSERT_EQ(schroot::process_start_time(getpid()), start);
+  ASSERT_LE(schroot::process_start_time(getppid()), start);
+  ASSERT_EQ(schroot::process_start_time(0), 0U);
+  ASSERT_EQ(schroot::process_start_time(-1), 0U);
+}